@@ -0,0 +1,13 @@
+long ackermann(long m, long n)
+{
+    if (m == 0) return n + 1;
+    if (n == 0) return ackermann(m - 1, 1);
+    return ackermann(m - 1, ackermann(m, n - 1));
+}
+
+int main(void)
+{
+    // Volatile, so gcc can not compute the result at compile time
+    volatile long m = 3;
+    return ackermann(m, 10) & 255;
+}
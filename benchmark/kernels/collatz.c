@@ -0,0 +1,24 @@
+// The self tail calls of the Ske version are loops, which is what the compiler turns them into
+long steps(long n, long count)
+{
+    while (n != 1)
+    {
+        if (n - n / 2 * 2 == 0) n = n / 2;
+        else n = 3 * n + 1;
+        count = count + 1;
+    }
+    return count;
+}
+
+long total(long n, long acc)
+{
+    for (; n != 0; n--) acc = acc + steps(n, 0);
+    return acc;
+}
+
+int main(void)
+{
+    // Volatile, so gcc can not compute the result at compile time
+    volatile long n = 300000;
+    return total(n, 0) & 255;
+}
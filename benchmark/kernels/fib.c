@@ -0,0 +1,12 @@
+long fib(long n)
+{
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main(void)
+{
+    // Volatile, so gcc can not compute the result at compile time
+    volatile long n = 36;
+    return fib(n) & 255;
+}
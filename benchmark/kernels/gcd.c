@@ -0,0 +1,23 @@
+// The self tail calls of the Ske version are loops, which is what the compiler turns them into
+long gcd(long a, long b)
+{
+    while (a != b)
+    {
+        if (a > b) a = a - b;
+        else b = b - a;
+    }
+    return a;
+}
+
+long sum(long n, long acc)
+{
+    for (; n != 0; n--) acc = acc + gcd(n * 7919, 1000003);
+    return acc;
+}
+
+int main(void)
+{
+    // Volatile, so gcc can not compute the result at compile time
+    volatile long n = 150000;
+    return sum(n, 0) & 255;
+}
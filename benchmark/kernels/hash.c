@@ -0,0 +1,13 @@
+// The self tail call of the Ske version is a loop, which is what the compiler turns it into
+long mix(long n, long acc)
+{
+    for (; n != 0; n--) acc = (acc * 31 + n * 7 + (acc / 64 | 3)) & 1048575;
+    return acc;
+}
+
+int main(void)
+{
+    // Volatile, so gcc can not compute the result at compile time
+    volatile long n = 100000000;
+    return mix(n, 1) & 255;
+}
@@ -0,0 +1,12 @@
+long tak(long x, long y, long z)
+{
+    if (y < x) return tak(tak(x - 1, y, z), tak(y - 1, z, x), tak(z - 1, x, y));
+    return z;
+}
+
+int main(void)
+{
+    // Volatile, so gcc can not compute the result at compile time
+    volatile long x = 30;
+    return tak(x, 20, 10) & 255;
+}
@@ -6,7 +6,7 @@ SCRIPT_NAME=ske
 
 mkdir -p $BUILD_DIR
 
-COMPILER_FLAGS="-Wall -Wpedantic -O0 -g"
+COMPILER_FLAGS="-Wall -Wpedantic -O0 -g -pthread"
 
 gcc $COMPILER_FLAGS src/main.c -Isrc -o $BUILD_DIR/$EXECUTABLE_NAME
 
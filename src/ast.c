@@ -3,7 +3,7 @@ void AST_node_list_add(AST_Node_List* list, AST_Node* node)
     if (list->count + 1 > list->capacity)
     {
         list->capacity = list->capacity == 0 ? 2 : list->capacity * 2;
-        list->nodes = realloc(list->nodes, list->capacity * sizeof(AST_Node*));
+        list->nodes = mem_realloc(list->nodes, list->capacity * sizeof(AST_Node*));
     }
     list->nodes[list->count++] = node;
 }
@@ -364,3 +364,65 @@ static String* pretty_print_ast(AST_Node* root, Allocator* allocator)
 
     return sb_get_result(&builder, allocator);
 }
+
+static i32 AST_count_list(AST_Node_List* list)
+{
+    i32 count = 0;
+    for (i32 i = 0; i < list->count; i++)
+    {
+        count += AST_count_nodes(list->nodes[i]);
+    }
+    return count;
+}
+
+i32 AST_count_nodes(AST_Node* node)
+{
+    if (!node) return 0;
+
+    switch(node->type)
+    {
+    case AST_NODE_PROGRAM:           return 1 + AST_count_list(&node->program.declarations);
+    case AST_NODE_FUN_DECL:          return 1 + AST_count_nodes(node->fun_decl.return_type) + AST_count_list(&node->fun_decl.arguments) + AST_count_nodes(node->fun_decl.body);
+    case AST_NODE_FUNCTION_ARGUMENT: return 1 + AST_count_nodes(node->fun_argument.type);
+    case AST_NODE_CALL:              return 1 + AST_count_list(&node->fun_call.arguments);
+    case AST_NODE_BLOCK:             return 1 + AST_count_list(&node->block.declarations);
+    case AST_NODE_STATEMENT:         return 1 + AST_count_nodes(node->statement.statement);
+    case AST_NODE_RETURN:            return 1 + AST_count_nodes(node->return_statement.expression);
+    case AST_NODE_IF:                return 1 + AST_count_nodes(node->if_statement.condition) + AST_count_nodes(node->if_statement.then_arm) + AST_count_nodes(node->if_statement.else_arm);
+    case AST_NODE_UNARY:             return 1 + AST_count_nodes(node->unary.expression);
+    case AST_NODE_BINARY:            return 1 + AST_count_nodes(node->binary.left) + AST_count_nodes(node->binary.right);
+    case AST_NODE_ERROR:             return 1 + AST_count_nodes(node->error.rest);
+    default:                         return 1;
+    }
+}
+
+static void AST_free_list(AST_Node_List* list)
+{
+    for (i32 i = 0; i < list->count; i++)
+    {
+        AST_free_lists(list->nodes[i]);
+    }
+    mem_free(list->nodes);
+    memset(list, 0, sizeof(AST_Node_List));
+}
+
+// The nodes are in the arena of the parser, but the lists grow on the heap
+void AST_free_lists(AST_Node* node)
+{
+    if (!node) return;
+
+    switch(node->type)
+    {
+    case AST_NODE_PROGRAM:           AST_free_list(&node->program.declarations); break;
+    case AST_NODE_FUN_DECL:          AST_free_list(&node->fun_decl.arguments); AST_free_lists(node->fun_decl.body); break;
+    case AST_NODE_CALL:              AST_free_list(&node->fun_call.arguments); break;
+    case AST_NODE_BLOCK:             AST_free_list(&node->block.declarations); break;
+    case AST_NODE_STATEMENT:         AST_free_lists(node->statement.statement); break;
+    case AST_NODE_RETURN:            AST_free_lists(node->return_statement.expression); break;
+    case AST_NODE_IF:                AST_free_lists(node->if_statement.condition); AST_free_lists(node->if_statement.then_arm); AST_free_lists(node->if_statement.else_arm); break;
+    case AST_NODE_UNARY:             AST_free_lists(node->unary.expression); break;
+    case AST_NODE_BINARY:            AST_free_lists(node->binary.left); AST_free_lists(node->binary.right); break;
+    case AST_NODE_ERROR:             AST_free_lists(node->error.rest); break;
+    default:                         break;
+    }
+}
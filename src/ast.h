@@ -144,5 +144,7 @@ static void pretty_print_block(AST_Node* block, i32 indentation, String_Builder*
 static void pretty_print_statement(AST_Node* statement, i32 indentation, String_Builder* builder);
 static void pretty_print_expression(AST_Node* expression, i32 indentation, String_Builder* builder);
 
+i32 AST_count_nodes(AST_Node* node);
+void AST_free_lists(AST_Node* node);
 
 #endif
@@ -23,9 +23,35 @@ static Scratch_Register scratch_alloc(Scratch_Register_Table* table)
     return -1;
 }
 
-static void scratch_free(Scratch_Register_Table* table, Scratch_Register reg)
+// @Note: rbx and r12-r15 belong to the caller (System V AMD64 ABI), so a function that writes them saves them first
+static bool scratch_is_callee_saved(Scratch_Register reg)
 {
-    table->inuse_table[reg] = false;
+    return reg != SCRATCH_R10 && reg != SCRATCH_R11;
+}
+
+// Values live across a call go to registers the callee preserves, everything else to ones nobody has to save
+static const Scratch_Register scratch_order_across_calls[SCRATCH_COUNT] =
+{
+    SCRATCH_RBX, SCRATCH_R12, SCRATCH_R13, SCRATCH_R14, SCRATCH_R15, SCRATCH_R10, SCRATCH_R11
+};
+
+static const Scratch_Register scratch_order_temporary[SCRATCH_COUNT] =
+{
+    SCRATCH_R10, SCRATCH_R11, SCRATCH_RBX, SCRATCH_R12, SCRATCH_R13, SCRATCH_R14, SCRATCH_R15
+};
+
+// SCRATCH_COUNT when every register is taken, the value is spilled then (see X64_assign_scratch_registers)
+static Scratch_Register scratch_alloc_in_order(Scratch_Register_Table* table, const Scratch_Register* order)
+{
+    for (i32 i = 0; i < SCRATCH_COUNT; i++)
+    {
+        if (!table->inuse_table[order[i]])
+        {
+            table->inuse_table[order[i]] = true;
+            return order[i];
+        }
+    }
+    return SCRATCH_COUNT;
 }
 
 static i32 hash_int(i32 a)
@@ -44,6 +70,13 @@ static void temp_table_init(Temp_Table* table)
     table->keys     = NULL;
 }
 
+static void temp_table_free(Temp_Table* table)
+{
+    mem_free(table->entries);
+    mem_free(table->keys);
+    temp_table_init(table);
+}
+
 static i32 temp_table_find_entry(i32* keys, Scratch_Register* entries, i32 capacity, i32 key)
 {
     i32 index = hash_int(key) % capacity;
@@ -74,8 +107,8 @@ static i32 temp_table_find_entry(i32* keys, Scratch_Register* entries, i32 capac
 
 static void temp_table_adjust_capacity(Temp_Table* table, i32 capacity)
 {
-    i32 *new_keys = malloc(sizeof(i32) * capacity);
-    Scratch_Register* new_entries = malloc(sizeof(Scratch_Register) * capacity);
+    i32 *new_keys = mem_alloc(sizeof(i32) * capacity);
+    Scratch_Register* new_entries = mem_alloc(sizeof(Scratch_Register) * capacity);
 
     for (i32 i = 0; i < capacity; i++)
     {
@@ -124,25 +157,13 @@ static bool temp_table_get(Temp_Table* table, i32 key, Scratch_Register* reg)
     if (table->count == 0) return false;
 
     i32 index = temp_table_find_entry(table->keys, table->entries, table->capacity, key);
-    if (table->entries[index] == SCRATCH_COUNT) return false;
+    // @Note: A missing key can land on a tombstone, which still has a (dummy) entry
+    if (table->entries[index] == SCRATCH_COUNT || table->keys[index] != key) return false;
 
     *reg = table->entries[index];
     return true;
 }
 
-static bool temp_table_delete(Temp_Table* table, i32 key)
-{
-    if (table->count == 0) return false;
-
-    i32 index = temp_table_find_entry(table->keys, table->entries, table->capacity, key);
-    if (table->entries[index] == SCRATCH_COUNT) return false;
-
-    table->keys[index] = -1;
-    table->entries[index] = SCRATCH_RBX; // dummy value
-    
-    return true;
-}
-
 static Scratch_Register get_or_add_scratch_from_temp(Temp_Table* table, IR_Register ir_register, Scratch_Register_Table* scratch_table)
 {
     i32 key = ir_register.gpr_index;
@@ -156,14 +177,6 @@ static Scratch_Register get_or_add_scratch_from_temp(Temp_Table* table, IR_Regis
     return scratch_register;
 }
 
-static void free_temp_scratch(Temp_Table* table, IR_Register ir_register, Scratch_Register_Table* scratch_table)
-{
-    i32 key = ir_register.gpr_index;
-    Scratch_Register scratch_register = get_or_add_scratch_from_temp(table, ir_register, scratch_table);    
-    temp_table_delete(table, key);
-    scratch_free(scratch_table, scratch_register);
-}
-
 static const char* instruction_name(Instruction instruction, Register dst_reg)
 {
 #ifdef SKE_CODEGEN_INTEL
@@ -291,10 +304,71 @@ static const char* instruction_name(Instruction instruction, Register dst_reg)
         default: COMPILER_BUG("Should not happen.");
         }
     }
+    case INS_AND:
+    {
+        switch(size)
+        {
+        case REG_SIZE_BYTE: return INS_NAME_AND REG_SUFFIX_BYTE;
+        case REG_SIZE_WORD: return INS_NAME_AND REG_SUFFIX_WORD;
+        case REG_SIZE_LONG: return INS_NAME_AND REG_SUFFIX_LONG;
+        case REG_SIZE_QUAD: return INS_NAME_AND REG_SUFFIX_QUAD;
+        default: COMPILER_BUG("Should not happen.");
+        }
+    }
+    case INS_OR:
+    {
+        switch(size)
+        {
+        case REG_SIZE_BYTE: return INS_NAME_OR REG_SUFFIX_BYTE;
+        case REG_SIZE_WORD: return INS_NAME_OR REG_SUFFIX_WORD;
+        case REG_SIZE_LONG: return INS_NAME_OR REG_SUFFIX_LONG;
+        case REG_SIZE_QUAD: return INS_NAME_OR REG_SUFFIX_QUAD;
+        default: COMPILER_BUG("Should not happen.");
+        }
+    }
     case INS_CALL:
     {
         return INS_NAME_CALL;
     }
+    case INS_JMP:
+    {
+        return INS_NAME_JMP;
+    }
+    case INS_SYSCALL:
+    {
+        return INS_NAME_SYSCALL;
+    }
+    case INS_MOVZX:
+    {
+        switch(size)
+        {
+        case REG_SIZE_WORD: return INS_NAME_MOVZX REG_SUFFIX_WORD;
+        case REG_SIZE_LONG: return INS_NAME_MOVZX REG_SUFFIX_LONG;
+        case REG_SIZE_QUAD: return INS_NAME_MOVZX REG_SUFFIX_QUAD;
+        default: COMPILER_BUG("Should not happen.");
+        }
+    }
+    case INS_LEA:
+    {
+        switch(size)
+        {
+        case REG_SIZE_WORD: return INS_NAME_LEA REG_SUFFIX_WORD;
+        case REG_SIZE_LONG: return INS_NAME_LEA REG_SUFFIX_LONG;
+        case REG_SIZE_QUAD: return INS_NAME_LEA REG_SUFFIX_QUAD;
+        default: COMPILER_BUG("Should not happen.");
+        }
+    }
+    case INS_TEST:
+    {
+        switch(size)
+        {
+        case REG_SIZE_BYTE: return INS_NAME_TEST REG_SUFFIX_BYTE;
+        case REG_SIZE_WORD: return INS_NAME_TEST REG_SUFFIX_WORD;
+        case REG_SIZE_LONG: return INS_NAME_TEST REG_SUFFIX_LONG;
+        case REG_SIZE_QUAD: return INS_NAME_TEST REG_SUFFIX_QUAD;
+        default: COMPILER_BUG("Should not happen.");
+        }
+    }
     default: COMPILER_BUG("Invalid instruction.");
     
     }
@@ -335,80 +409,117 @@ static Register scratch_to_register(Scratch_Register reg)
     assert(false && "Should not happend.");
 }
 
-i32 label_count = 0;
-i32 label_create()
+/* ======================
+   Instruction array
+   ====================== */
+
+static X64_Operand X64_operand_register(Register reg)
 {
-    return label_count++;
+    return (X64_Operand) { .type = OPERAND_REGISTER, .reg = reg };
 }
 
-String* label_name(i32 label, Allocator* allocator)
+static X64_Operand X64_operand_immediate(i32 immediate)
 {
-    return string_createf(allocator, ".L%d", label);
+    return (X64_Operand) { .type = OPERAND_IMMEDIATE, .immediate = immediate };
 }
 
-void X64_emit_label(String_Builder* sb, const char* label)
+static X64_Operand X64_operand_memory(X64_Memory memory)
 {
-    sb_appendf(sb, "%s:\n", label);
+    return (X64_Operand) { .type = OPERAND_MEMORY, .memory = memory };
 }
 
-void X64_emit_add(String_Builder* sb, Register src, Register dst)
+static X64_Operand X64_operand_label(const char* label)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-#ifdef SKE_CODEGEN_INTEL
-    sb_appendf(sb, "%s     %s, %s\n", instruction_names[INS_ADD], register_names[dst], register_names[src]);
-#elif SKE_CODEGEN_AT_T
-    sb_appendf(sb, "%s     %s, %s\n", instruction_name(INS_ADD, dst), register_names[src], register_names[dst]);
-#endif
+    return (X64_Operand) { .type = OPERAND_LABEL, .label = label };
 }
 
-void X64_emit_sub(String_Builder* sb, Register src, Register dst)
+static X64_Instruction* X64_push_instruction(X64_Instruction_Array* code, Instruction opcode)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-#ifdef SKE_CODEGEN_INTEL
-    sb_appendf(sb, "%s     %s, %s\n", instruction_names[INS_SUB], register_names[dst], register_names[src]);
-#elif SKE_CODEGEN_AT_T
-    sb_appendf(sb, "%s     %s, %s\n", instruction_name(INS_SUB, dst), register_names[src], register_names[dst]);
-#endif
+    if (code->count == code->capacity)
+    {
+        code->capacity = code->capacity == 0 ? 256 : code->capacity * 2;
+        code->instructions = mem_realloc(code->instructions, sizeof(X64_Instruction) * code->capacity);
+    }
+
+    X64_Instruction* instruction = &code->instructions[code->count++];
+    *instruction = (X64_Instruction) { .opcode = opcode, .condition = JMP_ALWAYS };
+    return instruction;
 }
 
-void X64_emit_mul(String_Builder* sb, Register src, Register dst)
+static X64_Instruction* X64_push(X64_Instruction_Array* code, Instruction opcode, i32 operand_count, X64_Operand a, X64_Operand b, X64_Operand c)
 {
-    X64_emit_move_reg_to_reg(sb, src, REG_RAX);
+    X64_Instruction* instruction = X64_push_instruction(code, opcode);
+    instruction->operands[0] = a;
+    instruction->operands[1] = b;
+    instruction->operands[2] = c;
+    instruction->operand_count = operand_count;
+    return instruction;
+}
 
-    sb_indent(sb, ASM_OUT_INDENT);
-    
-#ifdef SKE_CODEGEN_INTEL
-    const char* ins = instruction_names[INS_MUL];
-#elif SKE_CODEGEN_AT_T
-    const char* ins = instruction_name(INS_MUL, dst);
-#endif
-    
-    sb_appendf(sb, "%s    %s\n", ins, register_names[dst]);
+static X64_Operand none = { .type = OPERAND_NONE };
 
-    X64_emit_move_reg_to_reg(sb, REG_RAX, dst);
+static X64_Instruction* X64_emit_unary_operation(X64_Instruction_Array* code, Instruction opcode, X64_Operand operand)
+{
+    return X64_push(code, opcode, 1, operand, none, none);
 }
 
-void X64_emit_div(String_Builder* sb, Register src, Register dst) 
+static X64_Instruction* X64_emit_binary_operation(X64_Instruction_Array* code, Instruction opcode, X64_Operand src, X64_Operand dst)
 {
-    X64_emit_move_reg_to_reg(sb, src, REG_RAX);
+    return X64_push(code, opcode, 2, src, dst, none);
+}
 
-    sb_indent(sb, ASM_OUT_INDENT);
+void X64_instruction_array_free(X64_Instruction_Array* code)
+{
+    mem_free(code->instructions);
+    *code = (X64_Instruction_Array) {0};
+}
 
-#ifdef SKE_CODEGEN_INTEL
-    const char* ins_cqo = instruction_names[INS_CQO];
-    const char* ins_div = instruction_names[INS_DIV];
-#elif SKE_CODEGEN_AT_T
-    const char* ins_cqo = instruction_name(INS_CQO, REG_RAX);
-    const char* ins_div = instruction_name(INS_DIV, dst);
-#endif
-    
-    sb_appendf(sb, "%s\n", ins_cqo); 
+/* ======================
+   Emitters
+   ====================== */
 
-    sb_indent(sb, ASM_OUT_INDENT);
-    sb_appendf(sb, "%s    %s\n", ins_div, register_names[dst]);
+void X64_emit_label(X64_Instruction_Array* code, const char* label)
+{
+    X64_emit_unary_operation(code, INS_LABEL, X64_operand_label(label));
+}
+
+void X64_emit_add(X64_Instruction_Array* code, Register src, Register dst)
+{
+    X64_emit_binary_operation(code, INS_ADD, X64_operand_register(src), X64_operand_register(dst));
+}
+
+void X64_emit_sub(X64_Instruction_Array* code, Register src, Register dst)
+{
+    X64_emit_binary_operation(code, INS_SUB, X64_operand_register(src), X64_operand_register(dst));
+}
+
+void X64_emit_and(X64_Instruction_Array* code, Register src, Register dst)
+{
+    X64_emit_binary_operation(code, INS_AND, X64_operand_register(src), X64_operand_register(dst));
+}
+
+void X64_emit_or(X64_Instruction_Array* code, Register src, Register dst)
+{
+    X64_emit_binary_operation(code, INS_OR, X64_operand_register(src), X64_operand_register(dst));
+}
+
+// @Note: Only the low half of the product is kept, so the two operand imul does not need rax and rdx
+void X64_emit_mul(X64_Instruction_Array* code, Register src, Register dst)
+{
+    X64_emit_binary_operation(code, INS_MUL, X64_operand_register(src), X64_operand_register(dst));
+}
+
+void X64_emit_mul_lit(X64_Instruction_Array* code, i32 num, Register src, Register dst)
+{
+    X64_push(code, INS_MUL, 3, X64_operand_immediate(num), X64_operand_register(src), X64_operand_register(dst));
+}
 
-    X64_emit_move_reg_to_reg(sb, REG_RAX, dst);
-    /* X64_emit_move_name_to_name(sb, register_names[REG_RAX], dst_name); */
+void X64_emit_div(X64_Instruction_Array* code, Register src, Register dst) 
+{
+    X64_emit_move_reg_to_reg(code, src, REG_RAX);
+    X64_push(code, INS_CQO, 0, none, none, none);
+    X64_emit_unary_operation(code, INS_DIV, X64_operand_register(dst));
+    X64_emit_move_reg_to_reg(code, REG_RAX, dst);
 }
 
 static char literal_prefix()
@@ -421,25 +532,17 @@ static char literal_prefix()
     return ' ';
 }
 
-void X64_emit_cmp_lit_to_loc(String_Builder* sb, i32 lhs, IR_Location rhs, Scratch_Register_Table* table, Temp_Table* temp_table)
+void X64_emit_cmp_lit_to_loc(X64_Instruction_Array* code, i32 lhs, IR_Location rhs, Scratch_Register_Table* table, Temp_Table* temp_table)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-
     assert(rhs.type == IR_LOCATION_REGISTER);
     Scratch_Register s_right_reg = get_or_add_scratch_from_temp(temp_table, rhs.reg, table);
     Register right_reg = scratch_to_register(s_right_reg);
 
-#ifdef SKE_CODEGEN_INTEL
-    sb_appendf(sb, "%s     %s, %c%d\n", instruction_names[INS_CMP], register_names[right_reg], literal_prefix(), lhs);
-#elif SKE_CODEGEN_AT_T
-    sb_appendf(sb, "%s     %c%d, %s\n", instruction_name(INS_CMP, right_reg), literal_prefix(), lhs, register_names[right_reg]);
-#endif
+    X64_emit_binary_operation(code, INS_CMP, X64_operand_immediate(lhs), X64_operand_register(right_reg));
 }
 
-void X64_emit_cmp_loc_to_loc(String_Builder* sb, IR_Location lhs, IR_Location rhs, Scratch_Register_Table* table, Temp_Table* temp_table)
+void X64_emit_cmp_loc_to_loc(X64_Instruction_Array* code, IR_Location lhs, IR_Location rhs, Scratch_Register_Table* table, Temp_Table* temp_table)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-
     assert(lhs.type == IR_LOCATION_REGISTER && rhs.type == IR_LOCATION_REGISTER);
     Scratch_Register s_left_reg = get_or_add_scratch_from_temp(temp_table, lhs.reg, table);
     Scratch_Register s_right_reg = get_or_add_scratch_from_temp(temp_table, rhs.reg, table);
@@ -447,119 +550,86 @@ void X64_emit_cmp_loc_to_loc(String_Builder* sb, IR_Location lhs, IR_Location rh
     Register left_reg = scratch_to_register(s_left_reg);
     Register right_reg = scratch_to_register(s_right_reg);
 
-#ifdef SKE_CODEGEN_INTEL
-    sb_appendf(sb, "%s     %s, %s\n", instruction_names[INS_CMP], register_names[left_reg], register_names[right_reg]);
-#elif SKE_CODEGEN_AT_T
-    sb_appendf(sb, "%s     %s, %s\n", instruction_name(INS_CMP, right_reg), register_names[right_reg], register_names[left_reg]);
-#endif
+    // @Note: AT&T order, this sets the flags for left - right
+    X64_emit_binary_operation(code, INS_CMP, X64_operand_register(right_reg), X64_operand_register(left_reg));
 }
 
-void X64_emit_cmp_reg_to_reg(String_Builder* sb, Register s_lhs, Register s_rhs, IR_Op operator)
+// Sets the same flags as comparing against zero, with a shorter encoding
+void X64_emit_test(X64_Instruction_Array* code, Register reg)
 {
-    Register lhs = scratch_to_register(s_lhs);
-    Register rhs = scratch_to_register(s_rhs);
-    
-    X64_emit_move_reg_to_reg(sb, lhs, REG_RAX);
-
-    sb_indent(sb, ASM_OUT_INDENT);
-
-#ifdef SKE_CODEGEN_INTEL
-    sb_appendf(sb, "%s     %s, %s\n", instruction_names[INS_CMP], register_names[REG_RAX], register_names[rhs]);
-#elif SKE_CODEGEN_AT_T
-    sb_appendf(sb, "%s     %s, %s\n", instruction_name(INS_CMP, REG_RAX), register_names[rhs], register_names[REG_RAX]);
-#endif
+    X64_emit_binary_operation(code, INS_TEST, X64_operand_register(reg), X64_operand_register(reg));
 }
 
-void X64_emit_setcc(String_Builder* sb, IR_Op operator, Register result_reg)
+static Register low_byte_register(Register reg)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-
-    char* instruction = NULL;
-    switch(operator)
-    {
-    case OP_NOT_EQUAL:
-    {
-        instruction = "setne";
-    }
-    break;
-    case OP_EQUAL:
-    {
-        instruction = "sete ";
-    }
-    break;
-    case OP_OR:
-    {
-        NOT_IMPLEMENTED("Binary or (||)");
-    }
-    break;
-    case OP_AND:
-    {
-        NOT_IMPLEMENTED("Binary and (&&)");
-    }
-    break;
-    case OP_LESS:
-    {
-        instruction = "setl ";
-    }
-    break;
-    case OP_GREATER:
-    {
-        instruction = "setg ";
-    }
-    break;
-    case OP_LESS_EQUAL:
-    {
-        instruction = "setle";
-    }
-    break;
-    case OP_GREATER_EQUAL:
+    switch(reg)
     {
-        instruction = "setge";
-    }
-    break;
-    default: COMPILER_BUG("Comparison: Invalid operator.");
+    case REG_RAX: return REG_AL;
+    case REG_RBX: return REG_BL;
+    case REG_RCX: return REG_CL;
+    case REG_RDX: return REG_DL;
+    case REG_RSI: return REG_SIL;
+    case REG_RDI: return REG_DIL;
+    case REG_R8:  return REG_R8B;
+    case REG_R9:  return REG_R9B;
+    case REG_R10: return REG_R10B;
+    case REG_R11: return REG_R11B;
+    case REG_R12: return REG_R12B;
+    case REG_R13: return REG_R13B;
+    case REG_R14: return REG_R14B;
+    case REG_R15: return REG_R15B;
+    default: COMPILER_BUG("Register %s has no low byte.", register_names[reg]); return reg;
     }
+}
+
+// setcc only writes the low byte, so it is zero extended into the whole register afterwards
+void X64_emit_setcc(X64_Instruction_Array* code, IR_Jump_Type condition, Register result_reg)
+{
+    Register byte_reg = low_byte_register(result_reg);
 
-    sb_appendf(sb, "%s   %s\n", instruction, register_names[REG_AL]);
+    X64_emit_unary_operation(code, INS_SETCC, X64_operand_register(byte_reg))->condition = condition;
+    X64_emit_binary_operation(code, INS_MOVZX, X64_operand_register(byte_reg), X64_operand_register(result_reg));
+}
 
-    X64_emit_move_reg_to_reg(sb, REG_AL, result_reg);
+void X64_emit_cmov(X64_Instruction_Array* code, IR_Jump_Type condition, Register src, Register dst)
+{
+    X64_push(code, INS_CMOV, 2, X64_operand_register(src), X64_operand_register(dst), none)->condition = condition;
 }
 
-void X64_emit_unary(String_Builder* sb, Register src)
+void X64_emit_jump(X64_Instruction_Array* code, IR_Jump_Type condition, const char* label)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-    sb_appendf(sb, "%s     %s\n", instruction_name(INS_NEG, src), register_names[src]);
+    X64_emit_unary_operation(code, condition == JMP_ALWAYS ? INS_JMP : INS_JCC, X64_operand_label(label))->condition = condition;
 }
 
-void X64_emit_move_reg_to_reg(String_Builder* sb, Register src, Register dst)
+void X64_emit_unary(X64_Instruction_Array* code, Register src)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-#ifdef SKE_CODEGEN_INTEL
-    sb_appendf(sb, "%s     %s, %s\n", instruction_name(INS_MOV, dst), register_names[dst], register_names[src]);
-#elif SKE_CODEGEN_AT_T
-    sb_appendf(sb, "%s     %s, %s\n", instruction_name(INS_MOV, dst), register_names[src], register_names[dst]);
-#endif
+    X64_emit_unary_operation(code, INS_NEG, X64_operand_register(src));
 }
 
-void X64_emit_move_reg_to_mem(String_Builder* sb, Register src, IR_Mem dst, 
+void X64_emit_move_reg_to_reg(X64_Instruction_Array* code, Register src, Register dst)
+{
+    X64_emit_binary_operation(code, INS_MOV, X64_operand_register(src), X64_operand_register(dst));
+}
+
+void X64_emit_move_reg_to_mem(X64_Instruction_Array* code, Register src, IR_Mem dst, 
                               Scratch_Register_Table* table, Temp_Table* temp_table)
 {
     NOT_IMPLEMENTED("x86: Move reg to mem");
 }
 
-void X64_emit_move_mem_to_reg(String_Builder* sb, IR_Mem src, Register dst, 
+void X64_emit_move_mem_to_reg(X64_Instruction_Array* code, IR_Mem src, Register dst, 
                               Scratch_Register_Table* table, Temp_Table* temp_table)
 {
     NOT_IMPLEMENTED("x86: Move mem to reg");
 }
 
-void X64_emit_move_mem_to_mem(String_Builder* sb, IR_Mem src, IR_Mem dst, 
+void X64_emit_move_mem_to_mem(X64_Instruction_Array* code, IR_Mem src, IR_Mem dst, 
                               Scratch_Register_Table* table, Temp_Table* temp_table)
 {
     NOT_IMPLEMENTED("x86: Move mem to mem");
 }
 
-void X64_emit_move_loc_to_loc(String_Builder* sb, IR_Location src, IR_Location dst, 
+void X64_emit_move_loc_to_loc(X64_Instruction_Array* code, IR_Location src, IR_Location dst, 
                              Scratch_Register_Table* table, Temp_Table* temp_table)
 {
     assert(src.type == IR_LOCATION_REGISTER && dst.type == IR_LOCATION_REGISTER);
@@ -572,11 +642,11 @@ void X64_emit_move_loc_to_loc(String_Builder* sb, IR_Location src, IR_Location d
             Scratch_Register s_right_reg = get_or_add_scratch_from_temp(temp_table, src.reg, table);
             Register right_reg = scratch_to_register(s_right_reg);
 
-            X64_emit_move_reg_to_reg(sb, left_reg, right_reg);
+            X64_emit_move_reg_to_reg(code, left_reg, right_reg);
         }
         else if (dst.type == IR_LOCATION_MEMORY)
         {
-            X64_emit_move_reg_to_mem(sb, left_reg, dst.mem, table, temp_table);
+            X64_emit_move_reg_to_mem(code, left_reg, dst.mem, table, temp_table);
         }
     }
     else if (src.type == IR_LOCATION_MEMORY)
@@ -586,26 +656,42 @@ void X64_emit_move_loc_to_loc(String_Builder* sb, IR_Location src, IR_Location d
             Scratch_Register s_right_reg = get_or_add_scratch_from_temp(temp_table, dst.reg, table);
             Register right_reg = scratch_to_register(s_right_reg);
             
-            X64_emit_move_mem_to_reg(sb, src.mem, right_reg, table, temp_table);
+            X64_emit_move_mem_to_reg(code, src.mem, right_reg, table, temp_table);
         }
         else if(dst.type == IR_LOCATION_MEMORY)
         {
-            X64_emit_move_mem_to_mem(sb, src.mem, dst.mem, table, temp_table);
+            X64_emit_move_mem_to_mem(code, src.mem, dst.mem, table, temp_table);
         }
     }
 }
 
-void X64_emit_move_lit_to_reg(String_Builder* sb, i32 num, Register dst)
+void X64_emit_move_lit_to_reg(X64_Instruction_Array* code, i32 num, Register dst)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-#ifdef SKE_CODEGEN_INTEL
-    sb_appendf(sb, "%s     %s, %c%d\n", instruction_name(INS_MOV, dst), register_names[dst], literal_prefix(), num);
-#elif SKE_CODEGEN_AT_T
-    sb_appendf(sb, "%s     %c%d, %s\n", instruction_name(INS_MOV, dst), literal_prefix(), num, register_names[dst]);
-#endif
+    X64_emit_binary_operation(code, INS_MOV, X64_operand_immediate(num), X64_operand_register(dst));
+}
+
+void X64_emit_move_offset_to_reg(X64_Instruction_Array* code, Register base, i32 offset, Register dst)
+{
+    X64_Memory memory = { .type = MEM_TYPE_OFFSET, .offset = { base, offset } };
+    X64_emit_binary_operation(code, INS_MOV, X64_operand_memory(memory), X64_operand_register(dst));
+}
+
+void X64_emit_add_lit(X64_Instruction_Array* code, i32 num, Register dst)
+{
+    X64_emit_binary_operation(code, INS_ADD, X64_operand_immediate(num), X64_operand_register(dst));
+}
+
+void X64_emit_sub_lit(X64_Instruction_Array* code, i32 num, Register dst)
+{
+    X64_emit_binary_operation(code, INS_SUB, X64_operand_immediate(num), X64_operand_register(dst));
 }
 
-void X64_emit_move(String_Builder* sb, IR_Move* move, IR_Program* program, Temp_Table* temp_table, Scratch_Register_Table* table)
+void X64_emit_lea(X64_Instruction_Array* code, X64_Memory address, Register dst)
+{
+    X64_emit_binary_operation(code, INS_LEA, X64_operand_memory(address), X64_operand_register(dst));
+}
+
+void X64_emit_move(X64_Instruction_Array* code, IR_Move* move, IR_Program* program, Temp_Table* temp_table, Scratch_Register_Table* table)
 {
     IR_Value* src = &move->src;
     IR_Location* dst = &move->dst;
@@ -618,7 +704,7 @@ void X64_emit_move(String_Builder* sb, IR_Move* move, IR_Program* program, Temp_
         {
             Scratch_Register src_reg = get_or_add_scratch_from_temp(temp_table, src->loc.reg, table);
             Scratch_Register dst_reg = get_or_add_scratch_from_temp(temp_table, dst->reg, table);                           
-            X64_emit_move_reg_to_reg(sb, scratch_to_register(src_reg), scratch_to_register(dst_reg));
+            X64_emit_move_reg_to_reg(code, scratch_to_register(src_reg), scratch_to_register(dst_reg));
         }
     }
     break;
@@ -627,7 +713,7 @@ void X64_emit_move(String_Builder* sb, IR_Move* move, IR_Program* program, Temp_
         if(dst->type == IR_LOCATION_REGISTER)
         {
             Scratch_Register reg = get_or_add_scratch_from_temp(temp_table, dst->reg, table);
-            X64_emit_move_lit_to_reg(sb, src->integer, scratch_to_register(reg));
+            X64_emit_move_lit_to_reg(code, src->integer, scratch_to_register(reg));
         }
     }
     break;
@@ -639,137 +725,317 @@ void X64_emit_move(String_Builder* sb, IR_Move* move, IR_Program* program, Temp_
     }
 }
 
-void X64_emit_instruction(String_Builder* sb, IR_Instruction* instruction, IR_Program* program, Temp_Table* temp_table, Scratch_Register_Table* table)
+// The stack slot of `reg`, -1 when it has a scratch register
+static i32 X64_find_spill(X64_Frame* frame, IR_Register reg)
 {
-    switch(instruction->type)
-    {
-    case IR_INS_RET:
+    return frame->spill_count > 0 ? IR_register_map_find(&frame->spills, reg) : -1;
+}
+
+// Below the saved registers, rbp does not move when calls push their arguments
+static X64_Operand X64_spill_slot(X64_Frame* frame, i32 slot)
+{
+    X64_Memory memory = { .type = MEM_TYPE_OFFSET, .offset = { REG_RBP, -8 * (frame->saved_count + 1 + slot) } };
+    return X64_operand_memory(memory);
+}
+
+/*
+Spilled registers are loaded into r10 or r11, which functions that spill keep free for it, right before an
+instruction reads them. An instruction reads at most two registers, and one that only writes its destination
+reads its operands first, so the destination can share a register with them. Calls load their arguments from
+the slots themselves (see X64_emit_function_call).
+ */
+static void X64_reload_spilled(X64_Instruction_Array* code, IR_Program* program, IR_Instruction* instruction, Temp_Table* temp_table, X64_Frame* frame)
+{
+    if (frame->spill_count == 0) return;
+
+    static const Scratch_Register reload_registers[2] = { SCRATCH_R10, SCRATCH_R11 };
+    i32 loaded[2];
+    i32 loaded_count = 0;
+    if (instruction->type != IR_INS_CALL)
     {
-        IR_Return* ret = &instruction->ret;
-        if (ret->has_return_value)
+        for (i32 i = 0; i < IR_get_use_count(instruction); i++)
         {
-            Scratch_Register return_reg = get_or_add_scratch_from_temp(temp_table, ret->return_register, table);
-            X64_emit_move_reg_to_reg(sb, scratch_to_register(return_reg), REG_RAX); // calling convention defined return
+            IR_Register* use = IR_get_use(instruction, i);
+            i32 slot = use ? X64_find_spill(frame, *use) : -1;
+            if (slot < 0 || (loaded_count > 0 && loaded[0] == use->gpr_index)) continue;
+
+            assert(loaded_count < 2 && "More than two spilled operands");
+            Scratch_Register reg = reload_registers[loaded_count];
+            loaded[loaded_count++] = use->gpr_index;
+            temp_table_set(temp_table, use->gpr_index, reg);
+            X64_emit_binary_operation(code, INS_MOV, X64_spill_slot(frame, slot), X64_operand_register(scratch_to_register(reg)));
         }
-        X64_emit_pop_reg(sb, REG_RBP);
-        X64_emit_ret(sb);
     }
-    break;
-    case IR_INS_CALL:
+
+    IR_Register* definition = IR_get_definition(program, instruction);
+    if (definition && IR_register_is_valid(*definition) && X64_find_spill(frame, *definition) >= 0)
     {
-        IR_Call* call = &instruction->call;
-        String* name = IR_get_function_name(program, call->function_index);
-        X64_emit_call(sb, name->str);
+        for (i32 i = 0; i < loaded_count; i++)
+        {
+            if (loaded[i] == definition->gpr_index) return;
+        }
+        temp_table_set(temp_table, definition->gpr_index, reload_registers[loaded_count < 2 ? loaded_count : 0]);
     }
-    break;
-    case IR_INS_MOV:
+}
+
+// The spilled destination goes back to its slot right after the instruction that wrote it
+static void X64_store_spilled(X64_Instruction_Array* code, IR_Program* program, IR_Instruction* instruction, Temp_Table* temp_table, X64_Frame* frame)
+{
+    if (frame->spill_count == 0) return;
+
+    IR_Register* definition = IR_get_definition(program, instruction);
+    i32 slot = definition && IR_register_is_valid(*definition) ? X64_find_spill(frame, *definition) : -1;
+    Scratch_Register reg;
+    if (slot >= 0 && temp_table_get(temp_table, definition->gpr_index, &reg))
     {
-        IR_Move* move = &instruction->move;
-        X64_emit_move(sb, move, program, temp_table, table);        
+        X64_emit_binary_operation(code, INS_MOV, X64_operand_register(scratch_to_register(reg)), X64_spill_slot(frame, slot));
     }
-    break;
-    case IR_INS_PUSH:
-    {
-        IR_Push* push = &instruction->push;
-        IR_Value* value = &push->value;
+}
 
-        switch(value->type)
-        {
-        case VALUE_LOCATION:
-        {
-            Scratch_Register reg = get_or_add_scratch_from_temp(temp_table, value->loc.reg, table);
-            X64_emit_push_reg(sb, scratch_to_register(reg));
-        }
-        break;
-        case VALUE_VARIABLE:
+/*
+System V AMD64: the first six arguments go in rdi, rsi, rdx, rcx, r8 and r9, the rest are pushed right to
+left, and rsp has to be 16 byte aligned at the call. The callee preserves rbx and r12-r15, so only r10 and
+r11 are saved here, and only if they hold something that is still needed after the call.
+ */
+static void X64_emit_function_call(X64_Instruction_Array* code, IR_Instruction* instruction, IR_Program* program, Temp_Table* temp_table, Scratch_Register_Table* table, X64_Frame* frame)
+{
+    IR_Call* call = &instruction->call;
+    u32 live_across = frame->call_live_masks[frame->next_call++];
+
+    Register saved[SCRATCH_COUNT];
+    i32 saved_count = 0;
+    for (i32 i = 0; i < SCRATCH_COUNT; i++)
+    {
+        if ((live_across & (1u << i)) && !scratch_is_callee_saved(i))
         {
-                        
-        }
-        break;
-        default: break;
+            saved[saved_count] = scratch_to_register(i);
+            X64_emit_push_reg(code, saved[saved_count++]);
         }
     }
-    break;
-    case IR_INS_POP:
+
+    IR_Call_Arguments* arguments = &call->arguments;
+    i32 stack_count = arguments->count > X64_ARGUMENT_REGISTER_COUNT ? arguments->count - X64_ARGUMENT_REGISTER_COUNT : 0;
+    i32 padding = (saved_count + stack_count) % 2 == 1 ? 8 : 0;
+    if (padding)
     {
-        IR_Pop* pop = &instruction->pop;
-        IR_Value* value = &pop->value;
+        X64_emit_sub_lit(code, padding, REG_RSP);
+    }
 
-        switch(value->type)
-        {
-        case VALUE_LOCATION:
+    for (i32 i = arguments->count - 1; i >= 0; i--)
+    {
+        IR_Value* value = &arguments->values[i];
+        if (value->type == VALUE_INT)
         {
-            Scratch_Register reg = get_or_add_scratch_from_temp(temp_table, value->loc.reg, table);
-            X64_emit_push_reg(sb, scratch_to_register(reg));
+            if (i >= X64_ARGUMENT_REGISTER_COUNT) X64_emit_push_lit(code, value->integer);
+            else X64_emit_move_lit_to_reg(code, value->integer, argument_registers[i]);
         }
-        break;
-        case VALUE_VARIABLE:
+        else if (value->type == VALUE_LOCATION)
         {
-                        
+            i32 slot = X64_find_spill(frame, value->loc.reg);
+            X64_Operand source = slot >= 0 ? X64_spill_slot(frame, slot) : X64_operand_register(scratch_to_register(get_or_add_scratch_from_temp(temp_table, value->loc.reg, table)));
+            if (i >= X64_ARGUMENT_REGISTER_COUNT) X64_emit_unary_operation(code, INS_PUSH, source);
+            else X64_emit_binary_operation(code, INS_MOV, source, X64_operand_register(argument_registers[i]));
         }
-        break;
-        default: break;
+        else
+        {
+            NOT_IMPLEMENTED("Variables as call arguments");
         }
     }
-    break;
-    case IR_INS_JUMP:
+
+    X64_emit_call(code, IR_get_function_name(program, call->function_index)->str);
+
+    if (stack_count > 0 || padding)
     {
-        IR_Jump* jump = &instruction->jump;
-        sb_indent(sb, ASM_OUT_INDENT);
-        switch(jump->type)
+        X64_emit_add_lit(code, stack_count * 8 + padding, REG_RSP);
+    }
+
+    for (i32 i = saved_count - 1; i >= 0; i--)
+    {
+        X64_emit_pop_reg(code, saved[i]);
+    }
+
+    IR_Register* result = IR_get_definition(program, instruction);
+    if (result && IR_register_is_valid(*result))
+    {
+        Scratch_Register reg = get_or_add_scratch_from_temp(temp_table, *result, table);
+        X64_emit_move_reg_to_reg(code, REG_RAX, scratch_to_register(reg));
+    }
+}
+
+/*
+A call whose result is returned right away (or a call followed by a return without a value) is a tail call. The nodes
+in between can only be copies of the result. Returns the number of nodes from the call up to and including the
+return, 0 if the call at `index` is not a tail call. Calls with stack arguments are left alone, the caller's own
+argument area might not be large enough for them.
+ */
+static i32 X64_tail_call_length(IR_Block* block, i32 index)
+{
+    IR_Node* call_node = IR_get_node(block, index);
+    if (!call_node || call_node->type != IR_NODE_INSTRUCTION || call_node->instruction.type != IR_INS_CALL) return 0;
+
+    IR_Call* call = &call_node->instruction.call;
+    if (call->arguments.count > X64_ARGUMENT_REGISTER_COUNT) return 0;
+
+    IR_Register result = call->return_register;
+    for (i32 i = index + 1; i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION) return 0;
+
+        IR_Instruction* instruction = &node->instruction;
+        if (instruction->type == IR_INS_RET)
         {
-        case JMP_ALWAYS:
+            if (instruction->ret.has_return_value && (!IR_register_is_valid(result) || instruction->ret.return_register.gpr_index != result.gpr_index)) return 0;
+            return i - index + 1;
+        }
+
+        IR_Move* move = &instruction->move;
+        if (instruction->type != IR_INS_MOV || move->dst.type != IR_LOCATION_REGISTER || move->src.type != VALUE_LOCATION ||
+            move->src.loc.type != IR_LOCATION_REGISTER || move->src.loc.reg.gpr_index != result.gpr_index) return 0;
+
+        result = move->dst.reg;
+    }
+    return 0;
+}
+
+// The arguments go where the callee expects them before the epilogue restores the registers they might be in
+static void X64_emit_tail_call(X64_Instruction_Array* code, IR_Instruction* instruction, IR_Program* program, Temp_Table* temp_table, Scratch_Register_Table* table, X64_Frame* frame)
+{
+    IR_Call_Arguments* arguments = &instruction->call.arguments;
+    for (i32 i = 0; i < arguments->count; i++)
+    {
+        IR_Value* value = &arguments->values[i];
+        if (value->type == VALUE_INT)
         {
-            sb_append(sb, "jmp      ");
+            X64_emit_move_lit_to_reg(code, value->integer, argument_registers[i]);
         }
-        break;
-        case JMP_EQUAL:
+        else if (value->type == VALUE_LOCATION)
         {
-            sb_append(sb, "je       ");
+            i32 slot = X64_find_spill(frame, value->loc.reg);
+            X64_Operand source = slot >= 0 ? X64_spill_slot(frame, slot) : X64_operand_register(scratch_to_register(get_or_add_scratch_from_temp(temp_table, value->loc.reg, table)));
+            X64_emit_binary_operation(code, INS_MOV, source, X64_operand_register(argument_registers[i]));
         }
-        break;
-        case JMP_ZERO:
+        else
         {
-            sb_append(sb, "jz       ");
+            NOT_IMPLEMENTED("Variables as call arguments");
         }
-        break;
-        case JMP_NOT_EQUAL:
+    }
+
+    frame->next_call++;
+    X64_emit_epilogue(code, frame);
+    X64_emit_jump(code, JMP_ALWAYS, IR_get_function_name(program, instruction->call.function_index)->str);
+}
+
+void X64_emit_instruction(X64_Instruction_Array* code, IR_Instruction* instruction, IR_Program* program, Temp_Table* temp_table, Scratch_Register_Table* table, X64_Frame* frame)
+{
+    switch(instruction->type)
+    {
+    case IR_INS_RET:
+    {
+        IR_Return* ret = &instruction->ret;
+        if (ret->has_return_value)
         {
-            sb_append(sb, "jne      ");
+            Scratch_Register return_reg = get_or_add_scratch_from_temp(temp_table, ret->return_register, table);
+            X64_emit_move_reg_to_reg(code, scratch_to_register(return_reg), REG_RAX); // calling convention defined return
         }
-        break;
-        case JMP_NOT_ZERO:
+        X64_emit_epilogue(code, frame);
+        X64_emit_ret(code);
+    }
+    break;
+    case IR_INS_CALL:
+    {
+        X64_emit_function_call(code, instruction, program, temp_table, table, frame);
+    }
+    break;
+    case IR_INS_SET:
+    {
+        IR_Set* set = &instruction->set;
+        Register reg = scratch_to_register(get_or_add_scratch_from_temp(temp_table, set->destination, table));
+        X64_emit_setcc(code, set->condition, reg);
+    }
+    break;
+    case IR_INS_SELECT:
+    {
+        // @Note: The false operand is already in the destination, see IR_lower_two_address
+        IR_Select* select = &instruction->select;
+        Register src = scratch_to_register(get_or_add_scratch_from_temp(temp_table, select->if_true.loc.reg, table));
+        Register dst = scratch_to_register(get_or_add_scratch_from_temp(temp_table, select->destination, table));
+        X64_emit_cmov(code, select->condition, src, dst);
+    }
+    break;
+    case IR_INS_ARGUMENT:
+    {
+        IR_Argument_Load* argument = &instruction->argument;
+        Register reg = scratch_to_register(get_or_add_scratch_from_temp(temp_table, argument->destination, table));
+
+        if (argument->index < X64_ARGUMENT_REGISTER_COUNT)
         {
-            sb_append(sb, "jnz      ");
+            X64_emit_move_reg_to_reg(code, argument_registers[argument->index], reg);
         }
-        break;
-        case JMP_LESS:
+        else
+        {
+            i32 offset = frame->argument_offset + (argument->index - X64_ARGUMENT_REGISTER_COUNT) * 8;
+            X64_emit_move_offset_to_reg(code, frame->argument_base, offset, reg);
+        }
+    }
+    break;
+    case IR_INS_MOV:
+    {
+        IR_Move* move = &instruction->move;
+        X64_emit_move(code, move, program, temp_table, table);        
+    }
+    break;
+    case IR_INS_PUSH:
+    {
+        IR_Push* push = &instruction->push;
+        IR_Value* value = &push->value;
+
+        switch(value->type)
+        {
+        case VALUE_LOCATION:
         {
-            sb_append(sb, "jl       ");
+            Scratch_Register reg = get_or_add_scratch_from_temp(temp_table, value->loc.reg, table);
+            X64_emit_push_reg(code, scratch_to_register(reg));
         }
         break;
-        case JMP_LESS_EQUAL:
+        case VALUE_VARIABLE:
         {
-            sb_append(sb, "jle      ");
+                        
         }
         break;
-        case JMP_GREATER:
+        default: break;
+        }
+    }
+    break;
+    case IR_INS_POP:
+    {
+        IR_Pop* pop = &instruction->pop;
+        IR_Value* value = &pop->value;
+
+        switch(value->type)
+        {
+        case VALUE_LOCATION:
         {
-            sb_append(sb, "jg       ");
+            Scratch_Register reg = get_or_add_scratch_from_temp(temp_table, value->loc.reg, table);
+            X64_emit_push_reg(code, scratch_to_register(reg));
         }
         break;
-        case JMP_GREATER_EQUAL:
+        case VALUE_VARIABLE:
         {
-            sb_append(sb, "jge      ");
+                        
         }
         break;
+        default: break;
         }
-
+    }
+    break;
+    case IR_INS_JUMP:
+    {
+        IR_Jump* jump = &instruction->jump;
         IR_Block* block = IR_get_block(program, jump->address);
-        IR_Node* node = IR_get_node(block, 0);
-        IR_Label* label = &node->label;
-                    
-        sb_appendf(sb, "%s\n", label->label_name->str);
+        IR_Label* label = &IR_get_node(block, 0)->label;
+
+        X64_emit_jump(code, jump->type, label->label_name->str);
     }
     break;
     case IR_INS_UNOP:
@@ -782,57 +1048,67 @@ void X64_emit_instruction(String_Builder* sb, IR_Instruction* instruction, IR_Pr
         Scratch_Register s_reg = get_or_add_scratch_from_temp(temp_table, ir_reg, table);
         Register reg = scratch_to_register(s_reg);
 
-        X64_emit_unary(sb, reg);
+        X64_emit_unary(code, reg);
     }
     break;
     case IR_INS_BINOP:
     {
+        // @Note: The destination already holds the operand that is computed in place, see IR_lower_two_address
         IR_BinOp* binop = &instruction->binop;
-        IR_Value* left = &binop->left;
-        IR_Value* right = &binop->right;
+        Register dst = scratch_to_register(get_or_add_scratch_from_temp(temp_table, binop->destination, table));
 
-        IR_Register ir_left_reg = left->loc.reg;
-        IR_Register ir_right_reg = right->loc.reg;
+        if (binop->right.type == VALUE_INT)
+        {
+            i32 literal = binop->right.integer;
+            switch(binop->operator)
+            {
+            case OP_ADD: X64_emit_add_lit(code, literal, dst); break;
+            case OP_SUB: X64_emit_sub_lit(code, literal, dst); break;
+            case OP_MUL:
+            {
+                Register src = scratch_to_register(get_or_add_scratch_from_temp(temp_table, binop->left.loc.reg, table));
+                X64_emit_mul_lit(code, literal, src, dst);
+            }
+            break;
+            default: COMPILER_BUG("Unsupported operator for an immediate operand."); break;
+            }
+            break;
+        }
 
-        Scratch_Register s_left_reg = get_or_add_scratch_from_temp(temp_table, ir_left_reg, table);
-        Scratch_Register s_right_reg = get_or_add_scratch_from_temp(temp_table, ir_right_reg, table);
-        Register left_reg = scratch_to_register(s_left_reg);
-        Register right_reg = scratch_to_register(s_right_reg);
+        IR_Value* source = binop->operator == OP_SUB ? &binop->right : &binop->left;
+        Register src = scratch_to_register(get_or_add_scratch_from_temp(temp_table, source->loc.reg, table));
 
         switch(binop->operator)
         {
         case OP_ADD:
         {
-            X64_emit_add(sb, left_reg, right_reg);
+            X64_emit_add(code, src, dst);
         }
         break;
         case OP_SUB:
         {
-            X64_emit_sub(sb, right_reg, left_reg);
-            Register temp = right_reg;
-            right_reg = left_reg;
-            left_reg = temp;
-
-            IR_Register temp_ir = ir_right_reg;
-            ir_right_reg = ir_left_reg;
-            ir_left_reg = temp_ir;
+            X64_emit_sub(code, src, dst);
         }
         break;
         case OP_MUL:
         {
-            X64_emit_mul(sb, left_reg, right_reg);
+            X64_emit_mul(code, src, dst);
         }
         break;
         case OP_DIV:
         {
-            X64_emit_div(sb, left_reg, right_reg);
+            X64_emit_div(code, src, dst);
         }
         break;
         case OP_BIT_OR:
-        {}
+        {
+            X64_emit_or(code, src, dst);
+        }
         break;
         case OP_BIT_AND:
-        {}
+        {
+            X64_emit_and(code, src, dst);
+        }
         break;
         case OP_ASSIGN:
         {}
@@ -840,189 +1116,1591 @@ void X64_emit_instruction(String_Builder* sb, IR_Instruction* instruction, IR_Pr
 
         default: COMPILER_BUG("Unsupported operator for binary operation."); break;
         }
-
-        /* free_temp_scratch(temp_table, ir_left_reg, table); */
     }
     break;
-    case IR_INS_COMPARE:
-    {                    
-        IR_Compare* compare = &instruction->compare;
+    case IR_INS_LEA:
+    {
+        IR_Lea* lea = &instruction->lea;
+        Register dst = scratch_to_register(get_or_add_scratch_from_temp(temp_table, lea->destination, table));
 
-        switch(compare->operator)
+        X64_Memory address = { .type = MEM_TYPE_SCALED_INDEXED };
+        address.scaled_indexed.scaled = lea->scale;
+        address.scaled_indexed.offset = lea->offset;
+        if (IR_register_is_valid(lea->base))
         {
-        case OP_EQUAL:
-        case OP_OR:
-        case OP_AND:
-        case OP_LESS:
-        case OP_GREATER:
-        case OP_LESS_EQUAL:
-        case OP_GREATER_EQUAL:
-        case OP_NOT_EQUAL:
-        break;
-        default: COMPILER_BUG("Unsupported operator for comparison operation."); break;
+            address.type = MEM_TYPE_SCALED_INDEXED_BASE;
+            address.scaled_indexed.base = scratch_to_register(get_or_add_scratch_from_temp(temp_table, lea->base, table));
+        }
+        if (IR_register_is_valid(lea->index))
+        {
+            address.scaled_indexed.offset_register = scratch_to_register(get_or_add_scratch_from_temp(temp_table, lea->index, table));
+        }
+        else
+        {
+            address = (X64_Memory) { .type = MEM_TYPE_OFFSET, .offset = { address.scaled_indexed.base, lea->offset } };
         }
 
+        X64_emit_lea(code, address, dst);
+    }
+    break;
+    case IR_INS_COMPARE:
+    {                    
+        IR_Compare* compare = &instruction->compare;
         IR_Value left = compare->left;
         IR_Location right = compare->right;
 
-        if(left.type == VALUE_INT)
+        if (left.type == VALUE_INT && left.integer == 0 && right.type == IR_LOCATION_REGISTER)
+        {
+            X64_emit_test(code, scratch_to_register(get_or_add_scratch_from_temp(temp_table, right.reg, table)));
+        }
+        else if(left.type == VALUE_INT)
         {
-            X64_emit_cmp_lit_to_loc(sb, left.integer, right, table, temp_table);
+            X64_emit_cmp_lit_to_loc(code, left.integer, right, table, temp_table);
         }
         else if (left.type == VALUE_LOCATION)
         {
-            X64_emit_cmp_loc_to_loc(sb, left.loc, right, table, temp_table);
-            free_temp_scratch(temp_table, left.loc.reg, table);
+            X64_emit_cmp_loc_to_loc(code, left.loc, right, table, temp_table);
         }
 
-        free_temp_scratch(temp_table, right.reg, table);
+        // @Note: The operands are not freed here, value numbering can keep them alive past the compare.
+        // IR registers are compacted per function (see IR_destruct_ssa), so they map onto few scratch registers.
     }
     break;
     default: COMPILER_BUG("Unhandled IR instruction, was %s", IR_instruction_type_to_string(instruction)); break;
     }
 }
 
-void X64_emit_ret(String_Builder* sb)
+void X64_emit_ret(X64_Instruction_Array* code)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-    sb_appendf(sb, "%s\n", instruction_name(INS_RET, REG_RAX));
+    X64_push(code, INS_RET, 0, none, none, none);
 }
 
-void X64_emit_pop_reg(String_Builder* sb, Register reg)
+void X64_emit_pop_reg(X64_Instruction_Array* code, Register reg)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-    sb_appendf(sb, "%s     %s\n", instruction_name(INS_POP, reg), register_names[reg]);
+    X64_emit_unary_operation(code, INS_POP, X64_operand_register(reg));
 }
 
-void X64_emit_push_reg(String_Builder* sb, Register reg)
+void X64_emit_push_reg(X64_Instruction_Array* code, Register reg)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-    sb_appendf(sb, "%s    %s\n", instruction_name(INS_PUSH, reg), register_names[reg]);
+    X64_emit_unary_operation(code, INS_PUSH, X64_operand_register(reg));
 }
 
-void X64_emit_asciz(String_Builder* sb, const char* name, const char* value)
+void X64_emit_push_lit(X64_Instruction_Array* code, i32 num)
 {
-    sb_appendf(sb, "%s:\n", name);
-    sb_indent(sb, ASM_OUT_INDENT);
-    sb_appendf(sb, ".asciz \"%s\"\n", value);
+    X64_emit_unary_operation(code, INS_PUSH, X64_operand_immediate(num));
 }
 
-void X64_emit_call(String_Builder* sb, const char* function)
+void X64_emit_prologue(X64_Instruction_Array* code, X64_Frame* frame)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-    sb_appendf(sb, "%s     %s\n", instruction_name(INS_CALL, REG_RAX), function);
+    if (frame->frame_pointer)
+    {
+        X64_emit_push_reg(code, REG_RBP);
+        X64_emit_move_reg_to_reg(code, REG_RSP, REG_RBP);
+    }
+
+    for (i32 i = 0; i < frame->saved_count; i++)
+    {
+        X64_emit_push_reg(code, frame->saved_registers[i]);
+    }
+
+    if (frame->spill_count > 0 || frame->padding)
+    {
+        X64_emit_sub_lit(code, frame->spill_count * 8 + frame->padding, REG_RSP);
+    }
 }
 
-void X64_emit_comment_line(String_Builder* sb, const char* comment)
+void X64_emit_epilogue(X64_Instruction_Array* code, X64_Frame* frame)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-    sb_appendf(sb, "# %s\n", comment);
+    if (frame->spill_count > 0 || frame->padding)
+    {
+        X64_emit_add_lit(code, frame->spill_count * 8 + frame->padding, REG_RSP);
+    }
+
+    for (i32 i = frame->saved_count - 1; i >= 0; i--)
+    {
+        X64_emit_pop_reg(code, frame->saved_registers[i]);
+    }
+
+    if (frame->frame_pointer)
+    {
+        X64_emit_pop_reg(code, REG_RBP);
+    }
 }
 
-void X64_emit_xor_reg_to_reg(String_Builder* sb, Register lhs, Register rhs)
+void X64_emit_directive(X64_Instruction_Array* code, const char* directive)
 {
-    sb_indent(sb, ASM_OUT_INDENT);
-#ifdef SKE_CODEGEN_INTEL
-    sb_appendf(sb, "%s     %s, %s\n", instruction_name(INS_XOR, rhs), register_names[rhs], register_names[rhs]);
-#elif SKE_CODEGEN_AT_T
-    sb_appendf(sb, "%s     %s, %s\n", instruction_name(INS_XOR, rhs), register_names[lhs], register_names[rhs]);
-#endif
+    X64_emit_unary_operation(code, INS_DIRECTIVE, X64_operand_label(directive));
 }
 
-void X64_emit_syscall(String_Builder* sb, Linux_Syscall syscall)
+void X64_emit_asciz(X64_Instruction_Array* code, const char* name, const char* value)
 {
-    X64_emit_move_lit_to_reg(sb, (i32)syscall, REG_RAX);
-    sb_indent(sb, ASM_OUT_INDENT);
-    sb_append(sb, "syscall\n");
+    X64_emit_label(code, name);
+    X64_emit_unary_operation(code, INS_ASCIZ, X64_operand_label(value));
 }
 
-void X64_emit_exit_syscall(String_Builder* sb)
+void X64_emit_call(X64_Instruction_Array* code, const char* function)
 {
-    X64_emit_move_reg_to_reg(sb, REG_RAX, REG_RDI);  
-    X64_emit_move_lit_to_reg(sb, LINUX_SC_EXIT, REG_RAX);
+    X64_emit_unary_operation(code, INS_CALL, X64_operand_label(function));
+}
 
-    sb_indent(sb, ASM_OUT_INDENT);
-    sb_append(sb, "syscall\n");
+void X64_emit_comment_line(X64_Instruction_Array* code, const char* comment)
+{
+    X64_emit_unary_operation(code, INS_COMMENT, X64_operand_label(comment));
 }
 
-void X64_emit_start(String_Builder* sb)
+void X64_emit_xor_reg_to_reg(X64_Instruction_Array* code, Register lhs, Register rhs)
 {
-    sb_append(sb, ".global _start\n");
+    X64_emit_binary_operation(code, INS_XOR, X64_operand_register(lhs), X64_operand_register(rhs));
+}
 
-    sb_append(sb, ".text\n");
+void X64_emit_syscall(X64_Instruction_Array* code, Linux_Syscall syscall)
+{
+    X64_emit_move_lit_to_reg(code, (i32)syscall, REG_RAX);
+    X64_push(code, INS_SYSCALL, 0, none, none, none);
+}
 
-    X64_emit_label(sb, "_start");
+void X64_emit_exit_syscall(X64_Instruction_Array* code)
+{
+    X64_emit_move_reg_to_reg(code, REG_RAX, REG_RDI);  
+    X64_emit_syscall(code, LINUX_SC_EXIT);
+}
 
-    X64_emit_xor_reg_to_reg(sb, REG_RBP, REG_RBP);
+#define PROFILE_COUNTERS_SYMBOL "__ske_profile_counters"
+#define PROFILE_HEADER_SYMBOL   "__ske_profile_header"
+#define PROFILE_PATH_SYMBOL     "__ske_profile_path"
 
-    X64_emit_call(sb, "main");
-    
-    X64_emit_move_reg_to_reg(sb, REG_RAX, REG_RDI);
-    
-    X64_emit_syscall(sb, LINUX_SC_EXIT);
+static X64_Memory X64_rip_relative(const char* symbol, i32 offset)
+{
+    return (X64_Memory) { .type = MEM_TYPE_RIP_RELATIVE, .rip_relative = { .symbol = symbol, .offset = offset } };
 }
 
-String* X64_codegen_ir(IR_Program* program, Allocator* allocator)
+void X64_emit_profile_counter(X64_Instruction_Array* code, i32 index)
 {
-    String_Builder sb;
-    sb_init(&sb, 256);
+    X64_emit_binary_operation(code, INS_ADD, X64_operand_immediate(1), X64_operand_memory(X64_rip_relative(PROFILE_COUNTERS_SYMBOL, index * 8)));
+}
 
-    Scratch_Register_Table table;
-    scratch_table_init(&table);
+static void X64_emit_write(X64_Instruction_Array* code, Register file, const char* symbol, i32 length)
+{
+    X64_emit_move_reg_to_reg(code, file, REG_RDI);
+    X64_emit_lea(code, X64_rip_relative(symbol, 0), REG_RSI);
+    X64_emit_move_lit_to_reg(code, length, REG_RDX);
+    X64_emit_syscall(code, LINUX_SC_WRITE);
+}
 
-    Temp_Table temp_table;
-    temp_table_init(&temp_table);
+// @Note: Syscalls only clobber rax, rcx and r11, so the exit code stays in rbx and the file in r12
+static void X64_emit_profile_dump(X64_Instruction_Array* code, X64_Profile_Counters* profile)
+{
+    X64_emit_move_reg_to_reg(code, REG_RAX, REG_RBX);
 
-#ifdef SKE_CODEGEN_INTEL
-    sb_append(&sb, ".intel_syntax noprefix\n\n");
-#endif
-    
-    for (i32 i = 0; i < program->function_array.count; i++)
+    X64_emit_lea(code, X64_rip_relative(PROFILE_PATH_SYMBOL, 0), REG_RDI);
+    X64_emit_move_lit_to_reg(code, 01 | 0100 | 01000, REG_RSI); // O_WRONLY | O_CREAT | O_TRUNC
+    X64_emit_move_lit_to_reg(code, 0644, REG_RDX);
+    X64_emit_syscall(code, LINUX_SC_OPEN);
+    X64_emit_move_reg_to_reg(code, REG_RAX, REG_R12);
+
+    X64_emit_write(code, REG_R12, PROFILE_HEADER_SYMBOL, (i32)profile->header->length);
+    X64_emit_write(code, REG_R12, PROFILE_COUNTERS_SYMBOL, profile->count * 8);
+
+    X64_emit_move_reg_to_reg(code, REG_R12, REG_RDI);
+    X64_emit_syscall(code, LINUX_SC_CLOSE);
+
+    X64_emit_move_reg_to_reg(code, REG_RBX, REG_RAX);
+}
+
+// The inside of a string of the assembler, which takes the escapes of C
+static void X64_append_escaped(String_Builder* sb, const char* text, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
     {
-        IR_Function_Decl* function = program->function_array.functions[i];
-        if (function->export)
-        {
-            String* name = program->function_array.functions[i]->name;
-            sb_appendf(&sb, ".global %s\n", name->str);
-        }
+        char c = text[i];
+        if (c == '\n') sb_append(sb, "\\n");
+        else if (c == '"' || c == '\\') sb_appendf(sb, "\\%c", c);
+        else sb_appendf(sb, "%c", c);
     }
-    
-    X64_emit_start(&sb);
+}
 
-    for (i32 i = 0; i < program->block_array.count; i++)
-    {
-        IR_Block* block = &program->block_array.blocks[i];
+static void X64_emit_profile_data(X64_Instruction_Array* code, X64_Profile_Counters* profile, Allocator* allocator)
+{
+    String_Builder header;
+    sb_init(&header, 256);
+    X64_append_escaped(&header, profile->header->str, profile->header->length);
+
+    X64_emit_directive(code, ".data");
+    X64_emit_directive(code, ".balign 8");
+    X64_emit_label(code, PROFILE_COUNTERS_SYMBOL);
+    X64_emit_directive(code, string_createf(allocator, "    .zero %d", profile->count * 8)->str);
+    X64_emit_label(code, PROFILE_HEADER_SYMBOL);
+    X64_emit_directive(code, string_createf(allocator, "    .ascii \"%s\"", header.string)->str);
+    X64_emit_asciz(code, PROFILE_PATH_SYMBOL, profile->path);
+
+    sb_free(&header);
+}
 
-        for (i32 j = 0; j < block->node_array.count; j++)
-        {
-            IR_Node* node = &block->node_array.nodes[j];
+void X64_emit_start(X64_Instruction_Array* code, X64_Profile_Counters* profile)
+{
+    X64_emit_directive(code, ".global _start");
 
-            switch(node->type)
-            {
-            case IR_NODE_FUNCTION_DECL:
-            {
-                IR_Function_Decl* fun = &node->function;
-                sb_appendf(&sb, "%s:\n", fun->name->str);
+    X64_emit_directive(code, ".text");
 
-                X64_emit_push_reg(&sb, REG_RBP);
-                X64_emit_move_reg_to_reg(&sb, REG_RSP, REG_RBP);
-            }
-            break;
-            case IR_NODE_LABEL:
-            {
-                X64_emit_label(&sb, node->label.label_name->str);
-            }
-            break;
-            case IR_NODE_INSTRUCTION:
-            {
-                IR_Instruction* instruction = &node->instruction;
-                X64_emit_instruction(&sb, instruction, program, &temp_table, &table);
-            }
-            break;
-            }
-        }
+    X64_emit_label(code, "_start");
+
+    X64_emit_xor_reg_to_reg(code, REG_RBP, REG_RBP);
+
+    X64_emit_call(code, "main");
+
+    if (profile)
+    {
+        X64_emit_profile_dump(code, profile);
     }
+    
+    X64_emit_exit_syscall(code);
+}
 
-    String* assembly = sb_get_result(&sb, allocator);
-    return assembly;
+/* ======================
+   Printing
+   ====================== */
+
+static void X64_print_memory(String_Builder* sb, X64_Memory* memory)
+{
+    switch(memory->type)
+    {
+    case MEM_TYPE_REGISTER:
+    {
+#ifdef SKE_CODEGEN_INTEL
+        sb_appendf(sb, "[%s]", register_names[memory->reg]);
+#elif SKE_CODEGEN_AT_T
+        sb_appendf(sb, "(%s)", register_names[memory->reg]);
+#endif
+    }
+    break;
+    case MEM_TYPE_OFFSET:
+    {
+#ifdef SKE_CODEGEN_INTEL
+        sb_appendf(sb, "[%s + %d]", register_names[memory->offset.reg], memory->offset.offset);
+#elif SKE_CODEGEN_AT_T
+        sb_appendf(sb, "%d(%s)", memory->offset.offset, register_names[memory->offset.reg]);
+#endif
+    }
+    break;
+    case MEM_TYPE_SCALED_INDEXED_BASE:
+    case MEM_TYPE_SCALED_INDEXED:
+    {
+        const char* base = memory->type == MEM_TYPE_SCALED_INDEXED_BASE ? register_names[memory->scaled_indexed.base] : "";
+        const char* index = register_names[memory->scaled_indexed.offset_register];
+#ifdef SKE_CODEGEN_INTEL
+        sb_appendf(sb, "[%s%s%s * %d + %d]", base, *base ? " + " : "", index, memory->scaled_indexed.scaled, memory->scaled_indexed.offset);
+#elif SKE_CODEGEN_AT_T
+        if (memory->scaled_indexed.offset != 0 || !*base) sb_appendf(sb, "%d", memory->scaled_indexed.offset);
+        sb_appendf(sb, "(%s, %s, %d)", base, index, memory->scaled_indexed.scaled);
+#endif
+    }
+    break;
+    case MEM_TYPE_IMMEDIATE:
+    {
+        sb_appendf(sb, "%d", memory->immediate);
+    }
+    break;
+    case MEM_TYPE_RIP_RELATIVE:
+    {
+#ifdef SKE_CODEGEN_INTEL
+        sb_appendf(sb, "[rip + %s + %d]", memory->rip_relative.symbol, memory->rip_relative.offset);
+#elif SKE_CODEGEN_AT_T
+        sb_appendf(sb, "%s+%d(%%rip)", memory->rip_relative.symbol, memory->rip_relative.offset);
+#endif
+    }
+    break;
+    }
+}
+
+static void X64_print_operand(String_Builder* sb, X64_Operand* operand)
+{
+    switch(operand->type)
+    {
+    case OPERAND_REGISTER:  sb_append(sb, register_names[operand->reg]); break;
+    case OPERAND_IMMEDIATE: sb_appendf(sb, "%c%d", literal_prefix(), operand->immediate); break;
+    case OPERAND_MEMORY:    X64_print_memory(sb, &operand->memory); break;
+    case OPERAND_LABEL:     sb_append(sb, operand->label); break;
+    case OPERAND_NONE:      break;
+    }
+}
+
+// The operand size suffix comes from the destination, or the last register when that is not one
+static Register X64_size_register(X64_Instruction* instruction)
+{
+    for (i32 i = instruction->operand_count - 1; i >= 0; i--)
+    {
+        if (instruction->operands[i].type == OPERAND_REGISTER) return instruction->operands[i].reg;
+    }
+    return REG_RAX;
+}
+
+static void X64_print_instruction(String_Builder* sb, X64_Instruction* instruction)
+{
+    const char* text = instruction->operands[0].label;
+    switch(instruction->opcode)
+    {
+    case INS_LABEL:     sb_appendf(sb, "%s:\n", text); return;
+    case INS_DIRECTIVE: sb_appendf(sb, "%s\n", text); return;
+    case INS_ASCIZ:
+    {
+        sb_indent(sb, ASM_OUT_INDENT);
+        sb_append(sb, ".asciz \"");
+        X64_append_escaped(sb, text, strlen(text));
+        sb_append(sb, "\"\n");
+    }
+    return;
+    case INS_COMMENT:
+    {
+        sb_indent(sb, ASM_OUT_INDENT);
+        sb_appendf(sb, "# %s\n", text);
+    }
+    return;
+    default: break;
+    }
+
+    char mnemonic[16];
+    if (instruction->opcode == INS_JCC || instruction->opcode == INS_SETCC || instruction->opcode == INS_CMOV)
+    {
+        snprintf(mnemonic, sizeof(mnemonic), "%s%s", instruction_names[instruction->opcode], IR_condition_suffix(instruction->condition));
+    }
+    else
+    {
+#ifdef SKE_CODEGEN_INTEL
+        snprintf(mnemonic, sizeof(mnemonic), "%s", instruction_names[instruction->opcode]);
+#elif SKE_CODEGEN_AT_T
+        snprintf(mnemonic, sizeof(mnemonic), "%s", instruction_name(instruction->opcode, X64_size_register(instruction)));
+#endif
+    }
+
+    sb_indent(sb, ASM_OUT_INDENT);
+    if (instruction->operand_count == 0)
+    {
+        sb_appendf(sb, "%s\n", mnemonic);
+        return;
+    }
+
+    sb_appendf(sb, "%-8s ", mnemonic);
+    for (i32 i = 0; i < instruction->operand_count; i++)
+    {
+        if (i > 0) sb_append(sb, ", ");
+#ifdef SKE_CODEGEN_INTEL
+        X64_print_operand(sb, &instruction->operands[instruction->operand_count - 1 - i]);
+#elif SKE_CODEGEN_AT_T
+        X64_print_operand(sb, &instruction->operands[i]);
+#endif
+    }
+    sb_newline(sb);
+}
+
+void X64_print_instructions(String_Builder* sb, X64_Instruction_Array* code)
+{
+    for (i32 i = 0; i < code->count; i++)
+    {
+        X64_print_instruction(sb, &code->instructions[i]);
+    }
+}
+
+/* ======================
+   Peephole optimization
+   ====================== */
+
+// The 64 bit register that `reg` is a part of, registers are grouped from their smallest to their largest part
+static Register X64_register_family(Register reg)
+{
+    while (register_sizes[reg] != REG_SIZE_QUAD) reg++;
+    return reg;
+}
+
+static bool X64_operand_uses(X64_Operand* operand, Register family)
+{
+    switch(operand->type)
+    {
+    case OPERAND_REGISTER: return X64_register_family(operand->reg) == family;
+    case OPERAND_MEMORY:
+    {
+        X64_Memory* memory = &operand->memory;
+        switch(memory->type)
+        {
+        case MEM_TYPE_REGISTER: return X64_register_family(memory->reg) == family;
+        case MEM_TYPE_OFFSET:   return X64_register_family(memory->offset.reg) == family;
+        case MEM_TYPE_SCALED_INDEXED_BASE:
+        if (X64_register_family(memory->scaled_indexed.base) == family) return true;
+        // Fallthrough
+        case MEM_TYPE_SCALED_INDEXED: return X64_register_family(memory->scaled_indexed.offset_register) == family;
+        default: return false;
+        }
+    }
+    default: return false;
+    }
+}
+
+static bool X64_is_argument_register(Register family)
+{
+    for (i32 i = 0; i < X64_ARGUMENT_REGISTER_COUNT; i++)
+    {
+        if (argument_registers[i] == family) return true;
+    }
+    return false;
+}
+
+static bool X64_is_caller_saved(Register family)
+{
+    return family == REG_RAX || family == REG_R10 || family == REG_R11 || X64_is_argument_register(family);
+}
+
+static bool X64_reads_register(X64_Instruction* instruction, Register family)
+{
+    X64_Operand* operands = instruction->operands;
+    i32 count = instruction->operand_count;
+
+    switch(instruction->opcode)
+    {
+    case INS_MOV:
+    case INS_MOVZX:
+    case INS_LEA:
+    return X64_operand_uses(&operands[0], family) || (operands[1].type == OPERAND_MEMORY && X64_operand_uses(&operands[1], family));
+    case INS_MUL:
+    {
+        // The three operand form only writes its destination
+        if (count == 3) return X64_operand_uses(&operands[1], family);
+        return X64_operand_uses(&operands[0], family) || X64_operand_uses(&operands[1], family);
+    }
+    case INS_DIV:  return family == REG_RAX || family == REG_RDX || X64_operand_uses(&operands[0], family);
+    case INS_CQO:  return family == REG_RAX;
+    case INS_PUSH: return family == REG_RSP || X64_operand_uses(&operands[0], family);
+    case INS_POP:  return family == REG_RSP;
+    case INS_CALL: return family == REG_RSP || X64_is_argument_register(family);
+    case INS_RET:  return family == REG_RAX || family == REG_RSP || !X64_is_caller_saved(family);
+    case INS_SYSCALL: return family == REG_RAX || X64_is_argument_register(family);
+    default:
+    {
+        for (i32 i = 0; i < count; i++)
+        {
+            if (X64_operand_uses(&operands[i], family)) return true;
+        }
+        return false;
+    }
+    }
+}
+
+static bool X64_writes_register(X64_Instruction* instruction, Register family)
+{
+    // Only read for instructions that have operands
+    X64_Operand* destination = instruction->operands + (instruction->operand_count > 0 ? instruction->operand_count - 1 : 0);
+
+    switch(instruction->opcode)
+    {
+    case INS_CMP:
+    case INS_TEST:
+    case INS_JMP:
+    case INS_JCC:
+    case INS_RET:
+    return false;
+    case INS_DIV:  return family == REG_RAX || family == REG_RDX;
+    case INS_CQO:  return family == REG_RDX;
+    case INS_PUSH: return family == REG_RSP;
+    case INS_POP:  return family == REG_RSP || X64_operand_uses(destination, family);
+    case INS_CALL: return X64_is_caller_saved(family);
+    case INS_SYSCALL: return family == REG_RAX || family == REG_RCX || family == REG_R11;
+    default: return instruction->operand_count > 0 && destination->type == OPERAND_REGISTER && X64_operand_uses(destination, family);
+    }
+}
+
+static bool X64_ends_straight_line(X64_Instruction* instruction)
+{
+    return instruction->opcode == INS_JMP || instruction->opcode == INS_JCC || instruction->opcode == INS_LABEL || instruction->opcode == INS_RET;
+}
+
+// Conservative: a register is only dead if it is overwritten (or the function returns) before anything reads it
+static bool X64_register_is_dead_after(X64_Instruction_Array* code, i32 index, Register family)
+{
+    for (i32 i = index + 1; i < code->count; i++)
+    {
+        X64_Instruction* instruction = &code->instructions[i];
+        if (X64_reads_register(instruction, family)) return false;
+        if (X64_writes_register(instruction, family) || instruction->opcode == INS_RET) return true;
+        if (X64_ends_straight_line(instruction)) return false;
+    }
+    return false;
+}
+
+static bool X64_reads_flags(X64_Instruction* instruction)
+{
+    return instruction->opcode == INS_JCC || instruction->opcode == INS_SETCC || instruction->opcode == INS_CMOV;
+}
+
+static bool X64_writes_flags(X64_Instruction* instruction)
+{
+    switch(instruction->opcode)
+    {
+    case INS_ADD: case INS_SUB: case INS_MUL: case INS_DIV: case INS_NEG: case INS_XOR: case INS_AND: case INS_OR:
+    case INS_CMP: case INS_TEST: case INS_CALL: case INS_SYSCALL:
+    return true;
+    default: return false;
+    }
+}
+
+/*
+Whether the instructions after `index` only read the flags for equality, nil if they are not read at all.
+@Note: The IR never keeps the condition codes across blocks (see IR_Compare), so they are dead at labels
+       and jumps that leave the block.
+ */
+static bool X64_flags_read_after(X64_Instruction_Array* code, i32 index, bool* only_equality)
+{
+    bool read = false;
+    *only_equality = true;
+    for (i32 i = index + 1; i < code->count; i++)
+    {
+        X64_Instruction* instruction = &code->instructions[i];
+        if (X64_reads_flags(instruction))
+        {
+            read = true;
+            IR_Jump_Type condition = instruction->condition;
+            *only_equality &= condition == JMP_EQUAL || condition == JMP_NOT_EQUAL || condition == JMP_ZERO || condition == JMP_NOT_ZERO;
+        }
+        if (X64_writes_flags(instruction) || (X64_ends_straight_line(instruction) && instruction->opcode != INS_JCC)) break;
+    }
+    return read;
+}
+
+static bool X64_is_register(X64_Operand* operand, Register reg)
+{
+    return operand->type == OPERAND_REGISTER && operand->reg == reg;
+}
+
+static void X64_remove_instruction(X64_Instruction_Array* code, i32 index)
+{
+    memmove(&code->instructions[index], &code->instructions[index + 1], sizeof(X64_Instruction) * (code->count - index - 1));
+    code->count--;
+}
+
+// The label of the jump is among the labels right after it. Alignment padding in between runs as nops.
+static bool X64_jumps_to_next(X64_Instruction_Array* code, i32 index, const char* label)
+{
+    for (i32 i = index + 1; i < code->count; i++)
+    {
+        X64_Instruction* instruction = &code->instructions[i];
+        if (instruction->opcode == INS_DIRECTIVE && strncmp(instruction->operands[0].label, ".p2align", 8) == 0) continue;
+        if (instruction->opcode != INS_LABEL) return false;
+        if (strcmp(instruction->operands[0].label, label) == 0) return true;
+    }
+    return false;
+}
+
+// mov %r, %r
+static bool X64_peephole_self_move(X64_Instruction_Array* code, i32 index)
+{
+    X64_Instruction* move = &code->instructions[index];
+    if (move->opcode != INS_MOV || move->operands[0].type != OPERAND_REGISTER) return false;
+
+    // @Note: A 32 bit move to itself still clears the upper half
+    Register reg = move->operands[0].reg;
+    if (!X64_is_register(&move->operands[1], reg) || register_sizes[reg] != REG_SIZE_QUAD) return false;
+
+    X64_remove_instruction(code, index);
+    return true;
+}
+
+// mov a, %r1 ; mov %r1, %r2  ->  mov a, %r2 when %r1 is dead afterwards
+static bool X64_peephole_move_chain(X64_Instruction_Array* code, i32 index)
+{
+    if (index + 1 >= code->count) return false;
+
+    X64_Instruction* first = &code->instructions[index];
+    X64_Instruction* second = &code->instructions[index + 1];
+    if (first->opcode != INS_MOV || second->opcode != INS_MOV) return false;
+    if (first->operands[1].type != OPERAND_REGISTER || second->operands[1].type != OPERAND_REGISTER) return false;
+    if (first->operands[0].type == OPERAND_MEMORY && second->operands[1].type == OPERAND_MEMORY) return false;
+
+    Register middle = first->operands[1].reg;
+    if (!X64_is_register(&second->operands[0], middle) || register_sizes[middle] != REG_SIZE_QUAD) return false;
+    if (!X64_register_is_dead_after(code, index + 1, X64_register_family(middle))) return false;
+
+    second->operands[0] = first->operands[0];
+    X64_remove_instruction(code, index);
+    return true;
+}
+
+// jmp .L ; .L:
+static bool X64_peephole_jump_to_next(X64_Instruction_Array* code, i32 index)
+{
+    X64_Instruction* jump = &code->instructions[index];
+    if (jump->opcode != INS_JMP && jump->opcode != INS_JCC) return false;
+    if (!X64_jumps_to_next(code, index, jump->operands[0].label)) return false;
+
+    X64_remove_instruction(code, index);
+    return true;
+}
+
+// jcc .L1 ; jmp .L2 ; .L1:  ->  jncc .L2 ; .L1:
+static bool X64_peephole_jump_over_jump(X64_Instruction_Array* code, i32 index)
+{
+    if (index + 1 >= code->count) return false;
+
+    X64_Instruction* branch = &code->instructions[index];
+    X64_Instruction* jump = &code->instructions[index + 1];
+    if (branch->opcode != INS_JCC || jump->opcode != INS_JMP) return false;
+    if (!X64_jumps_to_next(code, index + 1, branch->operands[0].label)) return false;
+
+    branch->condition = IR_negate_condition(branch->condition);
+    branch->operands[0] = jump->operands[0];
+    X64_remove_instruction(code, index + 1);
+    return true;
+}
+
+// mov $0, %r  ->  xor %r32, %r32 when nothing reads the flags xor clobbers
+static bool X64_peephole_zero_idiom(X64_Instruction_Array* code, i32 index)
+{
+    X64_Instruction* move = &code->instructions[index];
+    if (move->opcode != INS_MOV || move->operands[0].type != OPERAND_IMMEDIATE || move->operands[0].immediate != 0) return false;
+    if (move->operands[1].type != OPERAND_REGISTER || register_sizes[move->operands[1].reg] != REG_SIZE_QUAD) return false;
+
+    bool only_equality;
+    if (X64_flags_read_after(code, index, &only_equality)) return false;
+
+    // @Note: Writing the 32 bit register clears the upper half, and its encoding is shorter
+    Register reg = move->operands[1].reg - 1;
+    assert(register_sizes[reg] == REG_SIZE_LONG);
+    *move = (X64_Instruction) { .opcode = INS_XOR, .condition = JMP_ALWAYS, .operands = { X64_operand_register(reg), X64_operand_register(reg) }, .operand_count = 2 };
+    return true;
+}
+
+/*
+add/sub/xor/neg ... %r ; test %r, %r  ->  add/sub/xor/neg ... %r
+The arithmetic already set the zero flag for the result, but not the overflow flag test clears, so only
+equality conditions may read them.
+ */
+static bool X64_peephole_redundant_test(X64_Instruction_Array* code, i32 index)
+{
+    if (index == 0) return false;
+
+    X64_Instruction* arithmetic = &code->instructions[index - 1];
+    X64_Instruction* test = &code->instructions[index];
+    if (test->opcode != INS_TEST || test->operands[0].type != OPERAND_REGISTER) return false;
+
+    Register reg = test->operands[0].reg;
+    if (!X64_is_register(&test->operands[1], reg)) return false;
+
+    switch(arithmetic->opcode)
+    {
+    case INS_ADD: case INS_SUB: case INS_XOR: case INS_AND: case INS_OR: case INS_NEG: break;
+    default: return false;
+    }
+    if (!X64_is_register(&arithmetic->operands[arithmetic->operand_count - 1], reg)) return false;
+
+    bool only_equality;
+    X64_flags_read_after(code, index, &only_equality);
+    if (!only_equality) return false;
+
+    X64_remove_instruction(code, index);
+    return true;
+}
+
+typedef bool (*X64_Peephole_Rule)(X64_Instruction_Array* code, i32 index);
+
+static const X64_Peephole_Rule peephole_rules[] =
+{
+    X64_peephole_self_move,
+    X64_peephole_move_chain,
+    X64_peephole_jump_to_next,
+    X64_peephole_jump_over_jump,
+    X64_peephole_zero_idiom,
+    X64_peephole_redundant_test,
+};
+
+void X64_peephole(X64_Instruction_Array* code)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (i32 i = 0; i < code->count; i++)
+        {
+            for (i32 r = 0; r < (i32)(sizeof(peephole_rules) / sizeof(peephole_rules[0])) && i < code->count; r++)
+            {
+                changed |= peephole_rules[r](code, i);
+            }
+        }
+    }
+}
+
+/*
+Assigns a scratch register to every IR register of the function up front, so the prologue knows which
+callee-saved registers it has to save before the body is emitted. Registers that are live across a call
+get callee-saved registers where possible, and the registers live across each call are kept for
+X64_emit_function_call.
+ */
+/* ======================
+   Instruction selection
+   ====================== */
+
+#define SELECT_MAX_FOLDED 8
+
+typedef struct X64_Selector X64_Selector;
+struct X64_Selector
+{
+    IR_Register_Map map;
+
+    IR_Instruction** definitions; // By local index, NULL for registers without a definition in the function
+    i32* definition_blocks;       // Layout index of the block holding the definition, by local index
+    i32* use_counts;              // By local index
+    bool* folded;                 // Definitions that lost a use to a pattern, so they might be dead now
+};
+
+// Partial lea while matching, the instructions it absorbs are only folded once the whole tree matched
+typedef struct X64_Address X64_Address;
+struct X64_Address
+{
+    IR_Register base;
+    IR_Register index;
+    i32 scale;
+    i64 offset;
+
+    i32 folded[SELECT_MAX_FOLDED]; // Locals of the definitions folded into the address
+    i32 folded_count;
+    i32 absorbed_count; // Instructions among them, literals do not count
+};
+
+static bool X64_match_literal(X64_Selector* selector, IR_Value* value, i32* literal)
+{
+    if (value->type == VALUE_INT)
+    {
+        *literal = value->integer;
+        return true;
+    }
+
+    IR_Register* reg = IR_get_value_register(value);
+    if (!reg) return false;
+
+    IR_Instruction* definition = selector->definitions[IR_register_map_find(&selector->map, *reg)];
+    if (!definition || definition->type != IR_INS_MOV || definition->move.src.type != VALUE_INT) return false;
+
+    *literal = definition->move.src.integer;
+    return true;
+}
+
+// Replaces a register that holds a literal with the literal itself
+static bool X64_fold_literal(X64_Selector* selector, IR_Value* value)
+{
+    i32 literal;
+    IR_Register* reg = IR_get_value_register(value);
+    if (!reg || !X64_match_literal(selector, value, &literal)) return false;
+
+    selector->folded[IR_register_map_find(&selector->map, *reg)] = true;
+    *value = IR_create_value_number(literal);
+    return true;
+}
+
+// The definition of `value` if it only exists for the instruction reading it in `block`
+static IR_Instruction* X64_match_subtree(X64_Selector* selector, IR_Value* value, i32 block)
+{
+    IR_Register* reg = IR_get_value_register(value);
+    if (!reg) return NULL;
+
+    i32 local = IR_register_map_find(&selector->map, *reg);
+    if (selector->use_counts[local] != 1 || selector->definition_blocks[local] != block) return NULL;
+    return selector->definitions[local];
+}
+
+static bool X64_address_add_register(X64_Address* address, IR_Register reg, i32 scale)
+{
+    if (scale == 1 && !IR_register_is_valid(address->base))
+    {
+        address->base = reg;
+        return true;
+    }
+
+    // @Note: Only the index can be scaled, so an unscaled index moves over to the base to make room
+    if (IR_register_is_valid(address->index) && address->scale == 1 && !IR_register_is_valid(address->base))
+    {
+        address->base = address->index;
+        address->index = (IR_Register) { .gpr_index = -1 };
+    }
+
+    if (IR_register_is_valid(address->index)) return false;
+
+    address->index = reg;
+    address->scale = scale;
+    return true;
+}
+
+static bool X64_address_add_offset(X64_Address* address, i64 offset)
+{
+    address->offset += offset;
+    return address->offset >= INT32_MIN && address->offset <= INT32_MAX;
+}
+
+static bool X64_match_address(X64_Selector* selector, IR_Value* value, i32 block, X64_Address* address);
+
+// Adds the operands of an addition or an earlier lea to the address
+static bool X64_match_address_tree(X64_Selector* selector, IR_Instruction* instruction, i32 block, X64_Address* address)
+{
+    if (instruction->type == IR_INS_LEA)
+    {
+        IR_Lea* lea = &instruction->lea;
+        if (IR_register_is_valid(lea->base) && !X64_address_add_register(address, lea->base, 1)) return false;
+        if (IR_register_is_valid(lea->index) && !X64_address_add_register(address, lea->index, lea->scale)) return false;
+        return X64_address_add_offset(address, lea->offset);
+    }
+
+    if (instruction->type == IR_INS_BINOP && instruction->binop.operator == OP_ADD)
+    {
+        return X64_match_address(selector, &instruction->binop.left, block, address)
+            && X64_match_address(selector, &instruction->binop.right, block, address);
+    }
+
+    return false;
+}
+
+static bool X64_match_address(X64_Selector* selector, IR_Value* value, i32 block, X64_Address* address)
+{
+    IR_Register* reg = IR_get_value_register(value);
+    if (reg && address->folded_count == SELECT_MAX_FOLDED) return false;
+
+    i32 literal;
+    if (X64_match_literal(selector, value, &literal))
+    {
+        if (reg) address->folded[address->folded_count++] = IR_register_map_find(&selector->map, *reg);
+        return X64_address_add_offset(address, literal);
+    }
+
+    if (!reg) return false;
+
+    IR_Instruction* subtree = X64_match_subtree(selector, value, block);
+    if (subtree)
+    {
+        X64_Address folded = *address;
+        folded.folded[folded.folded_count++] = IR_register_map_find(&selector->map, *reg);
+        folded.absorbed_count++;
+        if (X64_match_address_tree(selector, subtree, block, &folded))
+        {
+            *address = folded;
+            return true;
+        }
+    }
+
+    return X64_address_add_register(address, *reg, 1);
+}
+
+static void X64_make_lea(IR_Instruction* instruction, IR_Register destination, IR_Register base, IR_Register index, i32 scale, i32 offset)
+{
+    instruction->type = IR_INS_LEA;
+    instruction->lea = (IR_Lea) { .base = base, .index = index, .scale = scale, .offset = offset, .destination = destination };
+}
+
+// An addition only becomes a lea when it absorbs another instruction, otherwise add does the same
+static bool X64_select_address(X64_Selector* selector, IR_Instruction* instruction, i32 block)
+{
+    IR_BinOp* binop = &instruction->binop;
+    X64_Address address = { .base = { .gpr_index = -1 }, .index = { .gpr_index = -1 }, .scale = 1 };
+
+    if (!X64_match_address(selector, &binop->left, block, &address)) return false;
+    if (!X64_match_address(selector, &binop->right, block, &address)) return false;
+    if (address.absorbed_count == 0) return false;
+    if (!IR_register_is_valid(address.base) && !IR_register_is_valid(address.index)) return false;
+
+    for (i32 i = 0; i < address.folded_count; i++)
+    {
+        selector->folded[address.folded[i]] = true;
+    }
+
+    X64_make_lea(instruction, binop->destination, address.base, address.index, address.scale, (i32)address.offset);
+    return true;
+}
+
+// Multiplications by 2, 3, 4, 5, 8 and 9 are a lea of the value with itself
+static void X64_select_multiply(IR_Instruction* instruction)
+{
+    IR_BinOp* binop = &instruction->binop;
+    IR_Register source = binop->left.loc.reg;
+    IR_Register none = { .gpr_index = -1 };
+
+    switch(binop->right.integer)
+    {
+    case 2:         X64_make_lea(instruction, binop->destination, source, source, 1, 0); break;
+    case 3: case 5:
+    case 9:         X64_make_lea(instruction, binop->destination, source, source, binop->right.integer - 1, 0); break;
+    case 4: case 8: X64_make_lea(instruction, binop->destination, none, source, binop->right.integer, 0); break;
+    default: break;
+    }
+}
+
+static void X64_select_instruction(X64_Selector* selector, IR_Instruction* instruction, i32 block)
+{
+    switch(instruction->type)
+    {
+    case IR_INS_BINOP:
+    {
+        IR_BinOp* binop = &instruction->binop;
+        if (binop->operator == OP_ADD && X64_select_address(selector, instruction, block)) break;
+
+        // @Note: idiv has no immediate form
+        if (binop->operator != OP_ADD && binop->operator != OP_SUB && binop->operator != OP_MUL) break;
+
+        // The immediate can only be the source operand, so commutative operations move it to the right
+        i32 literal;
+        if (binop->operator != OP_SUB && !X64_match_literal(selector, &binop->right, &literal)
+            && X64_match_literal(selector, &binop->left, &literal))
+        {
+            IR_Value temp = binop->left;
+            binop->left = binop->right;
+            binop->right = temp;
+        }
+
+        if (!IR_get_value_register(&binop->left)) break;
+
+        X64_fold_literal(selector, &binop->right);
+        if (binop->operator == OP_MUL && binop->right.type == VALUE_INT)
+        {
+            X64_select_multiply(instruction);
+        }
+    }
+    break;
+    case IR_INS_COMPARE:
+    {
+        // @Note: cmp only takes an immediate as its first operand, which sets the flags for `right - lit`
+        //        (see IR_Compare), so a literal on the right trades places with the register on the left
+        IR_Compare* compare = &instruction->compare;
+        IR_Value right = IR_create_value_location(compare->right);
+        IR_Register* right_reg = IR_get_value_register(&right);
+
+        i32 literal;
+        if (IR_get_value_register(&compare->left) && right_reg && X64_match_literal(selector, &right, &literal))
+        {
+            selector->folded[IR_register_map_find(&selector->map, *right_reg)] = true;
+            compare->right = compare->left.loc;
+            compare->left = IR_create_value_number(literal);
+        }
+    }
+    break;
+    case IR_INS_CALL:
+    {
+        IR_Call_Arguments* arguments = &instruction->call.arguments;
+        for (i32 i = 0; i < arguments->count; i++)
+        {
+            X64_fold_literal(selector, &arguments->values[i]);
+        }
+    }
+    break;
+    case IR_INS_MOV:
+    {
+        X64_fold_literal(selector, &instruction->move.src);
+    }
+    break;
+    default: break;
+    }
+}
+
+static void X64_count_uses(X64_Selector* selector, IR_Program* program, IR_Function_Decl* function)
+{
+    memset(selector->use_counts, 0, sizeof(i32) * selector->map.count);
+
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            for (i32 k = 0; k < IR_get_use_count(&node->instruction); k++)
+            {
+                IR_Register* use = IR_get_use(&node->instruction, k);
+                if (use) selector->use_counts[IR_register_map_find(&selector->map, *use)]++;
+            }
+        }
+    }
+}
+
+// Deletes the folded definitions nothing reads anymore, which can leave the ones they read unused in turn
+static void X64_remove_folded(X64_Selector* selector, IR_Program* program, IR_Function_Decl* function)
+{
+    bool removed = true;
+    while (removed)
+    {
+        removed = false;
+        X64_count_uses(selector, program, function);
+
+        for (i32 i = 0; i < function->blocks.count; i++)
+        {
+            IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+            for (i32 j = 0; j < block->node_array.count; j++)
+            {
+                IR_Node* node = &block->node_array.nodes[j];
+                if (node->type != IR_NODE_INSTRUCTION) continue;
+
+                IR_Register* definition = IR_get_definition(program, &node->instruction);
+                if (!definition || !IR_register_is_valid(*definition)) continue;
+
+                i32 local = IR_register_map_find(&selector->map, *definition);
+                if (selector->folded[local] && selector->use_counts[local] == 0)
+                {
+                    IR_remove_node(block, j--);
+                    removed = true;
+                }
+            }
+        }
+    }
+}
+
+void X64_select_instructions(IR_Program* program)
+{
+    X64_Selector selector;
+    IR_register_map_init(&selector.map, program);
+
+    for (i32 f = 0; f < program->function_array.count; f++)
+    {
+        IR_Function_Decl* function = program->function_array.functions[f];
+        if (function->removed) continue;
+
+        IR_register_map_clear(&selector.map);
+        IR_map_function_registers(program, function, &selector.map);
+
+        i32 register_count = selector.map.count;
+        selector.definitions = mem_calloc(register_count + 1, sizeof(IR_Instruction*));
+        selector.definition_blocks = mem_alloc(sizeof(i32) * (register_count + 1));
+        selector.use_counts = mem_alloc(sizeof(i32) * (register_count + 1));
+        selector.folded = mem_calloc(register_count + 1, sizeof(bool));
+        for (i32 i = 0; i < register_count; i++)
+        {
+            selector.definition_blocks[i] = -1;
+        }
+
+        for (i32 i = 0; i < function->blocks.count; i++)
+        {
+            IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+            for (i32 j = 0; j < block->node_array.count; j++)
+            {
+                IR_Node* node = &block->node_array.nodes[j];
+                if (node->type != IR_NODE_INSTRUCTION) continue;
+
+                IR_Register* definition = IR_get_definition(program, &node->instruction);
+                if (definition && IR_register_is_valid(*definition))
+                {
+                    i32 local = IR_register_map_find(&selector.map, *definition);
+                    selector.definitions[local] = &node->instruction;
+                    selector.definition_blocks[local] = i;
+                }
+            }
+        }
+
+        X64_count_uses(&selector, program, function);
+
+        // @Note: Blocks are matched top down, so the trees of earlier instructions are selected before the instructions reading them
+        for (i32 i = 0; i < function->blocks.count; i++)
+        {
+            IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+            for (i32 j = 0; j < block->node_array.count; j++)
+            {
+                IR_Node* node = &block->node_array.nodes[j];
+                if (node->type == IR_NODE_INSTRUCTION) X64_select_instruction(&selector, &node->instruction, i);
+            }
+        }
+
+        X64_remove_folded(&selector, program, function);
+
+        mem_free(selector.definitions);
+        mem_free(selector.definition_blocks);
+        mem_free(selector.use_counts);
+        mem_free(selector.folded);
+    }
+
+    IR_register_map_free(&selector.map);
+}
+
+/*
+The copy IR_lower_two_address puts in front of an addition that can not compute in place, because its
+operand is still needed afterwards, is folded into a lea writing the sum straight into the destination.
+ */
+static bool X64_emit_copy_as_lea(X64_Instruction_Array* code, IR_Instruction* copy, IR_Node* next, Temp_Table* temp_table, Scratch_Register_Table* table, X64_Frame* frame)
+{
+    if (copy->type != IR_INS_MOV || copy->move.src.type != VALUE_LOCATION || copy->move.src.loc.type != IR_LOCATION_REGISTER) return false;
+    if (copy->move.dst.type != IR_LOCATION_REGISTER) return false;
+    if (!next || next->type != IR_NODE_INSTRUCTION || next->instruction.type != IR_INS_BINOP) return false;
+
+    IR_BinOp* binop = &next->instruction.binop;
+    if (binop->destination.gpr_index != copy->move.dst.reg.gpr_index) return false;
+
+    // Spilled registers are loaded and stored one instruction at a time
+    if (X64_find_spill(frame, copy->move.src.loc.reg) >= 0 || X64_find_spill(frame, binop->destination) >= 0) return false;
+    if (binop->left.type == VALUE_LOCATION && X64_find_spill(frame, binop->left.loc.reg) >= 0) return false;
+
+    Register dst = scratch_to_register(get_or_add_scratch_from_temp(temp_table, binop->destination, table));
+    Register base = scratch_to_register(get_or_add_scratch_from_temp(temp_table, copy->move.src.loc.reg, table));
+    X64_Memory address = { .type = MEM_TYPE_OFFSET, .offset = { base, 0 } };
+
+    if (binop->right.type == VALUE_INT && (binop->operator == OP_ADD || (binop->operator == OP_SUB && binop->right.integer != INT32_MIN)))
+    {
+        address.offset.offset = binop->operator == OP_ADD ? binop->right.integer : -binop->right.integer;
+    }
+    else if (binop->operator == OP_ADD && binop->left.type == VALUE_LOCATION && binop->left.loc.reg.gpr_index != binop->destination.gpr_index)
+    {
+        Register index = scratch_to_register(get_or_add_scratch_from_temp(temp_table, binop->left.loc.reg, table));
+        address = (X64_Memory) { .type = MEM_TYPE_SCALED_INDEXED_BASE, .scaled_indexed = { base, index, 1, 0 } };
+    }
+    else
+    {
+        return false;
+    }
+
+    X64_emit_lea(code, address, dst);
+    return true;
+}
+
+/*
+@Note: Registers that are never live at the same time share a scratch register, greedily in definition order.
+With `spill` r10 and r11 are left free to reload spilled registers into, and the registers that find nothing
+else free are left at SCRATCH_COUNT to be spilled. Returns whether every register got one.
+ */
+static bool X64_color_registers(i32 count, IR_Register_Set* interference, bool* across_call, bool spill, Scratch_Register* assigned)
+{
+    bool colored = true;
+    for (i32 i = 0; i < count; i++)
+    {
+        Scratch_Register_Table taken = {0};
+        taken.inuse_table[SCRATCH_R10] = spill;
+        taken.inuse_table[SCRATCH_R11] = spill;
+        for (i32 k = 0; k < i; k++)
+        {
+            // Edges are only recorded on the register being defined
+            if (assigned[k] != SCRATCH_COUNT && (IR_register_set_contains(&interference[i], k) || IR_register_set_contains(&interference[k], i)))
+            {
+                taken.inuse_table[assigned[k]] = true;
+            }
+        }
+
+        assigned[i] = scratch_alloc_in_order(&taken, across_call[i] ? scratch_order_across_calls : scratch_order_temporary);
+        if (assigned[i] == SCRATCH_COUNT)
+        {
+            colored = false;
+            if (!spill) return false;
+        }
+    }
+    return colored;
+}
+
+static void X64_assign_scratch_registers(IR_Program* program, IR_Function_Decl* function, Temp_Table* temp_table, Scratch_Register_Table* table, X64_Frame* frame)
+{
+    IR_Register_Map map;
+    IR_register_map_init(&map, program);
+
+    IR_Liveness liveness;
+    IR_compute_liveness(program, function, &map, &liveness);
+
+    i32 call_count = 0;
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type == IR_NODE_INSTRUCTION && node->instruction.type == IR_INS_CALL) call_count++;
+        }
+    }
+
+    IR_Register_Set* call_live = mem_alloc(sizeof(IR_Register_Set) * (call_count + 1));
+    bool* across_call = mem_calloc(map.count + 1, sizeof(bool));
+    IR_Register_Set live = IR_register_set_create(map.count);
+
+    IR_Register_Set* interference = mem_alloc(sizeof(IR_Register_Set) * (map.count + 1));
+    for (i32 i = 0; i < map.count; i++)
+    {
+        interference[i] = IR_register_set_create(map.count);
+    }
+
+    i32 block_calls_end = 0;
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type == IR_NODE_INSTRUCTION && node->instruction.type == IR_INS_CALL) block_calls_end++;
+        }
+
+        // Walk the block backwards from its live out set, calls are numbered in layout order
+        i32 call_index = block_calls_end;
+        memcpy(live.bits, liveness.live_out[i].bits, sizeof(u64) * live.word_count);
+        for (i32 j = block->node_array.count - 1; j >= 0; j--)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            IR_Register* definition = IR_get_definition(program, instruction);
+            if (definition && IR_register_is_valid(*definition))
+            {
+                // A definition interferes with everything live after it, even if it is never read
+                i32 defined = IR_register_map_find(&map, *definition);
+                IR_register_set_remove(&live, defined);
+                for (i32 w = 0; w < live.word_count; w++)
+                {
+                    interference[defined].bits[w] |= live.bits[w];
+                }
+            }
+
+            if (instruction->type == IR_INS_CALL)
+            {
+                IR_Register_Set* set = &call_live[--call_index];
+                *set = IR_register_set_create(map.count);
+                memcpy(set->bits, live.bits, sizeof(u64) * live.word_count);
+                for (i32 k = 0; k < map.count; k++)
+                {
+                    if (IR_register_set_contains(&live, k)) across_call[k] = true;
+                }
+            }
+
+            for (i32 k = 0; k < IR_get_use_count(instruction); k++)
+            {
+                IR_Register* use = IR_get_use(instruction, k);
+                if (use) IR_register_set_add(&live, IR_register_map_find(&map, *use));
+            }
+        }
+    }
+
+    // Coloring without the reload registers only when it does not fit in all of them
+    Scratch_Register* assigned = mem_alloc(sizeof(Scratch_Register) * (map.count + 1));
+    if (!X64_color_registers(map.count, interference, across_call, false, assigned))
+    {
+        X64_color_registers(map.count, interference, across_call, true, assigned);
+    }
+
+    for (i32 i = 0; i < map.count; i++)
+    {
+        if (assigned[i] == SCRATCH_COUNT)
+        {
+            if (frame->spill_count == 0) IR_register_map_init(&frame->spills, program);
+            frame->spill_count = IR_register_map_add(&frame->spills, map.registers[i]) + 1;
+            continue;
+        }
+
+        table->inuse_table[assigned[i]] = true;
+        temp_table_set(temp_table, map.registers[i].gpr_index, assigned[i]);
+    }
+
+    for (i32 i = 0; i < map.count; i++)
+    {
+        IR_register_set_free(&interference[i]);
+    }
+    mem_free(interference);
+    mem_free(assigned);
+
+    frame->call_live_masks = mem_realloc(frame->call_live_masks, sizeof(u32) * (call_count + 1));
+    frame->call_count = call_count;
+    frame->next_call = 0;
+    for (i32 i = 0; i < call_count; i++)
+    {
+        u32 mask = 0;
+        for (i32 k = 0; k < map.count; k++)
+        {
+            Scratch_Register reg;
+            if (IR_register_set_contains(&call_live[i], k) && temp_table_get(temp_table, map.registers[k].gpr_index, &reg))
+            {
+                mask |= 1u << reg;
+            }
+        }
+        frame->call_live_masks[i] = mask;
+        IR_register_set_free(&call_live[i]);
+    }
+
+    mem_free(call_live);
+    mem_free(across_call);
+    IR_register_set_free(&live);
+    IR_liveness_free(&liveness);
+    IR_register_map_free(&map);
+}
+
+/*
+Decides what the prologue has to set up once the scratch registers of the function are known. At the
+entry rsp is 8 off a 16 byte boundary because of the return address, so a function that makes calls pads
+its frame whenever the return address, rbp, the saved registers and the spill slots add up to an odd
+number of slots.
+Argument loads are all at the function entry, right after the prologue, so without a frame pointer the
+stack arguments are addressed from rsp.
+ */
+static void X64_layout_frame(Scratch_Register_Table* table, X64_Frame* frame, X64_Codegen_Options options)
+{
+    frame->leaf = frame->call_count == 0;
+    frame->frame_pointer = !options.omit_frame_pointer || frame->spill_count > 0;
+
+    frame->saved_count = 0;
+    for (i32 i = 0; i < SCRATCH_COUNT; i++)
+    {
+        if (table->inuse_table[i] && scratch_is_callee_saved(i))
+        {
+            frame->saved_registers[frame->saved_count++] = scratch_to_register(i);
+        }
+    }
+
+    i32 slots = 1 + frame->frame_pointer + frame->saved_count + frame->spill_count;
+    frame->padding = !frame->leaf && slots % 2 == 1 ? 8 : 0;
+
+    if (frame->frame_pointer)
+    {
+        // Above the saved rbp and the return address
+        frame->argument_base = REG_RBP;
+        frame->argument_offset = 16;
+    }
+    else
+    {
+        frame->argument_base = REG_RSP;
+        frame->argument_offset = slots * 8 + frame->padding;
+    }
+}
+
+/*
+Nothing is shared between functions, every one has its own scratch registers, frame and instructions, so
+they are generated at the same time (one job each, see job.h) into assemblies of their own, which are put
+one after the other in the order of the functions. The output is the same however many jobs ran.
+ */
+static void X64_codegen_function(void* data)
+{
+    X64_Function_Job* job = data;
+    IR_Program* program = job->program;
+    IR_Function_Decl* function = program->function_array.functions[job->function_index];
+    X64_Codegen_Options options = job->options;
+
+    Trace_begin("codegen", function->name->str);
+
+    Scratch_Register_Table table;
+    scratch_table_init(&table);
+
+    Temp_Table temp_table;
+    temp_table_init(&temp_table);
+
+    X64_Frame frame = {0};
+    X64_Instruction_Array code = {0};
+
+    X64_assign_scratch_registers(program, function, &temp_table, &table, &frame);
+    X64_layout_frame(&table, &frame, options);
+
+    // @Note: Fallthrough is defined by the layout of the function (see IR_build_cfg), not the block array
+    bool cold = false;
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+
+        // Cold blocks are all at the end of the layout (see IR_layout_blocks)
+        if (block->cold && !cold)
+        {
+            X64_emit_directive(&code, ".section .text.unlikely,\"ax\",@progbits");
+            cold = true;
+        }
+
+        // The counter goes after the label and the prologue
+        bool counted = !options.profile_generate;
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (!counted && node->type == IR_NODE_INSTRUCTION)
+            {
+                X64_emit_profile_counter(&code, job->counter_base + block->profile_index);
+                counted = true;
+            }
+
+            switch(node->type)
+            {
+            case IR_NODE_FUNCTION_DECL:
+            {
+                IR_Function_Decl* fun = &node->function;
+                X64_emit_label(&code, fun->name->str);
+
+                X64_emit_prologue(&code, &frame);
+            }
+            break;
+            case IR_NODE_LABEL:
+            {
+                // Loop headers start on a 16 byte boundary unless that takes more than 10 bytes of padding
+                if (block->loop_header)
+                {
+                    X64_emit_directive(&code, ".p2align 4,,10");
+                }
+                X64_emit_label(&code, node->label.label_name->str);
+            }
+            break;
+            case IR_NODE_INSTRUCTION:
+            {
+                IR_Instruction* instruction = &node->instruction;
+                if (X64_emit_copy_as_lea(&code, instruction, IR_get_node(block, j + 1), &temp_table, &table, &frame))
+                {
+                    j++;
+                    break;
+                }
+
+                i32 tail_call_length = options.tail_calls ? X64_tail_call_length(block, j) : 0;
+                if (tail_call_length)
+                {
+                    X64_emit_tail_call(&code, instruction, program, &temp_table, &table, &frame);
+                    j += tail_call_length - 1;
+                    break;
+                }
+                X64_reload_spilled(&code, program, instruction, &temp_table, &frame);
+                X64_emit_instruction(&code, instruction, program, &temp_table, &table, &frame);
+                X64_store_spilled(&code, program, instruction, &temp_table, &frame);
+            }
+            break;
+            }
+        }
+
+        if (!counted)
+        {
+            X64_emit_profile_counter(&code, job->counter_base + block->profile_index);
+        }
+    }
+
+    if (cold)
+    {
+        X64_emit_directive(&code, ".text");
+    }
+
+    if (options.peephole)
+    {
+        X64_peephole(&code);
+    }
+    sb_init(&job->assembly, 256);
+    X64_print_instructions(&job->assembly, &code);
+
+    mem_free(frame.call_live_masks);
+    if (frame.spill_count > 0) IR_register_map_free(&frame.spills);
+    X64_instruction_array_free(&code);
+    temp_table_free(&temp_table);
+    Trace_end();
+}
+
+String* X64_codegen_ir(IR_Program* program, X64_Codegen_Options options, Allocator* allocator)
+{
+    String_Builder sb;
+    sb_init(&sb, 256);
+
+    X64_Instruction_Array code = {0};
+
+#ifdef SKE_CODEGEN_INTEL
+    sb_append(&sb, ".intel_syntax noprefix\n\n");
+#endif
+    
+    // Only main is exported
+    bool has_main = false;
+    for (i32 i = 0; i < program->function_array.count; i++)
+    {
+        IR_Function_Decl* function = program->function_array.functions[i];
+        if (function->export)
+        {
+            String* name = program->function_array.functions[i]->name;
+            sb_appendf(&sb, ".global %s\n", name->str);
+            has_main = true;
+        }
+    }
+    
+    // The counters of every function follow those of the function before it, in the order the header lists them
+    X64_Profile_Counters profile = { .path = options.profile_generate };
+    X64_Function_Job* function_jobs = mem_calloc(program->function_array.count + 1, sizeof(X64_Function_Job));
+    String_Builder header;
+    if (options.profile_generate)
+    {
+        sb_init(&header, 256);
+        sb_append(&header, IR_PROFILE_MAGIC "\n");
+    }
+    for (i32 f = 0; f < program->function_array.count; f++)
+    {
+        IR_Function_Decl* function = program->function_array.functions[f];
+        if (function->removed) continue;
+
+        function_jobs[f].counter_base = profile.count;
+        if (options.profile_generate)
+        {
+            profile.count += function->blocks.count;
+            sb_appendf(&header, "%s %d\n", function->name->str, function->blocks.count);
+        }
+    }
+    if (options.profile_generate)
+    {
+        sb_newline(&header);
+        profile.header = sb_get_result(&header, allocator);
+        sb_free(&header);
+    }
+
+    // @Note: Files are linked together (see Compiler_link), and only the one with main starts the program
+    if (has_main)
+    {
+        X64_emit_start(&code, options.profile_generate ? &profile : NULL);
+    }
+    else
+    {
+        X64_emit_directive(&code, ".text");
+    }
+    X64_print_instructions(&sb, &code);
+
+    Job_Group group = {0};
+    for (i32 f = 0; f < program->function_array.count; f++)
+    {
+        if (program->function_array.functions[f]->removed) continue;
+
+        X64_Function_Job* job = &function_jobs[f];
+        job->program = program;
+        job->function_index = f;
+        job->options = options;
+        Job_push(&group, X64_codegen_function, job);
+    }
+    Job_wait(&group);
+
+    for (i32 f = 0; f < program->function_array.count; f++)
+    {
+        if (program->function_array.functions[f]->removed) continue;
+
+        sb_append(&sb, function_jobs[f].assembly.string);
+        sb_free(&function_jobs[f].assembly);
+    }
+    mem_free(function_jobs);
+
+    if (options.profile_generate)
+    {
+        code.count = 0;
+        X64_emit_profile_data(&code, &profile, allocator);
+        X64_print_instructions(&sb, &code);
+    }
+
+    X64_instruction_array_free(&code);
+
+    String* assembly = sb_get_result(&sb, allocator);
+    sb_free(&sb);
+    return assembly;
+}
+
+/*
+For -stream, the assembly of the file is written as its functions are compiled one at a time, see
+IR_translate_declaration. Whether there is a main is only known when it comes, so the entry point goes
+right before it instead of at the start.
+ */
+void X64_codegen_stream_begin(FILE* file)
+{
+#ifdef SKE_CODEGEN_INTEL
+    fputs(".intel_syntax noprefix\n\n", file);
+#endif
+    fputs(".text\n", file);
+}
+
+void X64_codegen_stream_function(IR_Program* program, X64_Codegen_Options options, FILE* file)
+{
+    assert(!options.profile_generate && "The counters of the file are only known at its end");
+
+    IR_Function_Decl* function = program->function_array.functions[0];
+    if (function->export)
+    {
+        X64_Instruction_Array code = {0};
+        X64_emit_start(&code, NULL);
+
+        String_Builder sb;
+        sb_init(&sb, 256);
+        sb_appendf(&sb, ".global %s\n", function->name->str);
+        X64_print_instructions(&sb, &code);
+        fputs(sb.string, file);
+
+        sb_free(&sb);
+        X64_instruction_array_free(&code);
+    }
+
+    X64_Function_Job job = { .program = program, .function_index = 0, .options = options };
+    X64_codegen_function(&job);
+    fputs(job.assembly.string, file);
+    sb_free(&job.assembly);
 }
@@ -315,9 +315,19 @@ typedef enum
     SCRATCH_COUNT
 } Scratch_Register;
 
+// Integer arguments in order, the rest go on the stack
+#define X64_ARGUMENT_REGISTER_COUNT 6
+const Register argument_registers[X64_ARGUMENT_REGISTER_COUNT] =
+{
+    REG_RDI, REG_RSI, REG_RDX, REG_RCX, REG_R8, REG_R9
+};
+
 typedef enum
 {
-    LINUX_SC_EXIT = 60
+    LINUX_SC_WRITE = 1,
+    LINUX_SC_OPEN  = 2,
+    LINUX_SC_CLOSE = 3,
+    LINUX_SC_EXIT  = 60
 } Linux_Syscall;
 
 typedef struct X64_Memory X64_Memory;
@@ -330,6 +340,7 @@ struct X64_Memory
         MEM_TYPE_OFFSET,
         MEM_TYPE_SCALED_INDEXED_BASE,
         MEM_TYPE_SCALED_INDEXED,
+        MEM_TYPE_RIP_RELATIVE,
     } type;
 
     union
@@ -343,10 +354,16 @@ struct X64_Memory
         } offset;
         struct
         {
-            Register base;
+            Register base; // Unused for MEM_TYPE_SCALED_INDEXED
             Register offset_register;
             i32      scaled;
+            i32      offset;
         } scaled_indexed;
+        struct
+        {
+            const char* symbol;
+            i32         offset;
+        } rip_relative;
     };
 };
 
@@ -401,6 +418,44 @@ struct Temp_Table
 
 #define TABLE_MAX_LOAD 0.75f
 
+typedef struct X64_Codegen_Options X64_Codegen_Options;
+struct X64_Codegen_Options
+{
+    bool omit_frame_pointer;
+    bool peephole;
+    bool tail_calls; // Calls that are returned right away jump to the callee, which returns to our caller
+    const char* profile_generate; // Where the instrumented program writes its profile, NULL to not instrument
+};
+
+/* @Note:
+   Laid out per function by X64_layout_frame once its scratch registers are known. Without a frame
+   pointer the frame is only as large as the function needs: a leaf function that uses no callee-saved
+   registers has no prologue or epilogue at all.
+   Registers that do not fit in the scratch registers get a stack slot each, below the saved registers.
+   A function with spills always has a frame pointer, the slots are addressed from rbp so pushes around
+   calls do not move them.
+ */
+typedef struct X64_Frame X64_Frame;
+struct X64_Frame
+{
+    bool frame_pointer; // rbp is pushed and points at the saved rbp
+    bool leaf;          // The function makes no calls, so the stack does not need to be aligned
+
+    Register saved_registers[SCRATCH_COUNT]; // Callee-saved registers the function uses, in push order
+    i32 saved_count;
+    i32 padding; // Bytes below the saved registers that keep the stack 16 byte aligned at calls
+
+    Register argument_base;  // Register the stack arguments are addressed from
+    i32 argument_offset;     // Offset of the first stack argument from argument_base
+
+    u32* call_live_masks; // Scratch registers live across each call, by call in layout order
+    i32 call_count;
+    i32 next_call;
+
+    IR_Register_Map spills; // The local index of a spilled register is its stack slot
+    i32 spill_count;
+};
+
 const char* scratch_name(Scratch_Register reg);
 
 typedef enum
@@ -417,7 +472,23 @@ typedef enum
     INS_NEG,
     INS_CQO,
     INS_XOR,
+    INS_AND,
+    INS_OR,
     INS_CALL,
+    INS_LEA,
+    INS_TEST,
+    INS_JMP,
+    INS_JCC,
+    INS_SETCC,
+    INS_CMOV,
+    INS_MOVZX,
+    INS_SYSCALL,
+
+    // Not instructions, but they live in the same stream
+    INS_LABEL,
+    INS_DIRECTIVE,
+    INS_ASCIZ,
+    INS_COMMENT,
     INS_COUNT
 } Instruction;
 
@@ -435,7 +506,17 @@ const char* instruction_names[INS_COUNT] =
     [INS_NEG]  = "neg",
     [INS_CQO]  = "cqo",
     [INS_XOR]  = "xor",
-    [INS_CALL] = "call"
+    [INS_AND]  = "and",
+    [INS_OR]   = "or",
+    [INS_CALL] = "call",
+    [INS_LEA]  = "lea",
+    [INS_TEST] = "test",
+    [INS_JMP]  = "jmp",
+    [INS_JCC]  = "j",
+    [INS_SETCC] = "set",
+    [INS_CMOV] = "cmov",
+    [INS_MOVZX] = "movzx",
+    [INS_SYSCALL] = "syscall"
 };
 
 #define INS_NAME_MOV  "mov"
@@ -450,73 +531,201 @@ const char* instruction_names[INS_COUNT] =
 #define INS_NAME_NEG  "neg"
 #define INS_NAME_CQO  "cqo"
 #define INS_NAME_XOR  "xor"
+#define INS_NAME_AND  "and"
+#define INS_NAME_OR   "or"
 #define INS_NAME_CALL "call"
+#define INS_NAME_LEA  "lea"
+#define INS_NAME_TEST "test"
+#define INS_NAME_JMP  "jmp"
+#define INS_NAME_MOVZX "movzb"
+#define INS_NAME_SYSCALL "syscall"
 
 #define REG_SUFFIX_BYTE "b"
 #define REG_SUFFIX_WORD "w"
 #define REG_SUFFIX_LONG "l"
 #define REG_SUFFIX_QUAD "q"
 
-void X64_emit_label(String_Builder* sb, const char* label);
-void X64_emit_ret(String_Builder* sb);
-void X64_emit_call(String_Builder* sb, const char* function);
-void X64_emit_comment_line(String_Builder* sb, const char* comment);
-void X64_emit_syscall(String_Builder* sb, Linux_Syscall syscall);
-void X64_emit_exit_syscall(String_Builder* sb);
-void X64_emit_start(String_Builder* sb);
+typedef struct X64_Operand X64_Operand;
+struct X64_Operand
+{
+    enum X64_Operand_Type
+    {
+        OPERAND_NONE,
+        OPERAND_REGISTER,
+        OPERAND_IMMEDIATE,
+        OPERAND_MEMORY,
+        OPERAND_LABEL
+    } type;
+
+    union
+    {
+        Register    reg;
+        i32         immediate;
+        X64_Memory  memory;
+        const char* label; // Also the text of directives and comments
+    };
+};
+
+/* @Note:
+   Codegen appends instructions to an array instead of writing text, so X64_peephole can rewrite them
+   before X64_print_instructions turns them into assembly. Operands are in AT&T order, sources first and
+   the destination last. The condition is only used by jcc, setcc and cmov.
+ */
+typedef struct X64_Instruction X64_Instruction;
+struct X64_Instruction
+{
+    Instruction opcode;
+    IR_Jump_Type condition;
+
+    X64_Operand operands[3];
+    i32 operand_count;
+};
+
+typedef struct X64_Instruction_Array X64_Instruction_Array;
+struct X64_Instruction_Array
+{
+    X64_Instruction* instructions;
+    i32 count;
+    i32 capacity;
+};
+
+/* @Note:
+   With -fprofile-generate every block adds one to its own counter in .data when it starts, and _start
+   writes the header describing the counters (see ir_opt.h) and the counters to the profile file once main
+   returned. Flags are dead at the start of a block, so the add can clobber them.
+ */
+typedef struct X64_Profile_Counters X64_Profile_Counters;
+struct X64_Profile_Counters
+{
+    const char* path;
+    String* header;
+    i32 count;
+};
+
+void X64_emit_label(X64_Instruction_Array* code, const char* label);
+void X64_emit_ret(X64_Instruction_Array* code);
+void X64_emit_call(X64_Instruction_Array* code, const char* function);
+void X64_emit_comment_line(X64_Instruction_Array* code, const char* comment);
+void X64_emit_syscall(X64_Instruction_Array* code, Linux_Syscall syscall);
+void X64_emit_exit_syscall(X64_Instruction_Array* code);
+void X64_emit_start(X64_Instruction_Array* code, X64_Profile_Counters* profile);
+void X64_emit_profile_counter(X64_Instruction_Array* code, i32 index);
+void X64_emit_directive(X64_Instruction_Array* code, const char* directive);
+void X64_instruction_array_free(X64_Instruction_Array* code);
 
 /* ======================
    Values
    ====================== */
-void X64_emit_asciz(String_Builder* sb, const char* name, const char* value);
+void X64_emit_asciz(X64_Instruction_Array* code, const char* name, const char* value);
 
 /* ======================
    Stack related instructions
    ====================== */
-void X64_emit_pop_reg(String_Builder* sb, Register reg);
-void X64_emit_push_reg(String_Builder* sb, Register reg);
+void X64_emit_pop_reg(X64_Instruction_Array* code, Register reg);
+void X64_emit_push_reg(X64_Instruction_Array* code, Register reg);
+void X64_emit_push_lit(X64_Instruction_Array* code, i32 num);
+void X64_emit_prologue(X64_Instruction_Array* code, X64_Frame* frame);
+void X64_emit_epilogue(X64_Instruction_Array* code, X64_Frame* frame);
 
 /* ======================
    Moves
    ====================== */
-void X64_emit_move_reg_to_reg(String_Builder* sb, Register src, Register dst);
-void X64_emit_move_lit_to_reg(String_Builder* sb, i32 num, Register dst);
-void X64_emit_move_loc_to_loc(String_Builder* sb, IR_Location src, IR_Location dst, 
+void X64_emit_move_reg_to_reg(X64_Instruction_Array* code, Register src, Register dst);
+void X64_emit_move_lit_to_reg(X64_Instruction_Array* code, i32 num, Register dst);
+void X64_emit_move_offset_to_reg(X64_Instruction_Array* code, Register base, i32 offset, Register dst);
+void X64_emit_move_loc_to_loc(X64_Instruction_Array* code, IR_Location src, IR_Location dst, 
                               Scratch_Register_Table* table, Temp_Table* temp_table);
-void X64_emit_move_reg_to_mem(String_Builder* sb, Register src, IR_Mem dst, 
+void X64_emit_move_reg_to_mem(X64_Instruction_Array* code, Register src, IR_Mem dst, 
                               Scratch_Register_Table* table, Temp_Table* temp_table);
-void X64_emit_move_mem_to_mem(String_Builder* sb, IR_Mem src, IR_Mem dst, 
+void X64_emit_move_mem_to_mem(X64_Instruction_Array* code, IR_Mem src, IR_Mem dst, 
                               Scratch_Register_Table* table, Temp_Table* temp_table);
-void X64_emit_move_mem_to_reg(String_Builder* sb, IR_Mem src, Register dst, 
+void X64_emit_move_mem_to_reg(X64_Instruction_Array* code, IR_Mem src, Register dst, 
                               Scratch_Register_Table* table, Temp_Table* temp_table);
 
 /* ======================
    Comparisons
    ====================== */
-void X64_emit_cmp_lit_to_loc(String_Builder* sb, i32 lhs, IR_Location rhs,
+void X64_emit_cmp_lit_to_loc(X64_Instruction_Array* code, i32 lhs, IR_Location rhs,
                              Scratch_Register_Table* table, Temp_Table* temp_table);
 
-void X64_emit_cmp_loc_to_loc(String_Builder* sb, IR_Location lhs, IR_Location rhs,
+void X64_emit_cmp_loc_to_loc(X64_Instruction_Array* code, IR_Location lhs, IR_Location rhs,
                              Scratch_Register_Table* table, Temp_Table* temp_table);
+void X64_emit_test(X64_Instruction_Array* code, Register reg);
 
-void X64_emit_cmp_reg_to_reg(String_Builder* sb, Register s_lhs, Register s_rhs, IR_Op operator);
 
-void X64_emit_setcc(String_Builder* sb, IR_Op operator, Register result_reg);
+void X64_emit_setcc(X64_Instruction_Array* code, IR_Jump_Type condition, Register result_reg);
+void X64_emit_cmov(X64_Instruction_Array* code, IR_Jump_Type condition, Register src, Register dst);
+void X64_emit_jump(X64_Instruction_Array* code, IR_Jump_Type condition, const char* label);
 
 /* ======================
    Arithmetic instructions
    ====================== */
-void X64_emit_unary(String_Builder* sb, Register reg);
-void X64_emit_div(String_Builder* sb, Register src, Register dst);
-void X64_emit_mul(String_Builder* sb, Register src, Register dst);
-void X64_emit_sub(String_Builder* sb, Register src, Register dst);
-void X64_emit_add(String_Builder* sb, Register src, Register dst);
+void X64_emit_unary(X64_Instruction_Array* code, Register reg);
+void X64_emit_div(X64_Instruction_Array* code, Register src, Register dst);
+void X64_emit_mul(X64_Instruction_Array* code, Register src, Register dst);
+void X64_emit_mul_lit(X64_Instruction_Array* code, i32 num, Register src, Register dst);
+void X64_emit_sub(X64_Instruction_Array* code, Register src, Register dst);
+void X64_emit_and(X64_Instruction_Array* code, Register src, Register dst);
+void X64_emit_or(X64_Instruction_Array* code, Register src, Register dst);
+void X64_emit_add(X64_Instruction_Array* code, Register src, Register dst);
+void X64_emit_add_lit(X64_Instruction_Array* code, i32 num, Register dst);
+void X64_emit_sub_lit(X64_Instruction_Array* code, i32 num, Register dst);
+void X64_emit_lea(X64_Instruction_Array* code, X64_Memory address, Register dst);
+
+void X64_emit_xor_reg_to_reg(X64_Instruction_Array* code, Register lhs, Register rhs);
+
+/* ======================
+   Instruction selection
+   ====================== */
+
+/* @Note:
+   Tree pattern matching over the SSA form right before it is destructed. The trees are the single use
+   definitions in the block of the instruction reading them, and the tiles are the x86 instruction forms:
+   - Literals are folded into the instructions reading them as immediates (`add $5, %r10`), which saves
+     the move and the register holding them. Compares against a literal are turned around, so
+     `cmp $lit, %reg` sets the same flags (see IR_Compare), and a compare against zero becomes `test`.
+   - Additions of registers, literals and multiplications by 1, 2, 4 or 8 become a single lea with an
+     addressing mode (`lea 8(%rbx, %r10, 4), %r11`), and so do multiplications by 2, 3, 4, 5, 8 and 9.
+   - Multiplications by any other literal use the three operand imul.
+   Definitions that are folded away entirely are deleted. The language has no memory besides the stack
+   arguments, so addressing modes are only used for lea.
+ */
+void X64_select_instructions(IR_Program* program);
+
+/* ======================
+   Peephole optimization
+   ====================== */
 
-void X64_emit_xor_reg_to_reg(String_Builder* sb, Register lhs, Register rhs);
+/* @Note:
+   Rewrites the instructions of one function until no rule applies anymore. Every rule looks at a short
+   window of instructions and only uses liveness it can prove within the straight line code around it:
+   - Self moves are deleted, and a move into a register that is only moved on and then dead is merged
+     with the move after it (`mov %r12, %r13 ; mov %r13, %rax` -> `mov %r12, %rax`).
+   - Jumps to the label right after them are deleted, and a conditional jump over an unconditional one
+     is turned into the negated conditional jump.
+   - `mov $0, %r` becomes `xor %r32, %r32` when the flags are dead.
+   - `test %r, %r` right after arithmetic writing %r is deleted when only equality conditions read the flags.
+ */
+void X64_peephole(X64_Instruction_Array* code);
+void X64_print_instructions(String_Builder* sb, X64_Instruction_Array* code);
 
 /* ======================
    Interface
    ====================== */
-String* X64_codegen_ir(IR_Program* program_node, Allocator* allocator);
+
+// One function, generated into an assembly of its own by a job (see X64_codegen_ir)
+typedef struct X64_Function_Job X64_Function_Job;
+struct X64_Function_Job
+{
+    IR_Program* program;
+    i32 function_index;
+    i32 counter_base; // Of its profile counters
+    X64_Codegen_Options options;
+    String_Builder assembly;
+};
+
+String* X64_codegen_ir(IR_Program* program_node, X64_Codegen_Options options, Allocator* allocator);
+void X64_codegen_stream_begin(FILE* file);
+void X64_codegen_stream_function(IR_Program* program, X64_Codegen_Options options, FILE* file);
 
 #endif
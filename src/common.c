@@ -44,3 +44,12 @@ Source_Location make_location(const char* file, i32 line)
         };
 }
 
+void spin_lock(Spin_Lock* lock)
+{
+    while (atomic_flag_test_and_set_explicit(&lock->flag, memory_order_acquire));
+}
+
+void spin_unlock(Spin_Lock* lock)
+{
+    atomic_flag_clear_explicit(&lock->flag, memory_order_release);
+}
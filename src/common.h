@@ -22,4 +22,21 @@ Source_Location make_location(const char* file, i32 line);
 
 void output_error(Source_Location location, const char* type, const char* format, va_list arglist);
 
+// @Note: For the little state every worker of the job system (see job.h) needs its own copy of
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+// Guards state shared between threads that is only held for a few instructions, like the counters of an allocator
+typedef struct Spin_Lock Spin_Lock;
+struct Spin_Lock
+{
+    atomic_flag flag; // Clear when zeroed
+};
+
+void spin_lock(Spin_Lock* lock);
+void spin_unlock(Spin_Lock* lock);
+
 #endif
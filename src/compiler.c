@@ -20,14 +20,36 @@ static void print_help()
     printf("  -tokenizer              Tokenize and output tokens\n");
     printf("  -parser                 Parse and output AST\n");
     printf("  -ir                     Generate IR and output\n");
+    printf("  -ssa                    Generate IR in SSA form and output\n");
+    printf("  -stream                 Compile one declaration at a time, in memory for the largest function instead of the file\n");
+    printf("  -O0                     Disable optimizations\n");
+    printf("  -O1                     Enable optimizations (default)\n");
+    printf("  -inline-report          Print inlining decisions to stderr\n");
+    printf("  -fno-omit-frame-pointer Keep rbp as a frame pointer in every function\n");
+    printf("  -fprofile-generate[=<file>] Count how often every block runs, written to <file> (default %s) on exit\n", IR_DEFAULT_PROFILE_PATH);
+    printf("  -fprofile-use[=<file>]  Lay out blocks and functions by the counts in <file>\n");
+    printf("  -time-passes            Print the time and memory every compiler stage took to stderr\n");
+    printf("  -stats-json=<file>      Write the same statistics to <file> as JSON\n");
+    printf("  -mem-report             Print where the compiler allocated its memory to stderr\n");
+    printf("  -trace=<file>           Write a timeline of the compile to <file> as Chrome trace events\n");
+    printf("  --t or -test[=<dir>]    Run the tests in <dir> (default %s) in parallel, the other flags are passed to every compile\n", TEST_DEFAULT_DIRECTORY);
+    printf("  -j <n>                  Run <n> jobs at once, files and tests (default one per processor)\n");
 }
 
 Compiler_Arguments parse_args(int argc, char** argv, Allocator* allocator)
 {
     Compiler_Arguments arguments;
     arguments.options = OPT_NONE;
+    arguments.input_files = string_array_allocate(argc + 1, allocator);
     arguments.input_file = NULL;
+    arguments.absolute_path = NULL;
     arguments.out_path = NULL;
+    arguments.profile_generate_path = NULL;
+    arguments.profile_use_path = NULL;
+    arguments.stats_json_path = NULL;
+    arguments.trace_path = NULL;
+    arguments.test_directory = NULL;
+    arguments.job_count = 0;
 
     for (i32 i = 1; i < argc; i++)
     {
@@ -38,9 +60,22 @@ Compiler_Arguments parse_args(int argc, char** argv, Allocator* allocator)
         {
             if (string_equal_cstr(&string, "--t") || string_equal_cstr(&string, "-test"))
             {
-                printf("Running tests...\n");
-
-                /* String* command = string_create_from_arena("", 1 , ALLOCATOR(&string_arena)); */
+                arguments.options |= OPT_RUN_TESTS;
+            }
+            else if (strncmp(arg, "-test=", 6) == 0)
+            {
+                arguments.options |= OPT_RUN_TESTS;
+                arguments.test_directory = string_allocate(arg + 6, allocator);
+            }
+            else if (string_equal_cstr(&string, "-j") || (arg[0] == '-' && arg[1] == 'j' && arg[2] >= '0' && arg[2] <= '9'))
+            {
+                const char* count = arg[2] ? arg + 2 : (i + 1 < argc ? argv[++i] : "");
+                arguments.job_count = atoi(count);
+                if (arguments.job_count <= 0)
+                {
+                    printf("-j needs a number of jobs above 0, got '%s'\n", count);
+                    arguments.job_count = 0;
+                }
             }
             else if (string_equal_cstr(&string, "-outfile"))
             {
@@ -64,6 +99,58 @@ Compiler_Arguments parse_args(int argc, char** argv, Allocator* allocator)
             {
                 arguments.options |= OPT_IR_OUTPUT;
             }
+            else if (string_equal_cstr(&string, "-ssa"))
+            {
+                arguments.options |= OPT_SSA_OUTPUT;
+            }
+            else if (string_equal_cstr(&string, "-stream"))
+            {
+                arguments.options |= OPT_STREAM;
+            }
+            else if (string_equal_cstr(&string, "-O0"))
+            {
+                arguments.options |= OPT_NO_OPTIMIZE;
+            }
+            else if (string_equal_cstr(&string, "-O1"))
+            {
+                arguments.options &= ~OPT_NO_OPTIMIZE;
+            }
+            else if (string_equal_cstr(&string, "-inline-report"))
+            {
+                arguments.options |= OPT_INLINE_REPORT;
+            }
+            else if (string_equal_cstr(&string, "-fno-omit-frame-pointer"))
+            {
+                arguments.options |= OPT_FRAME_POINTER;
+            }
+            else if (string_equal_cstr(&string, "-fomit-frame-pointer"))
+            {
+                arguments.options &= ~OPT_FRAME_POINTER;
+            }
+            else if (string_equal_cstr(&string, "-fprofile-generate") || strncmp(arg, "-fprofile-generate=", 19) == 0)
+            {
+                arguments.profile_generate_path = string_allocate(arg[18] == '=' ? arg + 19 : IR_DEFAULT_PROFILE_PATH, allocator);
+            }
+            else if (string_equal_cstr(&string, "-fprofile-use") || strncmp(arg, "-fprofile-use=", 14) == 0)
+            {
+                arguments.profile_use_path = string_allocate(arg[13] == '=' ? arg + 14 : IR_DEFAULT_PROFILE_PATH, allocator);
+            }
+            else if (string_equal_cstr(&string, "-time-passes"))
+            {
+                arguments.options |= OPT_TIME_PASSES;
+            }
+            else if (strncmp(arg, "-stats-json=", 12) == 0)
+            {
+                arguments.stats_json_path = string_allocate(arg + 12, allocator);
+            }
+            else if (string_equal_cstr(&string, "-mem-report"))
+            {
+                arguments.options |= OPT_MEM_REPORT;
+            }
+            else if (strncmp(arg, "-trace=", 7) == 0)
+            {
+                arguments.trace_path = string_allocate(arg + 7, allocator);
+            }
             else if (string_equal_cstr(&string, "-parser"))
             {
                 arguments.options |= OPT_AST_OUTPUT;
@@ -74,17 +161,7 @@ Compiler_Arguments parse_args(int argc, char** argv, Allocator* allocator)
             }
             else if (is_source_file(&string))
             {
-                arguments.input_file = string_copy(&string, allocator);
-                char buf[128];
-                String full_path = { .length = 128, .str = buf};
-                if (!absolute_path(&string, &full_path))
-                {
-                    fprintf(stderr, "\x1b[1;37mInvalid input path: \x1b[0m%s\n", string.str);
-                }
-                else
-                {
-                    arguments.absolute_path = string_copy(&full_path, allocator);
-                }
+                string_array_push(arguments.input_files, string_copy(&string, allocator));
             }
             else
             {
@@ -104,191 +181,589 @@ bool Compiler_assemble_x86_with_input_file(String* file_path, String* output_pat
     return run_subprocess(cmd);
 }
 
-bool Compiler_link(String* input_file_path, String* output_file_path, Allocator* allocator)
+bool Compiler_link(String_Array* object_paths, String* output_file_path, Allocator* allocator)
 {
-    char *cmd[] = {"ld", "-o", output_file_path->str, "-dynamic-linker", "/lib64/ld-linux-x86-64.so.2", "-lc", input_file_path->str, "-lm", "-no-pie", NULL};
-    return run_subprocess(cmd); 
+    char* head[] = {"ld", "-o", output_file_path->str, "-dynamic-linker", "/lib64/ld-linux-x86-64.so.2", "-lc"};
+    char* tail[] = {"-lm", "-no-pie", NULL};
+    i32 head_count = sizeof(head) / sizeof(head[0]);
+    i32 tail_count = sizeof(tail) / sizeof(tail[0]);
+
+    char** cmd = mem_alloc(sizeof(char*) * (head_count + object_paths->count + tail_count));
+    memcpy(cmd, head, sizeof(head));
+    for (i32 i = 0; i < object_paths->count; i++)
+    {
+        cmd[head_count + i] = object_paths->strings[i]->str;
+    }
+    memcpy(cmd + head_count + object_paths->count, tail, sizeof(tail));
+
+    bool result = run_subprocess(cmd);
+    mem_free(cmd);
+    return result;
+}
+
+// `profile` is left empty when there is none
+static bool Compiler_read_profile(Compiler_Arguments arguments, IR_Profile* profile)
+{
+    if (!arguments.profile_use_path)
+    {
+        return false;
+    }
+
+    bool has_profile = IR_read_profile(arguments.profile_use_path->str, profile);
+    if (!has_profile)
+    {
+        fprintf(stderr, "Unable to read profile: %s\n", arguments.profile_use_path->str);
+    }
+    return has_profile;
+}
+
+static X64_Codegen_Options Compiler_codegen_options(Compiler_Arguments arguments)
+{
+    // @Note: Like -O0 in other compilers, unoptimized code keeps the frame pointer for debuggers
+    X64_Codegen_Options codegen_options = {
+        .omit_frame_pointer = !has_flag(arguments.options, OPT_FRAME_POINTER) && !has_flag(arguments.options, OPT_NO_OPTIMIZE),
+        .peephole = !has_flag(arguments.options, OPT_NO_OPTIMIZE),
+        .tail_calls = !has_flag(arguments.options, OPT_NO_OPTIMIZE),
+        .profile_generate = arguments.profile_generate_path ? arguments.profile_generate_path->str : NULL
+    };
+    return codegen_options;
+}
+
+// Writes `output` to `out_path`, or to stdout without one
+static bool Compiler_write_output(String* output, String* out_path)
+{
+    if (!out_path)
+    {
+        // @Note: Write out directly to prevent formatting bugs with register names in AT&T.
+        fwrite(output->str, 1, output->length, stdout);
+        return true;
+    }
+
+    FILE* file = fopen(out_path->str, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Unable to open temp file: %s\n", out_path->str);
+        return false;
+    }
+    string_write_to_file(output, file);
+    fclose(file);
+    return true;
 }
 
-bool Compiler_compile(String* source, Compiler_Arguments arguments, Allocator* allocator)
+// From SSA to the object file, or to the output one of the flags asks for. The caller frees `program`.
+static bool Compiler_compile_program(IR_Program* program, Compiler_Arguments arguments, Compiler_Stats* stats, String* object_path, Allocator* allocator)
+{
+    Stats_begin(stats, STAGE_SSA);
+    IR_construct_ssa(program);
+    Stats_end(stats);
+
+    if (!has_flag(arguments.options, OPT_NO_OPTIMIZE))
+    {
+        Stats_begin(stats, STAGE_OPTIMIZE);
+        IR_Optimization_Options optimization_options = { .report_inlining = has_flag(arguments.options, OPT_INLINE_REPORT) };
+        IR_optimize(program, optimization_options, allocator);
+        Stats_end(stats);
+    }
+
+    if (has_flag(arguments.options, OPT_SSA_OUTPUT))
+    {
+        return Compiler_write_output(IR_pretty_print(program, allocator), arguments.out_path);
+    }
+
+    Stats_begin(stats, STAGE_LOWER);
+    X64_select_instructions(program);
+    IR_destruct_ssa(program);
+    Stats_end(stats);
+
+    Stats_begin(stats, STAGE_LAYOUT);
+    IR_Profile profile = {0};
+    bool has_profile = Compiler_read_profile(arguments, &profile);
+    IR_layout_blocks(program, has_profile ? &profile : NULL, !has_flag(arguments.options, OPT_NO_OPTIMIZE), allocator);
+    IR_free_profile(&profile);
+    Stats_end(stats);
+    Stats_count_ir(stats, program, false);
+
+    if (has_flag(arguments.options, OPT_IR_OUTPUT))
+    {
+        return Compiler_write_output(IR_pretty_print(program, allocator), arguments.out_path);
+    }
+
+    X64_Codegen_Options codegen_options = Compiler_codegen_options(arguments);
+    Stats_begin(stats, STAGE_CODEGEN);
+    String* assembly = X64_codegen_ir(program, codegen_options, allocator);
+    Stats_end(stats);
+    if (!assembly)
+    {
+        return false;
+    }
+    if (has_flag(arguments.options, OPT_ASSEMBLY_OUTPUT))
+    {
+        return Compiler_write_output(assembly, arguments.out_path);
+    }
+
+    String* assembly_path = string_createf(allocator, "%s.s", object_path->str);
+    if (!Compiler_write_output(assembly, assembly_path))
+    {
+        return false;
+    }
+
+    Stats_begin(stats, STAGE_ASSEMBLE);
+    bool result = Compiler_assemble_x86_with_input_file(assembly_path, object_path, allocator);
+    Stats_end(stats);
+
+    if (!result)
+    {
+        fprintf(stderr, "Assembler failed\n");
+    }
+    return result;
+}
+
+/*
+Stops at the object file, which the caller links (see Compiler_compile_files). The assembly goes next to it.
+`object_path` has to outlive `allocator`, which is reset when the parser is freed. `has_main` is set when the
+file defines main, if it is not NULL. Everything the file needed is freed before this returns, whichever way
+it ends, so compiling many files in a row does not add up.
+ */
+bool Compiler_compile(String* source, Compiler_Arguments arguments, Compiler_Stats* stats, String* object_path, bool* has_main, Allocator* allocator)
 {
     if(source->length == 0)
     {
         COMPILER_BUG("Empty input\n");
         return false;
     }
-    String* out_path = arguments.out_path;
+    Stats_begin(stats, STAGE_LEX);
     Token_List* tokens = Lex_tokenize(source, arguments.input_file, arguments.absolute_path);
+    Stats_end(stats);
+    stats->token_count += tokens->count;
 
     if (has_flag(arguments.options, OPT_TOK_OUTPUT))
     {
-        String* tok_out = Lex_pretty_print(tokens, allocator);
-        if (out_path)
-        {
-            FILE* temp_file = fopen(out_path->str, "w");
-            if (!temp_file)
-            {
-                fprintf(stderr, "Unable to open temp file: %s\n", out_path->str);
-                exit(1);
-            }
-
-            string_write_to_file(tok_out, temp_file);
-            fclose(temp_file);
-        }
-        else
-        {
-            fprintf(stdout, tok_out->str);
-        }
-
-        return true;
+        bool written = Compiler_write_output(Lex_pretty_print(tokens, allocator), arguments.out_path);
+        token_list_free(tokens);
+        allocator->free_all(allocator);
+        return written;
     }
     
     Parser parser;
     Parser_init(&parser, arguments.absolute_path, tokens, allocator);
 
     bool result = false;
-    if (Parser_parse(&parser, false, allocator))
+    Stats_begin(stats, STAGE_PARSE);
+    bool parsed = Parser_parse(&parser, false, allocator);
+    Stats_end(stats);
+    if (parsed)
     {
+        stats->ast_node_count += AST_count_nodes(parser.root);
+
         if (has_flag(arguments.options, OPT_AST_OUTPUT))
         {
-            String* ast = pretty_print_ast(parser.root, allocator);
-            if (out_path)
+            result = Compiler_write_output(pretty_print_ast(parser.root, allocator), arguments.out_path);
+        }
+        else
+        {
+            Stats_begin(stats, STAGE_SEMANTIC_CHECK);
+            Sem_check(parser.root, arguments.absolute_path, allocator);
+            Stats_end(stats);
+
+            Stats_begin(stats, STAGE_TRANSLATE);
+            IR_Program program = IR_translate_ast(parser.root, allocator);
+            Stats_end(stats);
+            Stats_count_ir(stats, &program, true);
+
+            for (i32 i = 0; has_main && i < program.function_array.count; i++)
             {
-                FILE* temp_file = fopen(out_path->str, "w");
-                if (!temp_file)
+                if (string_equal_cstr(program.function_array.functions[i]->name, "main"))
                 {
-                    fprintf(stderr, "Unable to open temp file: %s\n", out_path->str);
-                    exit(1);
+                    *has_main = true;
                 }
-
-                string_write_to_file(ast, temp_file);
-                fclose(temp_file);
             }
-            else
-            {
-                fprintf(stdout, ast->str);
-            }
-            return true;
+
+            result = Compiler_compile_program(&program, arguments, stats, object_path, allocator);
+            IR_free_program(&program);
         }
+    }
+
+    AST_free_lists(parser.root);
+    Parser_free(&parser);
+    token_list_free(tokens);
+
+    return result;
+}
+
+/*
+-stream: the file is compiled one top level declaration at a time, from its tokens to its assembly, which is
+written out before the next declaration is parsed. What a declaration needs comes from the arena, rolled
+back once its assembly is out, and from the heap, freed with its IR. Only the signatures of the functions
+declared so far stay, in the checker and for calls to refer to, and the source is mapped rather than read,
+so memory grows with the largest function and the number of functions instead of the size of the file.
+Nothing is inlined and functions nobody calls are kept, that needs the whole file. Lexing counts as parsing.
+ */
+static bool Compiler_compile_stream(Compiler_Arguments arguments, Compiler_Stats* stats, String* object_path, bool* has_main, Allocator* allocator)
+{
+    size_t size;
+    char* source = os_map_file(arguments.input_file->str, &size);
+    if (!source)
+    {
+        fprintf(stderr, "\x1b[1;37mUnable to open: \x1b[0m%s\n", arguments.input_file->str);
+        return false;
+    }
+    if (size == 0)
+    {
+        os_unmap_file(source, size);
+        COMPILER_BUG("Empty input\n");
+        return false;
+    }
+
+    bool assembly_only = has_flag(arguments.options, OPT_ASSEMBLY_OUTPUT);
+    String* out_path = assembly_only ? arguments.out_path : string_createf(allocator, "%s.s", object_path->str);
+    FILE* assembly = out_path ? fopen(out_path->str, "w") : stdout;
+    if (!assembly)
+    {
+        fprintf(stderr, "Unable to open temp file: %s\n", out_path->str);
+        os_unmap_file(source, size);
+        return false;
+    }
+
+    IR_Profile profile = {0};
+    bool has_profile = Compiler_read_profile(arguments, &profile);
+    X64_Codegen_Options codegen_options = Compiler_codegen_options(arguments);
+    IR_Optimization_Options optimization_options = { .streaming = true };
+
+    String source_string = { .length = size, .str = source };
+    Lexer lexer;
+    Lex_init(&lexer, &source_string, sv_create(arguments.input_file), sv_create(arguments.absolute_path));
 
-        Sem_check(parser.root, arguments.absolute_path, allocator);
-        
-        IR_Program program = IR_translate_ast(parser.root, allocator);
-        if (has_flag(arguments.options, OPT_IR_OUTPUT))
+    Parser parser;
+    Parser_init_stream(&parser, arguments.absolute_path, &lexer, allocator);
+
+    // What stays until the end of the file
+    Allocator* heap = ALLOCATOR(&heap_tracker);
+    Sem_Checker checker;
+    Sem_begin(&checker, arguments.absolute_path, heap);
+    IR_Signature_Table signatures = {0};
+
+    Arena* arena = AS_ARENA(AS_TRACKING(allocator)->backing);
+    X64_codegen_stream_begin(assembly);
+    for (i32 function_index = 0; ; function_index++)
+    {
+        Temporary_Arena temp = temp_arena_memory_begin(arena);
+        size_t live = tracking_live(AS_TRACKING(allocator));
+
+        Stats_begin(stats, STAGE_PARSE);
+        AST_Node* declaration = Parser_parse_declaration(&parser);
+        Stats_end(stats);
+        if (!declaration)
         {
-            String* IR_out = IR_pretty_print(&program, allocator);
-            if (out_path)
-            {
-                FILE* temp_file = fopen(out_path->str, "w");
-                if (!temp_file)
-                {
-                    fprintf(stderr, "Unable to open temp file: %s\n", out_path->str);
-                    exit(1);
-                }
+            break;
+        }
+        stats->ast_node_count += AST_count_nodes(declaration);
+        if (has_main && string_equal_cstr(declaration->fun_decl.name, "main"))
+        {
+            *has_main = true;
+        }
 
-                string_write_to_file(IR_out, temp_file);
-                fclose(temp_file);
-            }
-            else
-            {
-                fprintf(stdout, IR_out->str);
-            }
-            return true;
+        // The signatures refer to the name after the declaration is gone
+        declaration->fun_decl.name = string_copy(declaration->fun_decl.name, heap);
+        IR_add_signature(&signatures, declaration->fun_decl.name, declaration->fun_decl.return_type != NULL);
+
+        Stats_begin(stats, STAGE_SEMANTIC_CHECK);
+        Sem_declare_function(&checker, declaration, heap);
+        Sem_check_function(&checker, declaration, allocator);
+        Stats_end(stats);
+
+        Stats_begin(stats, STAGE_TRANSLATE);
+        IR_Program program = IR_translate_declaration(declaration, &signatures, function_index, allocator);
+        Stats_end(stats);
+        Stats_count_ir(stats, &program, true);
+
+        Stats_begin(stats, STAGE_SSA);
+        IR_construct_ssa(&program);
+        Stats_end(stats);
+
+        if (!has_flag(arguments.options, OPT_NO_OPTIMIZE))
+        {
+            Stats_begin(stats, STAGE_OPTIMIZE);
+            IR_optimize(&program, optimization_options, allocator);
+            Stats_end(stats);
         }
-        
-        String* assembly = X64_codegen_ir(&program, allocator);
-        if (assembly)
-        {           
-            if (has_flag(arguments.options, OPT_ASSEMBLY_OUTPUT))
-            {
-                if (out_path)
-                {
-                    FILE* temp_file = fopen(out_path->str, "w");
-                    if (!temp_file)
-                    {
-                        fprintf(stderr, "Unable to open temp file: %s\n", out_path->str);
-                        exit(1);
-                    }
-                    
-                    string_write_to_file(assembly, temp_file);
-                    fclose(temp_file);
-                }
-                else
-                {
-                    // @Note: Write out directly to prevent formatting bugs with register names in AT&T.
-                    fwrite(assembly->str, 1, assembly->length, stdout);
-                }
-                return true;
-            }
-            else
-            {
-                out_path = create_temp_file(allocator);
-            }            
-                
-            if (out_path)
-            {
-                FILE* temp_file = fopen(out_path->str, "w");
-                if (!temp_file)
-                {
-                    fprintf(stderr, "Unable to open temp file: %s\n", out_path->str);
-                    exit(1);
-                }
 
-                string_write_to_file(assembly, temp_file);
-                fclose(temp_file);
+        Stats_begin(stats, STAGE_LOWER);
+        X64_select_instructions(&program);
+        IR_destruct_ssa(&program);
+        Stats_end(stats);
 
-                String* assembly_out = create_temp_file(allocator);
-                result = Compiler_assemble_x86_with_input_file(out_path, assembly_out, allocator);
+        Stats_begin(stats, STAGE_LAYOUT);
+        IR_layout_blocks(&program, has_profile ? &profile : NULL, !has_flag(arguments.options, OPT_NO_OPTIMIZE), allocator);
+        Stats_end(stats);
+        Stats_count_ir(stats, &program, false);
 
-                if (!result)
-                {
-                    fprintf(stderr, "Assembler failed\n");
-                    exit(1);
-                }
+        Stats_begin(stats, STAGE_CODEGEN);
+        X64_codegen_stream_function(&program, codegen_options, assembly);
+        Stats_end(stats);
 
-                if (!DEFAULT_EXECUTABLE_OUT_PATH)
-                {
-                    DEFAULT_EXECUTABLE_OUT_PATH = string_allocate("a.out", allocator);
-                }
-                
-                String* executable_out = arguments.out_path ? arguments.out_path : DEFAULT_EXECUTABLE_OUT_PATH;
+        IR_free_program(&program);
+        AST_free_lists(declaration);
+        temp_arena_memory_end(temp);
+        tracking_rewind(AS_TRACKING(allocator), live);
+        os_drop_file_pages(source, parser.current.start - source);
+    }
+    stats->token_count += parser.token_count;
 
-                result = Compiler_link(assembly_out, executable_out, allocator);
+    if (out_path)
+    {
+        fclose(assembly);
+    }
+    IR_free_profile(&profile);
+    Sem_end(&checker);
+    for (i32 i = 0; i < signatures.count; i++)
+    {
+        mem_free(signatures.signatures[i].name);
+    }
+    IR_free_signatures(&signatures);
+    os_unmap_file(source, size);
 
-                if (!result)
-                {
-                    fprintf(stderr, "Linking failed\n");
-                    exit(1);
-                }
-            }
-        }
+    if (parser.had_error)
+    {
+        return false;
     }
-    else
+    if (assembly_only)
     {
-        exit(1);
+        return true;
     }
-    
-    Parser_free(&parser);
-    token_list_free(tokens);
 
+    Stats_begin(stats, STAGE_ASSEMBLE);
+    bool result = Compiler_assemble_x86_with_input_file(out_path, object_path, allocator);
+    Stats_end(stats);
+
+    if (!result)
+    {
+        fprintf(stderr, "Assembler failed\n");
+    }
     return result;
 }
 
-bool Compiler_compile_file(Compiler_Arguments arguments, Allocator* allocator)
+static bool Compiler_compile_file(Compiler_Arguments arguments, Compiler_Stats* stats, String* object_path, bool* has_main, Allocator* allocator)
 {
-    if (!arguments.input_file)
+    FILE* file = fopen(arguments.input_file->str, "r");
+    if (!file)
     {
+        fprintf(stderr, "\x1b[1;37mUnable to open: \x1b[0m%s\n", arguments.input_file->str);
         return false;
     }
-    
-    FILE* file = fopen(arguments.input_file->str, "r");
-    bool result = false;
-    if (file)
+
+    char buf[128];
+    String full_path = { .length = 128, .str = buf};
+    if (!absolute_path(arguments.input_file, &full_path))
+    {
+        fprintf(stderr, "\x1b[1;37mInvalid input path: \x1b[0m%s\n", arguments.input_file->str);
+    }
+    else
+    {
+        arguments.absolute_path = string_copy(&full_path, allocator);
+    }
+
+    bool result;
+    Trace_begin("compile", arguments.input_file->str);
+    if (has_flag(arguments.options, OPT_STREAM))
+    {
+        fclose(file);
+        result = Compiler_compile_stream(arguments, stats, object_path, has_main, allocator);
+    }
+    else
     {
         String* source = string_create_from_file_with_allocator(file, allocator);
-        result = Compiler_compile(source, arguments, allocator);
         fclose(file);
-        /* cleanup_temp_files(); */
+        result = Compiler_compile(source, arguments, stats, object_path, has_main, allocator);
+    }
+    Trace_end();
+    return result;
+}
+
+static bool Compiler_has_output_flag(Compiler_Options options)
+{
+    return has_flag(options, OPT_TOK_OUTPUT | OPT_AST_OUTPUT | OPT_IR_OUTPUT | OPT_SSA_OUTPUT | OPT_ASSEMBLY_OUTPUT);
+}
+
+// Everything the file needs lives in the arena of the worker, which is reset when the file is done
+static void Compiler_compile_file_job(void* data)
+{
+    Compiler_File_Job* job = data;
+    Stats_init(&job->stats, Job_allocator());
+    job->result = Compiler_compile_file(job->arguments, &job->stats, job->object_path, &job->has_main, Job_allocator());
+}
+
+/*
+Every file is compiled to an object of its own, each file a job (see job.h), and the objects are linked into
+one executable in the order the files were given. Statistics and the trace cover all of them. The outputs of
+the other flags go to stdout, so with those the files are compiled one after the other, on this thread.
+A file that fails to compile fails its job rather than exiting, and neither does a failing assembler or
+linker, so the objects are removed either way. Exactly one of the files has to define main.
+@Note: Only the objects to link and the arguments (in `allocator`) grow with the number of files.
+ */
+bool Compiler_compile_files(Compiler_Arguments arguments, Allocator* allocator)
+{
+    String_Array* files = arguments.input_files;
+    if (files->count == 0)
+    {
+        return false;
+    }
+
+    bool linking = !Compiler_has_output_flag(arguments.options);
+    if (files->count > 1)
+    {
+        // The outputs of the other flags go to stdout, one file after the other
+        if (arguments.out_path && !linking)
+        {
+            fprintf(stderr, "-outfile only names the executable when compiling several files\n");
+            return false;
+        }
+        if (arguments.profile_generate_path)
+        {
+            NOT_IMPLEMENTED("-fprofile-generate with several files\n");
+            return false;
+        }
+    }
+    if (has_flag(arguments.options, OPT_STREAM))
+    {
+        // Their output is the whole file
+        if (has_flag(arguments.options, OPT_TOK_OUTPUT | OPT_AST_OUTPUT | OPT_IR_OUTPUT | OPT_SSA_OUTPUT))
+        {
+            NOT_IMPLEMENTED("-stream with -tokenize, -parser, -ir or -ssa\n");
+            return false;
+        }
+        if (arguments.profile_generate_path)
+        {
+            NOT_IMPLEMENTED("-fprofile-generate with -stream\n");
+            return false;
+        }
+    }
+
+    char object_directory[] = "/tmp/ske-XXXXXX";
+    if (linking && !os_make_temp_directory(object_directory))
+    {
+        fprintf(stderr, "Unable to create a directory for the objects: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (arguments.trace_path)
+    {
+        Trace_init();
+    }
+    Trace_begin("compile", files->count == 1 ? files->strings[0]->str : "all files");
+
+    Compiler_Stats stats;
+    Stats_init(&stats, Job_allocator());
+    if (has_flag(arguments.options, OPT_MEM_REPORT))
+    {
+        for (i32 i = 0; i < jobs.worker_count; i++)
+        {
+            jobs.workers[i].allocator.record_sites = true;
+        }
+        heap_tracker.record_sites = true;
+    }
+
+    String_Array* objects = string_array_allocate(files->count + 1, allocator);
+    bool result = true;
+    if (linking)
+    {
+        Compiler_File_Job* file_jobs = mem_calloc(files->count, sizeof(Compiler_File_Job));
+        Job_Group group = {0};
+        for (i32 i = 0; i < files->count; i++)
+        {
+            Compiler_File_Job* job = &file_jobs[i];
+            job->arguments = arguments;
+            job->arguments.input_file = files->strings[i];
+            job->object_path = string_createf(allocator, "%s/%d.o", object_directory, i);
+            string_array_push(objects, job->object_path);
+            Job_push(&group, Compiler_compile_file_job, job);
+        }
+        Job_wait(&group);
+
+        i32 main_count = 0;
+        for (i32 i = 0; i < files->count; i++)
+        {
+            Stats_merge(&stats, &file_jobs[i].stats);
+            result = result && file_jobs[i].result;
+            if (file_jobs[i].has_main) main_count++;
+        }
+
+        // Only the object with main starts the program (see X64_codegen_ir)
+        if (result && main_count == 0)
+        {
+            fprintf(stderr, "No main function in %s\n", files->count == 1 ? files->strings[0]->str : "any of the files");
+            result = false;
+        }
+        if (result && main_count > 1)
+        {
+            fprintf(stderr, "More than one main function:");
+            for (i32 i = 0; i < files->count; i++)
+            {
+                if (file_jobs[i].has_main) fprintf(stderr, " %s", files->strings[i]->str);
+            }
+            fprintf(stderr, "\n");
+            result = false;
+        }
+        mem_free(file_jobs);
+    }
+    else
+    {
+        for (i32 i = 0; i < files->count && result; i++)
+        {
+            arguments.input_file = files->strings[i];
+            result = Compiler_compile_file(arguments, &stats, NULL, NULL, Job_allocator());
+        }
+    }
+
+    if (result && linking)
+    {
+        if (!DEFAULT_EXECUTABLE_OUT_PATH)
+        {
+            DEFAULT_EXECUTABLE_OUT_PATH = string_allocate("a.out", allocator);
+        }
+
+        String* executable_out = arguments.out_path ? arguments.out_path : DEFAULT_EXECUTABLE_OUT_PATH;
+
+        Stats_begin(&stats, STAGE_LINK);
+        result = Compiler_link(objects, executable_out, allocator);
+        Stats_end(&stats);
+
+        if (!result)
+        {
+            fprintf(stderr, "Linker failed\n");
+        }
+    }
+
+    Trace_end();
+
+    if (linking)
+    {
+        for (i32 i = 0; i < objects->count; i++)
+        {
+            remove(objects->strings[i]->str);
+            remove(string_createf(allocator, "%s.s", objects->strings[i]->str)->str);
+        }
+        remove(object_directory);
+    }
+
+    if (has_flag(arguments.options, OPT_TIME_PASSES))
+    {
+        Stats_print(&stats, stderr);
+    }
+    if (has_flag(arguments.options, OPT_MEM_REPORT))
+    {
+        Stats_print_memory(&stats, stderr);
+    }
+    if (arguments.stats_json_path && !Stats_write_json(&stats, arguments.stats_json_path->str))
+    {
+        fprintf(stderr, "Unable to write statistics: %s\n", arguments.stats_json_path->str);
+    }
+    if (arguments.trace_path)
+    {
+        if (!Trace_write(arguments.trace_path->str))
+        {
+            fprintf(stderr, "Unable to write trace: %s\n", arguments.trace_path->str);
+        }
+        Trace_free();
     }
     return result;
 }
@@ -11,16 +11,42 @@ typedef enum
     OPT_ASSEMBLY_OUTPUT = 1 << 1,
     OPT_IR_OUTPUT       = 1 << 2,
     OPT_TOK_OUTPUT      = 1 << 3,
-    OPT_AST_OUTPUT      = 1 << 4
+    OPT_AST_OUTPUT      = 1 << 4,
+    OPT_SSA_OUTPUT      = 1 << 5,
+    OPT_NO_OPTIMIZE     = 1 << 6,
+    OPT_INLINE_REPORT   = 1 << 7,
+    OPT_FRAME_POINTER   = 1 << 8,
+    OPT_TIME_PASSES     = 1 << 9,
+    OPT_MEM_REPORT      = 1 << 10,
+    OPT_RUN_TESTS       = 1 << 11,
+    OPT_STREAM          = 1 << 12
 } Compiler_Options;
 
 typedef struct Compiler_Arguments Compiler_Arguments;
 struct Compiler_Arguments
 {
     Compiler_Options options;
-    String* input_file; // @Incomplete: Should be a string array, but for now it is just a single string
+    String_Array* input_files; // Every source file, in the order they were given
+    String* input_file;        // The one being compiled
     String* out_path; // Out path for the chosen output 
-    String* absolute_path;
+    String* absolute_path;     // Of input_file
+    String* profile_generate_path; // NULL unless -fprofile-generate
+    String* profile_use_path;      // NULL unless -fprofile-use
+    String* stats_json_path;       // NULL unless -stats-json
+    String* trace_path;            // NULL unless -trace
+    String* test_directory;        // NULL unless -test=<directory>
+    i32 job_count;                 // -j, 0 for one per processor
+};
+
+// One file of a batch compile, run as a job (see Compiler_compile_files)
+typedef struct Compiler_File_Job Compiler_File_Job;
+struct Compiler_File_Job
+{
+    Compiler_Arguments arguments; // input_file is the file of this job
+    String* object_path;
+    Compiler_Stats stats;         // Merged into those of the batch when every file is done
+    bool has_main;
+    bool result;
 };
 
 #endif
@@ -1,24 +1,18 @@
 IR_Register IR_register_alloc(IR_Register_Table* table)
 {
-    for (i32 i = 0; i < table->capacity; i++)
+    if (table->count == table->capacity)
     {
-        if (!table->inuse_table[i])
+        i32 old_capacity = table->capacity;
+        table->capacity = table->capacity == 0 ? 256 : table->capacity * 2;
+        table->inuse_table = mem_realloc(table->inuse_table, sizeof(bool) * table->capacity);
+        for (i32 i = old_capacity; i < table->capacity; i++)
         {
-            table->inuse_table[i] = true;
-            IR_Register reg = { .gpr_index = i};
-            return reg;
+            table->inuse_table[i] = false;
         }
     }
 
-    i32 old_capacity = table->capacity;
-    table->capacity = table->capacity == 0 ? 256 : table->capacity * 2;
-    table->inuse_table = realloc(table->inuse_table, sizeof(bool) * table->capacity);
-    for (i32 i = old_capacity; i < table->capacity; i++)
-    {
-        table->inuse_table[i] = false;
-    }
-    IR_Register reg = { .gpr_index = old_capacity };
-    table->inuse_table[old_capacity] = true;
+    IR_Register reg = { .gpr_index = table->count++ };
+    table->inuse_table[reg.gpr_index] = true;
     return reg;
 }
 
@@ -69,6 +63,16 @@ static char* IR_instruction_type_to_string(IR_Instruction* instruction)
     return "unop";
     case IR_INS_COMPARE:
     return "compare";
+    case IR_INS_PHI:
+    return "phi";
+    case IR_INS_ARGUMENT:
+    return "argument";
+    case IR_INS_SET:
+    return "set";
+    case IR_INS_SELECT:
+    return "select";
+    case IR_INS_LEA:
+    return "lea";
     default: IR_ERROR("Unknown instruction type.");
     }
     return NULL;
@@ -97,8 +101,13 @@ static char* IR_instruction_type_to_string(IR_Instruction* instruction)
 /*     return NULL; */
 /* } */
 
+// Functions translated on their own number their labels apart, by function
 String* IR_generate_label_name(IR_Program* program, Allocator* allocator)
 {
+    if (program->signature_count > 0)
+    {
+        return string_createf(allocator, ".Label_%d_%d", program->signature_count - 1, program->label_counter++);
+    }
     return string_createf(allocator, ".Label_%d", program->label_counter++);
 }
 
@@ -108,7 +117,7 @@ IR_Block* IR_allocate_block(IR_Program* program)
     if (block_array->count + 1 > block_array->capacity)
     {
         block_array->capacity = block_array->capacity == 0 ? 256 : block_array->capacity * 2;
-        block_array->blocks = realloc(block_array->blocks, sizeof(IR_Block) * block_array->capacity);
+        block_array->blocks = mem_realloc(block_array->blocks, sizeof(IR_Block) * block_array->capacity);
     }
 
     IR_Block* block = &block_array->blocks[block_array->count++];
@@ -120,31 +129,83 @@ IR_Block* IR_allocate_block(IR_Program* program)
     block->node_array.count    = 0;
     block->node_array.nodes    = NULL;
     block->node_array.capacity = 0;
+    block->function_index      = program->function_array.count - 1;
+
+    block->predecessors            = (IR_Block_Address_Array){0};
+    block->successors              = (IR_Block_Address_Array){0};
+    block->layout_index            = -1;
+    block->reverse_postorder_index = -1;
+    block->immediate_dominator     = (IR_Block_Address) { .address = -1 };
+    block->dominator_children      = (IR_Block_Address_Array){0};
+    block->dominance_frontier      = (IR_Block_Address_Array){0};
+    block->dominator_preorder      = -1;
+    block->dominator_postorder     = -1;
+    block->profile_index           = -1;
+    block->execution_count         = 0;
+    block->cold                    = false;
+    block->loop_header             = false;
 
     return block;
 }
 
-IR_Node* IR_emit_node(IR_Block* block, IR_Node_Type node_type)
+static void IR_maybe_grow_node_array(IR_Block* block)
 {
     IR_Node_Array* node_array = &block->node_array;
     if (node_array->count + 1 > node_array->capacity)
     {
         node_array->capacity = node_array->capacity == 0 ? 256 : node_array->capacity * 2;
-        node_array->nodes = realloc(node_array->nodes, sizeof(IR_Node) * node_array->capacity);
+        node_array->nodes = mem_realloc(node_array->nodes, sizeof(IR_Node) * node_array->capacity);
+
+        // @Note: The function array points into the node array of the function's first block,
+        // so it has to follow the nodes when they move.
+        if (node_array->count > 0 && node_array->nodes[0].type == IR_NODE_FUNCTION_DECL)
+        {
+            block->parent_program->function_array.functions[block->function_index] = &node_array->nodes[0].function;
+        }
     }
+}
+
+IR_Node* IR_emit_node(IR_Block* block, IR_Node_Type node_type)
+{
+    IR_maybe_grow_node_array(block);
 
+    IR_Node_Array* node_array = &block->node_array;
     IR_Node* node = &node_array->nodes[node_array->count++];
+    *node = (IR_Node){0};
     node->type = node_type;
     return node;
 }
 
+IR_Node* IR_insert_node(IR_Block* block, i32 index, IR_Node_Type node_type)
+{
+    assert(index > 0 || block->node_array.count == 0 || block->node_array.nodes[0].type != IR_NODE_FUNCTION_DECL);
+    IR_maybe_grow_node_array(block);
+
+    IR_Node_Array* node_array = &block->node_array;
+    memmove(&node_array->nodes[index + 1], &node_array->nodes[index], sizeof(IR_Node) * (node_array->count - index));
+    node_array->count++;
+
+    IR_Node* node = &node_array->nodes[index];
+    *node = (IR_Node){0};
+    node->type = node_type;
+    return node;
+}
+
+void IR_remove_node(IR_Block* block, i32 index)
+{
+    IR_Node_Array* node_array = &block->node_array;
+    assert(index >= 0 && index < node_array->count);
+    memmove(&node_array->nodes[index], &node_array->nodes[index + 1], sizeof(IR_Node) * (node_array->count - index - 1));
+    node_array->count--;
+}
+
 void IR_add_function(IR_Program* program, IR_Function_Decl* function)
 {
     IR_Function_Array* array = &program->function_array;
     if (array->count + 1 > array->capacity)
     {
         array->capacity = array->capacity == 0 ? 256 : array->capacity * 2;
-        array->functions = realloc(array->functions, sizeof(IR_Function_Decl*) * array->capacity);
+        array->functions = mem_realloc(array->functions, sizeof(IR_Function_Decl*) * array->capacity);
     }
 
     array->functions[array->count++] = function;
@@ -155,7 +216,7 @@ void IR_add_argument(IR_Argument_Array* array, IR_Argument argument)
     if (array->count + 1 > array->capacity)
     {
         array->capacity = array->capacity == 0 ? 256 : array->capacity * 2;
-        array->arguments = realloc(array->arguments, sizeof(IR_Argument) * array->capacity);
+        array->arguments = mem_realloc(array->arguments, sizeof(IR_Argument) * array->capacity);
     }
 
     array->arguments[array->count++] = argument;
@@ -166,12 +227,41 @@ void IR_add_call_argument(IR_Call_Arguments* array, IR_Value argument)
     if (array->count + 1 > array->capacity)
     {
         array->capacity = array->capacity == 0 ? 256 : array->capacity * 2;
-        array->values = realloc(array->values, sizeof(IR_Value) * array->capacity);
+        array->values = mem_realloc(array->values, sizeof(IR_Value) * array->capacity);
     }
 
     array->values[array->count++] = argument;
 }
 
+void IR_add_block_address(IR_Block_Address_Array* array, IR_Block_Address address)
+{
+    if (array->count + 1 > array->capacity)
+    {
+        array->capacity = array->capacity == 0 ? 8 : array->capacity * 2;
+        array->addresses = mem_realloc(array->addresses, sizeof(IR_Block_Address) * array->capacity);
+    }
+
+    array->addresses[array->count++] = address;
+}
+
+void IR_insert_block_address(IR_Block_Address_Array* array, i32 index, IR_Block_Address address)
+{
+    IR_add_block_address(array, address);
+    memmove(&array->addresses[index + 1], &array->addresses[index], sizeof(IR_Block_Address) * (array->count - index - 1));
+    array->addresses[index] = address;
+}
+
+void IR_add_phi_operand(IR_Phi* phi, IR_Phi_Operand operand)
+{
+    if (phi->count + 1 > phi->capacity)
+    {
+        phi->capacity = phi->capacity == 0 ? 4 : phi->capacity * 2;
+        phi->operands = mem_realloc(phi->operands, sizeof(IR_Phi_Operand) * phi->capacity);
+    }
+
+    phi->operands[phi->count++] = operand;
+}
+
 i32 IR_find_function(IR_Program* program, String* name)
 {
     // @Speed: Optimize at some point using a hash table
@@ -202,6 +292,7 @@ IR_Node* IR_emit_function_decl(IR_Block* block, String* name, bool export, b32 h
     function_decl->function.name   = name;
     function_decl->function.arguments = arguments;
     IR_add_function(block->parent_program, &function_decl->function);
+    block->function_index = block->parent_program->function_array.count - 1;
 
     return function_decl;
 }
@@ -256,6 +347,7 @@ IR_UnOp* IR_emit_unop(IR_Block* block, IR_Register reg, IR_Op operator, Allocato
     location->type = IR_LOCATION_REGISTER;
     location->reg = reg;
 
+    unop->destination = reg;
     unop->operator = operator;
 
     return unop;
@@ -409,19 +501,108 @@ IR_Jump* IR_emit_jump(IR_Block* block, IR_Label label, IR_Jump_Type jump_type, I
     return jump;
 }
 
-IR_Compare* IR_emit_comparison(IR_Block* block, IR_Value left, IR_Location right, IR_Op operator, IR_Register_Table* table, Allocator* allocator)
+IR_Compare* IR_emit_comparison(IR_Block* block, IR_Value left, IR_Location right, Allocator* allocator)
 {
     IR_Node* node = IR_emit_instruction(block, IR_INS_COMPARE);
     IR_Compare* compare = &node->instruction.compare;
 
     compare->left = left;
     compare->right = right;
-    compare->operator = operator;
-    compare->destination = compare->right.reg;
 
     return compare;
 }
 
+IR_Set* IR_emit_set(IR_Block* block, IR_Jump_Type condition, IR_Register destination, Allocator* allocator)
+{
+    IR_Node* node = IR_emit_instruction(block, IR_INS_SET);
+    IR_Set* set = &node->instruction.set;
+
+    set->condition = condition;
+    set->destination = destination;
+
+    return set;
+}
+
+static bool IR_is_comparison(Token_Type operator)
+{
+    switch(operator)
+    {
+    case TOKEN_EQUAL_EQUAL:
+    case TOKEN_BANG_EQUAL:
+    case TOKEN_LESS:
+    case TOKEN_GREATER:
+    case TOKEN_LESS_EQUAL:
+    case TOKEN_GREATER_EQUAL:
+    return true;
+    default: return false;
+    }
+}
+
+// Condition that holds after comparing `left` to `right` when `left operator right` is true
+static IR_Jump_Type IR_condition_for_operator(Token_Type operator)
+{
+    switch(operator)
+    {
+    case TOKEN_EQUAL_EQUAL:   return JMP_EQUAL;
+    case TOKEN_BANG_EQUAL:    return JMP_NOT_EQUAL;
+    case TOKEN_LESS:          return JMP_LESS;
+    case TOKEN_GREATER:       return JMP_GREATER;
+    case TOKEN_LESS_EQUAL:    return JMP_LESS_EQUAL;
+    case TOKEN_GREATER_EQUAL: return JMP_GREATER_EQUAL;
+    default: IR_ERROR("Invalid comparison operator %s", token_type_to_string(operator)); return JMP_ALWAYS;
+    }
+}
+
+// Suffix of the x86 jcc and setcc mnemonics
+const char* IR_condition_suffix(IR_Jump_Type condition)
+{
+    switch(condition)
+    {
+    case JMP_EQUAL:         return "e";
+    case JMP_ZERO:          return "z";
+    case JMP_NOT_EQUAL:     return "ne";
+    case JMP_NOT_ZERO:      return "nz";
+    case JMP_LESS:          return "l";
+    case JMP_LESS_EQUAL:    return "le";
+    case JMP_GREATER:       return "g";
+    case JMP_GREATER_EQUAL: return "ge";
+    default: COMPILER_BUG("Unconditional jumps have no condition."); return "";
+    }
+}
+
+IR_Jump_Type IR_negate_condition(IR_Jump_Type condition)
+{
+    switch(condition)
+    {
+    case JMP_EQUAL:         return JMP_NOT_EQUAL;
+    case JMP_ZERO:          return JMP_NOT_ZERO;
+    case JMP_NOT_EQUAL:     return JMP_EQUAL;
+    case JMP_NOT_ZERO:      return JMP_ZERO;
+    case JMP_LESS:          return JMP_GREATER_EQUAL;
+    case JMP_LESS_EQUAL:    return JMP_GREATER;
+    case JMP_GREATER:       return JMP_LESS_EQUAL;
+    case JMP_GREATER_EQUAL: return JMP_LESS;
+    default: COMPILER_BUG("Unconditional jumps can not be negated."); return JMP_ALWAYS;
+    }
+}
+
+/*
+The compare whose condition codes the conditional jump or set at `index` reads, or NULL if nothing in the
+block sets them.
+ */
+IR_Instruction* IR_find_flags(IR_Block* block, i32 index)
+{
+    for (i32 i = index - 1; i >= 0; i--)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type == IR_NODE_INSTRUCTION && node->instruction.type == IR_INS_COMPARE)
+        {
+            return &node->instruction;
+        }
+    }
+    return NULL;
+}
+
 IR_Block* IR_get_block(IR_Program* program, IR_Block_Address address)
 {
     IR_Block_Array* blocks = &program->block_array;
@@ -451,8 +632,218 @@ IR_Block* IR_get_current_block(IR_Program* program)
     return &program->block_array.blocks[program->block_array.count - 1];
 }
 
+bool IR_register_is_valid(IR_Register reg)
+{
+    return reg.type == IR_GPR && reg.gpr_index >= 0;
+}
+
+static IR_Register* IR_get_value_register(IR_Value* value)
+{
+    if (value->type == VALUE_LOCATION && value->loc.type == IR_LOCATION_REGISTER && IR_register_is_valid(value->loc.reg))
+    {
+        return &value->loc.reg;
+    }
+    return NULL;
+}
+
+i32 IR_get_use_count(IR_Instruction* instruction)
+{
+    switch(instruction->type)
+    {
+    case IR_INS_MOV:     return 1;
+    case IR_INS_PUSH:    return 1;
+    case IR_INS_BINOP:   return 2;
+    case IR_INS_RET:     return instruction->ret.has_return_value ? 1 : 0;
+    case IR_INS_CALL:    return instruction->call.arguments.count;
+    case IR_INS_UNOP:    return 1;
+    case IR_INS_COMPARE: return 2;
+    case IR_INS_PHI:     return instruction->phi.count;
+    case IR_INS_SELECT:  return 2;
+    case IR_INS_LEA:     return 2;
+    default:             return 0;
+    }
+}
+
+// @Note: Returns NULL for operands that are not registers (literals etc.)
+IR_Register* IR_get_use(IR_Instruction* instruction, i32 index)
+{
+    switch(instruction->type)
+    {
+    case IR_INS_MOV:     return IR_get_value_register(&instruction->move.src);
+    case IR_INS_PUSH:    return IR_get_value_register(&instruction->push.value);
+    case IR_INS_BINOP:   return IR_get_value_register(index == 0 ? &instruction->binop.left : &instruction->binop.right);
+    case IR_INS_RET:     return IR_register_is_valid(instruction->ret.return_register) ? &instruction->ret.return_register : NULL;
+    case IR_INS_CALL:    return IR_get_value_register(&instruction->call.arguments.values[index]);
+    case IR_INS_UNOP:    return IR_get_value_register(&instruction->unop.value);
+    case IR_INS_COMPARE:
+    {
+        if (index == 0)
+        {
+            return IR_get_value_register(&instruction->compare.left);
+        }
+
+        IR_Location* right = &instruction->compare.right;
+        return right->type == IR_LOCATION_REGISTER && IR_register_is_valid(right->reg) ? &right->reg : NULL;
+    }
+    case IR_INS_PHI:     return IR_get_value_register(&instruction->phi.operands[index].value);
+    case IR_INS_SELECT:  return IR_get_value_register(index == 0 ? &instruction->select.if_true : &instruction->select.if_false);
+    case IR_INS_LEA:
+    {
+        IR_Register* reg = index == 0 ? &instruction->lea.base : &instruction->lea.index;
+        return IR_register_is_valid(*reg) ? reg : NULL;
+    }
+    default:             return NULL;
+    }
+}
 
-IR_Register IR_translate_expression(AST_Node* node, IR_Block* block, IR_Block* end_block, Allocator* allocator, IR_Register_Table* table)
+// @Note: Compares only read their operands, the destination just mirrors the right operand.
+IR_Register* IR_get_definition(IR_Program* program, IR_Instruction* instruction)
+{
+    switch(instruction->type)
+    {
+    case IR_INS_MOV:
+    {
+        IR_Location* dst = &instruction->move.dst;
+        return dst->type == IR_LOCATION_REGISTER && IR_register_is_valid(dst->reg) ? &dst->reg : NULL;
+    }
+    case IR_INS_POP:   return IR_get_value_register(&instruction->pop.value);
+    case IR_INS_BINOP: return &instruction->binop.destination;
+    case IR_INS_UNOP:  return &instruction->unop.destination;
+    case IR_INS_PHI:   return &instruction->phi.destination;
+    case IR_INS_ARGUMENT: return &instruction->argument.destination;
+    case IR_INS_SET:   return &instruction->set.destination;
+    case IR_INS_SELECT: return &instruction->select.destination;
+    case IR_INS_LEA:    return &instruction->lea.destination;
+    case IR_INS_CALL:
+    {
+        IR_Function_Decl* function = program->function_array.functions[instruction->call.function_index];
+        return function->has_return_value ? &instruction->call.return_register : NULL;
+    }
+    default:           return NULL;
+    }
+}
+
+/* ======================
+   Translation
+   ====================== */
+
+/*
+@Note: Blocks are laid out in the order they are placed in, not the order they are allocated in, so a
+block that is allocated up front as a jump target can still be placed after the code that jumps to it.
+The block array can move when a block is allocated, so code that allocates blocks holds on to block
+addresses and looks the blocks up again afterwards.
+ */
+static void IR_place_block(IR_Block* block)
+{
+    IR_Function_Decl* function = block->parent_program->function_array.functions[block->function_index];
+    IR_add_block_address(&function->blocks, block->block_address);
+}
+
+static IR_Block_Address IR_allocate_labeled_block(IR_Program* program, Allocator* allocator)
+{
+    IR_Block* block = IR_allocate_block(program);
+    IR_emit_label(block, IR_generate_label_name(program, allocator), allocator);
+    return block->block_address;
+}
+
+static IR_Block* IR_allocate_placed_block(IR_Program* program)
+{
+    IR_Block* block = IR_allocate_block(program);
+    IR_place_block(block);
+    return block;
+}
+
+static void IR_emit_jump_to(IR_Block* block, IR_Jump_Type jump_type, IR_Block_Address target, Allocator* allocator)
+{
+    IR_Label* label = &IR_get_node(IR_get_block(block->parent_program, target), 0)->label;
+    IR_emit_jump(block, *label, jump_type, target, allocator);
+}
+
+static bool IR_ends_in_terminator(IR_Block* block)
+{
+    return block->node_array.count > 0 && IR_is_terminator(&block->node_array.nodes[block->node_array.count - 1]);
+}
+
+static bool IR_is_logical(AST_Node* node)
+{
+    return node->type == AST_NODE_BINARY && (node->binary.operator == TOKEN_AMPERSAND_AMPERSAND || node->binary.operator == TOKEN_PIPE_PIPE);
+}
+
+static IR_Block* IR_translate_branch(AST_Node* condition, IR_Block* block, bool jump_when, IR_Block_Address target, Allocator* allocator, IR_Register_Table* table);
+
+static u32 IR_hash_name(String* name)
+{
+    u32 hash = 2166136261u;
+    for (size_t i = 0; i < name->length; i++)
+    {
+        hash ^= (u8)name->str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Slot of `name`, or the free one it would go in
+static i32 IR_find_signature_slot(IR_Signature_Table* table, String* name)
+{
+    i32 slot = IR_hash_name(name) & (table->slot_capacity - 1);
+    while (table->slots[slot] != -1 && !string_equal(name, table->signatures[table->slots[slot]].name))
+    {
+        slot = (slot + 1) & (table->slot_capacity - 1);
+    }
+    return slot;
+}
+
+// Declares the function for the calls translated after this, a name that is already declared keeps its first function
+void IR_add_signature(IR_Signature_Table* table, String* name, b32 has_return_value)
+{
+    if (table->count + 1 > table->capacity)
+    {
+        table->capacity = table->capacity == 0 ? 256 : table->capacity * 2;
+        table->signatures = mem_realloc(table->signatures, sizeof(IR_Function_Decl) * table->capacity);
+    }
+
+    // Kept at most half full
+    if ((table->count + 1) * 2 > table->slot_capacity)
+    {
+        mem_free(table->slots);
+        table->slot_capacity = table->slot_capacity == 0 ? 512 : table->slot_capacity * 2;
+        table->slots = mem_alloc(sizeof(i32) * table->slot_capacity);
+        memset(table->slots, -1, sizeof(i32) * table->slot_capacity);
+        for (i32 i = 0; i < table->count; i++)
+        {
+            i32 slot = IR_find_signature_slot(table, table->signatures[i].name);
+            if (table->slots[slot] == -1) table->slots[slot] = i;
+        }
+    }
+
+    IR_Function_Decl* signature = &table->signatures[table->count];
+    memset(signature, 0, sizeof(IR_Function_Decl));
+    signature->name = name;
+    signature->has_return_value = has_return_value;
+
+    i32 slot = IR_find_signature_slot(table, name);
+    if (table->slots[slot] == -1) table->slots[slot] = table->count;
+    table->count++;
+}
+
+void IR_free_signatures(IR_Signature_Table* table)
+{
+    mem_free(table->signatures);
+    mem_free(table->slots);
+    memset(table, 0, sizeof(IR_Signature_Table));
+}
+
+// A function can call those declared before it and itself
+static i32 IR_find_signature(IR_Program* program, String* name)
+{
+    IR_Signature_Table* table = program->signatures;
+    if (!table || table->count == 0) return -1;
+
+    i32 index = table->slots[IR_find_signature_slot(table, name)];
+    return index < program->signature_count ? index : -1;
+}
+
+IR_Register IR_translate_expression(AST_Node* node, IR_Block** block, Allocator* allocator, IR_Register_Table* table)
 {
     switch(node->type)
     {
@@ -464,7 +855,7 @@ IR_Register IR_translate_expression(AST_Node* node, IR_Block* block, IR_Block* e
         {
         case LIT_INT:
         {
-            IR_emit_move_lit_to_reg(block, literal->i, reg, allocator);            
+            IR_emit_move_lit_to_reg(*block, literal->i, reg, allocator);            
         }
         break;
         case LIT_FLOAT:
@@ -480,25 +871,25 @@ IR_Register IR_translate_expression(AST_Node* node, IR_Block* block, IR_Block* e
     case AST_NODE_CALL:
     {
         String* fun_name = node->fun_call.name;
-        i32 index = IR_find_function(block->parent_program, fun_name);
-        IR_Function_Decl* function = block->parent_program->function_array.functions[index];
+        i32 index = IR_find_signature((*block)->parent_program, fun_name);
             
         if (index != -1)
         {
+            bool has_return_value = (*block)->parent_program->signatures->signatures[index].has_return_value;
             AST_Node_List ast_arguments = node->fun_call.arguments;
             IR_Call_Arguments arguments = {0};
 
             for (i32 i = 0; i < ast_arguments.count; i++)
             {
-                IR_add_call_argument(&arguments, IR_create_value_register(IR_translate_expression(ast_arguments.nodes[i], block, NULL, allocator, table)));
+                IR_add_call_argument(&arguments, IR_create_value_register(IR_translate_expression(ast_arguments.nodes[i], block, allocator, table)));
             }
             
-            IR_Node* ir_node = IR_emit_instruction(block, IR_INS_CALL);
+            IR_Node* ir_node = IR_emit_instruction(*block, IR_INS_CALL);
             IR_Call* call = &ir_node->instruction.call;
             call->arguments = arguments;
             call->function_index = index;
             
-            if (function->has_return_value)
+            if (has_return_value)
             {
                 call->return_register = IR_register_alloc(table);
                 return call->return_register;
@@ -512,16 +903,55 @@ IR_Register IR_translate_expression(AST_Node* node, IR_Block* block, IR_Block* e
     break;
     case AST_NODE_VARIABLE:
     {
-        NOT_IMPLEMENTED("Variables not yet implemented in IR generation");
+        IR_Program* program = (*block)->parent_program;
+        IR_Function_Decl* function = program->function_array.functions[(*block)->function_index];
+        String* name = node->variable.variable_name;
+
+        for (i32 i = 0; i < function->arguments.count; i++)
+        {
+            IR_Argument* argument = &function->arguments.arguments[i];
+            if (string_equal(argument->name, name))
+            {
+                // @Note: Binary and unary operations overwrite one of their operands, so every read gets its own copy
+                IR_Register reg = IR_register_alloc(table);
+                IR_emit_move_reg_to_reg(*block, argument->reg, reg, allocator);
+                return reg;
+            }
+        }
+
+        NOT_IMPLEMENTED("Local variables not yet implemented in IR generation");
     }
     break;
     case AST_NODE_BINARY:
     {
-        IR_Register left_reg = IR_translate_expression(node->binary.left, block, NULL, allocator, table);
-        IR_Register right_reg = IR_translate_expression(node->binary.right, block, NULL, allocator, table);
-
         Token_Type operator = node->binary.operator;
 
+        if (IR_is_logical(node))
+        {
+            // Branch over the assignment of 1, the phi for the result is placed when going into SSA
+            IR_Program* program = (*block)->parent_program;
+            IR_Block_Address address = (*block)->block_address;
+            IR_Register reg = IR_register_alloc(table);
+
+            IR_Block_Address false_address = IR_allocate_labeled_block(program, allocator);
+            IR_Block_Address join_address = IR_allocate_labeled_block(program, allocator);
+
+            IR_Block* true_block = IR_translate_branch(node, IR_get_block(program, address), false, false_address, allocator, table);
+            IR_emit_move_lit_to_reg(true_block, 1, reg, allocator);
+            IR_emit_jump_to(true_block, JMP_ALWAYS, join_address, allocator);
+
+            IR_Block* false_block = IR_get_block(program, false_address);
+            IR_place_block(false_block);
+            IR_emit_move_lit_to_reg(false_block, 0, reg, allocator);
+
+            *block = IR_get_block(program, join_address);
+            IR_place_block(*block);
+            return reg;
+        }
+
+        IR_Register left_reg = IR_translate_expression(node->binary.left, block, allocator, table);
+        IR_Register right_reg = IR_translate_expression(node->binary.right, block, allocator, table);
+
         switch(operator)
         {
         case TOKEN_PLUS:
@@ -533,93 +963,22 @@ IR_Register IR_translate_expression(AST_Node* node, IR_Block* block, IR_Block* e
         case TOKEN_PIPE:
         case TOKEN_AMPERSAND:
         {
-            IR_BinOp* binop = IR_emit_binop(block, left_reg, right_reg, IR_map_operator(operator), table, allocator);
+            IR_BinOp* binop = IR_emit_binop(*block, left_reg, right_reg, IR_map_operator(operator), table, allocator);
             return binop->destination;
         }
         case TOKEN_EQUAL_EQUAL:
-        case TOKEN_PIPE_PIPE:
-        case TOKEN_AMPERSAND_AMPERSAND:
         case TOKEN_LESS:
         case TOKEN_GREATER:
         case TOKEN_LESS_EQUAL:
         case TOKEN_GREATER_EQUAL:
         case TOKEN_BANG_EQUAL:
         {
-            IR_Value left_val = IR_create_value_location(IR_create_location_register(left_reg));
-            IR_Location right_loc = IR_create_location_register(right_reg);
-
-            bool left_is_zero = left_val.type == VALUE_INT && left_val.integer;
-            
-            IR_Jump_Type jump_type = JMP_ALWAYS;
-            switch(operator)
-            {
-            case TOKEN_EQUAL_EQUAL:
-            {
-                if (left_is_zero)
-                {
-                    jump_type = JMP_ZERO;
-                }
-                else
-                {
-                    jump_type = JMP_NOT_EQUAL;
-                }
-            }
-            break;
-            case TOKEN_LESS:
-            {
-                jump_type = JMP_GREATER_EQUAL;
-                /* jump_type = JMP_LESS; */
-            }
-            break;
-            case TOKEN_GREATER:
-            {
-                jump_type = JMP_LESS_EQUAL;
-                /* jump_type = JMP_GREATER; */
-            }
-            break;
-            case TOKEN_LESS_EQUAL:
-            {
-                jump_type = JMP_GREATER;
-                /* jump_type = JMP_LESS_EQUAL; */
-            }
-            break;
-            case TOKEN_GREATER_EQUAL:
-            {
-                jump_type = JMP_LESS;
-                /* jump_type = JMP_GREATER_EQUAL; */
-            }
-            break;
-            case TOKEN_BANG_EQUAL:
-            {
-                if (left_is_zero)
-                {
-                    jump_type = JMP_NOT_ZERO;
-                }
-                else
-                {
-                    jump_type = JMP_EQUAL;
-                }
-            }
-            break;
-            default: IR_ERROR("Invalid comparison operator %s", token_type_to_string(operator));
-            }
-
-            IR_Compare* compare = IR_emit_comparison(block, left_val, right_loc, IR_map_operator(operator), table, allocator);
-
-            // @Incomplete: Do some kind of short circuiting? Right now this won't work with &&, ||
-
-            if (end_block)
-            {
-                IR_Node* node = IR_get_node(end_block, 0);
-                IR_Label* end_label = &node->label;
-                IR_emit_jump(block, *end_label, jump_type, end_block->block_address, allocator);
-            }
-            else
-            {
-                // @Incomplete: Emit set instruction (setcc in x86_64)
-            }
+            // Conditions of if statements never get here, they jump on the condition codes directly (see IR_translate_branch)
+            IR_emit_comparison(*block, IR_create_value_register(left_reg), IR_create_location_register(right_reg), allocator);
 
-            return compare->destination;
+            IR_Register reg = IR_register_alloc(table);
+            IR_emit_set(*block, IR_condition_for_operator(operator), reg, allocator);
+            return reg;
         }
         default:
         IR_ERROR("Unsupported operator for binary operations %s\n", token_type_to_string(operator));
@@ -628,18 +987,22 @@ IR_Register IR_translate_expression(AST_Node* node, IR_Block* block, IR_Block* e
     }
     case AST_NODE_UNARY:
     {
-        IR_Register reg = IR_translate_expression(node->unary.expression, block, NULL, allocator, table);
+        IR_Register reg = IR_translate_expression(node->unary.expression, block, allocator, table);
         Token_Type operator = node->unary.operator;
         switch(operator)
         {
         case TOKEN_MINUS:
         {
-            IR_emit_unop(block, reg, OP_SUB, allocator);
+            IR_emit_unop(*block, reg, OP_SUB, allocator);
         }
         break;
         case TOKEN_BANG:
         {
-            IR_emit_unop(block, reg, OP_NOT, allocator);
+            IR_emit_comparison(*block, IR_create_value_number(0), IR_create_location_register(reg), allocator);
+
+            IR_Register result = IR_register_alloc(table);
+            IR_emit_set(*block, JMP_EQUAL, result, allocator);
+            return result;
         }
         break;
         default: IR_ERROR("Unsupported operator for unary operations %s\n", token_type_to_string(operator));
@@ -654,6 +1017,67 @@ IR_Register IR_translate_expression(AST_Node* node, IR_Block* block, IR_Block* e
     return (IR_Register){ .gpr_index = -1};
 }
 
+/*
+Jumps to `target` when the condition is `jump_when` and falls through otherwise, into the block that is
+returned. A comparison is compared once and branched on right away, so the compare and the jump end up
+next to each other and the CPU can fuse them. && and || branch on each operand in turn, so the right one
+is only evaluated when the left one does not decide the outcome already. Any other value is compared
+against zero.
+ */
+static IR_Block* IR_translate_branch(AST_Node* condition, IR_Block* block, bool jump_when, IR_Block_Address target, Allocator* allocator, IR_Register_Table* table)
+{
+    IR_Program* program = block->parent_program;
+
+    if (condition->type == AST_NODE_UNARY && condition->unary.operator == TOKEN_BANG)
+    {
+        return IR_translate_branch(condition->unary.expression, block, !jump_when, target, allocator, table);
+    }
+
+    if (IR_is_logical(condition))
+    {
+        AST_Node* left = condition->binary.left;
+        AST_Node* right = condition->binary.right;
+
+        // The left operand decides on its own when it is false for && or true for ||
+        bool decides_when = condition->binary.operator == TOKEN_PIPE_PIPE;
+        if (decides_when == jump_when)
+        {
+            block = IR_translate_branch(left, block, jump_when, target, allocator, table);
+            return IR_translate_branch(right, block, jump_when, target, allocator, table);
+        }
+
+        IR_Block_Address address = block->block_address;
+        IR_Block_Address skip_address = IR_allocate_labeled_block(program, allocator);
+        block = IR_translate_branch(left, IR_get_block(program, address), decides_when, skip_address, allocator, table);
+        block = IR_translate_branch(right, block, jump_when, target, allocator, table);
+
+        // Falling out of the right operand ends up in the same place as skipping it, so the skip target is placed right after it
+        IR_Block* skip = IR_get_block(program, skip_address);
+        IR_place_block(skip);
+        return skip;
+    }
+
+    IR_Jump_Type condition_code = JMP_NOT_EQUAL;
+    if (condition->type == AST_NODE_BINARY && IR_is_comparison(condition->binary.operator))
+    {
+        IR_Register left_reg = IR_translate_expression(condition->binary.left, &block, allocator, table);
+        IR_Register right_reg = IR_translate_expression(condition->binary.right, &block, allocator, table);
+
+        IR_emit_comparison(block, IR_create_value_register(left_reg), IR_create_location_register(right_reg), allocator);
+        condition_code = IR_condition_for_operator(condition->binary.operator);
+    }
+    else
+    {
+        IR_Register reg = IR_translate_expression(condition, &block, allocator, table);
+        IR_emit_comparison(block, IR_create_value_number(0), IR_create_location_register(reg), allocator);
+    }
+
+    IR_emit_jump_to(block, jump_when ? condition_code : IR_negate_condition(condition_code), target, allocator);
+
+    // Only the last instructions of a block may jump, the fallthrough starts a new one
+    return IR_allocate_placed_block(program);
+}
+
 IR_Block* IR_translate_block(IR_Block* block, AST_Node* body, Allocator* allocator, IR_Register_Table* register_table);
 
 IR_Block* IR_translate_statement(IR_Block* block, AST_Node* statement, Allocator* allocator, IR_Register_Table* register_table)
@@ -664,7 +1088,7 @@ IR_Block* IR_translate_statement(IR_Block* block, AST_Node* statement, Allocator
     {
         if (statement->return_statement.expression)
         {
-            IR_Register reg = IR_translate_expression(statement->return_statement.expression, block, NULL, allocator, register_table);
+            IR_Register reg = IR_translate_expression(statement->return_statement.expression, &block, allocator, register_table);
             IR_Register dst = IR_register_alloc(register_table);
                 
             IR_emit_move_reg_to_reg(block, reg, dst, allocator);
@@ -679,6 +1103,7 @@ IR_Block* IR_translate_statement(IR_Block* block, AST_Node* statement, Allocator
     break;
     case AST_NODE_IF:
     {
+        IR_Program* program = block->parent_program;
         AST_Node* ast_condition = statement->if_statement.condition;
 
         AST_Node* ast_then_arm = statement->if_statement.then_arm;
@@ -687,71 +1112,61 @@ IR_Block* IR_translate_statement(IR_Block* block, AST_Node* statement, Allocator
             IR_ERROR("Then arm for if statement has to be a block, was %s", AST_type_string(ast_then_arm->type));
         }
 
-        IR_Block* then_block = IR_allocate_block(block->parent_program);
-        IR_Block* end_block = IR_allocate_block(block->parent_program);
-
-        IR_Label* end_label = IR_emit_label(end_block, IR_generate_label_name(block->parent_program, allocator), allocator);
+        IR_Block_Address address = block->block_address;
+        IR_Block_Address else_address = IR_allocate_labeled_block(program, allocator);
 
-        IR_Register cond_register = IR_translate_expression(ast_condition, block, end_block, allocator, register_table);
-        IR_Block* new_block = end_block;
+        IR_Block* then_block = IR_translate_branch(ast_condition, IR_get_block(program, address), false, else_address, allocator, register_table);
+        IR_Block_Address then_end = IR_translate_block(then_block, ast_then_arm, allocator, register_table)->block_address;
 
-        if (ast_condition->type == AST_NODE_LITERAL)
+        AST_Node* ast_else_arm = statement->if_statement.else_arm;
+        if (!ast_else_arm)
         {
-            IR_emit_comparison(block, IR_create_value_number(0), IR_create_location_register(cond_register), OP_EQUAL, register_table, allocator);
-            IR_emit_jump(block, *end_label, JMP_EQUAL, end_block->block_address, allocator);
-
-            IR_translate_block(then_block, ast_then_arm, allocator, register_table);     
+            IR_Block* end_block = IR_get_block(program, else_address);
+            IR_place_block(end_block);
+            return end_block;
         }
-        else if (ast_condition->type == AST_NODE_BINARY)
+
+        // The then arm jumps over the else arm, unless it returns
+        IR_Block_Address join_address = IR_allocate_labeled_block(program, allocator);
+        if (!IR_ends_in_terminator(IR_get_block(program, then_end)))
         {
-            IR_translate_block(then_block, ast_then_arm, allocator, register_table);
+            IR_emit_jump_to(IR_get_block(program, then_end), JMP_ALWAYS, join_address, allocator);
         }
 
-        AST_Node* ast_else_arm = statement->if_statement.else_arm;
-        if (ast_else_arm)
+        IR_Block* else_block = IR_get_block(program, else_address);
+        IR_place_block(else_block);
+
+        IR_Block* else_end = NULL;
+        switch(ast_else_arm->type)
         {
-            // @Incomplete: This will not be enough if the else arm is an if-statement, in that case, we need to re-translate some other way.
-            // In this case, we probably just need a IR_translate_statement function, that does whatever this function does instead,
-            // and then explicitly call IR_translate_block on blocks instead of what we are currently doing.
-            switch(ast_else_arm->type)
-            {
-            case AST_NODE_BLOCK:
-            {
-                new_block = IR_translate_block(end_block, ast_else_arm, allocator, register_table);                
-            }
-            break;
-            case AST_NODE_IF:
-            {
-                new_block = IR_translate_statement(end_block, ast_else_arm, allocator, register_table);
-            }
-            break;
-            default: COMPILER_BUG("Invalid statement type for else statement %s.", AST_type_string(ast_else_arm->type));
-            }
+        case AST_NODE_BLOCK:
+        {
+            else_end = IR_translate_block(else_block, ast_else_arm, allocator, register_table);
         }
-        return new_block;                    
-    }
-    break;
-    case AST_NODE_CALL:
-    {
-        String* fun_name = statement->fun_call.name;
-        i32 index = IR_find_function(block->parent_program, fun_name);
-            
-        if (index != -1)
+        break;
+        case AST_NODE_IF:
         {
-            IR_Node* call = IR_emit_instruction(block, IR_INS_CALL);
-            call->instruction.call.function_index = index;
+            else_end = IR_translate_statement(else_block, ast_else_arm, allocator, register_table);
         }
-        else
+        break;
+        default: COMPILER_BUG("Invalid statement type for else statement %s.", AST_type_string(ast_else_arm->type));
+        }
+
+        IR_Block* join = IR_get_block(program, join_address);
+        if (!IR_ends_in_terminator(else_end))
         {
-            COMPILER_BUG("Unknown function %s.", fun_name->str);
+            IR_emit_jump_to(else_end, JMP_ALWAYS, join_address, allocator);
         }
+        IR_place_block(join);
+        return join;
     }
     break;
+    case AST_NODE_CALL:
     case AST_NODE_LITERAL:
     case AST_NODE_BINARY:
     case AST_NODE_UNARY:
     {
-        IR_translate_expression(statement, block, NULL, allocator, register_table);
+        IR_translate_expression(statement, &block, allocator, register_table);
     }
     break;
     default: COMPILER_BUG("Invalid AST node type %s.", AST_type_string(statement->type));
@@ -774,44 +1189,296 @@ IR_Block* IR_translate_block(IR_Block* block, AST_Node* body, Allocator* allocat
     return used_block;
 }
 
+/*
+@Note: Every function is translated on its own, as a job (see job.h), into a program of its own with its
+own blocks, registers and labels. Labels are numbered per function, and the functions are appended to the
+program in source order, their blocks and registers numbered past those of the functions before them, so
+the program comes out the same however many jobs ran and in whatever order.
+Jobs run on any worker, so what they allocate comes from the heap and not from the arena of the file.
+ */
+static void IR_translate_function(void* data)
+{
+    IR_Translation* translation = data;
+    AST_Node* node = translation->declaration;
+    IR_Program* program = &translation->fragment;
+    Allocator* allocator = translation->allocator;
+
+    IR_Register_Table* register_table = mem_calloc(1, sizeof(IR_Register_Table));
+    program->register_table = register_table;
+    program->signatures = translation->signatures;
+    program->signature_count = translation->function_index + 1;
+
+    Trace_begin("translate", node->fun_decl.name->str);
+    IR_Block* block = IR_allocate_block(program);
+
+    AST_Node_List arguments = node->fun_decl.arguments;
+    IR_Argument_Array argument_array = {0};
+    for(i32 i = 0; i < arguments.count; i++)
+    {
+        AST_Node* node = arguments.nodes[i];
+        AST_Node* type = node->fun_argument.type;
+        String* name  = node->fun_argument.name;
+
+        IR_Argument argument =
+            {
+                .type = type->type_specifier.type,
+                .name = name
+            };
+        IR_add_argument(&argument_array, argument);
+    }
+
+    // @Note: Programs are linked on their own, so only the entry point has to be visible to the linker
+    bool export = string_equal_cstr(node->fun_decl.name, "main");
+    IR_emit_function_decl(block, node->fun_decl.name, export, node->fun_decl.return_type != NULL, argument_array);
+    IR_place_block(block);
+
+    for (i32 i = 0; i < argument_array.count; i++)
+    {
+        IR_Register reg = IR_register_alloc(register_table);
+        IR_Node* load = IR_emit_instruction(block, IR_INS_ARGUMENT);
+        load->instruction.argument.index = i;
+        load->instruction.argument.destination = reg;
+        argument_array.arguments[i].reg = reg;
+    }
+
+    IR_translate_block(block, node->fun_decl.body, allocator, register_table);
+    Trace_end();
+}
+
+static void IR_rebase_register(IR_Register* reg, i32 register_base)
+{
+    if (reg && IR_register_is_valid(*reg)) reg->gpr_index += register_base;
+}
+
+// Only what translation emits, nothing else has run on the fragment yet
+static void IR_rebase_instruction(IR_Program* program, IR_Instruction* instruction, i32 block_base, i32 register_base)
+{
+    for (i32 i = 0; i < IR_get_use_count(instruction); i++)
+    {
+        IR_rebase_register(IR_get_use(instruction, i), register_base);
+    }
+    IR_rebase_register(IR_get_definition(program, instruction), register_base);
+
+    if (instruction->type == IR_INS_JUMP)
+    {
+        instruction->jump.address.address += block_base;
+    }
+}
+
+/*
+Appends the function translated into `fragment` to the program, as function `function_index`. Registers are
+only allocated during translation and never given back, so those of the fragment are the first
+`register_count` and go right after the `register_base` the functions before it used. Its labels were
+allocated on the heap by the job, they are moved into `allocator` with the rest of the program.
+ */
+static void IR_append_fragment(IR_Program* program, IR_Program* fragment, i32 function_index, i32* register_base, Allocator* allocator)
+{
+    assert(program->function_array.count == function_index);
+
+    i32 register_count = fragment->register_table->count;
+
+    IR_Register_Table* table = program->register_table;
+    if (*register_base + register_count > table->capacity)
+    {
+        i32 old_capacity = table->capacity;
+        while (*register_base + register_count > table->capacity)
+        {
+            table->capacity = table->capacity == 0 ? 256 : table->capacity * 2;
+        }
+        table->inuse_table = mem_realloc(table->inuse_table, sizeof(bool) * table->capacity);
+        memset(table->inuse_table + old_capacity, 0, sizeof(bool) * (table->capacity - old_capacity));
+    }
+    memset(table->inuse_table + *register_base, true, sizeof(bool) * register_count);
+    table->count = *register_base + register_count;
+
+    i32 block_base = program->block_array.count;
+    for (i32 i = 0; i < fragment->block_array.count; i++)
+    {
+        IR_Block* block = IR_allocate_block(program);
+        IR_Block_Address address = block->block_address;
+        *block = fragment->block_array.blocks[i];
+        block->block_address = address;
+        block->parent_program = program;
+        block->function_index = function_index;
+    }
+
+    // The declaration is the first node of the first block, which the nodes did not move out of
+    IR_Function_Decl* function = &IR_get_block(program, (IR_Block_Address){ block_base })->node_array.nodes[0].function;
+    IR_add_function(program, function);
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        function->blocks.addresses[i].address += block_base;
+    }
+    for (i32 i = 0; i < function->arguments.count; i++)
+    {
+        IR_rebase_register(&function->arguments.arguments[i].reg, *register_base);
+    }
+
+    for (i32 i = block_base; i < program->block_array.count; i++)
+    {
+        IR_Block* block = &program->block_array.blocks[i];
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type == IR_NODE_INSTRUCTION) IR_rebase_instruction(program, &node->instruction, block_base, *register_base);
+            if (node->type == IR_NODE_LABEL)
+            {
+                String* heap_name = node->label.label_name;
+                node->label.label_name = string_copy(heap_name, allocator);
+                mem_free(heap_name);
+            }
+        }
+    }
+
+    *register_base += register_count;
+
+    mem_free(fragment->block_array.blocks);
+    mem_free(fragment->function_array.functions);
+    mem_free(fragment->register_table->inuse_table);
+    mem_free(fragment->register_table);
+}
+
 void IR_translate_program(IR_Program* program, AST_Node* ast_program, Allocator* allocator, IR_Register_Table* register_table)
 {
     AST_Node_List declarations = ast_program->program.declarations;
 
+    // Calls only need to know what they call, so every function is declared before any is translated
+    IR_Signature_Table signatures = {0};
+    IR_Translation* translations = mem_calloc(declarations.count + 1, sizeof(IR_Translation));
     for (i32 i = 0; i < declarations.count; i++)
     {
         AST_Node* node = declarations.nodes[i];
+        if (node->type != AST_NODE_FUN_DECL)
+        {
+            COMPILER_BUG("Invalid AST node type %s.", AST_type_string(node->type));
+        }
+
+        IR_add_signature(&signatures, node->fun_decl.name, node->fun_decl.return_type != NULL);
+        translations[i].declaration = node;
+        translations[i].signatures = &signatures;
+        translations[i].function_index = i;
+        translations[i].allocator = ALLOCATOR(&heap_tracker);
+    }
+
+    Job_Group group = {0};
+    for (i32 i = 0; i < declarations.count; i++)
+    {
+        Job_push(&group, IR_translate_function, &translations[i]);
+    }
+    Job_wait(&group);
+
+    i32 register_base = 0;
+    for (i32 i = 0; i < declarations.count; i++)
+    {
+        IR_append_fragment(program, &translations[i].fragment, i, &register_base, allocator);
+    }
+
+    mem_free(translations);
+    IR_free_signatures(&signatures);
+}
+
+/*
+@Note: For -stream, a file compiled one declaration at a time. The program is the function alone, and the
+functions it calls are declared in it as removed, numbered in the order they are first called in. Its labels
+are numbered by its index in the file like those of a job (see IR_translate_function), so they are unique
+in the assembly of the file. It is freed with IR_free_program, what it allocated from `allocator` is not.
+ */
+IR_Program IR_translate_declaration(AST_Node* declaration, IR_Signature_Table* signatures, i32 function_index, Allocator* allocator)
+{
+    if (declaration->type != AST_NODE_FUN_DECL)
+    {
+        COMPILER_BUG("Invalid AST node type %s.", AST_type_string(declaration->type));
+    }
 
-        switch(node->type)
+    IR_Translation translation =
         {
-        case AST_NODE_FUN_DECL:
+            .declaration = declaration,
+            .signatures = signatures,
+            .function_index = function_index,
+            .allocator = allocator
+        };
+    IR_translate_function(&translation);
+    IR_Program program = translation.fragment;
+
+    // Calls use the index of the callee in the file up to here
+    i32* callees = NULL;
+    i32 callee_count = 0;
+    for (i32 i = 0; i < program.block_array.count; i++)
+    {
+        IR_Block* block = &program.block_array.blocks[i];
+        for (i32 j = 0; j < block->node_array.count; j++)
         {
-            IR_Block* block = IR_allocate_block(program);
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION || node->instruction.type != IR_INS_CALL) continue;
 
-            AST_Node_List arguments = node->fun_decl.arguments;
-            IR_Argument_Array argument_array = {0};
-            for(i32 i = 0; i < arguments.count; i++)
+            IR_Call* call = &node->instruction.call;
+            if (call->function_index == function_index)
             {
-                AST_Node* node = arguments.nodes[i];
-                AST_Node* type = node->fun_argument.type;
-                String* name  = node->fun_argument.name;
-
-                IR_Argument argument =
-                    {
-                        .type = type->type_specifier.type,
-                        .name = name
-                    };
-                IR_add_argument(&argument_array, argument);
+                call->function_index = 0;
+                continue;
             }
-            
-            IR_emit_function_decl(block, node->fun_decl.name, true, node->fun_decl.return_type != NULL, argument_array);
 
-            IR_translate_block(block, node->fun_decl.body, allocator, register_table);
+            i32 callee = 0;
+            while (callee < callee_count && callees[callee] != call->function_index) callee++;
+            if (callee == callee_count)
+            {
+                callees = mem_realloc(callees, sizeof(i32) * (callee_count + 1));
+                callees[callee_count++] = call->function_index;
+
+                IR_Function_Decl* function = allocator->allocate(allocator, sizeof(IR_Function_Decl));
+                *function = signatures->signatures[call->function_index];
+                function->removed = true;
+                IR_add_function(&program, function);
+            }
+            call->function_index = callee + 1;
         }
-        break;
-        default: COMPILER_BUG("Invalid AST node type %s.", AST_type_string(node->type));
+    }
+    mem_free(callees);
+
+    return program;
+}
+
+// Everything IR_translate_declaration and the passes after it took from the heap
+void IR_free_program(IR_Program* program)
+{
+    for (i32 i = 0; i < program->block_array.count; i++)
+    {
+        IR_Block* block = &program->block_array.blocks[i];
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type == IR_NODE_FUNCTION_DECL)
+            {
+                mem_free(node->function.arguments.arguments);
+                mem_free(node->function.blocks.addresses);
+                mem_free(node->function.reverse_postorder.addresses);
+            }
+            else if (node->type == IR_NODE_INSTRUCTION && node->instruction.type == IR_INS_PHI)
+            {
+                mem_free(node->instruction.phi.operands);
+            }
+            else if (node->type == IR_NODE_INSTRUCTION && node->instruction.type == IR_INS_CALL)
+            {
+                mem_free(node->instruction.call.arguments.values);
+            }
         }
+
+        mem_free(block->node_array.nodes);
+        mem_free(block->predecessors.addresses);
+        mem_free(block->successors.addresses);
+        mem_free(block->dominator_children.addresses);
+        mem_free(block->dominance_frontier.addresses);
+    }
+
+    mem_free(program->block_array.blocks);
+    mem_free(program->function_array.functions);
+    mem_free(program->data_array.data);
+    if (program->register_table)
+    {
+        mem_free(program->register_table->inuse_table);
+        mem_free(program->register_table);
     }
+    memset(program, 0, sizeof(IR_Program));
 }
 
 IR_Program IR_translate_ast(AST_Node* root_node, Allocator* allocator)
@@ -824,9 +1491,11 @@ IR_Program IR_translate_ast(AST_Node* root_node, Allocator* allocator)
             .label_counter = 0
         };
 
-    IR_Register_Table* register_table = malloc(sizeof(IR_Register_Table));
+    IR_Register_Table* register_table = mem_alloc(sizeof(IR_Register_Table));
     register_table->capacity = 0;
+    register_table->count = 0;
     register_table->inuse_table = NULL;
+    program.register_table = register_table;
 
     IR_translate_program(&program, root_node, allocator, register_table);
 
@@ -947,53 +1616,13 @@ void IR_pretty_print_instruction(String_Builder* sb, IR_Instruction* instruction
     case IR_INS_JUMP:
     {
         IR_Jump* jump = &instruction->jump;
-        switch(jump->type)
-        {
-        case JMP_ALWAYS:
+        if (jump->type == JMP_ALWAYS)
         {
             sb_append(sb, "jmp ");
         }
-        break;
-        case JMP_EQUAL:
-        {
-            sb_append(sb, "je ");
-        }
-        break;
-        case JMP_ZERO:
-        {
-            sb_append(sb, "jz ");
-        }
-        break;
-        case JMP_NOT_EQUAL:
-        {
-            sb_append(sb, "jne ");
-        }
-        break;
-        case JMP_NOT_ZERO:
-        {
-            sb_append(sb, "jnz ");
-        }
-        break;
-        case JMP_LESS:
-        {
-            sb_append(sb, "jl ");
-        }
-        break;
-        case JMP_LESS_EQUAL:
-        {
-            sb_append(sb, "jle ");
-        }
-        break;
-        case JMP_GREATER:
-        {
-            sb_append(sb, "jg ");
-        }
-        break;
-        case JMP_GREATER_EQUAL:
+        else
         {
-            sb_append(sb, "jge ");
-        }
-        break;
+            sb_appendf(sb, "j%s ", IR_condition_suffix(jump->type));
         }
 
         IR_Block_Address address = jump->address;
@@ -1120,7 +1749,7 @@ void IR_pretty_print_instruction(String_Builder* sb, IR_Instruction* instruction
     {
         IR_UnOp* unop = &instruction->unop;
 
-        IR_pretty_print_value(sb, &unop->value);
+        IR_pretty_print_register(sb, &unop->destination);
         sb_append(sb, " := ");
         switch(unop->operator)
         {
@@ -1145,56 +1774,83 @@ void IR_pretty_print_instruction(String_Builder* sb, IR_Instruction* instruction
     {
         IR_Compare* compare = &instruction->compare;
 
-        IR_pretty_print_register(sb, &compare->destination);
-        sb_append(sb, " := ");
+        sb_append(sb, "cmp ");
         IR_pretty_print_value(sb, &compare->left);
-                    
-        switch(compare->operator)
-        {
-        case OP_OR:
-        {
-            sb_append(sb, " || ");
-        }
-        break;
-        case OP_AND:
-        {
-            sb_append(sb, " && ");
-        }
-        break;
-        case OP_LESS:
-        {
-            sb_append(sb, " < ");
-        }
-        break;
-        case OP_GREATER:
-        {
-            sb_append(sb, " > ");
-        }
-        break;
-        case OP_LESS_EQUAL:
-        {
-            sb_append(sb, " <= ");
-        }
-        break;
-        case OP_GREATER_EQUAL:
+        sb_append(sb, ", ");
+        IR_pretty_print_location(sb, &compare->right);
+        sb_newline(sb);
+    }
+    break;
+    case IR_INS_SET:
+    {
+        IR_Set* set = &instruction->set;
+
+        IR_pretty_print_register(sb, &set->destination);
+        sb_appendf(sb, " := set%s\n", IR_condition_suffix(set->condition));
+    }
+    break;
+    case IR_INS_SELECT:
+    {
+        IR_Select* select = &instruction->select;
+
+        IR_pretty_print_register(sb, &select->destination);
+        sb_appendf(sb, " := select%s ", IR_condition_suffix(select->condition));
+        IR_pretty_print_value(sb, &select->if_true);
+        sb_append(sb, ", ");
+        IR_pretty_print_value(sb, &select->if_false);
+        sb_newline(sb);
+    }
+    break;
+    case IR_INS_LEA:
+    {
+        IR_Lea* lea = &instruction->lea;
+
+        IR_pretty_print_register(sb, &lea->destination);
+        sb_append(sb, " := lea [");
+        if (IR_register_is_valid(lea->base))
         {
-            sb_append(sb, " >= ");
+            IR_pretty_print_register(sb, &lea->base);
+            if (IR_register_is_valid(lea->index)) sb_append(sb, " + ");
         }
-        break;
-        case OP_EQUAL:
+        if (IR_register_is_valid(lea->index))
         {
-            sb_append(sb, " == ");
+            IR_pretty_print_register(sb, &lea->index);
+            if (lea->scale != 1) sb_appendf(sb, " * %d", lea->scale);
         }
-        break;
-        case OP_NOT_EQUAL:
+        if (lea->offset != 0) sb_appendf(sb, " + %d", lea->offset);
+        sb_append(sb, "]");
+        sb_newline(sb);
+    }
+    break;
+    case IR_INS_PHI:
+    {
+        IR_Phi* phi = &instruction->phi;
+
+        IR_pretty_print_register(sb, &phi->destination);
+        sb_append(sb, " := phi(");
+
+        for (i32 i = 0; i < phi->count; i++)
         {
-            sb_append(sb, " != ");
-        }
-        break;
-        default: IR_ERROR("Unsupported operator for compare operation\n");
+            IR_Phi_Operand* operand = &phi->operands[i];
+            sb_appendf(sb, "[#%d: ", operand->block.address);
+            IR_pretty_print_value(sb, &operand->value);
+            sb_append(sb, "]");
+
+            if (i < phi->count - 1)
+            {
+                sb_append(sb, ", ");
+            }
         }
-        IR_pretty_print_location(sb, &compare->right);
-        sb_newline(sb);
+
+        sb_append(sb, ")\n");
+    }
+    break;
+    case IR_INS_ARGUMENT:
+    {
+        IR_Argument_Load* argument = &instruction->argument;
+
+        IR_pretty_print_register(sb, &argument->destination);
+        sb_appendf(sb, " := arg %d\n", argument->index);
     }
     break;
     default: IR_ERROR("IR pretty printer: Unhandled instruction %s", IR_instruction_type_to_string(instruction));
@@ -1210,56 +1866,62 @@ String* IR_pretty_print(IR_Program* program, Allocator* allocator)
     // @Incomplete:
     // - Print data section
 
-    // Print blocks
-    for (i32 i = 0; i < program->block_array.count; i++)
+    // Print blocks in the layout of their function
+    for (i32 f = 0; f < program->function_array.count; f++)
     {
-        IR_Block* block = &program->block_array.blocks[i];
+        IR_Function_Decl* function = program->function_array.functions[f];
+        if (function->removed) continue;
 
-        for (i32 j = 0; j < block->node_array.count; j++)
+        for (i32 b = 0; b < function->blocks.count; b++)
         {
-            IR_Node* node = &block->node_array.nodes[j];
+            IR_Block* block = IR_get_block(program, function->blocks.addresses[b]);
 
-            switch(node->type)
+            for (i32 j = 0; j < block->node_array.count; j++)
             {
-            case IR_NODE_FUNCTION_DECL:
-            {
-                IR_Function_Decl* fun = &node->function;
-                if(fun->export)
-                {
-                    sb_append(&sb, "export ");
-                }
-                sb_appendf(&sb, "fun %s(", fun->name->str);
+                IR_Node* node = &block->node_array.nodes[j];
 
-                IR_Argument_Array arguments = fun->arguments;
-                for (i32 i = 0; i < arguments.count; i++)
+                switch(node->type)
                 {
-                    IR_Argument argument = arguments.arguments[i];
-                    Type_Specifier type = argument.type;
-                    String* name = argument.name;
-                    sb_appendf(&sb, "%s : %s", name->str, type_spec_to_string(type));
+                case IR_NODE_FUNCTION_DECL:
+                {
+                    IR_Function_Decl* fun = &node->function;
+                    if(fun->export)
+                    {
+                        sb_append(&sb, "export ");
+                    }
+                    sb_appendf(&sb, "fun %s(", fun->name->str);
 
-                    if (i < arguments.count - 1)
+                    IR_Argument_Array arguments = fun->arguments;
+                    for (i32 i = 0; i < arguments.count; i++)
                     {
-                        sb_append(&sb, ", ");
+                        IR_Argument argument = arguments.arguments[i];
+                        Type_Specifier type = argument.type;
+                        String* name = argument.name;
+                        sb_appendf(&sb, "%s : %s", name->str, type_spec_to_string(type));
+
+                        if (i < arguments.count - 1)
+                        {
+                            sb_append(&sb, ", ");
+                        }
                     }
-                }
 
-                sb_append(&sb, ")\n");
-            }
-            break;
-            case IR_NODE_LABEL:
-            {
-                IR_Label* label = &node->label;
-                sb_appendf(&sb, "%s:", label->label_name->str);
-                sb_newline(&sb);
-            }
-            break;
-            case IR_NODE_INSTRUCTION:
-            {
-                IR_Instruction* instruction = &node->instruction;
-                IR_pretty_print_instruction(&sb, instruction, program);
-            }
-            break;
+                    sb_append(&sb, ")\n");
+                }
+                break;
+                case IR_NODE_LABEL:
+                {
+                    IR_Label* label = &node->label;
+                    sb_appendf(&sb, "%s:", label->label_name->str);
+                    sb_newline(&sb);
+                }
+                break;
+                case IR_NODE_INSTRUCTION:
+                {
+                    IR_Instruction* instruction = &node->instruction;
+                    IR_pretty_print_instruction(&sb, instruction, program);
+                }
+                break;
+                }
             }
         }
     }
@@ -13,6 +13,11 @@ typedef enum
     IR_INS_CALL,
     IR_INS_UNOP,
     IR_INS_COMPARE,
+    IR_INS_PHI,
+    IR_INS_ARGUMENT,
+    IR_INS_SET,
+    IR_INS_SELECT,
+    IR_INS_LEA,
     IR_INS_COUNT
 } IR_Instruction_Type;
 
@@ -21,6 +26,7 @@ struct IR_Register_Table
 {
     bool *inuse_table;
     i32 capacity;
+    i32 count; // Registers are never given back, so the ones in use are the first `count`
 };
 
 typedef enum
@@ -168,6 +174,7 @@ struct IR_Call
     i32 function_index;
     IR_Call_Arguments arguments;
     IR_Register return_register;
+    bool inline_considered; // Set once the inliner has decided on this call site
 };
 
 typedef struct IR_Label IR_Label;
@@ -245,15 +252,52 @@ struct IR_BinOp
     IR_Op operator;
 };
 
+/*
+Sets the condition codes for `left - right` and nothing else. They are read by the conditional jumps and
+sets that follow it in the same block, which carry the condition themselves.
+A literal on the left is emitted as `cmp $lit, right`, so it sets them for `right - lit` instead.
+ */
 typedef struct IR_Compare IR_Compare;
 struct IR_Compare
 {
     IR_Value left;
     IR_Location right; // @Note: This is an x86 restriction, should we really conform to that in the IR?
+};
 
+// Materializes `condition` of the last compare as 0 or 1
+typedef struct IR_Set IR_Set;
+struct IR_Set
+{
+    IR_Jump_Type condition;
     IR_Register destination;
+};
 
-    IR_Op operator;
+/*
+Picks `if_true` when `condition` of the last compare holds and `if_false` otherwise, without branching.
+Both operands are registers, x86 can only conditionally move from a register or memory.
+ */
+typedef struct IR_Select IR_Select;
+struct IR_Select
+{
+    IR_Jump_Type condition;
+    IR_Value if_true;
+    IR_Value if_false;
+    IR_Register destination;
+};
+
+/*
+Computes `base + index * scale + offset` into `destination` in one instruction (lea on x86), without
+touching memory or the condition codes. Only instruction selection creates these, out of additions and
+small multiplications (see X64_select_instructions). `base` and `index` are invalid when left out.
+ */
+typedef struct IR_Lea IR_Lea;
+struct IR_Lea
+{
+    IR_Register base;
+    IR_Register index;
+    i32 scale; // 1, 2, 4 or 8
+    i32 offset;
+    IR_Register destination;
 };
 
 typedef struct IR_UnOp IR_UnOp;
@@ -265,6 +309,39 @@ struct IR_UnOp
     IR_Op operator;
 };
 
+typedef struct IR_Phi_Operand IR_Phi_Operand;
+struct IR_Phi_Operand
+{
+    IR_Block_Address block; // Predecessor the value flows in from
+    IR_Value value;
+};
+
+/*
+A phi only exists while the program is in SSA form (see ir_ssa.c).
+`variable` is the register the phi was inserted for before renaming.
+ */
+typedef struct IR_Phi IR_Phi;
+struct IR_Phi
+{
+    IR_Register destination;
+    IR_Register variable;
+
+    IR_Phi_Operand* operands;
+    i32 count;
+    i32 capacity;
+};
+
+/*
+Reads argument `index` of the enclosing function. Every argument gets one at the start of the function
+entry, before anything else, so the backend can still find the arguments where the caller left them.
+ */
+typedef struct IR_Argument_Load IR_Argument_Load;
+struct IR_Argument_Load
+{
+    i32 index;
+    IR_Register destination;
+};
+
 typedef struct IR_Instruction IR_Instruction;
 struct IR_Instruction
 {
@@ -280,6 +357,11 @@ struct IR_Instruction
         IR_BinOp   binop;
         IR_UnOp    unop;
         IR_Compare compare;
+        IR_Phi     phi;
+        IR_Argument_Load argument;
+        IR_Set     set;
+        IR_Select  select;
+        IR_Lea     lea;
     };
 };
 
@@ -295,6 +377,7 @@ struct IR_Argument
 {
     Type_Specifier type;
     String* name;
+    IR_Register reg; // Defined by the IR_INS_ARGUMENT at the function entry
 };
 
 typedef struct IR_Argument_Array IR_Argument_Array;
@@ -305,6 +388,14 @@ struct IR_Argument_Array
     i32 capacity;
 };
 
+typedef struct IR_Block_Address_Array IR_Block_Address_Array;
+struct IR_Block_Address_Array
+{
+    IR_Block_Address* addresses;
+    i32 count;
+    i32 capacity;
+};
+
 typedef struct IR_Function_Decl IR_Function_Decl;
 struct IR_Function_Decl
 {
@@ -313,6 +404,13 @@ struct IR_Function_Decl
     b32 has_return_value;
     Type_Specifier return_type;
     bool export;
+    bool removed; // Deleted by dead code elimination or compiled on its own (see -stream), the index stays reserved
+    bool cold;    // Never ran according to the profile, see IR_layout_blocks
+
+    // Filled in by IR_build_cfg
+    IR_Block_Address entry;
+    IR_Block_Address_Array blocks;            // Layout order, kept across IR_build_cfg calls
+    IR_Block_Address_Array reverse_postorder; // Reachable blocks only
 };
 
 typedef struct IR_Node IR_Node;
@@ -347,6 +445,27 @@ struct IR_Block
 
     bool has_label;
 
+    i32 function_index;
+
+    // Control flow graph, filled in by IR_build_cfg
+    IR_Block_Address_Array predecessors;
+    IR_Block_Address_Array successors;
+    i32 layout_index;            // Index into the owning function's block list
+    i32 reverse_postorder_index; // -1 if unreachable from the function entry
+
+    // Dominator tree. The entry block is its own immediate dominator.
+    IR_Block_Address immediate_dominator;
+    IR_Block_Address_Array dominator_children;
+    IR_Block_Address_Array dominance_frontier;
+    i32 dominator_preorder;
+    i32 dominator_postorder;
+
+    // Filled in by IR_layout_blocks
+    i32 profile_index;   // Index of the block's profile counter within its function
+    u64 execution_count; // From the profile, or estimated from the branch probabilities
+    bool cold;
+    bool loop_header;    // Target of a back edge
+
     struct IR_Program* parent_program;
 };
 
@@ -365,14 +484,42 @@ struct IR_Function_Array
     i32 capacity;
 };
 
+// What calls can refer to, by name, in source order
+typedef struct IR_Signature_Table IR_Signature_Table;
+struct IR_Signature_Table
+{
+    IR_Function_Decl* signatures;
+    i32 count;
+    i32 capacity;
+
+    i32* slots; // Open addressing on the names, -1 for free
+    i32 slot_capacity;
+};
+
 typedef struct IR_Program IR_Program;
 struct IR_Program
 {
     IR_Data_Array data_array;
     IR_Block_Array block_array;
     IR_Function_Array function_array;
+    IR_Register_Table* register_table;
 
     i32 label_counter;
+
+    // Only set while a function is translated on its own (see IR_translate_program), or for all of -stream
+    IR_Signature_Table* signatures;
+    i32 signature_count; // What calls can refer to: every function before the one translated and itself
+};
+
+// One function, translated into a program of its own by a job
+typedef struct IR_Translation IR_Translation;
+struct IR_Translation
+{
+    AST_Node* declaration;
+    IR_Signature_Table* signatures; // Of every function in the file
+    i32 function_index;
+    Allocator* allocator;           // The heap for jobs
+    IR_Program fragment;
 };
 
 String* IR_pretty_print(IR_Program* program, Allocator* allocator);
@@ -380,5 +527,24 @@ void IR_pretty_print_register(String_Builder* sb, IR_Register* reg);
 void IR_pretty_print_location(String_Builder* sb, IR_Location* location);
 void IR_pretty_print_value(String_Builder* sb, IR_Value* value);
 IR_Block* IR_get_current_block(IR_Program* program);
+IR_Block* IR_get_block(IR_Program* program, IR_Block_Address address);
+void IR_add_block_address(IR_Block_Address_Array* array, IR_Block_Address address);
+void IR_insert_block_address(IR_Block_Address_Array* array, i32 index, IR_Block_Address address);
+IR_Node* IR_insert_node(IR_Block* block, i32 index, IR_Node_Type node_type);
+void IR_remove_node(IR_Block* block, i32 index);
+
+bool IR_register_is_valid(IR_Register reg);
+i32 IR_get_use_count(IR_Instruction* instruction);
+IR_Register* IR_get_use(IR_Instruction* instruction, i32 index);
+IR_Register* IR_get_definition(IR_Program* program, IR_Instruction* instruction);
+
+void IR_add_signature(IR_Signature_Table* table, String* name, b32 has_return_value);
+void IR_free_signatures(IR_Signature_Table* table);
+IR_Program IR_translate_declaration(AST_Node* declaration, IR_Signature_Table* signatures, i32 function_index, Allocator* allocator);
+void IR_free_program(IR_Program* program);
+
+const char* IR_condition_suffix(IR_Jump_Type condition);
+IR_Jump_Type IR_negate_condition(IR_Jump_Type condition);
+IR_Instruction* IR_find_flags(IR_Block* block, i32 index);
 
 #endif
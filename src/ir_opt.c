@@ -0,0 +1,3304 @@
+/* ======================
+   Shared helpers
+   ====================== */
+
+static void IR_remove_phi_operand(IR_Phi* phi, i32 index)
+{
+    memmove(&phi->operands[index], &phi->operands[index + 1], sizeof(IR_Phi_Operand) * (phi->count - index - 1));
+    phi->count--;
+}
+
+static i32 IR_instruction_index(IR_Block* block, IR_Instruction* instruction)
+{
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        if (&block->node_array.nodes[i].instruction == instruction) return i;
+    }
+    return -1;
+}
+
+static bool IR_reads_flags(IR_Instruction* instruction)
+{
+    return (instruction->type == IR_INS_JUMP && instruction->jump.type != JMP_ALWAYS) || instruction->type == IR_INS_SET || instruction->type == IR_INS_SELECT;
+}
+
+// A compare only sets the flags, so it is dead unless a conditional jump, a set or a select reads them
+static void IR_remove_unused_compares(IR_Block* block)
+{
+    bool flags_read = false;
+    for (i32 i = block->node_array.count - 1; i >= 0; i--)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION) continue;
+
+        IR_Instruction* instruction = &node->instruction;
+        if (IR_reads_flags(instruction))
+        {
+            flags_read = true;
+        }
+        else if (instruction->type == IR_INS_COMPARE)
+        {
+            if (!flags_read)
+            {
+                IR_remove_node(block, i);
+            }
+            flags_read = false;
+        }
+    }
+}
+
+/*
+Deletes every block that can no longer be reached from the entry of its function and drops the phi
+operands of edges that went away. A deleted block keeps its slot in the block array (block addresses
+are indices) but belongs to no function and has no nodes, so neither the CFG nor codegen see it.
+ */
+static void IR_remove_unreachable_blocks(IR_Program* program)
+{
+    IR_build_cfg(program);
+
+    bool removed = false;
+    for (i32 i = 0; i < program->block_array.count; i++)
+    {
+        IR_Block* block = &program->block_array.blocks[i];
+        if (block->function_index < 0 || block->reverse_postorder_index != -1) continue;
+
+        block->function_index = -1;
+        block->node_array.count = 0;
+        removed = true;
+    }
+
+    if (removed)
+    {
+        IR_build_cfg(program);
+    }
+
+    for (i32 i = 0; i < program->block_array.count; i++)
+    {
+        IR_Block* block = &program->block_array.blocks[i];
+        if (block->function_index < 0) continue;
+
+        for (i32 j = 0; j < IR_first_non_phi(block); j++)
+        {
+            if (!IR_is_phi(&block->node_array.nodes[j])) continue;
+
+            IR_Phi* phi = &block->node_array.nodes[j].instruction.phi;
+            for (i32 k = 0; k < phi->count; k++)
+            {
+                if (!IR_address_array_contains(&block->predecessors, phi->operands[k].block))
+                {
+                    IR_remove_phi_operand(phi, k--);
+                }
+            }
+        }
+    }
+}
+
+/* ======================
+   Sparse conditional constant propagation
+   ====================== */
+
+typedef enum
+{
+    BRANCH_UNDEFINED, // The compare reads registers that have no value yet
+    BRANCH_TAKEN,
+    BRANCH_NOT_TAKEN,
+    BRANCH_UNKNOWN
+} IR_Branch_Outcome;
+
+typedef struct IR_Use_Site IR_Use_Site;
+struct IR_Use_Site
+{
+    i32 block; // Layout index
+    i32 node;
+};
+
+typedef struct IR_SCCP IR_SCCP;
+struct IR_SCCP
+{
+    IR_Program* program;
+    IR_Function_Decl* function;
+    IR_Register_Map* map;
+
+    IR_Lattice_Value* values; // By local register index
+
+    // Uses of local register i are uses[use_offsets[i]] up to uses[use_offsets[i + 1]]
+    i32* use_offsets;
+    IR_Use_Site* uses;
+
+    bool* block_executable; // By layout index
+
+    // Edge j out of the block with layout index i is edge edge_offsets[i] + j
+    i32* edge_offsets;
+    i32* edge_from;
+    bool* edge_executable;
+
+    i32* edge_worklist;
+    i32 edge_worklist_count;
+
+    i32* register_worklist;
+    i32 register_worklist_count;
+};
+
+static IR_Lattice_Value IR_lattice_constant(i32 constant)
+{
+    return (IR_Lattice_Value) { .type = LATTICE_CONSTANT, .constant = constant };
+}
+
+static IR_Lattice_Value IR_lattice_varying()
+{
+    return (IR_Lattice_Value) { .type = LATTICE_VARYING };
+}
+
+static IR_Lattice_Value IR_lattice_undefined()
+{
+    return (IR_Lattice_Value) { .type = LATTICE_UNDEFINED };
+}
+
+static IR_Lattice_Value IR_sccp_get_value(IR_SCCP* sccp, IR_Value* value)
+{
+    if (value->type == VALUE_INT)
+    {
+        return IR_lattice_constant(value->integer);
+    }
+
+    IR_Register* reg = IR_get_value_register(value);
+    i32 local = reg ? IR_register_map_find(sccp->map, *reg) : -1;
+    return local == -1 ? IR_lattice_varying() : sccp->values[local];
+}
+
+static void IR_sccp_set_value(IR_SCCP* sccp, IR_Register reg, IR_Lattice_Value value)
+{
+    i32 local = IR_register_map_find(sccp->map, reg);
+    IR_Lattice_Value* current = &sccp->values[local];
+
+    if (current->type == LATTICE_VARYING || value.type == LATTICE_UNDEFINED)
+    {
+        return;
+    }
+
+    if (current->type == LATTICE_CONSTANT)
+    {
+        if (value.type == LATTICE_CONSTANT && value.constant == current->constant)
+        {
+            return;
+        }
+        value = IR_lattice_varying();
+    }
+
+    // @Note: A register can only be lowered twice, so the worklist never needs more than twice the registers
+    *current = value;
+    sccp->register_worklist[sccp->register_worklist_count++] = local;
+}
+
+/*
+Only fold what the x86 backend would compute the same way: it works on 64 bit registers,
+so anything that would overflow an i32 is left alone, and it divides unsigned.
+ */
+static IR_Lattice_Value IR_fold_binop(IR_Op operator, i32 left, i32 right)
+{
+    i64 result = 0;
+    switch(operator)
+    {
+    case OP_ADD: result = (i64)left + right; break;
+    case OP_SUB: result = (i64)left - right; break;
+    case OP_MUL: result = (i64)left * right; break;
+    case OP_BIT_AND: result = left & right; break;
+    case OP_BIT_OR: result = left | right; break;
+    case OP_DIV:
+    {
+        if (left < 0 || right <= 0)
+        {
+            return IR_lattice_varying();
+        }
+        result = left / right;
+    }
+    break;
+    default: return IR_lattice_varying();
+    }
+
+    if (result < INT32_MIN || result > INT32_MAX)
+    {
+        return IR_lattice_varying();
+    }
+    return IR_lattice_constant((i32)result);
+}
+
+static bool IR_sccp_edge_is_executable(IR_SCCP* sccp, IR_Block_Address from, IR_Block_Address to)
+{
+    IR_Block* block = IR_get_block(sccp->program, from);
+    if (block->function_index < 0 || block->layout_index == -1)
+    {
+        return false;
+    }
+
+    for (i32 i = 0; i < block->successors.count; i++)
+    {
+        if (block->successors.addresses[i].address == to.address)
+        {
+            return sccp->edge_executable[sccp->edge_offsets[block->layout_index] + i];
+        }
+    }
+    return false;
+}
+
+static void IR_sccp_mark_edge(IR_SCCP* sccp, IR_Block* from, IR_Block_Address to)
+{
+    for (i32 i = 0; i < from->successors.count; i++)
+    {
+        if (from->successors.addresses[i].address != to.address) continue;
+
+        i32 edge = sccp->edge_offsets[from->layout_index] + i;
+        if (!sccp->edge_executable[edge])
+        {
+            sccp->edge_executable[edge] = true;
+            sccp->edge_worklist[sccp->edge_worklist_count++] = edge;
+        }
+        return;
+    }
+}
+
+static IR_Branch_Outcome IR_sccp_evaluate_jump(IR_SCCP* sccp, IR_Compare* compare, IR_Jump_Type jump_type)
+{
+    if (!compare)
+    {
+        return BRANCH_UNKNOWN;
+    }
+
+    IR_Value right_value = IR_create_value_location(compare->right);
+    IR_Lattice_Value left = IR_sccp_get_value(sccp, &compare->left);
+    IR_Lattice_Value right = IR_sccp_get_value(sccp, &right_value);
+
+    if (left.type == LATTICE_VARYING || right.type == LATTICE_VARYING)
+    {
+        return BRANCH_UNKNOWN;
+    }
+
+    if (left.type == LATTICE_UNDEFINED || right.type == LATTICE_UNDEFINED)
+    {
+        return BRANCH_UNDEFINED;
+    }
+
+    // @Note: A literal on the left is emitted as `cmp $lit, right`, which sets the flags for right - lit,
+    // while a register on the left sets them for left - right.
+    i32 a = left.constant;
+    i32 b = right.constant;
+    if (compare->left.type == VALUE_INT)
+    {
+        a = right.constant;
+        b = left.constant;
+    }
+
+    bool taken = false;
+    switch(jump_type)
+    {
+    case JMP_ALWAYS:        taken = true;   break;
+    case JMP_EQUAL:
+    case JMP_ZERO:          taken = a == b; break;
+    case JMP_NOT_EQUAL:
+    case JMP_NOT_ZERO:      taken = a != b; break;
+    case JMP_LESS:          taken = a < b;  break;
+    case JMP_LESS_EQUAL:    taken = a <= b; break;
+    case JMP_GREATER:       taken = a > b;  break;
+    case JMP_GREATER_EQUAL: taken = a >= b; break;
+    }
+
+    return taken ? BRANCH_TAKEN : BRANCH_NOT_TAKEN;
+}
+
+static void IR_sccp_visit_branches(IR_SCCP* sccp, IR_Block* block)
+{
+    IR_Compare* compare = NULL;
+
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION) continue;
+
+        IR_Instruction* instruction = &node->instruction;
+        if (instruction->type == IR_INS_COMPARE)
+        {
+            compare = &instruction->compare;
+        }
+        else if (instruction->type == IR_INS_RET)
+        {
+            return;
+        }
+        else if (instruction->type == IR_INS_JUMP)
+        {
+            IR_Jump* jump = &instruction->jump;
+            IR_Branch_Outcome outcome = jump->type == JMP_ALWAYS ? BRANCH_TAKEN : IR_sccp_evaluate_jump(sccp, compare, jump->type);
+
+            switch(outcome)
+            {
+            case BRANCH_UNDEFINED: return; // Wait until the compare has operands
+            case BRANCH_TAKEN:
+            {
+                IR_sccp_mark_edge(sccp, block, jump->address);
+                return;
+            }
+            case BRANCH_NOT_TAKEN: break;
+            case BRANCH_UNKNOWN:
+            {
+                IR_sccp_mark_edge(sccp, block, jump->address);
+            }
+            break;
+            }
+        }
+    }
+
+    IR_Block_Address_Array* blocks = &sccp->function->blocks;
+    if (block->layout_index + 1 < blocks->count)
+    {
+        IR_sccp_mark_edge(sccp, block, blocks->addresses[block->layout_index + 1]);
+    }
+}
+
+static void IR_sccp_visit_instruction(IR_SCCP* sccp, IR_Block* block, IR_Instruction* instruction)
+{
+    IR_Register* definition = IR_get_definition(sccp->program, instruction);
+    if (!definition || !IR_register_is_valid(*definition))
+    {
+        return;
+    }
+
+    IR_Lattice_Value result = IR_lattice_varying();
+    switch(instruction->type)
+    {
+    case IR_INS_MOV:
+    {
+        result = IR_sccp_get_value(sccp, &instruction->move.src);
+    }
+    break;
+    case IR_INS_BINOP:
+    {
+        IR_BinOp* binop = &instruction->binop;
+        IR_Lattice_Value left = IR_sccp_get_value(sccp, &binop->left);
+        IR_Lattice_Value right = IR_sccp_get_value(sccp, &binop->right);
+
+        if (left.type == LATTICE_VARYING || right.type == LATTICE_VARYING)
+        {
+            result = IR_lattice_varying();
+        }
+        else if (left.type == LATTICE_UNDEFINED || right.type == LATTICE_UNDEFINED)
+        {
+            result = IR_lattice_undefined();
+        }
+        else
+        {
+            result = IR_fold_binop(binop->operator, left.constant, right.constant);
+        }
+    }
+    break;
+    case IR_INS_UNOP:
+    {
+        IR_UnOp* unop = &instruction->unop;
+        IR_Lattice_Value value = IR_sccp_get_value(sccp, &unop->value);
+
+        // @Note: The backend negates for every unary operator, so only negation is folded
+        if (value.type != LATTICE_CONSTANT || unop->operator != OP_SUB)
+        {
+            result = value.type == LATTICE_UNDEFINED ? value : IR_lattice_varying();
+        }
+        else
+        {
+            result = value.constant == INT32_MIN ? IR_lattice_varying() : IR_lattice_constant(-value.constant);
+        }
+    }
+    break;
+    case IR_INS_SET:
+    {
+        IR_Instruction* flags = IR_find_flags(block, IR_instruction_index(block, instruction));
+        switch(IR_sccp_evaluate_jump(sccp, flags ? &flags->compare : NULL, instruction->set.condition))
+        {
+        case BRANCH_UNDEFINED: result = IR_lattice_undefined(); break;
+        case BRANCH_TAKEN:     result = IR_lattice_constant(1); break;
+        case BRANCH_NOT_TAKEN: result = IR_lattice_constant(0); break;
+        case BRANCH_UNKNOWN:   result = IR_lattice_varying();   break;
+        }
+    }
+    break;
+    case IR_INS_SELECT:
+    {
+        IR_Select* select = &instruction->select;
+        IR_Lattice_Value if_true = IR_sccp_get_value(sccp, &select->if_true);
+        IR_Lattice_Value if_false = IR_sccp_get_value(sccp, &select->if_false);
+
+        IR_Instruction* flags = IR_find_flags(block, IR_instruction_index(block, instruction));
+        switch(IR_sccp_evaluate_jump(sccp, flags ? &flags->compare : NULL, select->condition))
+        {
+        case BRANCH_UNDEFINED: result = IR_lattice_undefined(); break;
+        case BRANCH_TAKEN:     result = if_true;                break;
+        case BRANCH_NOT_TAKEN: result = if_false;               break;
+        case BRANCH_UNKNOWN:
+        {
+            // Either operand can come out, so it is only constant if they agree
+            if (if_true.type == LATTICE_UNDEFINED || if_false.type == LATTICE_UNDEFINED)
+            {
+                result = if_true.type == LATTICE_UNDEFINED ? if_false : if_true;
+            }
+            else if (if_true.type == LATTICE_CONSTANT && if_false.type == LATTICE_CONSTANT && if_true.constant == if_false.constant)
+            {
+                result = if_true;
+            }
+        }
+        break;
+        }
+    }
+    break;
+    case IR_INS_PHI:
+    {
+        IR_Phi* phi = &instruction->phi;
+        result = IR_lattice_undefined();
+
+        for (i32 i = 0; i < phi->count && result.type != LATTICE_VARYING; i++)
+        {
+            if (!IR_sccp_edge_is_executable(sccp, phi->operands[i].block, block->block_address)) continue;
+
+            IR_Lattice_Value value = IR_sccp_get_value(sccp, &phi->operands[i].value);
+            if (value.type == LATTICE_UNDEFINED) continue;
+
+            if (result.type == LATTICE_UNDEFINED)
+            {
+                result = value;
+            }
+            else if (value.type == LATTICE_VARYING || value.constant != result.constant)
+            {
+                result = IR_lattice_varying();
+            }
+        }
+    }
+    break;
+    default: break;
+    }
+
+    IR_sccp_set_value(sccp, *definition, result);
+}
+
+static void IR_sccp_visit_block(IR_SCCP* sccp, IR_Block* block)
+{
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION) continue;
+
+        IR_sccp_visit_instruction(sccp, block, &node->instruction);
+        if (IR_is_terminator(node)) break;
+    }
+
+    IR_sccp_visit_branches(sccp, block);
+}
+
+static void IR_sccp_solve(IR_SCCP* sccp)
+{
+    IR_Program* program = sccp->program;
+    IR_Block_Address_Array* blocks = &sccp->function->blocks;
+
+    IR_Block* entry = IR_get_block(program, sccp->function->entry);
+    sccp->block_executable[entry->layout_index] = true;
+    IR_sccp_visit_block(sccp, entry);
+
+    while (sccp->edge_worklist_count > 0 || sccp->register_worklist_count > 0)
+    {
+        if (sccp->edge_worklist_count > 0)
+        {
+            i32 edge = sccp->edge_worklist[--sccp->edge_worklist_count];
+            i32 from = sccp->edge_from[edge];
+            IR_Block* from_block = IR_get_block(program, blocks->addresses[from]);
+            IR_Block* block = IR_get_block(program, from_block->successors.addresses[edge - sccp->edge_offsets[from]]);
+
+            if (!sccp->block_executable[block->layout_index])
+            {
+                sccp->block_executable[block->layout_index] = true;
+                IR_sccp_visit_block(sccp, block);
+            }
+            else
+            {
+                // Only the phis can see the new edge
+                for (i32 i = 0; i < IR_first_non_phi(block); i++)
+                {
+                    if (IR_is_phi(&block->node_array.nodes[i]))
+                    {
+                        IR_sccp_visit_instruction(sccp, block, &block->node_array.nodes[i].instruction);
+                    }
+                }
+            }
+            continue;
+        }
+
+        i32 local = sccp->register_worklist[--sccp->register_worklist_count];
+        for (i32 i = sccp->use_offsets[local]; i < sccp->use_offsets[local + 1]; i++)
+        {
+            IR_Use_Site site = sccp->uses[i];
+            if (!sccp->block_executable[site.block]) continue;
+
+            IR_Block* block = IR_get_block(program, blocks->addresses[site.block]);
+            IR_Instruction* instruction = &block->node_array.nodes[site.node].instruction;
+
+            if (instruction->type == IR_INS_COMPARE)
+            {
+                IR_sccp_visit_branches(sccp, block);
+
+                // Sets and selects read the flags as well
+                for (i32 j = site.node + 1; j < block->node_array.count; j++)
+                {
+                    IR_Node* node = &block->node_array.nodes[j];
+                    if (node->type != IR_NODE_INSTRUCTION) continue;
+                    if (node->instruction.type == IR_INS_COMPARE) break;
+
+                    if (node->instruction.type == IR_INS_SET || node->instruction.type == IR_INS_SELECT)
+                    {
+                        IR_sccp_visit_instruction(sccp, block, &node->instruction);
+                    }
+                }
+            }
+            else
+            {
+                IR_sccp_visit_instruction(sccp, block, instruction);
+            }
+        }
+    }
+}
+
+static void IR_sccp_rewrite_constants(IR_SCCP* sccp, IR_Block* block)
+{
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION) continue;
+
+        IR_Instruction* instruction = &node->instruction;
+        switch(instruction->type)
+        {
+        case IR_INS_MOV:
+        {
+            if (instruction->move.src.type == VALUE_INT) continue;
+        }
+        break;
+        case IR_INS_CALL:
+        {
+            // Constant arguments are passed as immediates, so they do not tie up a register until the call
+            IR_Call_Arguments* arguments = &instruction->call.arguments;
+            for (i32 j = 0; j < arguments->count; j++)
+            {
+                IR_Register* use = IR_get_use(instruction, j);
+                if (!use) continue;
+
+                IR_Lattice_Value value = sccp->values[IR_register_map_find(sccp->map, *use)];
+                if (value.type == LATTICE_CONSTANT)
+                {
+                    arguments->values[j] = IR_create_value_number(value.constant);
+                }
+            }
+        }
+        continue;
+        case IR_INS_BINOP:
+        case IR_INS_UNOP:
+        case IR_INS_PHI:
+        case IR_INS_SET:
+        case IR_INS_SELECT:
+        break;
+        default: continue;
+        }
+
+        IR_Register* definition = IR_get_definition(sccp->program, instruction);
+        if (!definition || !IR_register_is_valid(*definition)) continue;
+
+        IR_Register reg = *definition;
+
+        IR_Lattice_Value value = sccp->values[IR_register_map_find(sccp->map, reg)];
+        if (value.type != LATTICE_CONSTANT) continue;
+
+        if (instruction->type == IR_INS_PHI)
+        {
+            // @Note: Phis have to stay at the top of the block, so the move goes in after them
+            mem_free(instruction->phi.operands);
+            IR_remove_node(block, i);
+            IR_insert_move(block, IR_first_non_phi(block), IR_create_value_number(value.constant), reg);
+            i--;
+        }
+        else
+        {
+            instruction->type = IR_INS_MOV;
+            instruction->move.src = IR_create_value_number(value.constant);
+            instruction->move.dst = IR_create_location_register(reg);
+        }
+    }
+}
+
+static void IR_sccp_resolve_branches(IR_SCCP* sccp, IR_Block* block)
+{
+    IR_Compare* compare = NULL;
+
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION) continue;
+
+        IR_Instruction* instruction = &node->instruction;
+        if (instruction->type == IR_INS_COMPARE)
+        {
+            compare = &instruction->compare;
+            continue;
+        }
+
+        if (instruction->type == IR_INS_SELECT)
+        {
+            // A select on a known condition is a copy of the operand it picks
+            IR_Select select = instruction->select;
+            IR_Branch_Outcome outcome = IR_sccp_evaluate_jump(sccp, compare, select.condition);
+            if (outcome == BRANCH_TAKEN || outcome == BRANCH_NOT_TAKEN)
+            {
+                instruction->type = IR_INS_MOV;
+                instruction->move.src = outcome == BRANCH_TAKEN ? select.if_true : select.if_false;
+                instruction->move.dst = IR_create_location_register(select.destination);
+            }
+            continue;
+        }
+
+        if (instruction->type != IR_INS_JUMP) continue;
+
+        IR_Branch_Outcome outcome = instruction->jump.type == JMP_ALWAYS ? BRANCH_TAKEN : IR_sccp_evaluate_jump(sccp, compare, instruction->jump.type);
+        if (outcome == BRANCH_TAKEN)
+        {
+            // Nothing after this jump can run
+            instruction->jump.type = JMP_ALWAYS;
+            block->node_array.count = i + 1;
+            break;
+        }
+        else if (outcome == BRANCH_NOT_TAKEN)
+        {
+            IR_remove_node(block, i--);
+        }
+    }
+
+    IR_remove_unused_compares(block);
+}
+
+static void IR_sccp_function(IR_Program* program, IR_Function_Decl* function, IR_Register_Map* map)
+{
+    if (function->reverse_postorder.count == 0)
+    {
+        return;
+    }
+
+    IR_register_map_clear(map);
+    IR_map_function_registers(program, function, map);
+
+    IR_SCCP sccp = {0};
+    sccp.program = program;
+    sccp.function = function;
+    sccp.map = map;
+
+    i32 register_count = map->count;
+    i32 block_count = function->blocks.count;
+
+    // Registers without a definition in the function can hold anything
+    sccp.values = mem_alloc(sizeof(IR_Lattice_Value) * (register_count + 1));
+    sccp.use_offsets = mem_calloc(register_count + 1, sizeof(i32));
+    for (i32 i = 0; i < register_count; i++)
+    {
+        sccp.values[i] = IR_lattice_varying();
+    }
+
+    i32 use_count = 0;
+    i32 edge_count = 0;
+    for (i32 i = 0; i < block_count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        edge_count += block->successors.count;
+
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            IR_Register* definition = IR_get_definition(program, instruction);
+            if (definition && IR_register_is_valid(*definition))
+            {
+                sccp.values[IR_register_map_find(map, *definition)] = IR_lattice_undefined();
+            }
+
+            for (i32 k = 0; k < IR_get_use_count(instruction); k++)
+            {
+                IR_Register* use = IR_get_use(instruction, k);
+                if (use)
+                {
+                    sccp.use_offsets[IR_register_map_find(map, *use) + 1]++;
+                    use_count++;
+                }
+            }
+
+            if (IR_is_terminator(node)) break;
+        }
+    }
+
+    for (i32 i = 0; i < register_count; i++)
+    {
+        sccp.use_offsets[i + 1] += sccp.use_offsets[i];
+    }
+
+    sccp.uses = mem_alloc(sizeof(IR_Use_Site) * (use_count + 1));
+    i32* use_cursor = mem_alloc(sizeof(i32) * (register_count + 1));
+    memcpy(use_cursor, sccp.use_offsets, sizeof(i32) * (register_count + 1));
+
+    sccp.edge_offsets = mem_alloc(sizeof(i32) * (block_count + 1));
+    sccp.edge_from = mem_alloc(sizeof(i32) * (edge_count + 1));
+    sccp.edge_executable = mem_calloc(edge_count + 1, sizeof(bool));
+    sccp.edge_worklist = mem_alloc(sizeof(i32) * (edge_count + 1));
+    sccp.block_executable = mem_calloc(block_count, sizeof(bool));
+    sccp.register_worklist = mem_alloc(sizeof(i32) * (register_count * 2 + 1));
+
+    i32 edge = 0;
+    for (i32 i = 0; i < block_count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        sccp.edge_offsets[i] = edge;
+        for (i32 j = 0; j < block->successors.count; j++)
+        {
+            sccp.edge_from[edge++] = i;
+        }
+
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            for (i32 k = 0; k < IR_get_use_count(instruction); k++)
+            {
+                IR_Register* use = IR_get_use(instruction, k);
+                if (use)
+                {
+                    IR_Use_Site site = { .block = i, .node = j };
+                    sccp.uses[use_cursor[IR_register_map_find(map, *use)]++] = site;
+                }
+            }
+
+            if (IR_is_terminator(node)) break;
+        }
+    }
+
+    IR_sccp_solve(&sccp);
+
+    for (i32 i = 0; i < block_count; i++)
+    {
+        if (!sccp.block_executable[i]) continue;
+
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        IR_sccp_rewrite_constants(&sccp, block);
+        IR_sccp_resolve_branches(&sccp, block);
+    }
+
+    mem_free(sccp.values);
+    mem_free(sccp.use_offsets);
+    mem_free(sccp.uses);
+    mem_free(use_cursor);
+    mem_free(sccp.edge_offsets);
+    mem_free(sccp.edge_from);
+    mem_free(sccp.edge_executable);
+    mem_free(sccp.edge_worklist);
+    mem_free(sccp.block_executable);
+    mem_free(sccp.register_worklist);
+}
+
+void IR_sccp(IR_Program* program)
+{
+    IR_build_cfg(program);
+
+    IR_Register_Map map;
+    IR_register_map_init(&map, program);
+
+    for (i32 i = 0; i < program->function_array.count; i++)
+    {
+        IR_sccp_function(program, program->function_array.functions[i], &map);
+    }
+
+    IR_register_map_free(&map);
+
+    // Resolved jumps can leave whole regions without predecessors
+    IR_remove_unreachable_blocks(program);
+}
+
+/* ======================
+   Global value numbering
+   ====================== */
+
+#define GVN_CONSTANT_BIT ((i64)1 << 40)
+// Instructions up the dominator path a value may be reused over when that keeps it alive longer
+#define GVN_REUSE_DISTANCE 32
+
+typedef enum
+{
+    GVN_BINOP,
+    GVN_UNOP
+} IR_GVN_Kind;
+
+typedef struct IR_GVN_Entry IR_GVN_Entry;
+struct IR_GVN_Entry
+{
+    IR_GVN_Kind kind;
+    IR_Op operator;
+    i64 left;
+    i64 right;
+
+    i32 leader; // Local index of the register holding the value
+    i32 next;   // Next entry in the same bucket, -1 if none
+    u64 hash;
+
+    i32 position; // Of the leader on the dominator path, see IR_GVN
+    i32 calls;    // Calls on the dominator path before the leader
+};
+
+typedef struct IR_GVN IR_GVN;
+struct IR_GVN
+{
+    IR_Program* program;
+    IR_Register_Map* map;
+
+    // Value number by local register index. Registers are numbered by the local index of their leader,
+    // registers holding a literal by the literal tagged with GVN_CONSTANT_BIT.
+    i64* value_numbers;
+    IR_Register* replacements; // By local register index, the register every use should read instead
+
+    // Chained hash table whose entries form a stack, so leaving a dominator subtree just pops
+    // the entries it pushed: they are always the heads of their buckets.
+    i32* buckets;
+    i32 bucket_count;
+    IR_GVN_Entry* entries;
+    i32 entry_count;
+    i32 entry_capacity;
+
+    /* @Note:
+       Reusing a value keeps it alive until the reuse, and the backend only has seven scratch registers
+       before it spills. That costs nothing when the leader is read after the reuse anyway, or when an
+       operand of the expression is not and the leader is in the same block: the leader then takes over
+       the register the operand held up to here. Otherwise a value is not reused across a call, where it
+       would need a callee-saved register, or from more than GVN_REUSE_DISTANCE instructions up the
+       dominator path. The expression is computed again there and becomes the leader for what comes
+       after it.
+     */
+    i32 position; // Instructions on the dominator path to the one being visited
+    i32 calls;    // Calls among them
+
+    IR_Liveness liveness;
+    IR_Register_Set* live_out;   // Of the block being visited
+    i32 block_index;             // Its layout index
+    i32 block_position;          // Position before its first instruction
+    i32* last_use;               // By local register index, position of the last instruction of the block that reads it
+    i32* last_use_block;         // Layout index of the block `last_use` is about
+    i32* replaced_next;          // By local register index, the next register replaced by the same one, -1 at the end
+};
+
+static u64 IR_gvn_hash(IR_GVN_Kind kind, IR_Op operator, i64 left, i64 right)
+{
+    u64 hash = 14695981039346656037ULL;
+    u64 parts[4] = { (u64)kind, (u64)operator, (u64)left, (u64)right };
+    for (i32 i = 0; i < 4; i++)
+    {
+        hash ^= parts[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static IR_GVN_Entry* IR_gvn_find(IR_GVN* gvn, IR_GVN_Kind kind, IR_Op operator, i64 left, i64 right, u64 hash)
+{
+    for (i32 i = gvn->buckets[hash % gvn->bucket_count]; i != -1; i = gvn->entries[i].next)
+    {
+        IR_GVN_Entry* entry = &gvn->entries[i];
+        if (entry->hash == hash && entry->kind == kind && entry->operator == operator && entry->left == left && entry->right == right)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void IR_gvn_push(IR_GVN* gvn, IR_GVN_Kind kind, IR_Op operator, i64 left, i64 right, u64 hash, i32 leader)
+{
+    if (gvn->entry_count + 1 > gvn->entry_capacity)
+    {
+        gvn->entry_capacity = gvn->entry_capacity == 0 ? 256 : gvn->entry_capacity * 2;
+        gvn->entries = mem_realloc(gvn->entries, sizeof(IR_GVN_Entry) * gvn->entry_capacity);
+    }
+
+    i32 bucket = hash % gvn->bucket_count;
+    IR_GVN_Entry* entry = &gvn->entries[gvn->entry_count];
+    entry->kind = kind;
+    entry->operator = operator;
+    entry->left = left;
+    entry->right = right;
+    entry->hash = hash;
+    entry->leader = leader;
+    entry->position = gvn->position;
+    entry->calls = gvn->calls;
+    entry->next = gvn->buckets[bucket];
+    gvn->buckets[bucket] = gvn->entry_count++;
+}
+
+static void IR_gvn_pop(IR_GVN* gvn, i32 entry_mark)
+{
+    while (gvn->entry_count > entry_mark)
+    {
+        IR_GVN_Entry* entry = &gvn->entries[--gvn->entry_count];
+        gvn->buckets[entry->hash % gvn->bucket_count] = entry->next;
+    }
+}
+
+static void IR_gvn_replace_uses(IR_GVN* gvn, IR_Instruction* instruction)
+{
+    for (i32 i = 0; i < IR_get_use_count(instruction); i++)
+    {
+        IR_Register* use = IR_get_use(instruction, i);
+        i32 local = use ? IR_register_map_find(gvn->map, *use) : -1;
+        if (local != -1)
+        {
+            *use = gvn->replacements[local];
+        }
+    }
+}
+
+static i64 IR_gvn_value_number(IR_GVN* gvn, IR_Value* value)
+{
+    if (value->type == VALUE_INT)
+    {
+        return GVN_CONSTANT_BIT | (u32)value->integer;
+    }
+
+    IR_Register* reg = IR_get_value_register(value);
+    i32 local = reg ? IR_register_map_find(gvn->map, *reg) : -1;
+    return local == -1 ? -1 : gvn->value_numbers[local];
+}
+
+// Whether nothing after the instruction at `position` reads the register at `local`, or one replaced by it
+static bool IR_gvn_dies_at(IR_GVN* gvn, i32 local, i32 position)
+{
+    for (i32 i = local; i != -1; i = gvn->replaced_next[i])
+    {
+        if (IR_register_set_contains(gvn->live_out, i)) return false;
+        if (gvn->last_use_block[i] == gvn->block_index && gvn->last_use[i] > position) return false;
+    }
+    return true;
+}
+
+static void IR_gvn_replace(IR_GVN* gvn, i32 local, i32 replacement)
+{
+    gvn->value_numbers[local] = gvn->value_numbers[replacement];
+    gvn->replacements[local] = gvn->map->registers[replacement];
+    gvn->replaced_next[local] = gvn->replaced_next[replacement];
+    gvn->replaced_next[replacement] = local;
+}
+
+// Whether reusing `leader` for the instruction being visited keeps no more registers alive than computing it again
+static bool IR_gvn_reuse_is_free(IR_GVN* gvn, IR_Instruction* instruction, IR_GVN_Entry* leader)
+{
+    if (!IR_gvn_dies_at(gvn, leader->leader, gvn->position)) return true;
+
+    // In another block the operand can still be needed on the paths that do not lead here
+    if (leader->position <= gvn->block_position) return false;
+
+    for (i32 i = 0; i < IR_get_use_count(instruction); i++)
+    {
+        IR_Register* use = IR_get_use(instruction, i);
+        i32 local = use ? IR_register_map_find(gvn->map, *use) : -1;
+
+        // A literal is moved into a register of its own right before it is used, the leader read another one
+        if (local == -1 || gvn->value_numbers[local] & GVN_CONSTANT_BIT) continue;
+        if (IR_gvn_dies_at(gvn, local, gvn->position)) return true;
+    }
+    return false;
+}
+
+static bool IR_is_commutative(IR_Op operator)
+{
+    return operator == OP_ADD || operator == OP_MUL;
+}
+
+// Returns true if the instruction was removed
+static bool IR_gvn_visit_instruction(IR_GVN* gvn, IR_Instruction* instruction)
+{
+    IR_gvn_replace_uses(gvn, instruction);
+
+    IR_Register* definition = IR_get_definition(gvn->program, instruction);
+    if (!definition || !IR_register_is_valid(*definition))
+    {
+        return false;
+    }
+
+    i32 local = IR_register_map_find(gvn->map, *definition);
+    IR_GVN_Kind kind;
+    IR_Op operator;
+    i64 left = 0;
+    i64 right = 0;
+
+    switch(instruction->type)
+    {
+    case IR_INS_MOV:
+    {
+        IR_Value* src = &instruction->move.src;
+        if (src->type == VALUE_INT)
+        {
+            // @Note: Literals are cheaper to materialize again than to keep alive in a register,
+            // so they only get a value number and the move stays.
+            gvn->value_numbers[local] = IR_gvn_value_number(gvn, src);
+            return false;
+        }
+
+        IR_Register* reg = IR_get_value_register(src);
+        i32 src_local = reg ? IR_register_map_find(gvn->map, *reg) : -1;
+        if (src_local == -1)
+        {
+            return false;
+        }
+
+        // Plain copy, every use can read the source instead
+        IR_gvn_replace(gvn, local, src_local);
+        return true;
+    }
+    case IR_INS_BINOP:
+    {
+        kind = GVN_BINOP;
+        operator = instruction->binop.operator;
+        left = IR_gvn_value_number(gvn, &instruction->binop.left);
+        right = IR_gvn_value_number(gvn, &instruction->binop.right);
+        if (IR_is_commutative(operator) && left > right)
+        {
+            i64 temp = left;
+            left = right;
+            right = temp;
+        }
+    }
+    break;
+    case IR_INS_UNOP:
+    {
+        kind = GVN_UNOP;
+        operator = instruction->unop.operator;
+        left = IR_gvn_value_number(gvn, &instruction->unop.value);
+    }
+    break;
+    default: return false;
+    }
+
+    if (left == -1 || right == -1)
+    {
+        return false;
+    }
+
+    u64 hash = IR_gvn_hash(kind, operator, left, right);
+    IR_GVN_Entry* found = IR_gvn_find(gvn, kind, operator, left, right, hash);
+    bool nearby = found && found->calls == gvn->calls && gvn->position - found->position <= GVN_REUSE_DISTANCE;
+    if (found && (nearby || IR_gvn_reuse_is_free(gvn, instruction, found)))
+    {
+        // @Note: The table only holds values computed in dominating blocks, so the leader is available here
+        IR_gvn_replace(gvn, local, found->leader);
+        return true;
+    }
+
+    IR_gvn_push(gvn, kind, operator, left, right, hash, local);
+    return false;
+}
+
+static void IR_gvn_visit_block(IR_GVN* gvn, IR_Block* block)
+{
+    gvn->live_out = &gvn->liveness.live_out[block->layout_index];
+    gvn->block_index = block->layout_index;
+    gvn->block_position = gvn->position;
+
+    // Numbered like gvn->position counts them below, removing nodes does not change it
+    i32 position = gvn->position;
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION || IR_is_phi(node)) continue;
+
+        position++;
+        for (i32 j = 0; j < IR_get_use_count(&node->instruction); j++)
+        {
+            IR_Register* use = IR_get_use(&node->instruction, j);
+            i32 local = use ? IR_register_map_find(gvn->map, *use) : -1;
+            if (local == -1) continue;
+
+            gvn->last_use[local] = position;
+            gvn->last_use_block[local] = block->layout_index;
+        }
+    }
+
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION || IR_is_phi(node)) continue;
+
+        gvn->position++;
+        if (IR_gvn_visit_instruction(gvn, &node->instruction))
+        {
+            IR_remove_node(block, i--);
+        }
+        else if (node->instruction.type == IR_INS_CALL)
+        {
+            gvn->calls++;
+        }
+    }
+}
+
+static void IR_gvn_function(IR_GVN* gvn, IR_Function_Decl* function)
+{
+    IR_Program* program = gvn->program;
+    IR_Block_Address_Array* rpo = &function->reverse_postorder;
+    if (rpo->count == 0)
+    {
+        return;
+    }
+
+    IR_Register_Map* map = gvn->map;
+    IR_register_map_clear(map);
+    IR_compute_liveness(program, function, map, &gvn->liveness);
+
+    i32 register_count = map->count;
+    gvn->value_numbers = mem_alloc(sizeof(i64) * (register_count + 1));
+    gvn->replacements = mem_alloc(sizeof(IR_Register) * (register_count + 1));
+    gvn->last_use = mem_alloc(sizeof(i32) * (register_count + 1));
+    gvn->last_use_block = mem_alloc(sizeof(i32) * (register_count + 1));
+    gvn->replaced_next = mem_alloc(sizeof(i32) * (register_count + 1));
+    for (i32 i = 0; i < register_count; i++)
+    {
+        gvn->value_numbers[i] = i;
+        gvn->replacements[i] = map->registers[i];
+        gvn->last_use_block[i] = -1;
+        gvn->replaced_next[i] = -1;
+    }
+
+    gvn->bucket_count = 1;
+    while (gvn->bucket_count < register_count) gvn->bucket_count *= 2;
+    gvn->buckets = mem_alloc(sizeof(i32) * gvn->bucket_count);
+    for (i32 i = 0; i < gvn->bucket_count; i++)
+    {
+        gvn->buckets[i] = -1;
+    }
+    gvn->entry_count = 0;
+
+    // Walk the dominator tree so an expression is only ever replaced by one computed in a dominating block
+    IR_Block_Address* stack = mem_alloc(sizeof(IR_Block_Address) * rpo->count);
+    i32* next_child = mem_alloc(sizeof(i32) * rpo->count);
+    i32* entry_marks = mem_alloc(sizeof(i32) * rpo->count);
+    // Where the dominator path stands at the end of the block, what its children continue from
+    i32* position_marks = mem_alloc(sizeof(i32) * rpo->count);
+    i32* call_marks = mem_alloc(sizeof(i32) * rpo->count);
+    i32 stack_count = 0;
+
+    gvn->position = 0;
+    gvn->calls = 0;
+    entry_marks[stack_count] = gvn->entry_count;
+    IR_gvn_visit_block(gvn, IR_get_block(program, function->entry));
+    position_marks[stack_count] = gvn->position;
+    call_marks[stack_count] = gvn->calls;
+    stack[stack_count] = function->entry;
+    next_child[stack_count++] = 0;
+
+    while (stack_count > 0)
+    {
+        IR_Block* block = IR_get_block(program, stack[stack_count - 1]);
+        i32* next = &next_child[stack_count - 1];
+
+        if (*next < block->dominator_children.count)
+        {
+            IR_Block_Address child = block->dominator_children.addresses[(*next)++];
+            gvn->position = position_marks[stack_count - 1];
+            gvn->calls = call_marks[stack_count - 1];
+            entry_marks[stack_count] = gvn->entry_count;
+            IR_gvn_visit_block(gvn, IR_get_block(program, child));
+            position_marks[stack_count] = gvn->position;
+            call_marks[stack_count] = gvn->calls;
+            stack[stack_count] = child;
+            next_child[stack_count++] = 0;
+        }
+        else
+        {
+            stack_count--;
+            IR_gvn_pop(gvn, entry_marks[stack_count]);
+        }
+    }
+
+    // Phi operands can flow in over back edges from blocks visited later
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = 0; j < IR_first_non_phi(block); j++)
+        {
+            if (IR_is_phi(&block->node_array.nodes[j]))
+            {
+                IR_gvn_replace_uses(gvn, &block->node_array.nodes[j].instruction);
+            }
+        }
+    }
+
+    mem_free(stack);
+    mem_free(next_child);
+    mem_free(entry_marks);
+    mem_free(position_marks);
+    mem_free(call_marks);
+    mem_free(gvn->value_numbers);
+    mem_free(gvn->replacements);
+    mem_free(gvn->last_use);
+    mem_free(gvn->last_use_block);
+    mem_free(gvn->replaced_next);
+    mem_free(gvn->buckets);
+    IR_liveness_free(&gvn->liveness);
+}
+
+void IR_gvn(IR_Program* program)
+{
+    IR_build_cfg(program);
+
+    IR_Register_Map map;
+    IR_register_map_init(&map, program);
+
+    IR_GVN gvn = {0};
+    gvn.program = program;
+    gvn.map = &map;
+
+    for (i32 i = 0; i < program->function_array.count; i++)
+    {
+        IR_gvn_function(&gvn, program->function_array.functions[i]);
+    }
+
+    mem_free(gvn.entries);
+    IR_register_map_free(&map);
+}
+
+/* ======================
+   Dead code elimination
+   ====================== */
+
+typedef struct IR_Definition_Site IR_Definition_Site;
+struct IR_Definition_Site
+{
+    IR_Block* block;
+    i32 node; // -1 if the register is never defined in the function
+};
+
+// Instructions that can be deleted when nothing reads their result
+static bool IR_is_pure(IR_Program* program, IR_Instruction* instruction)
+{
+    switch(instruction->type)
+    {
+    case IR_INS_MOV:
+    {
+        IR_Register* definition = IR_get_definition(program, instruction);
+        return definition && IR_register_is_valid(*definition);
+    }
+    case IR_INS_BINOP:
+    case IR_INS_UNOP:
+    case IR_INS_PHI:
+    case IR_INS_ARGUMENT:
+    case IR_INS_SET:
+    case IR_INS_SELECT:
+    return true;
+    default: return false;
+    }
+}
+
+static void IR_remove_code_after_terminators(IR_Program* program)
+{
+    for (i32 i = 0; i < program->block_array.count; i++)
+    {
+        IR_Block* block = &program->block_array.blocks[i];
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            if (IR_is_terminator(&block->node_array.nodes[j]))
+            {
+                block->node_array.count = j + 1;
+                break;
+            }
+        }
+    }
+}
+
+static void IR_dce_mark_uses(IR_Register_Map* map, IR_Instruction* instruction, bool* live, i32* worklist, i32* worklist_count)
+{
+    for (i32 i = 0; i < IR_get_use_count(instruction); i++)
+    {
+        IR_Register* use = IR_get_use(instruction, i);
+        i32 local = use ? IR_register_map_find(map, *use) : -1;
+        if (local != -1 && !live[local])
+        {
+            live[local] = true;
+            worklist[(*worklist_count)++] = local;
+        }
+    }
+}
+
+static void IR_dce_function(IR_Program* program, IR_Function_Decl* function, IR_Register_Map* map)
+{
+    IR_register_map_clear(map);
+    IR_map_function_registers(program, function, map);
+
+    i32 register_count = map->count;
+    bool* live = mem_calloc(register_count + 1, sizeof(bool));
+    i32* worklist = mem_alloc(sizeof(i32) * (register_count + 1));
+    i32 worklist_count = 0;
+    IR_Definition_Site* definitions = mem_alloc(sizeof(IR_Definition_Site) * (register_count + 1));
+    for (i32 i = 0; i < register_count; i++)
+    {
+        definitions[i] = (IR_Definition_Site) { .block = NULL, .node = -1 };
+    }
+
+    // Everything with an effect besides its result is live, and so is everything it reads
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        IR_remove_unused_compares(block);
+
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            IR_Register* definition = IR_get_definition(program, instruction);
+            if (definition && IR_register_is_valid(*definition))
+            {
+                definitions[IR_register_map_find(map, *definition)] = (IR_Definition_Site) { .block = block, .node = j };
+            }
+
+            // @Note: A compare is only live if something reads its flags
+            if (instruction->type == IR_INS_COMPARE) continue;
+
+            if (!IR_is_pure(program, instruction))
+            {
+                IR_dce_mark_uses(map, instruction, live, worklist, &worklist_count);
+            }
+
+            if (instruction->type == IR_INS_JUMP && instruction->jump.type != JMP_ALWAYS)
+            {
+                IR_Instruction* flags = IR_find_flags(block, j);
+                if (flags) IR_dce_mark_uses(map, flags, live, worklist, &worklist_count);
+            }
+        }
+    }
+
+    while (worklist_count > 0)
+    {
+        IR_Definition_Site site = definitions[worklist[--worklist_count]];
+        if (site.node == -1) continue;
+
+        IR_Instruction* instruction = &site.block->node_array.nodes[site.node].instruction;
+        if (IR_is_pure(program, instruction))
+        {
+            IR_dce_mark_uses(map, instruction, live, worklist, &worklist_count);
+        }
+
+        if (IR_reads_flags(instruction))
+        {
+            IR_Instruction* flags = IR_find_flags(site.block, site.node);
+            if (flags) IR_dce_mark_uses(map, flags, live, worklist, &worklist_count);
+        }
+    }
+
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION || !IR_is_pure(program, &node->instruction)) continue;
+
+            IR_Register* definition = IR_get_definition(program, &node->instruction);
+            if (!live[IR_register_map_find(map, *definition)])
+            {
+                if (node->instruction.type == IR_INS_PHI)
+                {
+                    mem_free(node->instruction.phi.operands);
+                }
+                IR_remove_node(block, j--);
+            }
+        }
+
+        IR_remove_unused_compares(block);
+    }
+
+    mem_free(live);
+    mem_free(worklist);
+    mem_free(definitions);
+}
+
+/*
+Functions that are neither exported nor called from one that is (transitively) are deleted along with
+their blocks. Function indices are referenced by calls, so the declaration stays in the function array,
+marked as removed.
+ */
+static void IR_remove_unreachable_functions(IR_Program* program)
+{
+    IR_Function_Array* functions = &program->function_array;
+    bool* reachable = mem_calloc(functions->count + 1, sizeof(bool));
+    i32* worklist = mem_alloc(sizeof(i32) * (functions->count + 1));
+    i32 worklist_count = 0;
+
+    for (i32 i = 0; i < functions->count; i++)
+    {
+        IR_Function_Decl* function = functions->functions[i];
+        if (!function->removed && (function->export || string_equal_cstr(function->name, "main")))
+        {
+            reachable[i] = true;
+            worklist[worklist_count++] = i;
+        }
+    }
+
+    while (worklist_count > 0)
+    {
+        IR_Function_Decl* function = functions->functions[worklist[--worklist_count]];
+        for (i32 i = 0; i < function->blocks.count; i++)
+        {
+            IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+            for (i32 j = 0; j < block->node_array.count; j++)
+            {
+                IR_Node* node = &block->node_array.nodes[j];
+                if (node->type != IR_NODE_INSTRUCTION || node->instruction.type != IR_INS_CALL) continue;
+
+                i32 callee = node->instruction.call.function_index;
+                if (!reachable[callee])
+                {
+                    reachable[callee] = true;
+                    worklist[worklist_count++] = callee;
+                }
+            }
+        }
+    }
+
+    for (i32 i = 0; i < functions->count; i++)
+    {
+        IR_Function_Decl* function = functions->functions[i];
+        if (reachable[i] || function->removed) continue;
+
+        function->removed = true;
+        for (i32 j = 0; j < program->block_array.count; j++)
+        {
+            IR_Block* block = &program->block_array.blocks[j];
+            if (block->function_index != i) continue;
+
+            // @Note: The entry block keeps its nodes allocated, the function array still points at the declaration
+            block->function_index = -1;
+            block->node_array.count = 0;
+        }
+    }
+
+    mem_free(reachable);
+    mem_free(worklist);
+
+    IR_build_cfg(program);
+}
+
+void IR_dce(IR_Program* program)
+{
+    IR_remove_code_after_terminators(program);
+    IR_remove_unreachable_blocks(program);
+
+    IR_Register_Map map;
+    IR_register_map_init(&map, program);
+
+    for (i32 i = 0; i < program->function_array.count; i++)
+    {
+        IR_Function_Decl* function = program->function_array.functions[i];
+        if (!function->removed)
+        {
+            IR_dce_function(program, function, &map);
+        }
+    }
+
+    IR_register_map_free(&map);
+}
+
+/* ======================
+   If-conversion
+   ====================== */
+
+// Cycles lost to a mispredicted branch on current x86 cores
+#define IF_CONVERT_MISPREDICT_PENALTY 16
+// Both arms run once converted, so larger ones are not worth it however badly the branch predicts
+#define IF_CONVERT_MAX_ARM_COST 8
+
+typedef struct IR_If_Arm IR_If_Arm;
+struct IR_If_Arm
+{
+    IR_Block_Address block; // First block, -1 when the edge goes straight to the join
+    IR_Block_Address last;  // Block the arm leaves from
+    IR_Block_Address exit;  // Block the arm continues in, -1 when it returns
+    IR_Register return_register;
+    i32 cost;
+};
+
+// Rough cycles an instruction costs when it runs on both paths, -1 if it must not run on the path that did not ask for it
+static i32 IR_speculation_cost(IR_Instruction* instruction)
+{
+    switch(instruction->type)
+    {
+    case IR_INS_MOV:
+    {
+        IR_Location* dst = &instruction->move.dst;
+        if (dst->type != IR_LOCATION_REGISTER) return -1;
+
+        // Copies are coalesced away when leaving SSA
+        return instruction->move.src.type == VALUE_LOCATION ? 0 : 1;
+    }
+    case IR_INS_BINOP:
+    {
+        // @Note: Division traps on a zero divisor, which is exactly what the branch might be guarding against
+        if (instruction->binop.operator == OP_DIV) return -1;
+        return instruction->binop.operator == OP_MUL ? 3 : 1;
+    }
+    case IR_INS_UNOP:
+    case IR_INS_COMPARE:
+    case IR_INS_SET:
+    case IR_INS_SELECT:
+    return 1;
+    default: return -1;
+    }
+}
+
+static bool IR_get_literal_operand(IR_Block* block, IR_Value* value, i32* literal)
+{
+    if (value->type == VALUE_INT)
+    {
+        *literal = value->integer;
+        return true;
+    }
+
+    // Literals are moved into a register right before the compare that reads them
+    IR_Register* reg = IR_get_value_register(value);
+    for (i32 i = 0; reg && i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION || node->instruction.type != IR_INS_MOV) continue;
+
+        IR_Move* move = &node->instruction.move;
+        if (move->dst.type == IR_LOCATION_REGISTER && move->dst.reg.gpr_index == reg->gpr_index)
+        {
+            if (move->src.type != VALUE_INT) return false;
+
+            *literal = move->src.integer;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool IR_is_literal_operand(IR_Block* block, IR_Value* value)
+{
+    i32 literal;
+    return IR_get_literal_operand(block, value, &literal);
+}
+
+/*
+Without a profile the only hint for how well a branch predicts is what it compares. Comparing against a
+literal is usually a guard or a base case that goes the same way almost every time, two values are rarely
+equal, while ordering two values (the heart of min, max and clamp) goes either way depending on the data.
+ */
+static i32 IR_mispredict_percentage(IR_Block* block, IR_Compare* compare, IR_Jump_Type condition)
+{
+    IR_Value right = IR_create_value_location(compare->right);
+    bool literal = IR_is_literal_operand(block, &compare->left) || IR_is_literal_operand(block, &right);
+    bool equality = condition == JMP_EQUAL || condition == JMP_NOT_EQUAL || condition == JMP_ZERO || condition == JMP_NOT_ZERO;
+
+    if (literal)
+    {
+        return equality ? 5 : 15;
+    }
+    return equality ? 20 : 40;
+}
+
+// The block a block without a conditional jump continues in, -1 if it returns or runs off the end of the function
+static IR_Block_Address IR_straight_line_successor(IR_Program* program, IR_Function_Decl* function, IR_Block* block)
+{
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (IR_is_jump(node)) return node->instruction.jump.address;
+        if (IR_is_terminator(node)) return (IR_Block_Address) { .address = -1 };
+    }
+
+    if (block->layout_index + 1 >= function->blocks.count)
+    {
+        return (IR_Block_Address) { .address = -1 };
+    }
+    return function->blocks.addresses[block->layout_index + 1];
+}
+
+/*
+An arm is a chain of blocks only reachable from the branch, made of instructions that are safe to run on
+both paths, that either returns a value or continues in a single block. Translation leaves plenty of blocks
+that just run into the next one, so the chain follows them as long as nothing else can get there.
+ */
+static bool IR_if_convert_arm(IR_Program* program, IR_Function_Decl* function, IR_Block_Address address, IR_Block_Address branch, bool* touched, IR_If_Arm* arm)
+{
+    *arm = (IR_If_Arm) { .block = address, .last = address, .exit = { .address = -1 } };
+
+    IR_Block_Address from = branch;
+    bool has_flags = false;
+    while (true)
+    {
+        IR_Block* block = IR_get_block(program, address);
+        if (touched[address.address] || block->predecessors.count != 1 || block->predecessors.addresses[0].address != from.address)
+        {
+            return false;
+        }
+        arm->last = address;
+
+        for (i32 i = 0; i < block->node_array.count; i++)
+        {
+            IR_Node* node = &block->node_array.nodes[i];
+            if (node->type == IR_NODE_LABEL) continue;
+            if (node->type != IR_NODE_INSTRUCTION) return false;
+
+            IR_Instruction* instruction = &node->instruction;
+            if (instruction->type == IR_INS_RET)
+            {
+                arm->return_register = instruction->ret.return_register;
+                return instruction->ret.has_return_value;
+            }
+
+            if (instruction->type == IR_INS_JUMP)
+            {
+                if (instruction->jump.type != JMP_ALWAYS) return false;
+                break;
+            }
+
+            // The arm is hoisted above the compare of the branch, so it can only read flags it sets itself
+            if (IR_reads_flags(instruction) && !has_flags) return false;
+            has_flags |= instruction->type == IR_INS_COMPARE;
+
+            i32 cost = IR_speculation_cost(instruction);
+            if (cost < 0) return false;
+            arm->cost += cost;
+        }
+
+        IR_Block_Address next = IR_straight_line_successor(program, function, block);
+        if (next.address == -1)
+        {
+            return false;
+        }
+
+        if (IR_get_block(program, next)->predecessors.count != 1 || next.address == function->entry.address)
+        {
+            arm->exit = next;
+            return true;
+        }
+
+        from = address;
+        address = next;
+    }
+}
+
+static IR_Value IR_if_convert_operand(IR_Program* program, IR_Block* block, i32* insert, IR_Value value)
+{
+    if (value.type != VALUE_INT)
+    {
+        return value;
+    }
+
+    // cmov has no immediate form
+    IR_Register reg = IR_register_alloc(program->register_table);
+    IR_insert_move(block, (*insert)++, value, reg);
+    return IR_create_value_register(reg);
+}
+
+/*
+Converts the branch at the end of the block if both of its successors are arms that return, or that meet
+again in a join block only reachable from them. One of the arms can be empty, if the branch jumps straight
+to the join. The arms are hoisted above the compare and the values they produce are picked with selects.
+ */
+static bool IR_if_convert_branch(IR_Program* program, IR_Function_Decl* function, IR_Block_Address address, bool* touched)
+{
+    IR_Block* block = IR_get_block(program, address);
+    i32 jump_index = block->node_array.count - 1;
+    if (jump_index < 0 || !IR_is_jump(&block->node_array.nodes[jump_index]) || block->node_array.nodes[jump_index].instruction.jump.type == JMP_ALWAYS)
+    {
+        return false;
+    }
+
+    for (i32 i = 0; i < jump_index; i++)
+    {
+        if (IR_is_jump(&block->node_array.nodes[i])) return false;
+    }
+
+    IR_Instruction* flags = IR_find_flags(block, jump_index);
+    if (!flags || block->layout_index + 1 >= function->blocks.count)
+    {
+        return false;
+    }
+
+    IR_Jump_Type condition = block->node_array.nodes[jump_index].instruction.jump.type;
+    IR_Block_Address taken = block->node_array.nodes[jump_index].instruction.jump.address;
+    IR_Block_Address fallthrough = function->blocks.addresses[block->layout_index + 1];
+    if (taken.address == fallthrough.address)
+    {
+        return false;
+    }
+
+    // arms[0] runs when the condition holds, arms[1] when it does not
+    IR_If_Arm arms[2];
+    bool taken_is_arm = IR_if_convert_arm(program, function, taken, address, touched, &arms[0]);
+    bool fallthrough_is_arm = IR_if_convert_arm(program, function, fallthrough, address, touched, &arms[1]);
+    IR_Block_Address none = { .address = -1 };
+    IR_Block_Address join = none;
+
+    if (fallthrough_is_arm && arms[1].exit.address == taken.address)
+    {
+        arms[0] = (IR_If_Arm) { .block = none, .last = address, .exit = taken };
+        join = taken;
+    }
+    else if (taken_is_arm && arms[0].exit.address == fallthrough.address)
+    {
+        arms[1] = (IR_If_Arm) { .block = none, .last = address, .exit = fallthrough };
+        join = fallthrough;
+    }
+    else if (taken_is_arm && fallthrough_is_arm && arms[0].exit.address == arms[1].exit.address)
+    {
+        join = arms[0].exit;
+    }
+    else
+    {
+        return false;
+    }
+
+    if (touched[address.address] || (join.address != -1 && touched[join.address]))
+    {
+        return false;
+    }
+
+    for (i32 i = 0; i < 2; i++)
+    {
+        if (arms[i].cost > IF_CONVERT_MAX_ARM_COST) return false;
+    }
+
+    i32 selects = 1;
+    if (join.address != -1)
+    {
+        IR_Block* join_block = IR_get_block(program, join);
+        if (join_block->predecessors.count != 2 || join.address == function->entry.address)
+        {
+            return false;
+        }
+
+        selects = 0;
+        for (i32 i = 0; i < IR_first_non_phi(join_block); i++)
+        {
+            if (IR_is_phi(&join_block->node_array.nodes[i])) selects++;
+        }
+
+        // @Note: At least one edge into the join is a jump, so it always has a label to jump to
+        if (IR_get_node(join_block, 0)->type != IR_NODE_LABEL)
+        {
+            return false;
+        }
+    }
+
+    // Branchless runs both arms and the selects, the branch runs one arm on average, itself and sometimes mispredicts
+    i32 doubled_extra_cost = arms[0].cost + arms[1].cost + 2 * selects - 2;
+    if (doubled_extra_cost * 100 > 2 * IR_mispredict_percentage(block, &flags->compare, condition) * IF_CONVERT_MISPREDICT_PENALTY)
+    {
+        return false;
+    }
+
+    i32 insert = IR_instruction_index(block, flags);
+    for (i32 i = 0; i < 2; i++)
+    {
+        if (arms[i].block.address == -1) continue;
+
+        IR_Block_Address arm_address = arms[i].block;
+        while (true)
+        {
+            IR_Block* arm = IR_get_block(program, arm_address);
+            for (i32 j = 0; j < arm->node_array.count; j++)
+            {
+                IR_Node* node = &arm->node_array.nodes[j];
+                if (IR_is_terminator(node)) break;
+                if (node->type != IR_NODE_INSTRUCTION) continue;
+
+                *IR_insert_node(block, insert++, IR_NODE_INSTRUCTION) = *node;
+            }
+
+            IR_Block_Address next = IR_straight_line_successor(program, function, arm);
+            arm->function_index = -1;
+            arm->node_array.count = 0;
+            touched[arm_address.address] = true;
+
+            if (arm_address.address == arms[i].last.address) break;
+            arm_address = next;
+        }
+    }
+
+    // The jump is the last node, everything was hoisted above it
+    block->node_array.count--;
+
+    if (join.address == -1)
+    {
+        IR_Register result = IR_register_alloc(program->register_table);
+        IR_Node* node = IR_emit_instruction(block, IR_INS_SELECT);
+        node->instruction.select = (IR_Select) {
+            .condition   = condition,
+            .if_true     = IR_create_value_register(arms[0].return_register),
+            .if_false    = IR_create_value_register(arms[1].return_register),
+            .destination = result
+        };
+
+        IR_Node* ret = IR_emit_instruction(block, IR_INS_RET);
+        ret->instruction.ret = (IR_Return) { .return_register = result, .has_return_value = true };
+    }
+    else
+    {
+        // An empty arm is the edge from the branch block itself
+        IR_Block_Address from[2] = { arms[0].last, arms[1].last };
+
+        IR_Block* join_block = IR_get_block(program, join);
+        for (i32 i = 0; i < IR_first_non_phi(join_block); i++)
+        {
+            if (!IR_is_phi(&join_block->node_array.nodes[i])) continue;
+
+            IR_Phi phi = join_block->node_array.nodes[i].instruction.phi;
+            IR_Value values[2] = {0};
+            for (i32 j = 0; j < phi.count; j++)
+            {
+                if (phi.operands[j].block.address == from[0].address) values[0] = phi.operands[j].value;
+                if (phi.operands[j].block.address == from[1].address) values[1] = phi.operands[j].value;
+            }
+
+            IR_Select select = {
+                .condition   = condition,
+                .if_true     = IR_if_convert_operand(program, block, &insert, values[0]),
+                .if_false    = IR_if_convert_operand(program, block, &insert, values[1]),
+                .destination = phi.destination
+            };
+            IR_emit_instruction(block, IR_INS_SELECT)->instruction.select = select;
+
+            mem_free(phi.operands);
+            IR_remove_node(join_block, i--);
+        }
+
+        // Once the arms are gone the branch block might run straight into the join
+        bool join_follows = false;
+        for (i32 i = block->layout_index + 1; i < function->blocks.count; i++)
+        {
+            IR_Block* next = IR_get_block(program, function->blocks.addresses[i]);
+            if (next->function_index < 0) continue;
+
+            join_follows = next->block_address.address == join.address;
+            break;
+        }
+
+        if (!join_follows)
+        {
+            IR_emit_instruction(block, IR_INS_JUMP)->instruction.jump = (IR_Jump) { .type = JMP_ALWAYS, .address = join };
+        }
+        touched[join.address] = true;
+    }
+
+    touched[address.address] = true;
+    return true;
+}
+
+void IR_if_convert(IR_Program* program)
+{
+    // Converting a branch can turn its block into an arm of the branch before it, so this runs until nothing changes
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        IR_build_cfg(program);
+
+        // @Note: The CFG is only rebuilt between rounds, so blocks touched by a conversion are left alone until then
+        bool* touched = mem_calloc(program->block_array.count + 1, sizeof(bool));
+        for (i32 i = 0; i < program->function_array.count; i++)
+        {
+            IR_Function_Decl* function = program->function_array.functions[i];
+            if (function->removed) continue;
+
+            // Inner branches come later in the layout, so going backwards converts them first
+            for (i32 j = function->blocks.count - 1; j >= 0; j--)
+            {
+                changed |= IR_if_convert_branch(program, function, function->blocks.addresses[j], touched);
+            }
+        }
+        mem_free(touched);
+    }
+}
+
+/* ======================
+   Inlining
+   ====================== */
+
+// What a call costs besides the callee body: the call itself, the frame setup and teardown and the return
+#define INLINE_CALL_COST 5
+#define INLINE_THRESHOLD 16
+// A callee with a single call site is deleted after inlining it, so only the call site grows
+#define INLINE_SINGLE_CALL_SITE_THRESHOLD 128
+#define INLINE_MAX_CALLER_SIZE 4096
+
+typedef struct IR_Return_Site IR_Return_Site;
+struct IR_Return_Site
+{
+    IR_Block_Address block;
+    IR_Value value;
+};
+
+typedef struct IR_Inliner IR_Inliner;
+struct IR_Inliner
+{
+    IR_Program* program;
+    Allocator* allocator;
+    bool report;
+
+    i32* sizes;            // By function index, kept up to date as callers grow
+    i32* call_site_counts; // By function index
+    bool* returns_value;   // By function index, independent of the declared return type
+    bool* returns_nothing; // By function index, has a return without a value
+    bool* processed;       // By function index, a callee that is not processed yet is in a cycle with the caller
+
+    IR_Register_Map map;   // Callee registers
+    IR_Register* renamed;  // Fresh caller register by local index in the map
+    i32 renamed_count;
+    i32 renamed_capacity;
+
+    IR_Block_Address* clones; // By layout index of the callee block
+    i32 clone_capacity;
+
+    IR_Return_Site* return_sites;
+    i32 return_site_count;
+    i32 return_site_capacity;
+
+    IR_Call_Arguments arguments; // Of the call being inlined
+};
+
+static bool IR_is_call(IR_Node* node)
+{
+    return node->type == IR_NODE_INSTRUCTION && node->instruction.type == IR_INS_CALL;
+}
+
+static i32 IR_function_size(IR_Program* program, IR_Function_Decl* function)
+{
+    i32 size = 0;
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type == IR_NODE_INSTRUCTION && !IR_is_phi(node))
+            {
+                size++;
+            }
+
+            if (IR_is_terminator(node)) break;
+        }
+    }
+    return size;
+}
+
+/*
+Callees come before their callers, so by the time a call site is looked at the callee has already had
+its own calls inlined and its size is final. Functions in a call graph cycle are ordered arbitrarily.
+ */
+static i32* IR_bottom_up_call_order(IR_Program* program)
+{
+    IR_Function_Array* functions = &program->function_array;
+    i32 count = functions->count;
+
+    // The callees of function i are callees[callee_offsets[i]] up to callees[callee_offsets[i + 1]]
+    i32* callee_offsets = mem_alloc(sizeof(i32) * (count + 1));
+    i32* callees = NULL;
+    i32 callee_count = 0;
+    i32 callee_capacity = 0;
+
+    for (i32 i = 0; i < count; i++)
+    {
+        callee_offsets[i] = callee_count;
+
+        IR_Function_Decl* function = functions->functions[i];
+        if (function->removed) continue;
+
+        for (i32 j = 0; j < function->blocks.count; j++)
+        {
+            IR_Block* block = IR_get_block(program, function->blocks.addresses[j]);
+            for (i32 k = 0; k < block->node_array.count; k++)
+            {
+                if (!IR_is_call(&block->node_array.nodes[k])) continue;
+
+                if (callee_count + 1 > callee_capacity)
+                {
+                    callee_capacity = callee_capacity == 0 ? 256 : callee_capacity * 2;
+                    callees = mem_realloc(callees, sizeof(i32) * callee_capacity);
+                }
+                callees[callee_count++] = block->node_array.nodes[k].instruction.call.function_index;
+            }
+        }
+    }
+    callee_offsets[count] = callee_count;
+
+    i32* order = mem_alloc(sizeof(i32) * (count + 1));
+    i32 order_count = 0;
+    bool* visited = mem_calloc(count + 1, sizeof(bool));
+    i32* stack = mem_alloc(sizeof(i32) * (count + 1));
+    i32* next_callee = mem_alloc(sizeof(i32) * (count + 1));
+
+    for (i32 i = 0; i < count; i++)
+    {
+        if (visited[i] || functions->functions[i]->removed) continue;
+
+        i32 stack_count = 0;
+        stack[stack_count] = i;
+        next_callee[stack_count++] = callee_offsets[i];
+        visited[i] = true;
+
+        while (stack_count > 0)
+        {
+            i32 function = stack[stack_count - 1];
+            i32* next = &next_callee[stack_count - 1];
+
+            if (*next < callee_offsets[function + 1])
+            {
+                i32 callee = callees[(*next)++];
+                if (!visited[callee])
+                {
+                    visited[callee] = true;
+                    stack[stack_count] = callee;
+                    next_callee[stack_count++] = callee_offsets[callee];
+                }
+            }
+            else
+            {
+                order[order_count++] = function;
+                stack_count--;
+            }
+        }
+    }
+    order[order_count] = -1;
+
+    mem_free(callee_offsets);
+    mem_free(callees);
+    mem_free(visited);
+    mem_free(stack);
+    mem_free(next_callee);
+
+    return order;
+}
+
+static IR_Register IR_inline_rename(IR_Inliner* inliner, IR_Register reg)
+{
+    i32 local = IR_register_map_add(&inliner->map, reg);
+    if (local == inliner->renamed_count)
+    {
+        if (inliner->renamed_count + 1 > inliner->renamed_capacity)
+        {
+            inliner->renamed_capacity = inliner->renamed_capacity == 0 ? 256 : inliner->renamed_capacity * 2;
+            inliner->renamed = mem_realloc(inliner->renamed, sizeof(IR_Register) * inliner->renamed_capacity);
+        }
+        inliner->renamed[inliner->renamed_count++] = IR_register_alloc(inliner->program->register_table);
+    }
+    return inliner->renamed[local];
+}
+
+static IR_Block_Address IR_inline_clone_address(IR_Inliner* inliner, IR_Block_Address address)
+{
+    return inliner->clones[IR_get_block(inliner->program, address)->layout_index];
+}
+
+static void IR_inline_add_return_site(IR_Inliner* inliner, IR_Block_Address block, IR_Value value)
+{
+    if (inliner->return_site_count + 1 > inliner->return_site_capacity)
+    {
+        inliner->return_site_capacity = inliner->return_site_capacity == 0 ? 8 : inliner->return_site_capacity * 2;
+        inliner->return_sites = mem_realloc(inliner->return_sites, sizeof(IR_Return_Site) * inliner->return_site_capacity);
+    }
+    inliner->return_sites[inliner->return_site_count++] = (IR_Return_Site) { .block = block, .value = value };
+}
+
+// Copies an instruction of the callee into the caller with fresh registers and blocks, returns become jumps to the continuation
+static void IR_inline_clone_instruction(IR_Inliner* inliner, IR_Block* clone, IR_Instruction* instruction, IR_Block_Address continuation)
+{
+    IR_Node* node = IR_emit_instruction(clone, instruction->type);
+    IR_Instruction* copy = &node->instruction;
+    *copy = *instruction;
+
+    switch(copy->type)
+    {
+    case IR_INS_CALL:
+    {
+        IR_Call_Arguments* arguments = &copy->call.arguments;
+        if (arguments->count > 0)
+        {
+            arguments->values = mem_alloc(sizeof(IR_Value) * arguments->capacity);
+            memcpy(arguments->values, instruction->call.arguments.values, sizeof(IR_Value) * arguments->count);
+        }
+    }
+    break;
+    case IR_INS_PHI:
+    {
+        IR_Phi* phi = &copy->phi;
+        phi->operands = mem_alloc(sizeof(IR_Phi_Operand) * phi->capacity);
+        memcpy(phi->operands, instruction->phi.operands, sizeof(IR_Phi_Operand) * phi->count);
+        for (i32 i = 0; i < phi->count; i++)
+        {
+            phi->operands[i].block = IR_inline_clone_address(inliner, phi->operands[i].block);
+        }
+    }
+    break;
+    case IR_INS_JUMP:
+    {
+        copy->jump.address = IR_inline_clone_address(inliner, copy->jump.address);
+    }
+    break;
+    default: break;
+    }
+
+    for (i32 i = 0; i < IR_get_use_count(copy); i++)
+    {
+        IR_Register* use = IR_get_use(copy, i);
+        if (use) *use = IR_inline_rename(inliner, *use);
+    }
+
+    IR_Register* definition = IR_get_definition(inliner->program, copy);
+    if (definition && IR_register_is_valid(*definition))
+    {
+        *definition = IR_inline_rename(inliner, *definition);
+    }
+
+    if (copy->type == IR_INS_PHI)
+    {
+        copy->phi.variable = copy->phi.destination;
+    }
+
+    // The caller's registers are already final, so the arguments are only filled in after renaming
+    if (copy->type == IR_INS_ARGUMENT)
+    {
+        IR_Register destination = copy->argument.destination;
+        copy->type = IR_INS_MOV;
+        copy->move.src = inliner->arguments.values[instruction->argument.index];
+        copy->move.dst = IR_create_location_register(destination);
+    }
+
+    if (copy->type == IR_INS_RET)
+    {
+        IR_Value value = copy->ret.has_return_value ? IR_create_value_register(copy->ret.return_register) : IR_create_value_number(0);
+        IR_inline_add_return_site(inliner, clone->block_address, value);
+
+        copy->type = IR_INS_JUMP;
+        copy->jump = (IR_Jump) { .type = JMP_ALWAYS, .address = continuation };
+    }
+}
+
+static i32 IR_find_layout_index(IR_Function_Decl* function, IR_Block_Address address)
+{
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        if (function->blocks.addresses[i].address == address.address)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+Splits the block at the call into the part before the call and a continuation block with the rest,
+and places a copy of every block of the callee in between. The part before the call falls through
+into the copy of the callee entry, and every return jumps to the continuation, which picks up the
+returned value with a move or a phi if there is more than one return.
+ */
+static void IR_inline_call(IR_Inliner* inliner, i32 caller_index, IR_Block_Address call_block, i32 call_index)
+{
+    IR_Program* program = inliner->program;
+    IR_Call call = IR_get_block(program, call_block)->node_array.nodes[call_index].instruction.call;
+    IR_Function_Decl* callee = program->function_array.functions[call.function_index];
+    i32 callee_block_count = callee->blocks.count;
+    inliner->arguments = call.arguments;
+
+    IR_register_map_clear(&inliner->map);
+    inliner->renamed_count = 0;
+    inliner->return_site_count = 0;
+
+    if (callee_block_count > inliner->clone_capacity)
+    {
+        inliner->clone_capacity = callee_block_count;
+        inliner->clones = mem_realloc(inliner->clones, sizeof(IR_Block_Address) * inliner->clone_capacity);
+    }
+
+    // @Note: Allocating blocks can move the block array, so blocks are only looked up once everything is allocated
+    for (i32 i = 0; i < callee_block_count; i++)
+    {
+        IR_Block* clone = IR_allocate_block(program);
+        clone->function_index = caller_index;
+        inliner->clones[i] = clone->block_address;
+    }
+    IR_Block* continuation = IR_allocate_block(program);
+    continuation->function_index = caller_index;
+    IR_Block_Address continuation_address = continuation->block_address;
+    IR_emit_label(continuation, IR_generate_label_name(program, inliner->allocator), inliner->allocator);
+
+    for (i32 i = 0; i < callee_block_count; i++)
+    {
+        IR_get_block(program, callee->blocks.addresses[i])->layout_index = i;
+    }
+
+    for (i32 i = 0; i < callee_block_count; i++)
+    {
+        IR_Block* block = IR_get_block(program, callee->blocks.addresses[i]);
+        IR_Block* clone = IR_get_block(program, inliner->clones[i]);
+
+        bool falls_through = true;
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type == IR_NODE_LABEL)
+            {
+                IR_emit_label(clone, IR_generate_label_name(program, inliner->allocator), inliner->allocator);
+            }
+            else if (node->type == IR_NODE_INSTRUCTION)
+            {
+                IR_inline_clone_instruction(inliner, clone, &node->instruction, continuation_address);
+            }
+
+            if (IR_is_terminator(node))
+            {
+                falls_through = false;
+                break;
+            }
+        }
+
+        // Falling off the end of the callee returns
+        if (falls_through && i == callee_block_count - 1)
+        {
+            IR_inline_add_return_site(inliner, clone->block_address, IR_create_value_number(0));
+        }
+    }
+
+    IR_Block* block = IR_get_block(program, call_block);
+    IR_Register* result = IR_get_definition(program, &block->node_array.nodes[call_index].instruction);
+    bool has_result = result && IR_register_is_valid(*result);
+    IR_Register result_register = has_result ? *result : (IR_Register) {0};
+
+    // Everything after the call moves to the continuation, and with it the edges to the successors
+    continuation = IR_get_block(program, continuation_address);
+    for (i32 i = call_index + 1; i < block->node_array.count; i++)
+    {
+        *IR_emit_node(continuation, IR_NODE_INSTRUCTION) = block->node_array.nodes[i];
+    }
+    block->node_array.count = call_index;
+    mem_free(call.arguments.values);
+
+    for (i32 i = 0; i < continuation->node_array.count; i++)
+    {
+        if (!IR_is_jump(&continuation->node_array.nodes[i])) continue;
+
+        IR_Block* successor = IR_get_block(program, continuation->node_array.nodes[i].instruction.jump.address);
+        for (i32 j = 0; j < IR_first_non_phi(successor); j++)
+        {
+            if (!IR_is_phi(&successor->node_array.nodes[j])) continue;
+
+            IR_Phi* phi = &successor->node_array.nodes[j].instruction.phi;
+            for (i32 k = 0; k < phi->count; k++)
+            {
+                if (phi->operands[k].block.address == call_block.address)
+                {
+                    phi->operands[k].block = continuation_address;
+                }
+            }
+        }
+    }
+
+    IR_Function_Decl* caller = program->function_array.functions[caller_index];
+    i32 layout_index = IR_find_layout_index(caller, call_block);
+    bool continuation_falls_through = true;
+    for (i32 i = 0; i < continuation->node_array.count; i++)
+    {
+        if (IR_is_terminator(&continuation->node_array.nodes[i]))
+        {
+            continuation_falls_through = false;
+            break;
+        }
+    }
+
+    if (continuation_falls_through && layout_index + 1 < caller->blocks.count)
+    {
+        IR_Block* successor = IR_get_block(program, caller->blocks.addresses[layout_index + 1]);
+        for (i32 j = 0; j < IR_first_non_phi(successor); j++)
+        {
+            if (!IR_is_phi(&successor->node_array.nodes[j])) continue;
+
+            IR_Phi* phi = &successor->node_array.nodes[j].instruction.phi;
+            for (i32 k = 0; k < phi->count; k++)
+            {
+                if (phi->operands[k].block.address == call_block.address)
+                {
+                    phi->operands[k].block = continuation_address;
+                }
+            }
+        }
+    }
+
+    if (has_result)
+    {
+        if (inliner->return_site_count == 1)
+        {
+            IR_Return_Site* site = &inliner->return_sites[0];
+            IR_Block* return_block = IR_get_block(program, site->block);
+            IR_insert_move(return_block, IR_get_block_exit(return_block), site->value, result_register);
+        }
+        else if (inliner->return_site_count > 1)
+        {
+            IR_Node* node = IR_insert_node(continuation, 1, IR_NODE_INSTRUCTION);
+            node->instruction.type = IR_INS_PHI;
+
+            IR_Phi* phi = &node->instruction.phi;
+            phi->destination = result_register;
+            phi->variable = result_register;
+            for (i32 i = 0; i < inliner->return_site_count; i++)
+            {
+                IR_add_phi_operand(phi, (IR_Phi_Operand) { .block = inliner->return_sites[i].block, .value = inliner->return_sites[i].value });
+            }
+        }
+        else
+        {
+            // @Note: The callee never returns, so the continuation is unreachable, but the result still needs a definition
+            IR_insert_move(continuation, 1, IR_create_value_number(0), result_register);
+        }
+    }
+
+    for (i32 i = 0; i < callee_block_count; i++)
+    {
+        IR_insert_block_address(&caller->blocks, layout_index + 1 + i, inliner->clones[i]);
+    }
+    IR_insert_block_address(&caller->blocks, layout_index + 1 + callee_block_count, continuation_address);
+}
+
+// Returns NULL if the call site should be inlined, the reason it should not otherwise
+static char* IR_inline_reject_reason(IR_Inliner* inliner, i32 caller_index, IR_Call* call, i32* threshold)
+{
+    IR_Program* program = inliner->program;
+    i32 callee_index = call->function_index;
+    IR_Function_Decl* callee = program->function_array.functions[callee_index];
+    i32 size = inliner->sizes[callee_index];
+
+    *threshold = INLINE_THRESHOLD;
+    if (inliner->call_site_counts[callee_index] == 1 && !callee->export && !string_equal_cstr(callee->name, "main"))
+    {
+        *threshold = INLINE_SINGLE_CALL_SITE_THRESHOLD;
+    }
+
+    if (callee_index == caller_index || !inliner->processed[callee_index]) return "recursive call";
+    if (callee->removed || callee->blocks.count == 0)                      return "callee has no body";
+    if (IR_get_block(program, callee->entry)->predecessors.count > 0)       return "callee entry is a loop header";
+    if (callee->blocks.addresses[0].address != callee->entry.address)       return "callee entry is not laid out first";
+    // @Note: A return without a value hands back whatever the last call left in rax (main turns it into the exit code)
+    if (inliner->returns_nothing[caller_index] && inliner->returns_value[callee_index]) return "caller may return the result implicitly";
+
+    // Bodies no larger than the call itself always shrink the caller
+    if (size <= INLINE_CALL_COST) return NULL;
+
+    if (inliner->sizes[caller_index] + size > INLINE_MAX_CALLER_SIZE)       return "caller too large";
+    if (size > *threshold)                                                  return "callee too large";
+
+    return NULL;
+}
+
+static void IR_inline_function(IR_Inliner* inliner, i32 caller_index)
+{
+    IR_Program* program = inliner->program;
+    IR_Function_Decl* caller = program->function_array.functions[caller_index];
+
+    for (i32 i = 0; i < caller->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, caller->blocks.addresses[i]);
+        bool after_jump = false;
+
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (IR_is_terminator(node)) break;
+
+            if (IR_is_jump(node))
+            {
+                after_jump = true;
+            }
+
+            if (!IR_is_call(node) || node->instruction.call.inline_considered) continue;
+
+            IR_Call* call = &node->instruction.call;
+            call->inline_considered = true;
+
+            i32 callee_index = call->function_index;
+            String* callee_name = program->function_array.functions[callee_index]->name;
+            i32 threshold = 0;
+            char* reason = after_jump ? "call follows a branch in its block" : IR_inline_reject_reason(inliner, caller_index, call, &threshold);
+
+            if (reason)
+            {
+                if (inliner->report)
+                {
+                    fprintf(stderr, "Not inlining '%s' into '%s': %s\n", callee_name->str, caller->name->str, reason);
+                }
+                continue;
+            }
+
+            if (inliner->report)
+            {
+                fprintf(stderr, "Inlining '%s' into '%s' (cost %d, threshold %d)\n", callee_name->str, caller->name->str, inliner->sizes[callee_index], threshold);
+            }
+
+            IR_inline_call(inliner, caller_index, block->block_address, j);
+
+            // The callee has been processed, so the calls in its copy are all marked and the scan picks up again at the continuation
+            caller = program->function_array.functions[caller_index];
+            inliner->sizes[caller_index] += inliner->sizes[callee_index] - 1;
+            break;
+        }
+    }
+}
+
+void IR_inline(IR_Program* program, bool report, Allocator* allocator)
+{
+    IR_build_cfg(program);
+
+    IR_Function_Array* functions = &program->function_array;
+    IR_Inliner inliner = {0};
+    inliner.program = program;
+    inliner.allocator = allocator;
+    inliner.report = report;
+    inliner.sizes = mem_alloc(sizeof(i32) * (functions->count + 1));
+    inliner.call_site_counts = mem_calloc(functions->count + 1, sizeof(i32));
+    inliner.processed = mem_calloc(functions->count + 1, sizeof(bool));
+    inliner.returns_value = mem_calloc(functions->count + 1, sizeof(bool));
+    inliner.returns_nothing = mem_calloc(functions->count + 1, sizeof(bool));
+    IR_register_map_init(&inliner.map, program);
+
+    for (i32 i = 0; i < functions->count; i++)
+    {
+        IR_Function_Decl* function = functions->functions[i];
+        inliner.sizes[i] = function->removed ? 0 : IR_function_size(program, function);
+        if (function->removed) continue;
+
+        for (i32 j = 0; j < function->blocks.count; j++)
+        {
+            IR_Block* block = IR_get_block(program, function->blocks.addresses[j]);
+            for (i32 k = 0; k < block->node_array.count; k++)
+            {
+                IR_Node* node = &block->node_array.nodes[k];
+                if (IR_is_call(node))
+                {
+                    inliner.call_site_counts[node->instruction.call.function_index]++;
+                }
+                else if (node->type == IR_NODE_INSTRUCTION && node->instruction.type == IR_INS_RET)
+                {
+                    inliner.returns_value[i]   |= node->instruction.ret.has_return_value;
+                    inliner.returns_nothing[i] |= !node->instruction.ret.has_return_value;
+                }
+            }
+        }
+    }
+
+    // @Note: The CFG is only rebuilt at the end. Inlining never touches the callee, and the callee entry only needs its predecessors, which it keeps.
+    i32* order = IR_bottom_up_call_order(program);
+    for (i32 i = 0; order[i] != -1; i++)
+    {
+        IR_inline_function(&inliner, order[i]);
+        inliner.processed[order[i]] = true;
+    }
+
+    mem_free(order);
+    mem_free(inliner.sizes);
+    mem_free(inliner.call_site_counts);
+    mem_free(inliner.processed);
+    mem_free(inliner.returns_value);
+    mem_free(inliner.returns_nothing);
+    mem_free(inliner.renamed);
+    mem_free(inliner.clones);
+    mem_free(inliner.return_sites);
+    IR_register_map_free(&inliner.map);
+
+    IR_build_cfg(program);
+}
+
+void IR_optimize(IR_Program* program, IR_Optimization_Options options, Allocator* allocator)
+{
+    Trace_begin("pass", "if-convert");
+    IR_if_convert(program);
+    Trace_end();
+
+    Trace_begin("pass", "tail recursion");
+    IR_tail_recursion(program, allocator);
+    Trace_end();
+
+    if (!options.streaming)
+    {
+        Trace_begin("pass", "inline");
+        IR_inline(program, options.report_inlining, allocator);
+        Trace_end();
+    }
+
+    Trace_begin("pass", "sccp");
+    IR_sccp(program);
+    Trace_end();
+
+    Trace_begin("pass", "if-convert");
+    IR_if_convert(program);
+    Trace_end();
+
+    Trace_begin("pass", "gvn");
+    IR_gvn(program);
+    Trace_end();
+
+    Trace_begin("pass", "dce");
+    IR_dce(program);
+    // What calls a function compiled on its own comes later in the file
+    if (!options.streaming) IR_remove_unreachable_functions(program);
+    Trace_end();
+}
+
+/* ======================
+   Tail recursion
+   ====================== */
+
+// Index of the call to the function itself that the return at `index` returns the result of, -1 if there is none
+static i32 IR_find_tail_call(IR_Block* block, i32 index, i32 function_index)
+{
+    IR_Return* ret = &block->node_array.nodes[index].instruction.ret;
+    IR_Register result = ret->return_register;
+
+    // Translation copies the result before returning it
+    for (i32 i = index - 1; i >= 0; i--)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION) return -1;
+
+        IR_Instruction* instruction = &node->instruction;
+        if (ret->has_return_value && instruction->type == IR_INS_MOV && instruction->move.dst.type == IR_LOCATION_REGISTER &&
+            instruction->move.dst.reg.gpr_index == result.gpr_index)
+        {
+            IR_Register* source = IR_get_value_register(&instruction->move.src);
+            if (!source) return -1;
+
+            result = *source;
+            continue;
+        }
+
+        if (instruction->type != IR_INS_CALL || instruction->call.function_index != function_index) return -1;
+        if (ret->has_return_value && instruction->call.return_register.gpr_index != result.gpr_index) return -1;
+        return i;
+    }
+    return -1;
+}
+
+static bool IR_has_tail_recursion(IR_Program* program, i32 function_index)
+{
+    IR_Function_Decl* function = program->function_array.functions[function_index];
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type == IR_NODE_INSTRUCTION && node->instruction.type == IR_INS_RET)
+            {
+                if (IR_find_tail_call(block, j, function_index) != -1) return true;
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+static void IR_eliminate_tail_recursion(IR_Program* program, i32 function_index, Allocator* allocator)
+{
+    IR_Function_Decl* function = program->function_array.functions[function_index];
+
+    // The loop header takes everything in the entry after the argument loads
+    IR_Block* header = IR_allocate_block(program);
+    header->function_index = function_index;
+    IR_Block* entry = IR_get_block(program, function->entry);
+    IR_emit_label(header, IR_generate_label_name(program, allocator), allocator);
+
+    i32 split = 0;
+    while (split < entry->node_array.count)
+    {
+        IR_Node* node = &entry->node_array.nodes[split];
+        if (node->type == IR_NODE_INSTRUCTION && node->instruction.type != IR_INS_ARGUMENT) break;
+        split++;
+    }
+    for (i32 i = split; i < entry->node_array.count; i++)
+    {
+        *IR_emit_node(header, IR_NODE_INSTRUCTION) = entry->node_array.nodes[i];
+    }
+    entry->node_array.count = split;
+    IR_insert_block_address(&function->blocks, 1, header->block_address);
+
+    // Every argument gets a phi in the header, which replaces it everywhere but in the entry
+    i32 argument_count = 0;
+    IR_Register* arguments = mem_alloc(sizeof(IR_Register) * (split + 1));
+    IR_Register* phis = mem_alloc(sizeof(IR_Register) * (split + 1));
+    for (i32 i = 0; i < split; i++)
+    {
+        IR_Node* node = &entry->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION) continue;
+
+        arguments[argument_count] = node->instruction.argument.destination;
+        phis[argument_count] = IR_register_alloc(program->register_table);
+
+        IR_Node* phi_node = IR_insert_node(header, 1 + argument_count, IR_NODE_INSTRUCTION);
+        phi_node->instruction.type = IR_INS_PHI;
+        IR_Phi* phi = &phi_node->instruction.phi;
+        phi->destination = phis[argument_count];
+        phi->variable = phis[argument_count];
+        IR_add_phi_operand(phi, (IR_Phi_Operand) { .block = entry->block_address, .value = IR_create_value_register(arguments[argument_count]) });
+        argument_count++;
+    }
+
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = block == header ? 1 + argument_count : 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION || node->instruction.type == IR_INS_ARGUMENT) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            for (i32 k = 0; k < IR_get_use_count(instruction); k++)
+            {
+                IR_Register* use = IR_get_use(instruction, k);
+                for (i32 a = 0; use && a < argument_count; a++)
+                {
+                    if (use->gpr_index == arguments[a].gpr_index) *use = phis[a];
+                }
+            }
+
+            // The edges that left the entry leave the header now
+            for (i32 k = 0; instruction->type == IR_INS_PHI && k < instruction->phi.count; k++)
+            {
+                if (instruction->phi.operands[k].block.address == entry->block_address.address)
+                {
+                    instruction->phi.operands[k].block = header->block_address;
+                }
+            }
+        }
+    }
+
+    // Tail calls pass their arguments to the phis and jump back to the header
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION || node->instruction.type != IR_INS_RET) continue;
+
+            i32 call_index = IR_find_tail_call(block, j, function_index);
+            if (call_index != -1)
+            {
+                IR_Call* call = &block->node_array.nodes[call_index].instruction.call;
+                for (i32 a = 0; a < argument_count; a++)
+                {
+                    IR_Phi* phi = &header->node_array.nodes[1 + a].instruction.phi;
+                    IR_add_phi_operand(phi, (IR_Phi_Operand) { .block = block->block_address, .value = call->arguments.values[a] });
+                }
+                mem_free(call->arguments.values);
+
+                block->node_array.count = call_index;
+                IR_emit_jump(block, header->node_array.nodes[0].label, JMP_ALWAYS, header->block_address, allocator);
+            }
+            break;
+        }
+    }
+
+    mem_free(arguments);
+    mem_free(phis);
+}
+
+void IR_tail_recursion(IR_Program* program, Allocator* allocator)
+{
+    IR_build_cfg(program);
+
+    for (i32 i = 0; i < program->function_array.count; i++)
+    {
+        if (program->function_array.functions[i]->removed || !IR_has_tail_recursion(program, i)) continue;
+
+        IR_eliminate_tail_recursion(program, i, allocator);
+        IR_build_cfg(program);
+    }
+}
+
+/* ======================
+   Profiles
+   ====================== */
+
+static IR_Function_Profile* IR_find_function_profile(IR_Profile* profile, String* name)
+{
+    for (i32 i = 0; i < profile->count; i++)
+    {
+        if (string_equal_cstr(name, profile->functions[i].name)) return &profile->functions[i];
+    }
+    return NULL;
+}
+
+bool IR_read_profile(const char* path, IR_Profile* profile)
+{
+    *profile = (IR_Profile) {0};
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    char line[256];
+    bool valid = fgets(line, sizeof(line), file) && strcmp(line, IR_PROFILE_MAGIC "\n") == 0;
+    bool header_done = false;
+    while (valid && fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '\n')
+        {
+            header_done = true;
+            break;
+        }
+
+        char name[256];
+        i32 block_count;
+        if (sscanf(line, "%255s %d", name, &block_count) != 2 || block_count < 0)
+        {
+            valid = false;
+            break;
+        }
+
+        if (profile->count == profile->capacity)
+        {
+            profile->capacity = profile->capacity == 0 ? 256 : profile->capacity * 2;
+            profile->functions = mem_realloc(profile->functions, sizeof(IR_Function_Profile) * profile->capacity);
+        }
+
+        IR_Function_Profile* function = &profile->functions[profile->count++];
+        function->name = mem_alloc(strlen(name) + 1);
+        strcpy(function->name, name);
+        function->block_count = block_count;
+        function->counts = mem_calloc(block_count + 1, sizeof(u64));
+    }
+    valid &= header_done;
+
+    for (i32 i = 0; valid && i < profile->count; i++)
+    {
+        IR_Function_Profile* function = &profile->functions[i];
+        valid = fread(function->counts, sizeof(u64), function->block_count, file) == (size_t)function->block_count;
+    }
+    fclose(file);
+
+    if (!valid)
+    {
+        IR_free_profile(profile);
+    }
+    return valid;
+}
+
+void IR_free_profile(IR_Profile* profile)
+{
+    for (i32 i = 0; i < profile->count; i++)
+    {
+        mem_free(profile->functions[i].name);
+        mem_free(profile->functions[i].counts);
+    }
+    mem_free(profile->functions);
+    *profile = (IR_Profile) {0};
+}
+
+/* ======================
+   Block layout
+   ====================== */
+
+// Static estimates scale block frequencies so the entry of a function runs this often
+#define IR_ENTRY_FREQUENCY 10000
+
+// Ball and Larus - "Branch Prediction For Free", how often the predicted edge is taken in percent
+#define IR_PREDICT_LOOP_BRANCH  88
+#define IR_PREDICT_OPCODE       84
+#define IR_PREDICT_RETURN       72
+#define IR_PREDICT_ERROR_RETURN 90
+#define IR_PREDICT_RECURSION    72
+
+typedef struct IR_Block_Exits IR_Block_Exits;
+struct IR_Block_Exits
+{
+    IR_Node* branch;        // The conditional jump, NULL if there is none
+    IR_Block* taken;        // Target of the branch
+    IR_Block* continuation; // Where the block goes otherwise, NULL if it returns
+    i32 jump_index;         // Index of the unconditional jump to the continuation, -1 if it falls through
+};
+
+static IR_Block_Exits IR_get_block_exits(IR_Program* program, IR_Function_Decl* function, IR_Block* block)
+{
+    IR_Block_Exits exits = { .jump_index = -1 };
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (IR_is_terminator(node))
+        {
+            if (node->instruction.type == IR_INS_JUMP)
+            {
+                exits.continuation = IR_get_block(program, node->instruction.jump.address);
+                exits.jump_index = i;
+            }
+            return exits;
+        }
+
+        if (IR_is_jump(node))
+        {
+            exits.branch = node;
+            exits.taken = IR_get_block(program, node->instruction.jump.address);
+        }
+    }
+
+    if (block->layout_index + 1 < function->blocks.count)
+    {
+        exits.continuation = IR_get_block(program, function->blocks.addresses[block->layout_index + 1]);
+    }
+    return exits;
+}
+
+// Blocks only reached by falling through have no label, so they get one once something jumps to them
+static IR_Label* IR_get_or_add_label(IR_Program* program, IR_Block* block, Allocator* allocator)
+{
+    IR_Node* first = IR_get_node(block, 0);
+    if (!first || first->type != IR_NODE_LABEL)
+    {
+        first = IR_insert_node(block, 0, IR_NODE_LABEL);
+        first->label.label_name = IR_generate_label_name(program, allocator);
+    }
+    return &first->label;
+}
+
+// Dempster-Shafer, as Wu and Larus use it to combine the predictions of several heuristics for the same branch
+static i32 IR_combine_predictions(i32 a, i32 b)
+{
+    i32 taken = a * b;
+    i32 not_taken = (100 - a) * (100 - b);
+    i32 combined = taken * 100 / (taken + not_taken);
+    return combined < 1 ? 1 : combined > 99 ? 99 : combined;
+}
+
+// A prediction for successor 0 (the branch target) or 1 (the continuation) as the chance the branch is taken
+static i32 IR_predict_successor(i32 successor, i32 percentage)
+{
+    return successor == 0 ? percentage : 100 - percentage;
+}
+
+typedef enum
+{
+    IR_PATH_RETURNS       = 1 << 0,
+    IR_PATH_RETURNS_ERROR = 1 << 1,
+    IR_PATH_RECURSES      = 1 << 2,
+} IR_Path_Flags;
+
+static bool IR_returns_negative_literal(IR_Block* block, IR_Return* ret)
+{
+    if (!ret->has_return_value) return false;
+
+    i32 literal;
+    IR_Value value = IR_create_value_location(IR_create_location_register(ret->return_register));
+    return IR_get_literal_operand(block, &value, &literal) && literal < 0;
+}
+
+// What the straight line code starting at `block` does before it branches again or joins other paths
+static u32 IR_classify_path(IR_Program* program, IR_Function_Decl* function, i32 function_index, IR_Block* block)
+{
+    u32 flags = 0;
+    for (i32 depth = 0; depth < 4; depth++)
+    {
+        for (i32 i = 0; i < block->node_array.count; i++)
+        {
+            IR_Node* node = &block->node_array.nodes[i];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            if (instruction->type == IR_INS_CALL && instruction->call.function_index == function_index)
+            {
+                flags |= IR_PATH_RECURSES;
+            }
+            else if (instruction->type == IR_INS_RET)
+            {
+                flags |= IR_PATH_RETURNS;
+                if (IR_returns_negative_literal(block, &instruction->ret)) flags |= IR_PATH_RETURNS_ERROR;
+                return flags;
+            }
+        }
+
+        IR_Block_Exits exits = IR_get_block_exits(program, function, block);
+        if (exits.branch || !exits.continuation || exits.continuation->predecessors.count != 1) break;
+        block = exits.continuation;
+    }
+    return flags;
+}
+
+static bool IR_is_back_edge(IR_Program* program, IR_Block* from, IR_Block* to)
+{
+    return IR_dominates(program, to->block_address, from->block_address);
+}
+
+// The chance in percent that the conditional jump of a block is taken
+static i32 IR_predict_branch(IR_Program* program, IR_Function_Decl* function, i32 function_index, IR_Block* block, IR_Block_Exits* exits)
+{
+    i32 taken = 50;
+
+    IR_Instruction* flags = IR_find_flags(block, IR_instruction_index(block, &exits->branch->instruction));
+    if (flags)
+    {
+        IR_Value right = IR_create_value_location(flags->compare.right);
+        i32 literal = 1;
+        bool zero = (IR_get_literal_operand(block, &flags->compare.left, &literal) || IR_get_literal_operand(block, &right, &literal)) && literal == 0;
+
+        // Opcode heuristic: values are rarely equal and rarely negative. The literal is always subtracted (see IR_Compare).
+        switch(exits->branch->instruction.jump.type)
+        {
+        case JMP_EQUAL:
+        case JMP_ZERO:
+        taken = IR_combine_predictions(taken, 100 - IR_PREDICT_OPCODE);
+        break;
+        case JMP_NOT_EQUAL:
+        case JMP_NOT_ZERO:
+        taken = IR_combine_predictions(taken, IR_PREDICT_OPCODE);
+        break;
+        case JMP_LESS:
+        case JMP_LESS_EQUAL:
+        if (zero) taken = IR_combine_predictions(taken, 100 - IR_PREDICT_OPCODE);
+        break;
+        case JMP_GREATER:
+        case JMP_GREATER_EQUAL:
+        if (zero) taken = IR_combine_predictions(taken, IR_PREDICT_OPCODE);
+        break;
+        default: break;
+        }
+    }
+
+    IR_Block* successors[2] = { exits->taken, exits->continuation };
+    u32 paths[2];
+    for (i32 i = 0; i < 2; i++)
+    {
+        paths[i] = successors[i] ? IR_classify_path(program, function, function_index, successors[i]) : IR_PATH_RETURNS;
+
+        // Loop branch heuristic
+        if (successors[i] && IR_is_back_edge(program, block, successors[i]))
+        {
+            taken = IR_combine_predictions(taken, IR_predict_successor(i, IR_PREDICT_LOOP_BRANCH));
+        }
+    }
+
+    // @Note: Recursion is how this language loops, so the recursive path is the likely one
+    IR_Path_Flags heuristics[3] = { IR_PATH_RETURNS, IR_PATH_RETURNS_ERROR, IR_PATH_RECURSES };
+    i32 predictions[3] = { 100 - IR_PREDICT_RETURN, 100 - IR_PREDICT_ERROR_RETURN, IR_PREDICT_RECURSION };
+    for (i32 h = 0; h < 3; h++)
+    {
+        bool first = paths[0] & heuristics[h];
+        bool second = paths[1] & heuristics[h];
+        if (first != second)
+        {
+            taken = IR_combine_predictions(taken, IR_predict_successor(first ? 0 : 1, predictions[h]));
+        }
+    }
+    return taken;
+}
+
+// Percentage of the executions of a block that continue in `successor`
+static i32 IR_edge_percentage(IR_Block_Exits* exits, i32 taken, IR_Block* successor)
+{
+    if (!exits->branch) return exits->continuation == successor ? 100 : 0;
+
+    i32 percentage = 0;
+    if (exits->taken == successor) percentage += taken;
+    if (exits->continuation == successor) percentage += 100 - taken;
+    return percentage;
+}
+
+/*
+Propagates the predicted branch probabilities from the entry in reverse postorder (Wu and Larus - "Static Branch
+Frequency and Program Profile Analysis"). Back edges are not known yet when their header is visited, so a loop
+header is scaled by how likely its back edges are taken instead of how often the loop body gets to them.
+ */
+static void IR_estimate_frequencies(IR_Program* program, IR_Function_Decl* function, IR_Block_Exits* exits, i32* taken)
+{
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_get_block(program, function->blocks.addresses[i])->execution_count = 0;
+    }
+
+    for (i32 i = 0; i < function->reverse_postorder.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->reverse_postorder.addresses[i]);
+        u64 frequency = block->block_address.address == function->entry.address ? IR_ENTRY_FREQUENCY : 0;
+        i32 cyclic = 0;
+
+        for (i32 j = 0; j < block->predecessors.count; j++)
+        {
+            IR_Block* predecessor = IR_get_block(program, block->predecessors.addresses[j]);
+            if (predecessor->reverse_postorder_index == -1) continue;
+
+            i32 percentage = IR_edge_percentage(&exits[predecessor->layout_index], taken[predecessor->layout_index], block);
+            if (IR_is_back_edge(program, predecessor, block))
+            {
+                cyclic = percentage > cyclic ? percentage : cyclic;
+            }
+            else
+            {
+                frequency += predecessor->execution_count * percentage / 100;
+            }
+        }
+
+        if (cyclic > 0)
+        {
+            frequency = frequency * 100 / (100 - (cyclic > 95 ? 95 : cyclic));
+        }
+        block->execution_count = frequency;
+    }
+}
+
+typedef struct IR_Layout_Edge IR_Layout_Edge;
+struct IR_Layout_Edge
+{
+    i32 from; // Layout indices
+    i32 to;
+    u64 weight;
+};
+
+static int IR_compare_layout_edges(const void* a, const void* b)
+{
+    const IR_Layout_Edge* x = a;
+    const IR_Layout_Edge* y = b;
+    if (x->weight != y->weight) return x->weight < y->weight ? 1 : -1;
+    if (x->from != y->from) return x->from - y->from;
+    return x->to - y->to;
+}
+
+/*
+Pettis and Hansen - "Profile Guided Code Positioning". Every block starts out as its own chain, and going
+from the heaviest edge to the lightest, two chains are joined whenever the edge runs from the tail of one to
+the head of the other, so it becomes a fallthrough. The chain holding the entry goes first, and after that
+always the chain most strongly connected to what has been placed. Cold blocks are left out and go last.
+ */
+static void IR_place_blocks(IR_Program* program, IR_Function_Decl* function, IR_Block_Exits* exits, i32* taken, IR_Block** order, bool profiled)
+{
+    i32 count = function->blocks.count;
+    i32 entry = IR_get_block(program, function->entry)->layout_index;
+
+    IR_Layout_Edge* edges = mem_alloc(sizeof(IR_Layout_Edge) * (count * 2 + 1));
+    i32 edge_count = 0;
+    for (i32 i = 0; i < count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        IR_Block* successors[2] = { exits[i].taken, exits[i].continuation };
+        for (i32 j = 0; j < 2; j++)
+        {
+            IR_Block* successor = successors[j];
+            if (!successor || successor->layout_index == entry || successor == block || block->cold || successor->cold) continue;
+            if (j == 1 && successor == successors[0]) continue;
+
+            // @Note: Profiles only count blocks, so an edge can not have run more often than either of its ends
+            u64 weight = block->execution_count * IR_edge_percentage(&exits[i], taken[i], successor) / 100;
+            if (profiled)
+            {
+                weight = block->execution_count < successor->execution_count ? block->execution_count : successor->execution_count;
+            }
+            edges[edge_count++] = (IR_Layout_Edge) { .from = i, .to = successor->layout_index, .weight = weight };
+        }
+    }
+    qsort(edges, edge_count, sizeof(IR_Layout_Edge), IR_compare_layout_edges);
+
+    i32* next = mem_alloc(sizeof(i32) * count);
+    i32* previous = mem_alloc(sizeof(i32) * count);
+    i32* head = mem_alloc(sizeof(i32) * count);
+    bool* placed = mem_calloc(count, sizeof(bool));
+    for (i32 i = 0; i < count; i++)
+    {
+        next[i] = previous[i] = -1;
+        head[i] = i;
+    }
+
+    for (i32 i = 0; i < edge_count; i++)
+    {
+        i32 from = edges[i].from;
+        i32 to = edges[i].to;
+        if (next[from] != -1 || previous[to] != -1 || head[from] == head[to]) continue;
+
+        next[from] = to;
+        previous[to] = from;
+        for (i32 b = to; b != -1; b = next[b])
+        {
+            head[b] = head[from];
+        }
+    }
+
+    i32 placed_count = 0;
+    i32 chain = entry;
+    while (chain != -1)
+    {
+        for (i32 b = chain; b != -1; b = next[b])
+        {
+            order[placed_count++] = IR_get_block(program, function->blocks.addresses[b]);
+            placed[b] = true;
+        }
+
+        chain = -1;
+        for (i32 i = 0; i < edge_count && chain == -1; i++)
+        {
+            if (placed[edges[i].from] && !placed[edges[i].to]) chain = head[edges[i].to];
+        }
+        for (i32 i = 0; i < count && chain == -1; i++)
+        {
+            if (!placed[i] && !IR_get_block(program, function->blocks.addresses[i])->cold) chain = head[i];
+        }
+    }
+
+    for (i32 i = 0; i < count; i++)
+    {
+        if (!placed[i]) order[placed_count++] = IR_get_block(program, function->blocks.addresses[i]);
+    }
+
+    mem_free(edges);
+    mem_free(next);
+    mem_free(previous);
+    mem_free(head);
+    mem_free(placed);
+}
+
+/*
+Makes the control flow of every block explicit where the new order breaks it. A jump to the block that
+follows now is deleted, a branch to it is negated to go to the continuation instead, and a continuation
+that does not follow anymore gets a jump. Hot and cold blocks go to different sections, so they never fall
+through into each other.
+ */
+static void IR_apply_block_order(IR_Program* program, IR_Function_Decl* function, IR_Block** order, Allocator* allocator)
+{
+    i32 count = function->blocks.count;
+
+    // Labels go in first, since they move the nodes of their block
+    for (i32 i = 0; i < count; i++)
+    {
+        IR_Block* next = i + 1 < count && order[i + 1]->cold == order[i]->cold ? order[i + 1] : NULL;
+        IR_Block* continuation = IR_get_block_exits(program, function, order[i]).continuation;
+        if (continuation && continuation != next)
+        {
+            IR_get_or_add_label(program, continuation, allocator);
+        }
+    }
+
+    for (i32 i = 0; i < count; i++)
+    {
+        IR_Block* block = order[i];
+        IR_Block* next = i + 1 < count && order[i + 1]->cold == block->cold ? order[i + 1] : NULL;
+        IR_Block_Exits exits = IR_get_block_exits(program, function, block);
+        if (!exits.continuation) continue;
+
+        if (exits.jump_index != -1)
+        {
+            block->node_array.count = exits.jump_index;
+        }
+
+        if (exits.continuation == next) continue;
+
+        if (exits.branch && exits.taken == next)
+        {
+            exits.branch->instruction.jump.type = IR_negate_condition(exits.branch->instruction.jump.type);
+            exits.branch->instruction.jump.address = exits.continuation->block_address;
+        }
+        else
+        {
+            IR_emit_jump(block, IR_get_node(exits.continuation, 0)->label, JMP_ALWAYS, exits.continuation->block_address, allocator);
+        }
+    }
+
+    for (i32 i = 0; i < count; i++)
+    {
+        function->blocks.addresses[i] = order[i]->block_address;
+    }
+}
+
+static void IR_layout_function(IR_Program* program, i32 function_index, IR_Function_Profile* counts, Allocator* allocator)
+{
+    IR_Function_Decl* function = program->function_array.functions[function_index];
+    IR_Block_Address_Array* blocks = &function->blocks;
+    i32 count = blocks->count;
+
+    IR_Block_Exits* exits = mem_alloc(sizeof(IR_Block_Exits) * count);
+    i32* taken = mem_alloc(sizeof(i32) * count);
+    for (i32 i = 0; i < count; i++)
+    {
+        IR_Block* block = IR_get_block(program, blocks->addresses[i]);
+        exits[i] = IR_get_block_exits(program, function, block);
+        taken[i] = exits[i].branch ? IR_predict_branch(program, function, function_index, block, &exits[i]) : 100;
+
+        for (i32 j = 0; j < block->predecessors.count; j++)
+        {
+            block->loop_header |= IR_is_back_edge(program, IR_get_block(program, block->predecessors.addresses[j]), block);
+        }
+    }
+
+    // The code at the end of the function has nowhere to fall through to, so it has to stay there
+    IR_Block* last = IR_get_block(program, blocks->addresses[count - 1]);
+    IR_Node* last_node = IR_get_node(last, last->node_array.count - 1);
+    bool falls_off_end = !last_node || !IR_is_terminator(last_node);
+
+    if (counts)
+    {
+        for (i32 i = 0; i < count; i++)
+        {
+            IR_get_block(program, blocks->addresses[i])->execution_count = counts->counts[i];
+        }
+
+        function->cold = IR_get_block(program, function->entry)->execution_count == 0;
+        for (i32 i = 0; i < count; i++)
+        {
+            IR_Block* block = IR_get_block(program, blocks->addresses[i]);
+            block->cold = function->cold || block->execution_count == 0;
+        }
+    }
+    else
+    {
+        IR_estimate_frequencies(program, function, exits, taken);
+    }
+
+    if (!function->cold && !falls_off_end)
+    {
+        IR_Block** order = mem_alloc(sizeof(IR_Block*) * count);
+        IR_place_blocks(program, function, exits, taken, order, counts != NULL);
+        IR_apply_block_order(program, function, order, allocator);
+        mem_free(order);
+    }
+
+    mem_free(exits);
+    mem_free(taken);
+}
+
+void IR_layout_blocks(IR_Program* program, IR_Profile* profile, bool optimize, Allocator* allocator)
+{
+    IR_build_cfg(program);
+
+    for (i32 i = 0; i < program->function_array.count; i++)
+    {
+        IR_Function_Decl* function = program->function_array.functions[i];
+        if (function->removed) continue;
+
+        function->cold = false;
+        for (i32 j = 0; j < function->blocks.count; j++)
+        {
+            IR_Block* block = IR_get_block(program, function->blocks.addresses[j]);
+            block->profile_index = j;
+            block->execution_count = 0;
+            block->cold = false;
+            block->loop_header = false;
+        }
+
+        IR_Function_Profile* counts = profile ? IR_find_function_profile(profile, function->name) : NULL;
+        if (profile && (!counts || counts->block_count != function->blocks.count))
+        {
+            fprintf(stderr, "Profile does not match '%s', keeping its layout\n", function->name->str);
+            continue;
+        }
+
+        if (counts || optimize)
+        {
+            IR_layout_function(program, i, counts, allocator);
+        }
+    }
+
+    IR_build_cfg(program);
+}
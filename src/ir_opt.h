@@ -0,0 +1,131 @@
+#ifndef SKE_IR_OPT_H
+#define SKE_IR_OPT_H
+
+/* @Note:
+   Optimization passes over the IR. They all expect the program to be in SSA form (see ir_ssa.h),
+   so every register has exactly one definition, and they keep it that way.
+
+   ### If-conversion
+   Runs first, so small helpers like min, max and clamp are branch free by the time they are inlined, and
+   again after constant propagation, which resolves branches and can leave simple diamonds behind.
+   A conditional branch whose two arms are small and safe to run on both paths, and either both return or
+   meet again in a join block, is replaced by the arms followed by selects (cmov on x86) picking the values
+   the branch would have produced. The cost model weighs the extra work of running both arms against the
+   expected cost of mispredictions, guessed from what the branch compares, since there is no profile.
+
+   ### Tail recursion
+   Runs before inlining, so the loops it makes can be inlined like any other code. A function with at most
+   three arguments that returns the result of a call to itself gets the rest of its entry split off into a loop
+   header with a phi for every argument. Each such call becomes a jump back to the header that hands its
+   arguments to the phis, so deep recursions run in a single frame. Other tail calls are turned into jumps
+   by codegen (see X64_Codegen_Options).
+
+   ### Inlining
+   Runs after that, so the other passes see through the calls it removes. Functions are visited bottom up in
+   the call graph, so every callee already has its own calls inlined when its call sites are looked at.
+   A call site is inlined when the callee is no larger than the call itself, when it is below a size
+   threshold, or below a larger one if it is the only call site of a function that is not exported
+   (the callee is deleted afterwards). The blocks of the callee are copied into the caller right after
+   the call with fresh registers and labels, its argument loads become copies of the call arguments and
+   its returns jump to the block holding the rest of the caller. -inline-report prints every decision to stderr.
+   With -stream the bodies of the callees are gone by the time their callers are compiled, nothing is inlined.
+
+   ### Sparse conditional constant propagation
+   Wegman and Zadeck - "Constant Propagation with Conditional Branches". Registers start out
+   undefined and only move down the lattice (undefined -> constant -> not constant), and only blocks
+   reachable through executable edges are evaluated, so constants flowing through branches that are
+   never taken still fold. Constant definitions are rewritten into moves of the literal, conditional
+   jumps with a known outcome are resolved and blocks that can no longer be reached are deleted.
+
+   ### Global value numbering
+   Dominator based value numbering (Briggs, Cooper and Simpson - "Value Numbering"). Binary and
+   unary operations are hash-consed on their operator and the value numbers of their operands while
+   walking the dominator tree, with a scoped table so only values computed in a dominating block are
+   ever reused. Copies are propagated the same way. Compares have no result register in the IR, so
+   they only get their operands renumbered. A value is not reused across a call or from more than
+   GVN_REUSE_DISTANCE instructions up the dominator path, it is computed again instead, so reuse does not
+   keep more values alive than codegen has registers for.
+
+   ### Dead code elimination
+   Mark and sweep over the SSA registers: instructions with an effect besides their result (returns,
+   jumps, calls, pushes and pops) are live, and so is every definition they read, transitively. A compare
+   is live when a conditional jump or a live set or select reads its condition codes. Everything else is deleted, together with code behind a terminator, blocks that
+   are unreachable from their function entry and functions that are not reachable from main or an
+   exported function, unless the file is compiled a function at a time (-stream).
+
+   ### Block layout
+   Runs after the program is out of SSA form. Every block gets the index its profile counter has in its
+   function, which is its position before anything is moved, so the layout of an instrumented build and the
+   one reading its profile back agree as long as both run the same passes.
+   Block frequencies come from the profile with -fprofile-use. Otherwise, when optimizing, they are estimated
+   from static branch probabilities (Ball and Larus - "Branch Prediction For Free", combined and propagated as
+   in Wu and Larus - "Static Branch Frequency and Program Profile Analysis"):
+   - Back edges are taken.
+   - Values are rarely equal or negative.
+   - Paths that return a negative literal (an error) or return at all are unlikely.
+   - Paths that recurse are likely, since recursion is how this language loops.
+   Blocks are then placed by Pettis and Hansen's chain building, so the heaviest edges become fallthroughs.
+   Blocks that never ran according to the profile go to .text.unlikely, and so do whole functions that never
+   ran. Jumps to the block that now follows are deleted. A branch whose target now follows is negated, and a
+   continuation that no longer follows gets a jump. Loop headers are aligned by codegen.
+
+   ### Profiles
+   With -fprofile-generate codegen counts how often every block runs, and the program writes the counters to
+   the profile file on exit: IR_PROFILE_MAGIC, a line with the name and the block count of every function,
+   an empty line and then the 64 bit counters in the same order.
+ */
+
+#define IR_PROFILE_MAGIC "ske-profile 1"
+#define IR_DEFAULT_PROFILE_PATH "ske.profile"
+
+typedef enum
+{
+    LATTICE_UNDEFINED,
+    LATTICE_CONSTANT,
+    LATTICE_VARYING
+} IR_Lattice_Type;
+
+typedef struct IR_Lattice_Value IR_Lattice_Value;
+struct IR_Lattice_Value
+{
+    IR_Lattice_Type type;
+    i32 constant;
+};
+
+typedef struct IR_Function_Profile IR_Function_Profile;
+struct IR_Function_Profile
+{
+    char* name;
+    i32 block_count;
+    u64* counts; // By profile index
+};
+
+typedef struct IR_Profile IR_Profile;
+struct IR_Profile
+{
+    IR_Function_Profile* functions;
+    i32 count;
+    i32 capacity;
+};
+
+typedef struct IR_Optimization_Options IR_Optimization_Options;
+struct IR_Optimization_Options
+{
+    bool report_inlining;
+    bool streaming; // The program is one function of a file and what it calls (see IR_translate_declaration), nothing can be inlined or removed
+};
+
+void IR_if_convert(IR_Program* program);
+void IR_tail_recursion(IR_Program* program, Allocator* allocator);
+void IR_inline(IR_Program* program, bool report, Allocator* allocator);
+void IR_sccp(IR_Program* program);
+void IR_gvn(IR_Program* program);
+void IR_dce(IR_Program* program);
+
+void IR_optimize(IR_Program* program, IR_Optimization_Options options, Allocator* allocator);
+
+bool IR_read_profile(const char* path, IR_Profile* profile);
+void IR_free_profile(IR_Profile* profile);
+void IR_layout_blocks(IR_Program* program, IR_Profile* profile, bool optimize, Allocator* allocator);
+
+#endif
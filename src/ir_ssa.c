@@ -0,0 +1,1334 @@
+static bool IR_address_array_contains(IR_Block_Address_Array* array, IR_Block_Address address)
+{
+    for (i32 i = 0; i < array->count; i++)
+    {
+        if (array->addresses[i].address == address.address)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void IR_add_block_address_unique(IR_Block_Address_Array* array, IR_Block_Address address)
+{
+    if (!IR_address_array_contains(array, address))
+    {
+        IR_add_block_address(array, address);
+    }
+}
+
+bool IR_is_terminator(IR_Node* node)
+{
+    if (node->type != IR_NODE_INSTRUCTION) return false;
+
+    IR_Instruction* instruction = &node->instruction;
+    return instruction->type == IR_INS_RET || (instruction->type == IR_INS_JUMP && instruction->jump.type == JMP_ALWAYS);
+}
+
+static bool IR_is_jump(IR_Node* node)
+{
+    return node->type == IR_NODE_INSTRUCTION && node->instruction.type == IR_INS_JUMP;
+}
+
+static bool IR_is_phi(IR_Node* node)
+{
+    return node->type == IR_NODE_INSTRUCTION && node->instruction.type == IR_INS_PHI;
+}
+
+/*
+Index in front of the jumps that leave the block, and the compare setting the flags for them.
+This is where code that has to run on the way out of a block goes.
+ */
+i32 IR_get_block_exit(IR_Block* block)
+{
+    IR_Node* nodes = block->node_array.nodes;
+    i32 exit = block->node_array.count;
+
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        if (IR_is_terminator(&nodes[i]))
+        {
+            exit = i;
+            break;
+        }
+    }
+
+    bool skipped_conditional_jump = false;
+    while (exit > 0 && IR_is_jump(&nodes[exit - 1]))
+    {
+        skipped_conditional_jump = true;
+        exit--;
+    }
+
+    if (skipped_conditional_jump && exit > 0 && nodes[exit - 1].type == IR_NODE_INSTRUCTION && nodes[exit - 1].instruction.type == IR_INS_COMPARE)
+    {
+        exit--;
+    }
+
+    return exit;
+}
+
+static i32 IR_first_non_phi(IR_Block* block)
+{
+    i32 index = 0;
+    while (index < block->node_array.count && block->node_array.nodes[index].type != IR_NODE_INSTRUCTION)
+    {
+        index++;
+    }
+
+    while (index < block->node_array.count && IR_is_phi(&block->node_array.nodes[index]))
+    {
+        index++;
+    }
+    return index;
+}
+
+/* ======================
+   CFG
+   ====================== */
+
+static void IR_compute_reverse_postorder(IR_Program* program, IR_Function_Decl* function)
+{
+    i32 count = function->blocks.count;
+    if (function->entry.address == -1 || count == 0)
+    {
+        return;
+    }
+
+    bool* visited = mem_calloc(count, sizeof(bool));
+    IR_Block_Address* stack = mem_alloc(sizeof(IR_Block_Address) * count);
+    i32* next_successor = mem_alloc(sizeof(i32) * count);
+    IR_Block_Address* postorder = mem_alloc(sizeof(IR_Block_Address) * count);
+    i32 stack_count = 0;
+    i32 postorder_count = 0;
+
+    stack[stack_count] = function->entry;
+    next_successor[stack_count++] = 0;
+    visited[IR_get_block(program, function->entry)->layout_index] = true;
+
+    while (stack_count > 0)
+    {
+        IR_Block* block = IR_get_block(program, stack[stack_count - 1]);
+        i32* next = &next_successor[stack_count - 1];
+
+        if (*next < block->successors.count)
+        {
+            IR_Block_Address successor = block->successors.addresses[(*next)++];
+            IR_Block* successor_block = IR_get_block(program, successor);
+            if (!visited[successor_block->layout_index])
+            {
+                visited[successor_block->layout_index] = true;
+                stack[stack_count] = successor;
+                next_successor[stack_count++] = 0;
+            }
+        }
+        else
+        {
+            postorder[postorder_count++] = block->block_address;
+            stack_count--;
+        }
+    }
+
+    for (i32 i = postorder_count - 1; i >= 0; i--)
+    {
+        IR_Block* block = IR_get_block(program, postorder[i]);
+        block->reverse_postorder_index = function->reverse_postorder.count;
+        IR_add_block_address(&function->reverse_postorder, postorder[i]);
+    }
+
+    mem_free(visited);
+    mem_free(stack);
+    mem_free(next_successor);
+    mem_free(postorder);
+}
+
+static IR_Block_Address IR_intersect_dominators(IR_Program* program, IR_Block_Address a, IR_Block_Address b)
+{
+    IR_Block* first = IR_get_block(program, a);
+    IR_Block* second = IR_get_block(program, b);
+
+    while (first != second)
+    {
+        while (first->reverse_postorder_index > second->reverse_postorder_index)
+        {
+            first = IR_get_block(program, first->immediate_dominator);
+        }
+
+        while (second->reverse_postorder_index > first->reverse_postorder_index)
+        {
+            second = IR_get_block(program, second->immediate_dominator);
+        }
+    }
+
+    return first->block_address;
+}
+
+static void IR_number_dominator_tree(IR_Program* program, IR_Function_Decl* function)
+{
+    i32 count = function->reverse_postorder.count;
+    IR_Block_Address* stack = mem_alloc(sizeof(IR_Block_Address) * count);
+    i32* next_child = mem_alloc(sizeof(i32) * count);
+    i32 stack_count = 0;
+    i32 preorder = 0;
+    i32 postorder = 0;
+
+    stack[stack_count] = function->entry;
+    next_child[stack_count++] = 0;
+    IR_get_block(program, function->entry)->dominator_preorder = preorder++;
+
+    while (stack_count > 0)
+    {
+        IR_Block* block = IR_get_block(program, stack[stack_count - 1]);
+        i32* next = &next_child[stack_count - 1];
+
+        if (*next < block->dominator_children.count)
+        {
+            IR_Block_Address child = block->dominator_children.addresses[(*next)++];
+            IR_get_block(program, child)->dominator_preorder = preorder++;
+            stack[stack_count] = child;
+            next_child[stack_count++] = 0;
+        }
+        else
+        {
+            block->dominator_postorder = postorder++;
+            stack_count--;
+        }
+    }
+
+    mem_free(stack);
+    mem_free(next_child);
+}
+
+static void IR_compute_dominators(IR_Program* program, IR_Function_Decl* function)
+{
+    IR_Block_Address_Array* rpo = &function->reverse_postorder;
+    if (rpo->count == 0)
+    {
+        return;
+    }
+
+    IR_get_block(program, function->entry)->immediate_dominator = function->entry;
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (i32 i = 1; i < rpo->count; i++)
+        {
+            IR_Block* block = IR_get_block(program, rpo->addresses[i]);
+            IR_Block_Address new_dominator = { .address = -1 };
+
+            for (i32 j = 0; j < block->predecessors.count; j++)
+            {
+                IR_Block_Address predecessor = block->predecessors.addresses[j];
+                if (IR_get_block(program, predecessor)->immediate_dominator.address == -1)
+                {
+                    continue; // Unreachable or not processed yet
+                }
+
+                new_dominator = new_dominator.address == -1 ? predecessor : IR_intersect_dominators(program, predecessor, new_dominator);
+            }
+
+            if (block->immediate_dominator.address != new_dominator.address)
+            {
+                block->immediate_dominator = new_dominator;
+                changed = true;
+            }
+        }
+    }
+
+    for (i32 i = 1; i < rpo->count; i++)
+    {
+        IR_Block* block = IR_get_block(program, rpo->addresses[i]);
+        IR_add_block_address(&IR_get_block(program, block->immediate_dominator)->dominator_children, block->block_address);
+    }
+
+    IR_number_dominator_tree(program, function);
+
+    for (i32 i = 0; i < rpo->count; i++)
+    {
+        IR_Block* block = IR_get_block(program, rpo->addresses[i]);
+        if (block->predecessors.count < 2)
+        {
+            continue;
+        }
+
+        // @Note: The entry block can only have predecessors through a back edge, and then it is in its own frontier.
+        bool is_entry = block->block_address.address == function->entry.address;
+        IR_Block_Address stop = is_entry ? (IR_Block_Address) { .address = -1 } : block->immediate_dominator;
+
+        for (i32 j = 0; j < block->predecessors.count; j++)
+        {
+            IR_Block* runner = IR_get_block(program, block->predecessors.addresses[j]);
+            if (runner->reverse_postorder_index == -1)
+            {
+                continue;
+            }
+
+            while (runner->block_address.address != stop.address)
+            {
+                IR_add_block_address_unique(&runner->dominance_frontier, block->block_address);
+                if (runner->block_address.address == function->entry.address)
+                {
+                    break;
+                }
+                runner = IR_get_block(program, runner->immediate_dominator);
+            }
+        }
+    }
+}
+
+void IR_build_cfg(IR_Program* program)
+{
+    IR_Function_Array* functions = &program->function_array;
+    IR_Block_Array* block_array = &program->block_array;
+
+    for (i32 i = 0; i < block_array->count; i++)
+    {
+        block_array->blocks[i].layout_index = -1;
+    }
+
+    // Keep the layout of blocks that still belong to their function, deleted blocks drop out
+    for (i32 i = 0; i < functions->count; i++)
+    {
+        IR_Function_Decl* function = functions->functions[i];
+        function->entry = (IR_Block_Address) { .address = -1 };
+        function->reverse_postorder.count = 0;
+
+        i32 kept = 0;
+        for (i32 j = 0; j < function->blocks.count; j++)
+        {
+            IR_Block* block = IR_get_block(program, function->blocks.addresses[j]);
+            if (block->function_index == i && block->layout_index == -1)
+            {
+                block->layout_index = kept;
+                function->blocks.addresses[kept++] = block->block_address;
+            }
+        }
+        function->blocks.count = kept;
+    }
+
+    for (i32 i = 0; i < block_array->count; i++)
+    {
+        IR_Block* block = &block_array->blocks[i];
+        block->predecessors.count       = 0;
+        block->successors.count         = 0;
+        block->dominator_children.count = 0;
+        block->dominance_frontier.count = 0;
+        block->reverse_postorder_index  = -1;
+        block->immediate_dominator      = (IR_Block_Address) { .address = -1 };
+        block->dominator_preorder       = -1;
+        block->dominator_postorder      = -1;
+
+        if (block->function_index < 0)
+        {
+            continue;
+        }
+
+        IR_Function_Decl* function = functions->functions[block->function_index];
+        if (block->node_array.count > 0 && block->node_array.nodes[0].type == IR_NODE_FUNCTION_DECL)
+        {
+            function->entry = block->block_address;
+        }
+
+        // Blocks that are new since the last build go at the end of the layout
+        if (block->layout_index == -1)
+        {
+            block->layout_index = function->blocks.count;
+            IR_add_block_address(&function->blocks, block->block_address);
+        }
+    }
+
+    for (i32 i = 0; i < functions->count; i++)
+    {
+        IR_Function_Decl* function = functions->functions[i];
+        IR_Block_Address_Array* blocks = &function->blocks;
+
+        for (i32 j = 0; j < blocks->count; j++)
+        {
+            IR_Block* block = IR_get_block(program, blocks->addresses[j]);
+            bool falls_through = true;
+
+            for (i32 k = 0; k < block->node_array.count; k++)
+            {
+                IR_Node* node = &block->node_array.nodes[k];
+                if (IR_is_jump(node))
+                {
+                    IR_add_block_address_unique(&block->successors, node->instruction.jump.address);
+                }
+
+                if (IR_is_terminator(node))
+                {
+                    falls_through = false;
+                    break;
+                }
+            }
+
+            if (falls_through && j + 1 < blocks->count)
+            {
+                IR_add_block_address_unique(&block->successors, blocks->addresses[j + 1]);
+            }
+        }
+
+        for (i32 j = 0; j < blocks->count; j++)
+        {
+            IR_Block* block = IR_get_block(program, blocks->addresses[j]);
+            for (i32 k = 0; k < block->successors.count; k++)
+            {
+                IR_add_block_address(&IR_get_block(program, block->successors.addresses[k])->predecessors, block->block_address);
+            }
+        }
+
+        IR_compute_reverse_postorder(program, function);
+        IR_compute_dominators(program, function);
+    }
+}
+
+bool IR_dominates(IR_Program* program, IR_Block_Address dominator, IR_Block_Address block)
+{
+    IR_Block* a = IR_get_block(program, dominator);
+    IR_Block* b = IR_get_block(program, block);
+
+    if (a->dominator_preorder == -1 || b->dominator_preorder == -1)
+    {
+        return false;
+    }
+
+    return a->dominator_preorder <= b->dominator_preorder && b->dominator_postorder <= a->dominator_postorder;
+}
+
+/* ======================
+   Register maps and sets
+   ====================== */
+
+void IR_register_map_init(IR_Register_Map* map, IR_Program* program)
+{
+    map->capacity = program->register_table->capacity;
+    map->local_index = mem_alloc(sizeof(i32) * (map->capacity > 0 ? map->capacity : 1));
+    for (i32 i = 0; i < map->capacity; i++)
+    {
+        map->local_index[i] = -1;
+    }
+
+    map->registers = NULL;
+    map->count = 0;
+    map->register_capacity = 0;
+}
+
+i32 IR_register_map_add(IR_Register_Map* map, IR_Register reg)
+{
+    i32 key = reg.gpr_index;
+    if (key >= map->capacity)
+    {
+        i32 old_capacity = map->capacity;
+        while (map->capacity <= key)
+        {
+            map->capacity = map->capacity == 0 ? 256 : map->capacity * 2;
+        }
+
+        map->local_index = mem_realloc(map->local_index, sizeof(i32) * map->capacity);
+        for (i32 i = old_capacity; i < map->capacity; i++)
+        {
+            map->local_index[i] = -1;
+        }
+    }
+
+    if (map->local_index[key] != -1)
+    {
+        return map->local_index[key];
+    }
+
+    if (map->count + 1 > map->register_capacity)
+    {
+        map->register_capacity = map->register_capacity == 0 ? 256 : map->register_capacity * 2;
+        map->registers = mem_realloc(map->registers, sizeof(IR_Register) * map->register_capacity);
+    }
+
+    map->registers[map->count] = reg;
+    map->local_index[key] = map->count;
+    return map->count++;
+}
+
+i32 IR_register_map_find(IR_Register_Map* map, IR_Register reg)
+{
+    if (reg.gpr_index < 0 || reg.gpr_index >= map->capacity)
+    {
+        return -1;
+    }
+    return map->local_index[reg.gpr_index];
+}
+
+// @Note: Only touches the registers in the map, so clearing is proportional to the function and not the program
+void IR_register_map_clear(IR_Register_Map* map)
+{
+    for (i32 i = 0; i < map->count; i++)
+    {
+        map->local_index[map->registers[i].gpr_index] = -1;
+    }
+    map->count = 0;
+}
+
+void IR_register_map_free(IR_Register_Map* map)
+{
+    mem_free(map->local_index);
+    mem_free(map->registers);
+    map->local_index = NULL;
+    map->registers = NULL;
+    map->capacity = 0;
+    map->count = 0;
+    map->register_capacity = 0;
+}
+
+IR_Register_Set IR_register_set_create(i32 count)
+{
+    IR_Register_Set set;
+    set.word_count = (count + 63) / 64;
+    set.bits = mem_calloc(set.word_count > 0 ? set.word_count : 1, sizeof(u64));
+    return set;
+}
+
+void IR_register_set_free(IR_Register_Set* set)
+{
+    mem_free(set->bits);
+    set->bits = NULL;
+    set->word_count = 0;
+}
+
+bool IR_register_set_contains(IR_Register_Set* set, i32 index)
+{
+    return (set->bits[index / 64] >> (index % 64)) & 1;
+}
+
+void IR_register_set_add(IR_Register_Set* set, i32 index)
+{
+    set->bits[index / 64] |= (u64)1 << (index % 64);
+}
+
+void IR_register_set_remove(IR_Register_Set* set, i32 index)
+{
+    set->bits[index / 64] &= ~((u64)1 << (index % 64));
+}
+
+/* ======================
+   Liveness
+   ====================== */
+
+static void IR_map_function_registers(IR_Program* program, IR_Function_Decl* function, IR_Register_Map* map)
+{
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            for (i32 k = 0; k < IR_get_use_count(instruction); k++)
+            {
+                IR_Register* use = IR_get_use(instruction, k);
+                if (use) IR_register_map_add(map, *use);
+            }
+
+            IR_Register* definition = IR_get_definition(program, instruction);
+            if (definition && IR_register_is_valid(*definition))
+            {
+                IR_register_map_add(map, *definition);
+            }
+        }
+    }
+}
+
+/*
+Standard backwards dataflow over the blocks of a function. Phi operands are live out of the
+predecessor they come from, not live into the phi block.
+Every register of the function is added to the map, which has to be cleared by the caller.
+ */
+void IR_compute_liveness(IR_Program* program, IR_Function_Decl* function, IR_Register_Map* map, IR_Liveness* liveness)
+{
+    IR_map_function_registers(program, function, map);
+
+    i32 count = function->blocks.count;
+    i32 register_count = map->count;
+
+    liveness->block_count = count;
+    liveness->live_in = mem_alloc(sizeof(IR_Register_Set) * (count > 0 ? count : 1));
+    liveness->live_out = mem_alloc(sizeof(IR_Register_Set) * (count > 0 ? count : 1));
+
+    IR_Register_Set* upward_exposed = mem_alloc(sizeof(IR_Register_Set) * (count > 0 ? count : 1));
+    IR_Register_Set* killed = mem_alloc(sizeof(IR_Register_Set) * (count > 0 ? count : 1));
+    IR_Register_Set* phi_uses = mem_alloc(sizeof(IR_Register_Set) * (count > 0 ? count : 1));
+
+    for (i32 i = 0; i < count; i++)
+    {
+        liveness->live_in[i] = IR_register_set_create(register_count);
+        liveness->live_out[i] = IR_register_set_create(register_count);
+        upward_exposed[i] = IR_register_set_create(register_count);
+        killed[i] = IR_register_set_create(register_count);
+        phi_uses[i] = IR_register_set_create(register_count);
+    }
+
+    for (i32 i = 0; i < count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            if (instruction->type == IR_INS_PHI)
+            {
+                IR_Phi* phi = &instruction->phi;
+                for (i32 k = 0; k < phi->count; k++)
+                {
+                    IR_Register* use = IR_get_use(instruction, k);
+                    IR_Block* predecessor = IR_get_block(program, phi->operands[k].block);
+                    if (use && predecessor->function_index == block->function_index)
+                    {
+                        IR_register_set_add(&phi_uses[predecessor->layout_index], IR_register_map_find(map, *use));
+                    }
+                }
+            }
+            else
+            {
+                for (i32 k = 0; k < IR_get_use_count(instruction); k++)
+                {
+                    IR_Register* use = IR_get_use(instruction, k);
+                    if (!use) continue;
+
+                    i32 local = IR_register_map_find(map, *use);
+                    if (!IR_register_set_contains(&killed[i], local))
+                    {
+                        IR_register_set_add(&upward_exposed[i], local);
+                    }
+                }
+            }
+
+            IR_Register* definition = IR_get_definition(program, instruction);
+            if (definition && IR_register_is_valid(*definition))
+            {
+                IR_register_set_add(&killed[i], IR_register_map_find(map, *definition));
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (i32 i = count - 1; i >= 0; i--)
+        {
+            IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+            IR_Register_Set* out = &liveness->live_out[i];
+            IR_Register_Set* in = &liveness->live_in[i];
+
+            for (i32 w = 0; w < out->word_count; w++)
+            {
+                u64 bits = phi_uses[i].bits[w];
+                for (i32 k = 0; k < block->successors.count; k++)
+                {
+                    IR_Block* successor = IR_get_block(program, block->successors.addresses[k]);
+                    bits |= liveness->live_in[successor->layout_index].bits[w];
+                }
+                out->bits[w] = bits;
+
+                u64 new_in = upward_exposed[i].bits[w] | (bits & ~killed[i].bits[w]);
+                if (new_in != in->bits[w])
+                {
+                    in->bits[w] = new_in;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (i32 i = 0; i < count; i++)
+    {
+        IR_register_set_free(&upward_exposed[i]);
+        IR_register_set_free(&killed[i]);
+        IR_register_set_free(&phi_uses[i]);
+    }
+    mem_free(upward_exposed);
+    mem_free(killed);
+    mem_free(phi_uses);
+}
+
+void IR_liveness_free(IR_Liveness* liveness)
+{
+    for (i32 i = 0; i < liveness->block_count; i++)
+    {
+        IR_register_set_free(&liveness->live_in[i]);
+        IR_register_set_free(&liveness->live_out[i]);
+    }
+    mem_free(liveness->live_in);
+    mem_free(liveness->live_out);
+    liveness->live_in = NULL;
+    liveness->live_out = NULL;
+    liveness->block_count = 0;
+}
+
+/* ======================
+   SSA construction
+   ====================== */
+
+typedef struct IR_Rename_Stack IR_Rename_Stack;
+struct IR_Rename_Stack
+{
+    IR_Register* registers;
+    i32 count;
+    i32 capacity;
+};
+
+typedef struct IR_SSA_Builder IR_SSA_Builder;
+struct IR_SSA_Builder
+{
+    IR_Program* program;
+    IR_Register_Map map;
+
+    IR_Rename_Stack* stacks; // By local index
+    bool* has_original_name_been_used;
+
+    // Local indices in the order they were pushed, so a block can pop what it pushed
+    i32* push_log;
+    i32 push_log_count;
+    i32 push_log_capacity;
+};
+
+static void IR_ssa_push_name(IR_SSA_Builder* builder, i32 local, IR_Register reg)
+{
+    IR_Rename_Stack* stack = &builder->stacks[local];
+    if (stack->count + 1 > stack->capacity)
+    {
+        stack->capacity = stack->capacity == 0 ? 8 : stack->capacity * 2;
+        stack->registers = mem_realloc(stack->registers, sizeof(IR_Register) * stack->capacity);
+    }
+    stack->registers[stack->count++] = reg;
+
+    if (builder->push_log_count + 1 > builder->push_log_capacity)
+    {
+        builder->push_log_capacity = builder->push_log_capacity == 0 ? 256 : builder->push_log_capacity * 2;
+        builder->push_log = mem_realloc(builder->push_log, sizeof(i32) * builder->push_log_capacity);
+    }
+    builder->push_log[builder->push_log_count++] = local;
+}
+
+static void IR_ssa_pop_names(IR_SSA_Builder* builder, i32 push_log_mark)
+{
+    while (builder->push_log_count > push_log_mark)
+    {
+        i32 local = builder->push_log[--builder->push_log_count];
+        builder->stacks[local].count--;
+    }
+}
+
+// @Note: The first definition we run into keeps the original register, every other one gets a fresh one.
+static IR_Register IR_ssa_new_name(IR_SSA_Builder* builder, i32 local)
+{
+    IR_Register reg;
+    if (!builder->has_original_name_been_used[local])
+    {
+        builder->has_original_name_been_used[local] = true;
+        reg = builder->map.registers[local];
+    }
+    else
+    {
+        reg = IR_register_alloc(builder->program->register_table);
+    }
+
+    IR_ssa_push_name(builder, local, reg);
+    return reg;
+}
+
+static IR_Register* IR_ssa_current_name(IR_SSA_Builder* builder, IR_Register reg)
+{
+    i32 local = IR_register_map_find(&builder->map, reg);
+    if (local == -1 || builder->stacks[local].count == 0)
+    {
+        return NULL;
+    }
+
+    IR_Rename_Stack* stack = &builder->stacks[local];
+    return &stack->registers[stack->count - 1];
+}
+
+static void IR_ssa_rename_block(IR_SSA_Builder* builder, IR_Block* block)
+{
+    IR_Program* program = builder->program;
+
+    for (i32 i = 0; i < block->node_array.count; i++)
+    {
+        IR_Node* node = &block->node_array.nodes[i];
+        if (node->type != IR_NODE_INSTRUCTION) continue;
+
+        IR_Instruction* instruction = &node->instruction;
+        if (instruction->type == IR_INS_PHI)
+        {
+            i32 local = IR_register_map_find(&builder->map, instruction->phi.variable);
+            instruction->phi.destination = IR_ssa_new_name(builder, local);
+            continue;
+        }
+
+        for (i32 j = 0; j < IR_get_use_count(instruction); j++)
+        {
+            IR_Register* use = IR_get_use(instruction, j);
+            IR_Register* name = use ? IR_ssa_current_name(builder, *use) : NULL;
+            if (name)
+            {
+                *use = *name;
+            }
+        }
+
+        IR_Register* definition = IR_get_definition(program, instruction);
+        if (definition && IR_register_is_valid(*definition))
+        {
+            i32 local = IR_register_map_find(&builder->map, *definition);
+            *definition = IR_ssa_new_name(builder, local);
+        }
+    }
+
+    for (i32 i = 0; i < block->successors.count; i++)
+    {
+        IR_Block* successor = IR_get_block(program, block->successors.addresses[i]);
+        for (i32 j = IR_first_non_phi(successor) - 1; j >= 0 && IR_is_phi(&successor->node_array.nodes[j]); j--)
+        {
+            IR_Phi* phi = &successor->node_array.nodes[j].instruction.phi;
+            for (i32 k = 0; k < phi->count; k++)
+            {
+                if (phi->operands[k].block.address != block->block_address.address) continue;
+
+                IR_Register* name = IR_ssa_current_name(builder, phi->variable);
+                // @Note: Undefined along this edge, any value will do
+                phi->operands[k].value = name ? IR_create_value_register(*name) : IR_create_value_number(0);
+            }
+        }
+    }
+}
+
+static void IR_ssa_insert_phi(IR_Program* program, IR_Block* block, IR_Register variable)
+{
+    IR_Node* node = IR_insert_node(block, IR_first_non_phi(block), IR_NODE_INSTRUCTION);
+    node->instruction.type = IR_INS_PHI;
+
+    IR_Phi* phi = &node->instruction.phi;
+    phi->destination = variable;
+    phi->variable = variable;
+
+    for (i32 i = 0; i < block->predecessors.count; i++)
+    {
+        IR_Block_Address predecessor = block->predecessors.addresses[i];
+        if (IR_get_block(program, predecessor)->reverse_postorder_index == -1) continue;
+
+        IR_Phi_Operand operand = { .block = predecessor, .value = IR_create_value_register(variable) };
+        IR_add_phi_operand(phi, operand);
+    }
+}
+
+static void IR_construct_function_ssa(IR_SSA_Builder* builder, IR_Function_Decl* function)
+{
+    IR_Program* program = builder->program;
+    IR_Block_Address_Array* rpo = &function->reverse_postorder;
+    if (rpo->count == 0)
+    {
+        return;
+    }
+
+    IR_Register_Map* map = &builder->map;
+    IR_register_map_clear(map);
+
+    // Find the registers that are used in another block than the one defining them, and where they are defined
+    IR_Block_Address_Array* definition_blocks = NULL;
+    bool* is_global = NULL;
+    i32* defined_in_block = NULL; // Layout index + 1 of the block that last defined the register while scanning
+    i32 capacity = 0;
+
+    for (i32 i = 0; i < rpo->count; i++)
+    {
+        IR_Block* block = IR_get_block(program, rpo->addresses[i]);
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            for (i32 k = -1; k < IR_get_use_count(instruction); k++)
+            {
+                IR_Register* reg = k == -1 ? IR_get_definition(program, instruction) : IR_get_use(instruction, k);
+                if (!reg || !IR_register_is_valid(*reg)) continue;
+
+                i32 local = IR_register_map_add(map, *reg);
+                if (local >= capacity)
+                {
+                    i32 old_capacity = capacity;
+                    capacity = capacity == 0 ? 256 : capacity * 2;
+                    definition_blocks = mem_realloc(definition_blocks, sizeof(IR_Block_Address_Array) * capacity);
+                    is_global = mem_realloc(is_global, sizeof(bool) * capacity);
+                    defined_in_block = mem_realloc(defined_in_block, sizeof(i32) * capacity);
+                    for (i32 c = old_capacity; c < capacity; c++)
+                    {
+                        definition_blocks[c] = (IR_Block_Address_Array){0};
+                        is_global[c] = false;
+                        defined_in_block[c] = 0;
+                    }
+                }
+            }
+
+            // Uses come before the definition of the same instruction
+            for (i32 k = 0; k < IR_get_use_count(instruction); k++)
+            {
+                IR_Register* use = IR_get_use(instruction, k);
+                if (!use) continue;
+
+                i32 local = IR_register_map_find(map, *use);
+                if (defined_in_block[local] != block->layout_index + 1)
+                {
+                    is_global[local] = true;
+                }
+            }
+
+            IR_Register* definition = IR_get_definition(program, instruction);
+            if (definition && IR_register_is_valid(*definition))
+            {
+                i32 local = IR_register_map_find(map, *definition);
+                if (defined_in_block[local] != block->layout_index + 1)
+                {
+                    defined_in_block[local] = block->layout_index + 1;
+                    IR_add_block_address(&definition_blocks[local], block->block_address);
+                }
+            }
+        }
+    }
+
+    // Place phis on the iterated dominance frontier of the definitions
+    i32 block_count = function->blocks.count;
+    i32* has_phi = mem_alloc(sizeof(i32) * block_count);
+    i32* in_worklist = mem_alloc(sizeof(i32) * block_count);
+    IR_Block_Address* worklist = mem_alloc(sizeof(IR_Block_Address) * block_count);
+    for (i32 i = 0; i < block_count; i++)
+    {
+        has_phi[i] = -1;
+        in_worklist[i] = -1;
+    }
+
+    i32 register_count = map->count;
+    for (i32 local = 0; local < register_count; local++)
+    {
+        if (!is_global[local]) continue;
+
+        i32 worklist_count = 0;
+        IR_Block_Address_Array* definitions = &definition_blocks[local];
+        for (i32 i = 0; i < definitions->count; i++)
+        {
+            in_worklist[IR_get_block(program, definitions->addresses[i])->layout_index] = local;
+            worklist[worklist_count++] = definitions->addresses[i];
+        }
+
+        while (worklist_count > 0)
+        {
+            IR_Block* block = IR_get_block(program, worklist[--worklist_count]);
+            for (i32 i = 0; i < block->dominance_frontier.count; i++)
+            {
+                IR_Block* frontier = IR_get_block(program, block->dominance_frontier.addresses[i]);
+                if (has_phi[frontier->layout_index] == local) continue;
+
+                has_phi[frontier->layout_index] = local;
+                IR_ssa_insert_phi(program, frontier, map->registers[local]);
+
+                if (in_worklist[frontier->layout_index] != local)
+                {
+                    in_worklist[frontier->layout_index] = local;
+                    worklist[worklist_count++] = frontier->block_address;
+                }
+            }
+        }
+    }
+
+    for (i32 i = 0; i < capacity; i++)
+    {
+        mem_free(definition_blocks[i].addresses);
+    }
+    mem_free(definition_blocks);
+    mem_free(is_global);
+    mem_free(defined_in_block);
+    mem_free(has_phi);
+    mem_free(in_worklist);
+    mem_free(worklist);
+
+    // Rename along the dominator tree
+    builder->stacks = mem_calloc(register_count > 0 ? register_count : 1, sizeof(IR_Rename_Stack));
+    builder->has_original_name_been_used = mem_calloc(register_count > 0 ? register_count : 1, sizeof(bool));
+    builder->push_log_count = 0;
+
+    IR_Block_Address* stack = mem_alloc(sizeof(IR_Block_Address) * rpo->count);
+    i32* next_child = mem_alloc(sizeof(i32) * rpo->count);
+    i32* push_log_marks = mem_alloc(sizeof(i32) * rpo->count);
+    i32 stack_count = 0;
+
+    push_log_marks[stack_count] = builder->push_log_count;
+    IR_ssa_rename_block(builder, IR_get_block(program, function->entry));
+    stack[stack_count] = function->entry;
+    next_child[stack_count++] = 0;
+
+    while (stack_count > 0)
+    {
+        IR_Block* block = IR_get_block(program, stack[stack_count - 1]);
+        i32* next = &next_child[stack_count - 1];
+
+        if (*next < block->dominator_children.count)
+        {
+            IR_Block_Address child = block->dominator_children.addresses[(*next)++];
+            push_log_marks[stack_count] = builder->push_log_count;
+            IR_ssa_rename_block(builder, IR_get_block(program, child));
+            stack[stack_count] = child;
+            next_child[stack_count++] = 0;
+        }
+        else
+        {
+            stack_count--;
+            IR_ssa_pop_names(builder, push_log_marks[stack_count]);
+        }
+    }
+
+    mem_free(stack);
+    mem_free(next_child);
+    mem_free(push_log_marks);
+
+    for (i32 i = 0; i < register_count; i++)
+    {
+        mem_free(builder->stacks[i].registers);
+    }
+    mem_free(builder->stacks);
+    mem_free(builder->has_original_name_been_used);
+    builder->stacks = NULL;
+    builder->has_original_name_been_used = NULL;
+}
+
+void IR_construct_ssa(IR_Program* program)
+{
+    IR_build_cfg(program);
+
+    IR_SSA_Builder builder = {0};
+    builder.program = program;
+    IR_register_map_init(&builder.map, program);
+
+    for (i32 i = 0; i < program->function_array.count; i++)
+    {
+        IR_construct_function_ssa(&builder, program->function_array.functions[i]);
+    }
+
+    IR_register_map_free(&builder.map);
+    mem_free(builder.push_log);
+}
+
+/* ======================
+   Out of SSA
+   ====================== */
+
+static void IR_insert_move(IR_Block* block, i32 index, IR_Value src, IR_Register dst)
+{
+    IR_Node* node = IR_insert_node(block, index, IR_NODE_INSTRUCTION);
+    node->instruction.type = IR_INS_MOV;
+    node->instruction.move.src = src;
+    node->instruction.move.dst = IR_create_location_register(dst);
+}
+
+static void IR_eliminate_phis(IR_Program* program, IR_Function_Decl* function)
+{
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            if (!IR_is_phi(&block->node_array.nodes[j])) continue;
+
+            IR_Phi phi = block->node_array.nodes[j].instruction.phi;
+            IR_Register copy = IR_register_alloc(program->register_table);
+
+            for (i32 k = 0; k < phi.count; k++)
+            {
+                IR_Block* predecessor = IR_get_block(program, phi.operands[k].block);
+                IR_insert_move(predecessor, IR_get_block_exit(predecessor), phi.operands[k].value, copy);
+            }
+
+            // @Note: Predecessor exits are always behind the phis, so j still points at this phi
+            IR_Instruction* instruction = &block->node_array.nodes[j].instruction;
+            instruction->type = IR_INS_MOV;
+            instruction->move.src = IR_create_value_register(copy);
+            instruction->move.dst = IR_create_location_register(phi.destination);
+
+            mem_free(phi.operands);
+        }
+    }
+}
+
+// lea and the immediate form of imul write a register other than their operands, see X64_select_instructions
+static bool IR_is_three_address(IR_Instruction* instruction)
+{
+    return instruction->type == IR_INS_LEA
+        || (instruction->type == IR_INS_BINOP && instruction->binop.operator == OP_MUL && instruction->binop.right.type == VALUE_INT);
+}
+
+/*
+The x86 backend computes binary and unary operations in place: subtraction and operations with an
+immediate into their left operand and everything else into its right operand. Selects move their true
+operand over the false one.
+ */
+static void IR_lower_two_address(IR_Program* program, IR_Function_Decl* function)
+{
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            IR_Value* in_place = NULL;
+            IR_Register destination;
+
+            if (IR_is_three_address(instruction))
+            {
+                continue;
+            }
+            else if (instruction->type == IR_INS_BINOP)
+            {
+                IR_BinOp* binop = &instruction->binop;
+                in_place = binop->operator == OP_SUB || binop->right.type == VALUE_INT ? &binop->left : &binop->right;
+                destination = instruction->binop.destination;
+            }
+            else if (instruction->type == IR_INS_UNOP)
+            {
+                in_place = &instruction->unop.value;
+                destination = instruction->unop.destination;
+            }
+            else if (instruction->type == IR_INS_SELECT)
+            {
+                in_place = &instruction->select.if_false;
+                destination = instruction->select.destination;
+            }
+
+            if (!in_place) continue;
+            if (in_place->type == VALUE_LOCATION && in_place->loc.reg.gpr_index == destination.gpr_index) continue;
+
+            IR_Value src = *in_place;
+            *in_place = IR_create_value_register(destination);
+            IR_insert_move(block, j, src, destination);
+            j++;
+        }
+    }
+}
+
+typedef struct IR_Live_Interval IR_Live_Interval;
+struct IR_Live_Interval
+{
+    i32 start;
+    i32 end;
+    i32 hints[2];      // Local indices of the registers this one is copied or computed from at its start, -1 if none
+    i32 hint_position;
+    i32 color;
+};
+
+static THREAD_LOCAL IR_Live_Interval* sort_intervals;
+static int IR_compare_interval_start(const void* a, const void* b)
+{
+    i32 left = *(const i32*)a;
+    i32 right = *(const i32*)b;
+    if (sort_intervals[left].start != sort_intervals[right].start)
+    {
+        return sort_intervals[left].start < sort_intervals[right].start ? -1 : 1;
+    }
+    return left < right ? -1 : (left > right);
+}
+
+static void IR_extend_interval(IR_Live_Interval* interval, i32 position)
+{
+    if (position < interval->start) interval->start = position;
+    if (position > interval->end) interval->end = position;
+}
+
+static void IR_compact_registers(IR_Program* program, IR_Function_Decl* function, IR_Register_Map* map)
+{
+    IR_register_map_clear(map);
+
+    IR_Liveness liveness;
+    IR_compute_liveness(program, function, map, &liveness);
+
+    i32 register_count = map->count;
+    if (register_count == 0)
+    {
+        IR_liveness_free(&liveness);
+        return;
+    }
+
+    IR_Live_Interval* intervals = mem_alloc(sizeof(IR_Live_Interval) * register_count);
+    for (i32 i = 0; i < register_count; i++)
+    {
+        intervals[i] = (IR_Live_Interval) { .start = INT32_MAX, .end = -1, .hints = { -1, -1 }, .hint_position = -1, .color = -1 };
+    }
+
+    // Number every node of the function in layout order
+    i32 position = 0;
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+        i32 block_start = position;
+
+        for (i32 j = 0; j < block->node_array.count; j++, position++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            for (i32 k = 0; k < IR_get_use_count(instruction); k++)
+            {
+                IR_Register* use = IR_get_use(instruction, k);
+                if (use) IR_extend_interval(&intervals[IR_register_map_find(map, *use)], position);
+            }
+
+            IR_Register* definition = IR_get_definition(program, instruction);
+            if (definition && IR_register_is_valid(*definition))
+            {
+                // @Note: The arguments of a call are all read before its result is written, so the result
+                //        starts right after the call and can reuse the register of an argument that dies there
+                i32 local = IR_register_map_find(map, *definition);
+                IR_extend_interval(&intervals[local], instruction->type == IR_INS_CALL ? position + 1 : position);
+
+                // @Note: Three address instructions can write over an operand that dies there, just like a copy
+                bool three_address = IR_is_three_address(instruction);
+                if ((instruction->type == IR_INS_MOV || three_address) && intervals[local].hint_position == -1)
+                {
+                    for (i32 k = 0; k < (three_address ? 2 : 1); k++)
+                    {
+                        IR_Register* src = IR_get_use(instruction, k);
+                        if (!src) continue;
+
+                        intervals[local].hints[k] = IR_register_map_find(map, *src);
+                        intervals[local].hint_position = position;
+                    }
+                }
+            }
+        }
+
+        i32 block_end = position;
+        for (i32 local = 0; local < register_count; local++)
+        {
+            if (IR_register_set_contains(&liveness.live_in[i], local)) IR_extend_interval(&intervals[local], block_start);
+            if (IR_register_set_contains(&liveness.live_out[i], local)) IR_extend_interval(&intervals[local], block_end);
+        }
+    }
+
+    IR_liveness_free(&liveness);
+
+    i32* order = mem_alloc(sizeof(i32) * register_count);
+    for (i32 i = 0; i < register_count; i++)
+    {
+        order[i] = i;
+    }
+    sort_intervals = intervals;
+    qsort(order, register_count, sizeof(i32), IR_compare_interval_start);
+
+    i32* active = mem_alloc(sizeof(i32) * register_count);
+    i32 active_count = 0;
+    bool* color_in_use = mem_calloc(register_count, sizeof(bool));
+
+    for (i32 i = 0; i < register_count; i++)
+    {
+        IR_Live_Interval* current = &intervals[order[i]];
+
+        for (i32 j = 0; j < active_count; j++)
+        {
+            if (intervals[active[j]].end < current->start)
+            {
+                color_in_use[intervals[active[j]].color] = false;
+                active[j--] = active[--active_count];
+            }
+        }
+
+        // @Note: A copy from a register that dies at the copy can just take over its color
+        for (i32 k = 0; k < 2 && current->color == -1; k++)
+        {
+            i32 hint = current->hints[k];
+            if (hint == -1 || current->hint_position != current->start || intervals[hint].end != current->start) continue;
+
+            for (i32 j = 0; j < active_count; j++)
+            {
+                if (active[j] == hint)
+                {
+                    current->color = intervals[hint].color;
+                    active[j] = active[--active_count];
+                    break;
+                }
+            }
+        }
+
+        if (current->color == -1)
+        {
+            i32 color = 0;
+            while (color_in_use[color]) color++;
+            current->color = color;
+            color_in_use[color] = true;
+        }
+
+        active[active_count++] = order[i];
+    }
+
+    mem_free(order);
+    mem_free(active);
+    mem_free(color_in_use);
+
+    for (i32 i = 0; i < function->blocks.count; i++)
+    {
+        IR_Block* block = IR_get_block(program, function->blocks.addresses[i]);
+
+        for (i32 j = 0; j < block->node_array.count; j++)
+        {
+            IR_Node* node = &block->node_array.nodes[j];
+            if (node->type != IR_NODE_INSTRUCTION) continue;
+
+            IR_Instruction* instruction = &node->instruction;
+            for (i32 k = 0; k < IR_get_use_count(instruction); k++)
+            {
+                IR_Register* use = IR_get_use(instruction, k);
+                if (use) use->gpr_index = intervals[IR_register_map_find(map, *use)].color;
+            }
+
+            IR_Register* definition = IR_get_definition(program, instruction);
+            if (definition && IR_register_is_valid(*definition))
+            {
+                definition->gpr_index = intervals[IR_register_map_find(map, *definition)].color;
+            }
+
+            if (instruction->type == IR_INS_MOV && instruction->move.src.type == VALUE_LOCATION
+                && instruction->move.src.loc.reg.gpr_index == instruction->move.dst.reg.gpr_index)
+            {
+                IR_remove_node(block, j--);
+            }
+        }
+    }
+
+    mem_free(intervals);
+    // @Note: The map is keyed by the old register numbers, which no longer exist
+    IR_register_map_clear(map);
+}
+
+void IR_destruct_ssa(IR_Program* program)
+{
+    IR_build_cfg(program);
+
+    IR_Register_Map map;
+    IR_register_map_init(&map, program);
+
+    for (i32 i = 0; i < program->function_array.count; i++)
+    {
+        IR_Function_Decl* function = program->function_array.functions[i];
+        IR_eliminate_phis(program, function);
+        IR_lower_two_address(program, function);
+        IR_compact_registers(program, function, &map);
+    }
+
+    IR_register_map_free(&map);
+}
@@ -0,0 +1,85 @@
+#ifndef SKE_IR_SSA_H
+#define SKE_IR_SSA_H
+
+/* @Note:
+   Control flow graph, dominator tree and SSA form for the IR.
+
+   ### CFG
+   A block belongs to the function it was allocated for. It falls through to the next block in the
+   layout of that function unless it ends in an unconditional jump or a return, and X64_codegen_ir emits
+   the blocks in that same layout. The layout starts out in allocation order and is kept from then on,
+   so passes can place new blocks wherever they need them. Anything after the first terminator of a
+   block is dead.
+
+   ### Dominators
+   Cooper, Harvey and Kennedy - "A Simple, Fast Dominance Algorithm", iterated over reverse postorder.
+   The dominance frontiers are computed the same way.
+
+   ### SSA
+   Semi-pruned SSA: phis are only placed (Cytron et al.) for registers that are live across blocks,
+   and renaming walks the dominator tree.
+
+   Going out of SSA every phi gets a fresh register that each predecessor copies its operand into
+   right before its exit (Sreedhar's method I). That register is only ever read by the phi block, so the
+   copies are harmless on the other edge of a conditional jump and critical edges never need splitting.
+   The x86 backend computes binary and unary operations in place, so those get a copy into their
+   destination as well. All of those copies are then coalesced away by compacting the registers of each
+   function with a linear scan over their live intervals, which also keeps the number of registers the
+   backend has to map to scratch registers down to the actual register pressure.
+ */
+
+typedef struct IR_Register_Set IR_Register_Set;
+struct IR_Register_Set
+{
+    u64* bits;
+    i32 word_count;
+};
+
+/*
+Maps the program wide register indices used by a single function to a dense local index space,
+so the per block sets only need to be as large as the function.
+ */
+typedef struct IR_Register_Map IR_Register_Map;
+struct IR_Register_Map
+{
+    i32* local_index; // By gpr_index, -1 when the register is not in the map
+    i32 capacity;
+
+    IR_Register* registers; // By local index
+    i32 count;
+    i32 register_capacity;
+};
+
+typedef struct IR_Liveness IR_Liveness;
+struct IR_Liveness
+{
+    IR_Register_Set* live_in;  // By layout index
+    IR_Register_Set* live_out; // By layout index
+    i32 block_count;
+};
+
+bool IR_is_terminator(IR_Node* node);
+i32 IR_get_block_exit(IR_Block* block);
+
+void IR_build_cfg(IR_Program* program);
+bool IR_dominates(IR_Program* program, IR_Block_Address dominator, IR_Block_Address block);
+
+void IR_register_map_init(IR_Register_Map* map, IR_Program* program);
+i32 IR_register_map_add(IR_Register_Map* map, IR_Register reg);
+i32 IR_register_map_find(IR_Register_Map* map, IR_Register reg);
+void IR_register_map_clear(IR_Register_Map* map);
+void IR_register_map_free(IR_Register_Map* map);
+
+IR_Register_Set IR_register_set_create(i32 count);
+void IR_register_set_free(IR_Register_Set* set);
+bool IR_register_set_contains(IR_Register_Set* set, i32 index);
+void IR_register_set_add(IR_Register_Set* set, i32 index);
+void IR_register_set_remove(IR_Register_Set* set, i32 index);
+
+void IR_compute_liveness(IR_Program* program, IR_Function_Decl* function, IR_Register_Map* map, IR_Liveness* liveness);
+void IR_liveness_free(IR_Liveness* liveness);
+
+void IR_construct_ssa(IR_Program* program);
+void IR_destruct_ssa(IR_Program* program);
+
+#endif
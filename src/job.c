@@ -0,0 +1,235 @@
+Job_System jobs = {0};
+THREAD_LOCAL i32 job_worker = 0;
+
+static void Job_deque_push(Job_Deque* deque, Job job)
+{
+    spin_lock(&deque->lock);
+    if (deque->bottom + 1 > deque->capacity)
+    {
+        // Stolen jobs leave room at the top, use that before growing
+        if (deque->top > 0)
+        {
+            memmove(deque->jobs, deque->jobs + deque->top, sizeof(Job) * (deque->bottom - deque->top));
+            deque->bottom -= deque->top;
+            deque->top = 0;
+        }
+        if (deque->bottom + 1 > deque->capacity)
+        {
+            deque->capacity = deque->capacity == 0 ? 256 : deque->capacity * 2;
+            deque->jobs = mem_realloc(deque->jobs, sizeof(Job) * deque->capacity);
+        }
+    }
+    deque->jobs[deque->bottom++] = job;
+    spin_unlock(&deque->lock);
+}
+
+// The owner takes the newest job and thieves (steal == true) the oldest
+static bool Job_deque_take(Job_Deque* deque, bool steal, Job* job)
+{
+    spin_lock(&deque->lock);
+    bool found = deque->bottom > deque->top;
+    if (found)
+    {
+        *job = steal ? deque->jobs[deque->top++] : deque->jobs[--deque->bottom];
+        if (deque->top == deque->bottom)
+        {
+            deque->top = 0;
+            deque->bottom = 0;
+        }
+    }
+    spin_unlock(&deque->lock);
+    return found;
+}
+
+// Like Job_deque_take, for the jobs of `group` wherever they are in the deque. The ones pushed after it close the gap.
+static bool Job_deque_take_group(Job_Deque* deque, bool steal, Job_Group* group, Job* job)
+{
+    spin_lock(&deque->lock);
+    i32 count = deque->bottom - deque->top;
+    i32 found = -1;
+    for (i32 i = 0; i < count && found == -1; i++)
+    {
+        i32 index = steal ? deque->top + i : deque->bottom - 1 - i;
+        if (deque->jobs[index].group == group) found = index;
+    }
+    if (found != -1)
+    {
+        *job = deque->jobs[found];
+        memmove(&deque->jobs[found], &deque->jobs[found + 1], sizeof(Job) * (deque->bottom - found - 1));
+        if (--deque->bottom == deque->top)
+        {
+            deque->top = 0;
+            deque->bottom = 0;
+        }
+    }
+    spin_unlock(&deque->lock);
+    return found != -1;
+}
+
+static bool Job_find(i32 worker, Job* job)
+{
+    bool found = Job_deque_take(&jobs.workers[worker].deque, false, job);
+    for (i32 i = 1; i < jobs.worker_count && !found; i++)
+    {
+        found = Job_deque_take(&jobs.workers[(worker + i) % jobs.worker_count].deque, true, job);
+    }
+
+    if (found) atomic_fetch_sub(&jobs.queued, 1);
+    return found;
+}
+
+static void Job_run(Job job)
+{
+    const char* tag = tracking_tag;
+    tracking_tag = job.tag;
+    job.function(job.data);
+    tracking_tag = tag;
+
+    atomic_fetch_sub(&job.group->pending, 1);
+}
+
+static void Job_worker_main(void* data)
+{
+    Job_Worker* worker = data;
+    job_worker = worker->index;
+
+    while (!atomic_load(&jobs.stopping))
+    {
+        Job job;
+        if (Job_find(worker->index, &job))
+        {
+            Job_run(job);
+            continue;
+        }
+
+        // @Note: Job_push looks at sleeping after adding to queued, and this looks at queued after adding to sleeping, so one of them sees the other
+        os_mutex_lock(&jobs.sleep_mutex);
+        atomic_fetch_add(&jobs.sleeping, 1);
+        while (atomic_load(&jobs.queued) <= 0 && !atomic_load(&jobs.stopping))
+        {
+            os_condition_wait(&jobs.wake, &jobs.sleep_mutex);
+        }
+        atomic_fetch_sub(&jobs.sleeping, 1);
+        os_mutex_unlock(&jobs.sleep_mutex);
+    }
+}
+
+// `worker_count` is -j, one worker per processor when it is 0
+void Job_init(i32 worker_count)
+{
+    if (worker_count <= 0) worker_count = os_processor_count();
+    if (worker_count > JOB_MAX_WORKERS) worker_count = JOB_MAX_WORKERS;
+
+    memset(&jobs, 0, sizeof(Job_System));
+    os_mutex_init(&jobs.sleep_mutex);
+    os_condition_init(&jobs.wake);
+    jobs.workers = mem_calloc(worker_count, sizeof(Job_Worker));
+    jobs.worker_count = worker_count;
+    job_worker = 0;
+
+    for (i32 i = 0; i < worker_count; i++)
+    {
+        Job_Worker* worker = &jobs.workers[i];
+        worker->index = i;
+
+        // Not tracked, like the arenas of main
+        arena_init(&worker->arena, malloc(JOB_ARENA_SIZE), JOB_ARENA_SIZE);
+        tracking_allocator_init(&worker->allocator, ALLOCATOR(&worker->arena));
+    }
+
+    // Fewer workers if the system will not give us the threads
+    for (i32 i = 1; i < worker_count; i++)
+    {
+        if (!os_thread_start(&jobs.workers[i].thread, Job_worker_main, &jobs.workers[i]))
+        {
+            for (i32 j = i; j < worker_count; j++)
+            {
+                free(jobs.workers[j].arena.buffer);
+            }
+            jobs.worker_count = i;
+            break;
+        }
+    }
+}
+
+// Jobs that were pushed and not waited for are dropped
+void Job_shutdown()
+{
+    if (!jobs.workers) return;
+
+    os_mutex_lock(&jobs.sleep_mutex);
+    atomic_store(&jobs.stopping, true);
+    os_condition_broadcast(&jobs.wake);
+    os_mutex_unlock(&jobs.sleep_mutex);
+
+    for (i32 i = 1; i < jobs.worker_count; i++)
+    {
+        os_thread_join(jobs.workers[i].thread);
+    }
+
+    for (i32 i = 0; i < jobs.worker_count; i++)
+    {
+        free(jobs.workers[i].arena.buffer);
+        mem_free(jobs.workers[i].deque.jobs);
+    }
+    mem_free(jobs.workers);
+
+    os_condition_destroy(&jobs.wake);
+    os_mutex_destroy(&jobs.sleep_mutex);
+    memset(&jobs, 0, sizeof(Job_System));
+}
+
+// Runs `function(data)` on some worker, `group` is waited for with Job_wait
+void Job_push(Job_Group* group, Job_Fn function, void* data)
+{
+    assert(jobs.workers && "Job_init was not called");
+
+    atomic_fetch_add(&group->pending, 1);
+    Job_deque_push(&jobs.workers[job_worker].deque, (Job){ .function = function, .data = data, .group = group, .tag = tracking_tag });
+    atomic_fetch_add(&jobs.queued, 1);
+
+    if (atomic_load(&jobs.sleeping) > 0)
+    {
+        os_mutex_lock(&jobs.sleep_mutex);
+        os_condition_signal(&jobs.wake);
+        os_mutex_unlock(&jobs.sleep_mutex);
+    }
+}
+
+/*
+A job of `group` that has not finished is either in a deque, where this takes it from, this worker's first,
+or running on a worker that takes the jobs it waits for the same way, so waiting never depends on a job
+nobody runs, whoever pushed what in between.
+ */
+void Job_wait(Job_Group* group)
+{
+    while (atomic_load(&group->pending) > 0)
+    {
+        Job job;
+        bool found = false;
+        for (i32 i = 0; i < jobs.worker_count && !found; i++)
+        {
+            found = Job_deque_take_group(&jobs.workers[(job_worker + i) % jobs.worker_count].deque, i > 0, group, &job);
+        }
+
+        if (found)
+        {
+            atomic_fetch_sub(&jobs.queued, 1);
+            Job_run(job);
+        }
+        else
+        {
+            os_thread_yield();
+        }
+    }
+}
+
+i32 Job_worker_index()
+{
+    return job_worker;
+}
+
+Allocator* Job_allocator()
+{
+    return ALLOCATOR(&jobs.workers[job_worker].allocator);
+}
@@ -0,0 +1,84 @@
+#ifndef SKE_JOB_H
+#define SKE_JOB_H
+
+/* @Note:
+   The job system, what everything in the compiler that runs in parallel is built on. There are as many
+   workers as -j says (one per processor by default), and the thread that calls Job_init is worker 0, so
+   with -j 1 no thread is started and every job runs on the caller, when it waits for them.
+   Every worker has a deque of jobs and an arena of its own. A worker pushes and pops jobs at the bottom of
+   its deque, the jobs it made last, and a worker whose deque is empty steals from the top of the others,
+   the oldest and usually the biggest jobs. Jobs belong to a Job_Group, and Job_wait runs the jobs of the
+   group that are still queued, in its own deque first and then in those of the others, until every one of
+   them has finished. That keeps the worker busy without starting something unrelated in the middle of the
+   job that waits, which could reset the arena the waiting job allocates from. Workers with
+   nothing to run sleep until a job is pushed. The deques are behind a spin lock each rather than being lock
+   free: jobs are whole files or functions, and the lock is a few instructions next to them.
+   A job that does not wait for others can allocate from the arena of the worker it runs on (Job_allocator)
+   and reset it when it is done, like the compile of a file does. Jobs that are waited for in the middle of
+   another one allocate from the heap instead, they may run on a worker whose arena belongs to someone else.
+   Allocations are tagged like those of the code that pushed the job (see tracking_tag).
+ */
+
+#define JOB_MAX_WORKERS 256
+// Like the arena of main, pages that are never touched are never committed
+#define JOB_ARENA_SIZE (256 * 1024 * 1024)
+
+typedef void (*Job_Fn)(void* data);
+
+typedef struct Job_Group Job_Group;
+struct Job_Group
+{
+    atomic_int pending; // Pushed and not finished yet, zeroed to start
+};
+
+typedef struct Job Job;
+struct Job
+{
+    Job_Fn function;
+    void* data;
+    Job_Group* group;
+    const char* tag; // tracking_tag of the pusher
+};
+
+typedef struct Job_Deque Job_Deque;
+struct Job_Deque
+{
+    Spin_Lock lock;
+    Job* jobs;
+    i32 top;    // Where other workers steal
+    i32 bottom; // Where the owner pushes and pops
+    i32 capacity;
+};
+
+typedef struct Job_Worker Job_Worker;
+struct Job_Worker
+{
+    i32 index;
+    OS_Thread thread; // Not started for worker 0
+    Job_Deque deque;
+
+    Arena arena;
+    Tracking_Allocator allocator; // Over the arena, what the jobs running on this worker get
+};
+
+typedef struct Job_System Job_System;
+struct Job_System
+{
+    Job_Worker* workers;
+    i32 worker_count;
+
+    atomic_int queued;   // Jobs in all the deques
+    atomic_int sleeping; // Workers waiting for wake
+    atomic_bool stopping;
+    OS_Mutex sleep_mutex;
+    OS_Condition wake;
+};
+
+void Job_init(i32 worker_count);
+void Job_shutdown();
+void Job_push(Job_Group* group, Job_Fn function, void* data);
+void Job_wait(Job_Group* group);
+i32 Job_worker_index();
+Allocator* Job_allocator();
+
+#endif
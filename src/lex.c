@@ -321,7 +321,7 @@ Token Lex_scan_token(Lexer* lexer)
     case '>':
     {
         if (Lex_match_character(lexer, '=')) return Lex_make_token(lexer, TOKEN_GREATER_EQUAL);
-        return Lex_make_token(lexer, TOKEN_GREATER_EQUAL);
+        return Lex_make_token(lexer, TOKEN_GREATER);
     }
     
     case '(': return Lex_make_token(lexer, TOKEN_LEFT_PAREN);
@@ -345,14 +345,14 @@ Token Lex_scan_token(Lexer* lexer)
 void token_list_init(Token_List* list, i32 initial_capacity)
 {
     list->capacity = initial_capacity;
-    list->tokens = malloc(sizeof(Token) * initial_capacity);
+    list->tokens = mem_alloc(sizeof(Token) * initial_capacity);
     list->count = 0;
 }
 
 void token_list_free(Token_List* list)
 {
-    free(list->tokens);
-    free(list);
+    mem_free(list->tokens);
+    mem_free(list);
 }
 
 void token_list_maybe_expand(Token_List* list)
@@ -360,7 +360,7 @@ void token_list_maybe_expand(Token_List* list)
     if (list->count + 1 >= list->capacity)
     {
         list->capacity *= 2;
-        list->tokens = realloc(list->tokens, list->capacity);
+        list->tokens = mem_realloc(list->tokens, sizeof(Token) * list->capacity);
     }
 }
 
@@ -372,7 +372,7 @@ void token_list_add(Token_List* list, Token token)
 
 Token_List* Lex_tokenize(String* input, String* file_name, String* absolute_path)
 {
-    Token_List* list = malloc(sizeof(Token_List));
+    Token_List* list = mem_alloc(sizeof(Token_List));
     token_list_init(list, 128);
     
     Lexer lexer;
@@ -490,7 +490,7 @@ String* Lex_pretty_print(Token_List* list, Allocator* allocator)
         break;
         case TOKEN_GREATER_EQUAL:
         {
-            sb_append(&sb, "LESS_EQUAL('>=')\n");
+            sb_append(&sb, "GREATER_EQUAL('>=')\n");
         }
         break;
         case TOKEN_LEFT_PAREN:
@@ -33,20 +33,22 @@ void cleanup_temp_files()
 
 bool run_subprocess(char** argv)
 {
-    if (fork() == 0) // 0 == child process
+    Trace_begin("subprocess", argv[0]);
+    pid_t pid = fork();
+    if (pid == 0) // 0 == child process
     {
         execvp(argv[0], argv); // exec* never returns if successful (turns program into new process)
         GENERIC_ERR("exec failed: %s: %s\n", argv[0], strerror(errno));
         exit(1);
     }
 
-    i32 status;
-    while (wait(&status) > 0); // wait makes sure the child process is reaped
-    if (status != 0)
-    {
-        exit(1);
-    }
-    return true;
+    // Only this child, other threads may be waiting for theirs
+    i32 status = 1;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    Trace_end();
+
+    // What failed is for the caller to report, it may have files to clean up first
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
 
 bool absolute_path(String* str, String* out)
@@ -60,4 +62,279 @@ bool absolute_path(String* str, String* out)
     return true;
 }
 
+// Seconds since an arbitrary point, only differences mean anything
+f64 os_wall_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (f64)now.tv_sec + (f64)now.tv_nsec * 1e-9;
+}
+
+// Includes the subprocesses that were waited for, so the assembler and the linker are counted too
+f64 os_cpu_time()
+{
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    f64 seconds = 0;
+    seconds += (f64)(self.ru_utime.tv_sec + self.ru_stime.tv_sec + children.ru_utime.tv_sec + children.ru_stime.tv_sec);
+    seconds += (f64)(self.ru_utime.tv_usec + self.ru_stime.tv_usec + children.ru_utime.tv_usec + children.ru_stime.tv_usec) * 1e-6;
+    return seconds;
+}
+
+// Peak resident set size in bytes
+size_t os_peak_memory()
+{
+    struct rusage self;
+    getrusage(RUSAGE_SELF, &self);
+    return (size_t)self.ru_maxrss * 1024;
+}
+
+i32 os_thread_id()
+{
+    return (i32)syscall(SYS_gettid);
+}
+
+i32 os_processor_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (i32)count : 1;
+}
+
+// For starting the compiler again, argv[0] may only be found through PATH
+const char* os_executable_path()
+{
+    return "/proc/self/exe";
+}
+
+// Names of the files in `directory` that end in `extension`, in no particular order. The array is freed with mem_free.
+char** os_list_files(const char* directory, const char* extension, i32* count, Allocator* allocator)
+{
+    *count = 0;
+    DIR* dir = opendir(directory);
+    if (!dir)
+    {
+        return NULL;
+    }
+
+    i32 capacity = 256;
+    char** names = mem_alloc(sizeof(char*) * capacity);
+    size_t extension_length = strlen(extension);
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)))
+    {
+        size_t length = strlen(entry->d_name);
+        if (length <= extension_length || strcmp(entry->d_name + length - extension_length, extension) != 0) continue;
+
+        if (*count + 1 > capacity)
+        {
+            capacity *= 2;
+            names = mem_realloc(names, sizeof(char*) * capacity);
+        }
+        names[*count] = allocator->allocate(allocator, length + 1);
+        memcpy(names[*count], entry->d_name, length + 1);
+        (*count)++;
+    }
+
+    closedir(dir);
+    return names;
+}
+
+// `path_template` ends in XXXXXX, which is replaced with the name of the new directory
+bool os_make_temp_directory(char* path_template)
+{
+    return mkdtemp(path_template) != NULL;
+}
+
+// Starts argv[0] without waiting for it, with its output going to `log_path`. Returns the process id, or -1.
+i32 os_spawn(char** argv, const char* log_path)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        i32 log = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (log >= 0)
+        {
+            dup2(log, STDOUT_FILENO);
+            dup2(log, STDERR_FILENO);
+            close(log);
+        }
+        execv(argv[0], argv);
+        GENERIC_ERR("exec failed: %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    return pid;
+}
+
+// Waits for any child process. Like shells do, a process killed by a signal exits with 128 plus the signal.
+i32 os_wait_any(i32* exit_code)
+{
+    i32 status;
+    pid_t pid = wait(&status);
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    *exit_code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    return pid;
+}
+
+/*
+Whether `pattern`, a POSIX extended regular expression, matches anywhere in `text`. ^ and $ also match at line
+breaks and . does not match them. Returns false when the pattern is invalid.
+ */
+bool os_match_pattern(const char* pattern, const char* text, bool* matched)
+{
+    regex_t regex;
+    if (regcomp(&regex, pattern, REG_EXTENDED | REG_NEWLINE | REG_NOSUB) != 0)
+    {
+        return false;
+    }
+    *matched = regexec(&regex, text, 0, NULL, 0) == 0;
+    regfree(&regex);
+    return true;
+}
+
+/*
+Maps the file read only, followed by a zero like the strings the lexer reads, or returns NULL. The zero is in
+the rest of the last page of the file, or in a page of its own when the file fills its pages exactly.
+ */
+char* os_map_file(const char* path, size_t* size)
+{
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    *size = (size_t)status.st_size;
+
+    // The file goes over the start of zeroed pages one byte longer than it
+    char* memory = mmap(NULL, *size + 1, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+    if (*size > 0 && mmap(memory, *size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(memory, *size + 1);
+        close(fd);
+        return NULL;
+    }
+
+    close(fd);
+    madvise(memory, *size, MADV_SEQUENTIAL);
+    return memory;
+}
+
+void os_unmap_file(char* memory, size_t size)
+{
+    munmap(memory, size + 1);
+}
+
+// The pages in the first `size` bytes of a mapped file are read again from the file if they are touched after this
+void os_drop_file_pages(char* memory, size_t size)
+{
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size = size / page_size * page_size;
+    if (size > 0)
+    {
+        madvise(memory, size, MADV_DONTNEED);
+    }
+}
+
+typedef struct Linux_Thread_Start Linux_Thread_Start;
+struct Linux_Thread_Start
+{
+    OS_Thread_Fn function;
+    void* data;
+};
+
+static void* linux_thread_main(void* data)
+{
+    Linux_Thread_Start start = *(Linux_Thread_Start*)data;
+    mem_free(data);
+    start.function(start.data);
+    return NULL;
+}
+
+bool os_thread_start(OS_Thread* thread, OS_Thread_Fn function, void* data)
+{
+    Linux_Thread_Start* start = mem_alloc(sizeof(Linux_Thread_Start));
+    start->function = function;
+    start->data = data;
+    if (pthread_create(thread, NULL, linux_thread_main, start) != 0)
+    {
+        mem_free(start);
+        return false;
+    }
+    return true;
+}
+
+void os_thread_join(OS_Thread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+void os_thread_yield()
+{
+    sched_yield();
+}
+
+void os_mutex_init(OS_Mutex* mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+void os_mutex_lock(OS_Mutex* mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+void os_mutex_unlock(OS_Mutex* mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+void os_mutex_destroy(OS_Mutex* mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+void os_condition_init(OS_Condition* condition)
+{
+    pthread_cond_init(condition, NULL);
+}
+
+// Can wake up without being signalled, so callers wait in a loop
+void os_condition_wait(OS_Condition* condition, OS_Mutex* mutex)
+{
+    pthread_cond_wait(condition, mutex);
+}
+
+void os_condition_signal(OS_Condition* condition)
+{
+    pthread_cond_signal(condition);
+}
+
+void os_condition_broadcast(OS_Condition* condition)
+{
+    pthread_cond_broadcast(condition);
+}
+
+void os_condition_destroy(OS_Condition* condition)
+{
+    pthread_cond_destroy(condition);
+}
+
 #endif
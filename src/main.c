@@ -7,10 +7,21 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <errno.h>
+#include <stdatomic.h>
 #ifdef __linux__
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <regex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #elif _WIN32
 #define WIN32_LEAN_AND_MEAN
 #define VC_EXTRA_LEAN
@@ -36,6 +47,7 @@ typedef double     f64;
 #include "nb_memory.h"
 #include "nb_string.h"
 #include "nb_file.h"
+#include "trace.h"
 #include "os.h"
 
 #ifdef __linux__
@@ -43,51 +55,83 @@ typedef double     f64;
 #elif _WIN32
 #include "win32_os.h"
 #endif
+#include "job.h"
 
 #include "lex.h"
 #include "ast.h"
 #include "parse.h"
 #include "semant.h"
 #include "ir.h"
+#include "ir_ssa.h"
+#include "ir_opt.h"
 #include "codegen_x64.h"
+#include "stats.h"
 #include "compiler.h"
+#include "test_runner.h"
 #include "runtime.h"
 
 #include "common.c"
+#include "trace.c"
+#include "job.c"
 #include "lex.c"
 #include "ast.c"
 #include "parse.c"
 #include "semant.c"
 #include "ir.c"
+#include "ir_ssa.c"
+#include "ir_opt.c"
 #include "codegen_x64.c"
+#include "stats.c"
 #include "compiler.c"
+#include "test_runner.c"
 #include "runtime.c"
 
 #define LINE_BUFFER_SIZE 256
 
+// @Note: The AST lives in the arena, so this bounds the size of a program. Pages that are never touched are never committed.
+#define ARENA_SIZE (256 * 1024 * 1024)
+
 int main(int argc, char** argv)
 {
+    // Not tracked, the tracking allocators below count what the compiler takes from the arenas
     Arena base_allocator;
-    size_t buffer_length = 1024 * 1024;
+    size_t buffer_length = ARENA_SIZE;
     void* base_buffer = malloc(buffer_length);
     arena_init(&base_allocator, base_buffer, buffer_length);
 
     Arena string_arena;
-    size_t string_buffer_length = 1024 * 1024;
+    size_t string_buffer_length = ARENA_SIZE;
     void* string_buffer = malloc(string_buffer_length);
     arena_init(&string_arena, string_buffer, string_buffer_length);
 
+    // @Note: The compiler only ever gets tracked allocators, see Compiler_Stats
+    Tracking_Allocator base_tracker;
+    tracking_allocator_init(&base_tracker, ALLOCATOR(&base_allocator));
+
+    Tracking_Allocator string_tracker;
+    tracking_allocator_init(&string_tracker, ALLOCATOR(&string_arena));
+
     if(argc == 1)
     {
-        repl(ALLOCATOR(&base_allocator));
+        Job_init(1);
+        repl(ALLOCATOR(&base_tracker));
+        Job_shutdown();
     }
     else if(argc > 1)
     {
-        Compiler_Arguments arguments = parse_args(argc, argv, ALLOCATOR(&string_arena));
+        Compiler_Arguments arguments = parse_args(argc, argv, ALLOCATOR(&string_tracker));
 
-        if (arguments.input_file)
+        if (has_flag(arguments.options, OPT_RUN_TESTS))
+        {
+            return Test_run_all(arguments, argc, argv, ALLOCATOR(&string_tracker)) ? 0 : 1;
+        }
+        else if (arguments.input_files->count > 0)
         {
-            Compiler_compile_file(arguments, ALLOCATOR(&string_arena));
+            // @Note: Files are compiled in the arenas of the workers, the base arena is only for the REPL
+            Job_init(arguments.job_count);
+            bool result = Compiler_compile_files(arguments, ALLOCATOR(&string_tracker));
+            Job_shutdown();
+            return result ? 0 : 1;
         }
     }
 
@@ -9,12 +9,14 @@ typedef struct Allocator Allocator;
 typedef void* (*Allocate_Fn)(Allocator*, size_t);
 typedef void (*Free_Fn)(Allocator*, void*);
 typedef void (*Free_All_Fn)(Allocator*);
+typedef void* (*Resize_Fn)(Allocator*, void*, size_t old_size, size_t new_size);
 
 struct Allocator
 {
     Allocate_Fn allocate;
     Free_Fn free;
     Free_All_Fn free_all;
+    Resize_Fn resize; // Optional, allocate, copy and free otherwise
 };
 
 bool is_power_of_two(umm x)
@@ -81,6 +83,319 @@ void* arena_alloc_align(Arena* arena, size_t size, size_t alignment)
 #ifndef DEFAULT_ALIGNMENT
 #define DEFAULT_ALIGNMENT (2 * sizeof(void*))
 #endif
+
+/* ======================
+   Heap
+   ====================== */
+
+void* heap_alloc(Allocator* allocator, size_t size)
+{
+    (void)allocator;
+    return malloc(size);
+}
+
+void heap_free(Allocator* allocator, void* ptr)
+{
+    (void)allocator;
+    free(ptr);
+}
+
+void heap_free_all(Allocator* allocator)
+{
+    (void)allocator;
+}
+
+void* heap_resize(Allocator* allocator, void* old_memory, size_t old_size, size_t new_size)
+{
+    (void)allocator;
+    (void)old_size;
+    return realloc(old_memory, new_size);
+}
+
+Allocator heap_allocator = { heap_alloc, heap_free, heap_free_all, heap_resize };
+
+/* ======================
+   Tracking
+   ====================== */
+
+/*
+Decorates another allocator and counts what goes through it: bytes handed out, the number of allocations,
+and the bytes live right now and at most. Every allocation is prefixed by a header with its size, so frees
+and resizes know how much they give back. With record_sites set, the same is counted per call site and tag
+(e.g. the running compiler pass). Calls through the Allocator interface do not know their call site, the
+mem_* macros below do. The counters are behind a lock, since the heap tracker is shared by every thread,
+and the tag belongs to the thread that sets it.
+ */
+
+THREAD_LOCAL const char* tracking_tag = NULL; // Recorded with every allocation this thread makes until it changes
+
+typedef struct Allocation_Site Allocation_Site;
+struct Allocation_Site
+{
+    const char* file; // NULL for calls through the Allocator interface
+    i32 line;
+    const char* tag;
+
+    size_t bytes;
+    size_t count;
+    size_t live;
+    size_t peak;
+};
+
+typedef struct Tracking_Allocator Tracking_Allocator;
+struct Tracking_Allocator
+{
+    Allocator  base_allocator;
+    Allocator* backing;
+
+    Spin_Lock lock;
+    bool record_sites;
+
+    size_t bytes;
+    size_t count;
+    size_t live;
+    size_t peak;
+
+    Allocation_Site* sites;
+    i32 site_count;
+    i32 site_capacity;
+    i32* site_slots; // Open addressing into sites, -1 when empty
+    i32 slot_capacity;
+};
+#define AS_TRACKING(allocator) (ALLOCATOR_CAST(allocator, Tracking_Allocator))
+
+typedef struct Allocation_Header Allocation_Header;
+struct Allocation_Header
+{
+    size_t size;
+    i32 site; // -1 if sites were not recorded
+};
+#define ALLOCATION_HEADER_SIZE 16
+
+static u32 tracking_hash_site(const char* file, i32 line, const char* tag)
+{
+    umm hash = (umm)file * 31 + (umm)tag * 17 + (umm)line;
+    hash ^= hash >> 15;
+    return (u32)(hash * 2654435761u);
+}
+
+static i32 tracking_find_site(Tracking_Allocator* tracker, const char* file, i32 line)
+{
+    if (tracker->site_count + 1 > tracker->slot_capacity / 2)
+    {
+        tracker->slot_capacity = tracker->slot_capacity == 0 ? 256 : tracker->slot_capacity * 2;
+        tracker->site_slots = realloc(tracker->site_slots, sizeof(i32) * tracker->slot_capacity);
+        memset(tracker->site_slots, -1, sizeof(i32) * tracker->slot_capacity);
+
+        for (i32 i = 0; i < tracker->site_count; i++)
+        {
+            Allocation_Site* site = &tracker->sites[i];
+            u32 slot = tracking_hash_site(site->file, site->line, site->tag) & (tracker->slot_capacity - 1);
+            while (tracker->site_slots[slot] != -1) slot = (slot + 1) & (tracker->slot_capacity - 1);
+            tracker->site_slots[slot] = i;
+        }
+    }
+
+    u32 slot = tracking_hash_site(file, line, tracking_tag) & (tracker->slot_capacity - 1);
+    while (tracker->site_slots[slot] != -1)
+    {
+        Allocation_Site* site = &tracker->sites[tracker->site_slots[slot]];
+        if (site->file == file && site->line == line && site->tag == tracking_tag) return tracker->site_slots[slot];
+        slot = (slot + 1) & (tracker->slot_capacity - 1);
+    }
+
+    if (tracker->site_count + 1 > tracker->site_capacity)
+    {
+        tracker->site_capacity = tracker->site_capacity == 0 ? 256 : tracker->site_capacity * 2;
+        tracker->sites = realloc(tracker->sites, sizeof(Allocation_Site) * tracker->site_capacity);
+    }
+
+    Allocation_Site* site = &tracker->sites[tracker->site_count];
+    memset(site, 0, sizeof(Allocation_Site));
+    site->file = file;
+    site->line = line;
+    site->tag = tracking_tag;
+
+    tracker->site_slots[slot] = tracker->site_count;
+    return tracker->site_count++;
+}
+
+// @Note: Both are called with the lock of the tracker taken
+static void tracking_count(Tracking_Allocator* tracker, Allocation_Header* header, const char* file, i32 line, size_t size)
+{
+    tracker->bytes += size;
+    tracker->count++;
+    tracker->live += size;
+    if (tracker->live > tracker->peak) tracker->peak = tracker->live;
+
+    header->size = size;
+    header->site = tracker->record_sites ? tracking_find_site(tracker, file, line) : -1;
+    if (header->site != -1)
+    {
+        Allocation_Site* site = &tracker->sites[header->site];
+        site->bytes += size;
+        site->count++;
+        site->live += size;
+        if (site->live > site->peak) site->peak = site->live;
+    }
+}
+
+static void tracking_uncount(Tracking_Allocator* tracker, Allocation_Header* header)
+{
+    tracker->live -= header->size;
+    if (header->site != -1)
+    {
+        tracker->sites[header->site].live -= header->size;
+    }
+}
+
+void* tracking_allocate_at(Tracking_Allocator* tracker, size_t size, const char* file, i32 line)
+{
+    if (size > PTRDIFF_MAX - ALLOCATION_HEADER_SIZE) return NULL;
+
+    Allocation_Header* header = tracker->backing->allocate(tracker->backing, ALLOCATION_HEADER_SIZE + size);
+    if (!header) return NULL;
+
+    spin_lock(&tracker->lock);
+    tracking_count(tracker, header, file, line, size);
+    spin_unlock(&tracker->lock);
+    return (unsigned char*)header + ALLOCATION_HEADER_SIZE;
+}
+
+void* tracking_resize_at(Tracking_Allocator* tracker, void* memory, size_t size, const char* file, i32 line)
+{
+    if (!memory) return tracking_allocate_at(tracker, size, file, line);
+    if (size > PTRDIFF_MAX - ALLOCATION_HEADER_SIZE) return NULL;
+
+    // Like realloc, the old block is left as it was when there is no memory for the new one, so it stays counted
+    Allocation_Header* old_header = (Allocation_Header*)((unsigned char*)memory - ALLOCATION_HEADER_SIZE);
+    Allocation_Header old = *old_header;
+    size_t old_size = old.size;
+
+    Allocation_Header* header;
+    if (tracker->backing->resize)
+    {
+        header = tracker->backing->resize(tracker->backing, old_header, ALLOCATION_HEADER_SIZE + old_size, ALLOCATION_HEADER_SIZE + size);
+    }
+    else
+    {
+        header = tracker->backing->allocate(tracker->backing, ALLOCATION_HEADER_SIZE + size);
+        if (header)
+        {
+            memcpy((unsigned char*)header + ALLOCATION_HEADER_SIZE, memory, old_size < size ? old_size : size);
+            tracker->backing->free(tracker->backing, old_header);
+        }
+    }
+    if (!header) return NULL;
+
+    // Growing only counts what was added
+    spin_lock(&tracker->lock);
+    tracking_uncount(tracker, &old);
+    tracking_count(tracker, header, file, line, size);
+    tracker->bytes -= size > old_size ? old_size : size;
+    if (header->site != -1) tracker->sites[header->site].bytes -= size > old_size ? old_size : size;
+    spin_unlock(&tracker->lock);
+    return (unsigned char*)header + ALLOCATION_HEADER_SIZE;
+}
+
+// Like calloc, NULL when count * size overflows or is larger than malloc hands out (PTRDIFF_MAX)
+void* tracking_allocate_zeroed_at(Tracking_Allocator* tracker, size_t count, size_t size, const char* file, i32 line)
+{
+    if (size && count > PTRDIFF_MAX / size) return NULL;
+
+    void* memory = tracking_allocate_at(tracker, count * size, file, line);
+    if (memory) memset(memory, 0, count * size);
+    return memory;
+}
+
+void tracking_free(Allocator* allocator, void* memory)
+{
+    if (!memory) return;
+
+    Tracking_Allocator* tracker = AS_TRACKING(allocator);
+    Allocation_Header* header = (Allocation_Header*)((unsigned char*)memory - ALLOCATION_HEADER_SIZE);
+    spin_lock(&tracker->lock);
+    tracking_uncount(tracker, header);
+    spin_unlock(&tracker->lock);
+    tracker->backing->free(tracker->backing, header);
+}
+
+void* tracking_alloc(Allocator* allocator, size_t size)
+{
+    return tracking_allocate_at(AS_TRACKING(allocator), size, NULL, 0);
+}
+
+void* tracking_resize(Allocator* allocator, void* memory, size_t old_size, size_t new_size)
+{
+    (void)old_size;
+    return tracking_resize_at(AS_TRACKING(allocator), memory, new_size, NULL, 0);
+}
+
+void tracking_free_all(Allocator* allocator)
+{
+    Tracking_Allocator* tracker = AS_TRACKING(allocator);
+    tracker->backing->free_all(tracker->backing);
+
+    spin_lock(&tracker->lock);
+    tracker->live = 0;
+    for (i32 i = 0; i < tracker->site_count; i++)
+    {
+        tracker->sites[i].live = 0;
+    }
+    spin_unlock(&tracker->lock);
+}
+
+// Bytes handed out so far, other threads may be allocating from the same tracker
+size_t tracking_bytes(Tracking_Allocator* tracker)
+{
+    spin_lock(&tracker->lock);
+    size_t bytes = tracker->bytes;
+    spin_unlock(&tracker->lock);
+    return bytes;
+}
+
+// Bytes handed out and not freed yet
+size_t tracking_live(Tracking_Allocator* tracker)
+{
+    spin_lock(&tracker->lock);
+    size_t live = tracker->live;
+    spin_unlock(&tracker->lock);
+    return live;
+}
+
+/*
+For an arena rolled back with temp_arena_memory_end: what was allocated since tracking_live returned `live`
+is gone at once. The call sites keep counting it as live, their peaks are what they would be without.
+ */
+void tracking_rewind(Tracking_Allocator* tracker, size_t live)
+{
+    spin_lock(&tracker->lock);
+    if (tracker->live > live) tracker->live = live;
+    spin_unlock(&tracker->lock);
+}
+
+void tracking_allocator_init(Tracking_Allocator* tracker, Allocator* backing)
+{
+    memset(tracker, 0, sizeof(Tracking_Allocator));
+    tracker->base_allocator.allocate = tracking_alloc;
+    tracker->base_allocator.free = tracking_free;
+    tracker->base_allocator.free_all = tracking_free_all;
+    tracker->base_allocator.resize = tracking_resize;
+    tracker->backing = backing;
+}
+
+// @Note: All heap memory of the compiler goes through here, so it has to be freed with mem_free
+Tracking_Allocator heap_tracker =
+{
+    .base_allocator = { tracking_alloc, tracking_free, tracking_free_all, tracking_resize },
+    .backing = &heap_allocator
+};
+
+#define mem_alloc(size)          tracking_allocate_at(&heap_tracker, (size), __FILE__, __LINE__)
+#define mem_calloc(count, size)  tracking_allocate_zeroed_at(&heap_tracker, (count), (size), __FILE__, __LINE__)
+#define mem_realloc(ptr, size)   tracking_resize_at(&heap_tracker, (ptr), (size), __FILE__, __LINE__)
+#define mem_free(ptr)            tracking_free(ALLOCATOR(&heap_tracker), (ptr))
+
 void* arena_alloc(Allocator* arena, size_t size)
 {
     return arena_alloc_align(AS_ARENA(arena), size, DEFAULT_ALIGNMENT);
@@ -127,6 +442,11 @@ void* arena_resize(Arena* arena, void* old_memory, size_t old_size, size_t new_s
     return arena_resize_align(arena, old_memory, old_size, new_size, DEFAULT_ALIGNMENT);
 }
 
+static void* arena_resize_allocator(Allocator* allocator, void* old_memory, size_t old_size, size_t new_size)
+{
+    return arena_resize(AS_ARENA(allocator), old_memory, old_size, new_size);
+}
+
 void arena_free(Allocator* allocator, void* ptr)
 {
     (void)allocator;
@@ -145,6 +465,7 @@ void arena_init(Arena* arena, void* backing_buffer, size_t backing_buffer_length
     arena->base_allocator.allocate = arena_alloc;
     arena->base_allocator.free = arena_free;
     arena->base_allocator.free_all = arena_free_all;
+    arena->base_allocator.resize = arena_resize_allocator;
     arena->buffer = (unsigned char*)backing_buffer;
     arena->buffer_length = backing_buffer_length;
     arena->current_offset = 0;
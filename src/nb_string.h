@@ -288,7 +288,7 @@ String_Array* string_split(String* string, char delim, Allocator* allocator)
 void sb_init(String_Builder* builder, size_t initial_capacity)
 {
     builder->capacity = initial_capacity;
-    builder->string = calloc(builder->capacity, 1);
+    builder->string = mem_calloc(builder->capacity, 1);
     builder->current_index = 0;
 }
 
@@ -330,8 +330,12 @@ static void sb_maybe_expand(String_Builder* builder, size_t extra_length)
     if(builder->current_index + extra_length >= builder->capacity)
     {
         size_t old_capacity = builder->capacity;
-        builder->capacity *= LOAD_FACTOR;
-        builder->string = realloc(builder->string, builder->capacity);
+        // Appending a whole other builder can take more than one doubling
+        while (builder->current_index + extra_length >= builder->capacity)
+        {
+            builder->capacity *= LOAD_FACTOR;
+        }
+        builder->string = mem_realloc(builder->string, builder->capacity);
         for (size_t i = old_capacity; i < builder->capacity; i++)
         {
             builder->string[i] = '\0';
@@ -397,7 +401,7 @@ String* sb_get_result(String_Builder* builder, Allocator* allocator)
 
 void sb_free(String_Builder* builder)
 {
-    free(builder->string);
+    mem_free(builder->string);
 }
 
 static void sb_indent(String_Builder* builder, i32 indentation)
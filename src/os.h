@@ -9,4 +9,48 @@ void cleanup_temp_files();
 bool run_subprocess(char** argv);
 bool absolute_path(String* str, String* out);
 
+f64 os_wall_time();
+f64 os_cpu_time();
+size_t os_peak_memory();
+i32 os_thread_id();
+
+i32 os_processor_count();
+const char* os_executable_path();
+char** os_list_files(const char* directory, const char* extension, i32* count, Allocator* allocator);
+bool os_make_temp_directory(char* path_template);
+i32 os_spawn(char** argv, const char* log_path);
+i32 os_wait_any(i32* exit_code);
+bool os_match_pattern(const char* pattern, const char* text, bool* matched);
+
+char* os_map_file(const char* path, size_t* size);
+void os_unmap_file(char* memory, size_t size);
+void os_drop_file_pages(char* memory, size_t size);
+
+#ifdef __linux__
+typedef pthread_t       OS_Thread;
+typedef pthread_mutex_t OS_Mutex;
+typedef pthread_cond_t  OS_Condition;
+#elif _WIN32
+typedef HANDLE             OS_Thread;
+typedef CRITICAL_SECTION   OS_Mutex;
+typedef CONDITION_VARIABLE OS_Condition;
+#endif
+
+typedef void (*OS_Thread_Fn)(void* data);
+
+bool os_thread_start(OS_Thread* thread, OS_Thread_Fn function, void* data);
+void os_thread_join(OS_Thread thread);
+void os_thread_yield();
+
+void os_mutex_init(OS_Mutex* mutex);
+void os_mutex_lock(OS_Mutex* mutex);
+void os_mutex_unlock(OS_Mutex* mutex);
+void os_mutex_destroy(OS_Mutex* mutex);
+
+void os_condition_init(OS_Condition* condition);
+void os_condition_wait(OS_Condition* condition, OS_Mutex* mutex);
+void os_condition_signal(OS_Condition* condition);
+void os_condition_broadcast(OS_Condition* condition);
+void os_condition_destroy(OS_Condition* condition);
+
 #endif
@@ -29,7 +29,15 @@ void Parser_advance(Parser* parser)
 
     for (;;)
     {
-        parser->current = parser->token_stream->tokens[parser->current_token++];
+        if (parser->lexer)
+        {
+            parser->current = Lex_scan_token(parser->lexer);
+            parser->token_count++;
+        }
+        else
+        {
+            parser->current = parser->token_stream->tokens[parser->current_token++];
+        }
         if (parser->current.type != TOKEN_ERROR) break;
 
         char err[32];
@@ -46,10 +54,26 @@ void Parser_init(Parser* parser, String* absolute_path, Token_List* tokens, Allo
     parser->had_error = false;
     parser->panic_mode = false;
     parser->absolute_path = sv_create(absolute_path);
+    parser->lexer = NULL;
+    parser->token_count = 0;
 
     parser->allocator = allocator;
 }
 
+/*
+Parses the file one top level declaration at a time (see Parser_parse_declaration), scanning the tokens as
+it goes, so neither the tokens nor the tree of the whole file are ever in memory at once.
+ */
+void Parser_init_stream(Parser* parser, String* absolute_path, Lexer* lexer, Allocator* allocator)
+{
+    memset(parser, 0, sizeof(Parser));
+    parser->absolute_path = sv_create(absolute_path);
+    parser->lexer = lexer;
+    parser->allocator = allocator;
+
+    Parser_advance(parser);
+}
+
 void Parser_free(Parser* parser)
 {
     parser->allocator->free_all(parser->allocator);
@@ -469,6 +493,22 @@ static Parse_Rule* Parser_get_rule(Token_Type type)
     return &rules[type];
 }
 
+// The next top level declaration, NULL at the end of the file or after an error (see had_error)
+AST_Node* Parser_parse_declaration(Parser* parser)
+{
+    if (Parser_match(parser, TOKEN_EOF))
+    {
+        return NULL;
+    }
+
+    AST_Node* declaration = Parser_declaration(parser, NULL);
+    if (!declaration || declaration->type != AST_NODE_FUN_DECL)
+    {
+        Parser_error(parser, "Expect a function declaration.");
+    }
+    return parser->had_error ? NULL : declaration;
+}
+
 bool Parser_parse(Parser* parser, bool print_ast, Allocator* allocator)
 {
     Parser_advance(parser);
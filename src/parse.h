@@ -27,6 +27,9 @@ struct Parser
     Token_List* token_stream;
     i32 current_token;
 
+    Lexer* lexer;    // Scans the tokens as they are needed instead of token_stream, see Parser_init_stream
+    i32 token_count; // Scanned by the lexer above
+
     String_View absolute_path;
 
     Allocator* allocator;
@@ -1,6 +1,9 @@
 
 void repl(Allocator* allocator)
 {
+    Compiler_Stats stats;
+    Stats_init(&stats, allocator);
+
     char str[1024];
     String buffer = string_create(str);
     for(;;)
@@ -20,11 +23,16 @@ void repl(Allocator* allocator)
                 .out_path   = NULL
             };
 
-        bool result = Compiler_compile(&buffer, args, allocator);
+        String* object = create_temp_file(allocator);
+        bool result = Compiler_compile(&buffer, args, &stats, object, NULL, allocator);
         if (!result)
         {
             // TODO: Output errors?
             COMPILER_BUG("Compilation failed with errors\n");
         }
+
+        String_Array* objects = string_array_allocate(2, allocator);
+        string_array_push(objects, object);
+        Compiler_link(objects, string_allocate("a.out", allocator), allocator);
     }
 }
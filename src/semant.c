@@ -114,8 +114,8 @@ static Sem_Variable_Info* Sem_variable_get(Sem_Checker* checker, Sem_Variable_Ke
 
 static void Sem_adjust_capacity(Sem_Variable_Table* table, i32 capacity, Allocator* allocator)
 {
-    Sem_Variable_Info* entries = malloc(sizeof(Sem_Variable_Info) * capacity);
-    Sem_Variable_Key* keys = malloc(sizeof(Sem_Variable_Key) * capacity);
+    Sem_Variable_Info* entries = mem_alloc(sizeof(Sem_Variable_Info) * capacity);
+    Sem_Variable_Key* keys = mem_alloc(sizeof(Sem_Variable_Key) * capacity);
     for (i32 i = 0; i < capacity; i++)
     {
         entries[i].name = NULL;
@@ -141,8 +141,8 @@ static void Sem_adjust_capacity(Sem_Variable_Table* table, i32 capacity, Allocat
         table->count++;
     }
 
-    free(table->entries);
-    free(table->keys);
+    mem_free(table->entries);
+    mem_free(table->keys);
 
     table->entries = entries;
     table->keys = keys;
@@ -260,7 +260,7 @@ Sem_Scope* Sem_push_scope(Sem_Checker* checker, Allocator* allocator)
     if (count + 1 > capacity)
     {
         checker->scope_list.capacity = capacity < 8 ? 8 : capacity * 2;
-        checker->scope_list.scopes = realloc(checker->scope_list.scopes, sizeof(Sem_Scope) * checker->scope_list.capacity);
+        checker->scope_list.scopes = mem_realloc(checker->scope_list.scopes, sizeof(Sem_Scope) * checker->scope_list.capacity);
     }
 
     Sem_Scope* new_scope = &checker->scope_list.scopes[checker->scope_list.count++];
@@ -458,12 +458,98 @@ void Sem_check_block(Sem_Checker* checker, AST_Node* block, Allocator* allocator
     }
 }
 
+// Phase one, the function goes in the global scope so calls can be checked against it
+void Sem_declare_function(Sem_Checker* checker, AST_Node* node, Allocator* allocator)
+{
+    Sem_Scope* global_scope = Sem_get_scope(checker, (Sem_Scope_Handle){ .handle = 0 });
+    Sem_Type fun_type =
+        {
+            .kind = TYPE_KIND_FUNCTION,
+            .fun_decl = Sem_create_function_decl(node, allocator)
+        };
+    Sem_add_variable_to_scope(global_scope, node->fun_decl.name, fun_type, allocator);
+}
+
+// Phase two, the scope of the function is gone when it is done and only the global scope is left
+void Sem_check_function(Sem_Checker* checker, AST_Node* node, Allocator* allocator)
+{
+    /* @Incomplete:
+       - Create a new scope
+       - Add arguments to current scope
+       - Type check block
+       - Get return type of block and compare to function return type
+    */
+
+    Sem_Scope* function_scope = Sem_push_scope(checker, allocator);
+
+    AST_Node_List* arguments = &node->fun_decl.arguments;
+    for (i32 i = 0; i < arguments->count; i++)
+    {
+        AST_Node* argument = arguments->nodes[i];
+        String* name = argument->fun_argument.name;
+        AST_Node* ast_type = argument->fun_argument.type;
+
+        Type_Specifier type_spec = ast_type->type_specifier.type;
+        Sem_Type type = {0};
+
+        switch(type_spec)
+        {
+        case TYPE_SPEC_INT:
+        {
+            type.kind = TYPE_KIND_BUILTIN;
+            type.builtin = BUILTIN_INT;
+        }
+        break;
+        case TYPE_SPEC_UNIT:
+        {
+            type.kind = TYPE_KIND_BUILTIN;
+            type.builtin = BUILTIN_UNIT;
+        }
+        break;
+        case TYPE_SPEC_INVALID:
+        {
+            type.kind = TYPE_KIND_INVALID;
+        }
+        break;
+        }
+
+        Sem_add_variable_to_scope(function_scope, name, type, allocator);
+    }
+
+    Sem_check_block(checker, node->fun_decl.body, allocator);
+
+    Sem_pop_scope(checker);
+
+    function_scope = &checker->scope_list.scopes[--checker->scope_list.count];
+    mem_free(function_scope->table.entries);
+    mem_free(function_scope->table.keys);
+}
+
+// Starts with the global scope, see Sem_check
+void Sem_begin(Sem_Checker* checker, String* absolute_path, Allocator* allocator)
+{
+    Sem_init_checker(checker, absolute_path, allocator);
+    Sem_push_scope(checker, allocator);
+}
+
+// What the declarations took from the allocator they were given stays
+void Sem_end(Sem_Checker* checker)
+{
+    for (i32 i = 0; i < checker->scope_list.count; i++)
+    {
+        mem_free(checker->scope_list.scopes[i].table.entries);
+        mem_free(checker->scope_list.scopes[i].table.keys);
+    }
+    mem_free(checker->scope_list.scopes);
+    checker->scope_list.scopes = NULL;
+    checker->scope_list.count = 0;
+    checker->scope_list.capacity = 0;
+}
+
 void Sem_check(AST_Node* root, String* absolute_path, Allocator* allocator)
 {
     Sem_Checker checker = {0};
-    Sem_init_checker(&checker, absolute_path, allocator);
-    
-    Sem_Scope* global_scope = Sem_push_scope(&checker, allocator);
+    Sem_begin(&checker, absolute_path, allocator);
     
     AST_Node_List declarations = root->program.declarations;
 
@@ -475,13 +561,7 @@ void Sem_check(AST_Node* root, String* absolute_path, Allocator* allocator)
         {
         case AST_NODE_FUN_DECL:
         {
-            
-            Sem_Type fun_type =
-                {
-                    .kind = TYPE_KIND_FUNCTION,
-                    .fun_decl = Sem_create_function_decl(node, allocator)
-                };
-            Sem_add_variable_to_scope(global_scope, node->fun_decl.name, fun_type, allocator);
+            Sem_declare_function(&checker, node, allocator);
         }
         break;
         default: break;
@@ -496,52 +576,7 @@ void Sem_check(AST_Node* root, String* absolute_path, Allocator* allocator)
         {
             case AST_NODE_FUN_DECL:
             {
-                /* @Incomplete:
-                   - Create a new scope
-                   - Add arguments to current scope
-                   - Type check block
-                   - Get return type of block and compare to function return type
-                */
-
-                Sem_Scope* function_scope = Sem_push_scope(&checker, allocator);
-
-                AST_Node_List* arguments = &node->fun_decl.arguments;
-                for (i32 i = 0; i < arguments->count; i++)
-                {
-                    AST_Node* argument = arguments->nodes[i];
-                    String* name = argument->fun_argument.name;
-                    AST_Node* ast_type = argument->fun_argument.type;
-
-                    Type_Specifier type_spec = ast_type->type_specifier.type;
-                    Sem_Type type = {0};
-
-                    switch(type_spec)
-                    {
-                    case TYPE_SPEC_INT:
-                    {
-                        type.kind = TYPE_KIND_BUILTIN;
-                        type.builtin = BUILTIN_INT;
-                    }
-                    break;
-                    case TYPE_SPEC_UNIT:
-                    {
-                        type.kind = TYPE_KIND_BUILTIN;
-                        type.builtin = BUILTIN_UNIT;
-                    }
-                    break;
-                    case TYPE_SPEC_INVALID:
-                    {
-                        type.kind = TYPE_KIND_INVALID;
-                    }
-                    break;
-                    }
-
-                    Sem_add_variable_to_scope(function_scope, name, type, allocator);
-                }
-
-                Sem_check_block(&checker, node->fun_decl.body, allocator);
-
-                Sem_pop_scope(&checker);
+                Sem_check_function(&checker, node, allocator);
             }
             break;
         default:
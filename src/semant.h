@@ -136,4 +136,9 @@ Sem_Type Sem_check_expression(Sem_Checker* checker, AST_Node* expression, Alloca
 void Sem_check_block(Sem_Checker* checker, AST_Node* block, Allocator* allocator);
 void Sem_check_statement(Sem_Checker* checker, AST_Node* statement, Allocator* allocator);
 
+void Sem_begin(Sem_Checker* checker, String* absolute_path, Allocator* allocator);
+void Sem_declare_function(Sem_Checker* checker, AST_Node* node, Allocator* allocator);
+void Sem_check_function(Sem_Checker* checker, AST_Node* node, Allocator* allocator);
+void Sem_end(Sem_Checker* checker);
+
 #endif
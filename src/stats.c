@@ -0,0 +1,258 @@
+const char* stage_names[STAGE_COUNT] =
+{
+    [STAGE_LEX]            = "lex",
+    [STAGE_PARSE]          = "parse",
+    [STAGE_SEMANTIC_CHECK] = "semantic check",
+    [STAGE_TRANSLATE]      = "translate",
+    [STAGE_SSA]            = "ssa",
+    [STAGE_OPTIMIZE]       = "optimize",
+    [STAGE_LOWER]          = "lower",
+    [STAGE_LAYOUT]         = "layout",
+    [STAGE_CODEGEN]        = "codegen",
+    [STAGE_ASSEMBLE]       = "assemble",
+    [STAGE_LINK]           = "link",
+};
+
+// @Note: The compiler allocator is always tracked, see main
+void Stats_init(Compiler_Stats* stats, Allocator* allocator)
+{
+    memset(stats, 0, sizeof(Compiler_Stats));
+    stats->allocator = AS_TRACKING(allocator);
+    stats->stage = STAGE_COUNT;
+}
+
+void Stats_begin(Compiler_Stats* stats, Compiler_Stage stage)
+{
+    assert(stats->stage == STAGE_COUNT && "Stages do not nest");
+
+    Trace_begin("stage", stage_names[stage]);
+
+    stats->stage = stage;
+    tracking_tag = stage_names[stage];
+    stats->allocator_start = tracking_bytes(stats->allocator);
+    stats->heap_start = tracking_bytes(&heap_tracker);
+    stats->cpu_start = os_cpu_time();
+    stats->wall_start = os_wall_time();
+}
+
+void Stats_end(Compiler_Stats* stats)
+{
+    f64 wall_end = os_wall_time();
+    f64 cpu_end = os_cpu_time();
+
+    // A stage can run more than once, with the REPL
+    Stage_Stats* stage = &stats->stages[stats->stage];
+    stage->ran = true;
+    stage->wall_seconds += wall_end - stats->wall_start;
+    stage->cpu_seconds += cpu_end - stats->cpu_start;
+    stage->arena_bytes += (i64)(tracking_bytes(stats->allocator) - stats->allocator_start);
+    stage->heap_bytes += (i64)(tracking_bytes(&heap_tracker) - stats->heap_start);
+
+    stats->stage = STAGE_COUNT;
+    tracking_tag = NULL;
+    Trace_end();
+}
+
+void Stats_count_ir(Compiler_Stats* stats, IR_Program* program, bool translated)
+{
+    i32 function_count = 0;
+    i32 block_count = 0;
+    i32 node_count = 0;
+    for (i32 f = 0; f < program->function_array.count; f++)
+    {
+        IR_Function_Decl* function = program->function_array.functions[f];
+        if (function->removed) continue;
+
+        function_count++;
+        block_count += function->blocks.count;
+        for (i32 i = 0; i < function->blocks.count; i++)
+        {
+            node_count += IR_get_block(program, function->blocks.addresses[i])->node_array.count;
+        }
+    }
+
+    // Summed over the files of a batch compile
+    if (translated)
+    {
+        stats->function_count += function_count;
+        stats->translated_block_count += block_count;
+        stats->translated_ir_node_count += node_count;
+    }
+    else
+    {
+        stats->block_count += block_count;
+        stats->ir_node_count += node_count;
+    }
+}
+
+// Adds what `other` counted to `stats`
+void Stats_merge(Compiler_Stats* stats, Compiler_Stats* other)
+{
+    for (i32 i = 0; i < STAGE_COUNT; i++)
+    {
+        Stage_Stats* stage = &stats->stages[i];
+        Stage_Stats* other_stage = &other->stages[i];
+        if (!other_stage->ran) continue;
+
+        stage->ran = true;
+        stage->wall_seconds += other_stage->wall_seconds;
+        stage->cpu_seconds += other_stage->cpu_seconds;
+        stage->arena_bytes += other_stage->arena_bytes;
+        stage->heap_bytes += other_stage->heap_bytes;
+    }
+
+    stats->token_count += other->token_count;
+    stats->ast_node_count += other->ast_node_count;
+    stats->function_count += other->function_count;
+    stats->translated_block_count += other->translated_block_count;
+    stats->translated_ir_node_count += other->translated_ir_node_count;
+    stats->block_count += other->block_count;
+    stats->ir_node_count += other->ir_node_count;
+}
+
+void Stats_print(Compiler_Stats* stats, FILE* file)
+{
+    Stage_Stats total = {0};
+    fprintf(file, "%12s %12s %12s %12s  %s\n", "Wall (ms)", "CPU (ms)", "Arena (B)", "Heap (B)", "Stage");
+    for (i32 i = 0; i < STAGE_COUNT; i++)
+    {
+        Stage_Stats* stage = &stats->stages[i];
+        if (!stage->ran) continue;
+
+        fprintf(file, "%12.3f %12.3f %12lld %12lld  %s\n", stage->wall_seconds * 1000.0, stage->cpu_seconds * 1000.0,
+                (long long)stage->arena_bytes, (long long)stage->heap_bytes, stage_names[i]);
+
+        total.wall_seconds += stage->wall_seconds;
+        total.cpu_seconds += stage->cpu_seconds;
+        total.arena_bytes += stage->arena_bytes;
+        total.heap_bytes += stage->heap_bytes;
+    }
+    fprintf(file, "%12.3f %12.3f %12lld %12lld  %s\n\n", total.wall_seconds * 1000.0, total.cpu_seconds * 1000.0,
+            (long long)total.arena_bytes, (long long)total.heap_bytes, "total");
+
+    fprintf(file, "%12d tokens\n", stats->token_count);
+    fprintf(file, "%12d AST nodes\n", stats->ast_node_count);
+    fprintf(file, "%12d functions\n", stats->function_count);
+    fprintf(file, "%12d blocks (%d after translation)\n", stats->block_count, stats->translated_block_count);
+    fprintf(file, "%12d IR nodes (%d after translation)\n", stats->ir_node_count, stats->translated_ir_node_count);
+    fprintf(file, "%12zu bytes peak resident memory\n", os_peak_memory());
+}
+
+#define STATS_MEMORY_TOP_SITES 25
+
+static int Stats_compare_sites(const void* a, const void* b)
+{
+    const Allocation_Site* left = *(const Allocation_Site**)a;
+    const Allocation_Site* right = *(const Allocation_Site**)b;
+    if (left->bytes != right->bytes) return left->bytes < right->bytes ? 1 : -1;
+    return 0;
+}
+
+/*
+Call sites are only known when the trackers record them, see -mem-report. With the job system running, every
+worker has a compiler allocator of its own (see job.h) and the report covers all of them.
+ */
+void Stats_print_memory(Compiler_Stats* stats, FILE* file)
+{
+    i32 tracker_count = jobs.worker_count > 0 ? jobs.worker_count + 1 : 2;
+    Tracking_Allocator** trackers = malloc(sizeof(Tracking_Allocator*) * tracker_count);
+    trackers[0] = &heap_tracker;
+    if (jobs.worker_count > 0)
+    {
+        for (i32 i = 0; i < jobs.worker_count; i++) trackers[i + 1] = &jobs.workers[i].allocator;
+    }
+    else
+    {
+        trackers[1] = stats->allocator;
+    }
+
+    fprintf(file, "%14s %10s %14s  %s\n", "Allocated (B)", "Count", "Peak (B)", "Allocator");
+    i32 site_count = 0;
+    for (i32 i = 0; i < tracker_count; i++)
+    {
+        fprintf(file, "%14zu %10zu %14zu  ", trackers[i]->bytes, trackers[i]->count, trackers[i]->peak);
+        if (i == 0) fprintf(file, "heap\n");
+        else if (tracker_count > 2) fprintf(file, "compiler allocator (worker %d)\n", i - 1);
+        else fprintf(file, "compiler allocator\n");
+        site_count += trackers[i]->site_count;
+    }
+
+    // Not tracked, so the report does not show up in itself
+    Allocation_Site** sites = malloc(sizeof(Allocation_Site*) * (site_count + 1));
+    i32 count = 0;
+    for (i32 i = 0; i < tracker_count; i++)
+    {
+        for (i32 j = 0; j < trackers[i]->site_count; j++)
+        {
+            sites[count++] = &trackers[i]->sites[j];
+        }
+    }
+
+    // Allocations outside of any stage are not tagged
+    fprintf(file, "\n%14s %10s  %s\n", "Allocated (B)", "Count", "Stage");
+    for (i32 stage = 0; stage <= STAGE_COUNT; stage++)
+    {
+        const char* tag = stage < STAGE_COUNT ? stage_names[stage] : NULL;
+        size_t bytes = 0;
+        size_t allocations = 0;
+        for (i32 i = 0; i < count; i++)
+        {
+            if (sites[i]->tag != tag) continue;
+            bytes += sites[i]->bytes;
+            allocations += sites[i]->count;
+        }
+        if (allocations == 0) continue;
+
+        fprintf(file, "%14zu %10zu  %s\n", bytes, allocations, tag ? tag : "(no stage)");
+    }
+
+    qsort(sites, count, sizeof(Allocation_Site*), Stats_compare_sites);
+
+    fprintf(file, "\n%14s %10s %14s  %s\n", "Allocated (B)", "Count", "Peak (B)", "Call site");
+    for (i32 i = 0; i < count && i < STATS_MEMORY_TOP_SITES; i++)
+    {
+        Allocation_Site* site = sites[i];
+        if (site->file) fprintf(file, "%14zu %10zu %14zu  %s:%d", site->bytes, site->count, site->peak, site->file, site->line);
+        else fprintf(file, "%14zu %10zu %14zu  (compiler allocator)", site->bytes, site->count, site->peak);
+        fprintf(file, " [%s]\n", site->tag ? site->tag : "no stage");
+    }
+
+    free(sites);
+    free(trackers);
+}
+
+bool Stats_write_json(Compiler_Stats* stats, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "{\n  \"stages\": [");
+    bool first = true;
+    for (i32 i = 0; i < STAGE_COUNT; i++)
+    {
+        Stage_Stats* stage = &stats->stages[i];
+        if (!stage->ran) continue;
+
+        fprintf(file, "%s\n    { \"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"arena_bytes\": %lld, \"heap_bytes\": %lld }",
+                first ? "" : ",", stage_names[i], stage->wall_seconds * 1000.0, stage->cpu_seconds * 1000.0,
+                (long long)stage->arena_bytes, (long long)stage->heap_bytes);
+        first = false;
+    }
+    fprintf(file, "\n  ],\n");
+
+    fprintf(file, "  \"tokens\": %d,\n", stats->token_count);
+    fprintf(file, "  \"ast_nodes\": %d,\n", stats->ast_node_count);
+    fprintf(file, "  \"functions\": %d,\n", stats->function_count);
+    fprintf(file, "  \"translated_blocks\": %d,\n", stats->translated_block_count);
+    fprintf(file, "  \"translated_ir_nodes\": %d,\n", stats->translated_ir_node_count);
+    fprintf(file, "  \"blocks\": %d,\n", stats->block_count);
+    fprintf(file, "  \"ir_nodes\": %d,\n", stats->ir_node_count);
+    fprintf(file, "  \"peak_memory_bytes\": %zu\n", os_peak_memory());
+    fprintf(file, "}\n");
+
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef SKE_STATS_H
+#define SKE_STATS_H
+
+/* @Note:
+   Where a compile spends its time and memory, for -time-passes and -stats-json. Every stage is timed between
+   Stats_begin and Stats_end, in wall clock and CPU time (the assembler and the linker run as subprocesses, and
+   their CPU time is counted for their stage). Memory is how many bytes a stage allocated from the compiler
+   allocator (an arena) and from the heap, both counted by their Tracking_Allocator, which also tags every
+   allocation with the running stage. -mem-report breaks the allocations down by call site and stage.
+   Files compiled as jobs (see job.h) have stats of their own, merged when they are done. With more than one
+   worker the stages of different files overlap, so their times add up to more than the compile took, and the
+   CPU time and heap bytes of a stage include what the other workers did meanwhile.
+ */
+
+typedef enum
+{
+    STAGE_LEX,
+    STAGE_PARSE,
+    STAGE_SEMANTIC_CHECK,
+    STAGE_TRANSLATE,
+    STAGE_SSA,
+    STAGE_OPTIMIZE,
+    STAGE_LOWER,    // Instruction selection and out of SSA
+    STAGE_LAYOUT,
+    STAGE_CODEGEN,
+    STAGE_ASSEMBLE,
+    STAGE_LINK,
+    STAGE_COUNT
+} Compiler_Stage;
+
+typedef struct Stage_Stats Stage_Stats;
+struct Stage_Stats
+{
+    bool ran;
+    f64 wall_seconds;
+    f64 cpu_seconds;
+    i64 arena_bytes;
+    i64 heap_bytes;
+};
+
+typedef struct Compiler_Stats Compiler_Stats;
+struct Compiler_Stats
+{
+    Tracking_Allocator* allocator; // The compiler allocator
+    Stage_Stats stages[STAGE_COUNT];
+
+    // The running stage
+    Compiler_Stage stage;
+    f64 wall_start;
+    f64 cpu_start;
+    size_t allocator_start;
+    size_t heap_start;
+
+    i32 token_count;
+    i32 ast_node_count;
+    i32 function_count;
+
+    // Right after translation and what codegen gets
+    i32 translated_block_count;
+    i32 translated_ir_node_count;
+    i32 block_count;
+    i32 ir_node_count;
+};
+
+void Stats_init(Compiler_Stats* stats, Allocator* allocator);
+void Stats_begin(Compiler_Stats* stats, Compiler_Stage stage);
+void Stats_end(Compiler_Stats* stats);
+void Stats_count_ir(Compiler_Stats* stats, IR_Program* program, bool translated);
+void Stats_merge(Compiler_Stats* stats, Compiler_Stats* other);
+
+void Stats_print(Compiler_Stats* stats, FILE* file);
+void Stats_print_memory(Compiler_Stats* stats, FILE* file);
+bool Stats_write_json(Compiler_Stats* stats, const char* path);
+
+#endif
@@ -0,0 +1,444 @@
+static const char* test_kind_names[] =
+{
+    [TEST_SUCCEEDING] = "succeeding",
+    [TEST_FAILING]    = "failing",
+    [TEST_PROFILE]    = "profile",
+};
+
+static int Test_compare_names(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void Test_discover(Test_Runner* runner, const char* directory, Test_Kind kind, Allocator* allocator)
+{
+    const char* kind_name = test_kind_names[kind];
+    char* source_directory = string_createf(allocator, "%s/%s", directory, kind_name)->str;
+
+    i32 file_count;
+    char** files = os_list_files(source_directory, FILE_EXTENSION, &file_count, allocator);
+    if (!files)
+    {
+        return;
+    }
+    qsort(files, file_count, sizeof(char*), Test_compare_names);
+
+    for (i32 i = 0; i < file_count; i++)
+    {
+        if (runner->count + 1 > runner->capacity)
+        {
+            runner->capacity = runner->capacity == 0 ? 256 : runner->capacity * 2;
+            runner->tests = mem_realloc(runner->tests, sizeof(Test) * runner->capacity);
+        }
+
+        Test* test = &runner->tests[runner->count++];
+        memset(test, 0, sizeof(Test));
+        test->kind = kind;
+        test->state = TEST_PENDING;
+        test->name = string_createf(allocator, "%.*s", (int)(strlen(files[i]) - strlen(FILE_EXTENSION)), files[i])->str;
+        test->source_path = string_createf(allocator, "%s/%s", source_directory, files[i])->str;
+        test->output_path = string_createf(allocator, "%s/%s-%s.out", runner->output_directory, kind_name, test->name)->str;
+        test->log_path = string_createf(allocator, "%s/%s-%s.log", runner->output_directory, kind_name, test->name)->str;
+
+        char* expect_path = string_createf(allocator, "%s/expect/%s/%s.expect", directory, kind_name, test->name)->str;
+        FILE* expect = fopen(expect_path, "r");
+        if (expect)
+        {
+            test->has_expectation = fscanf(expect, "%d", &test->expected) == 1;
+            fclose(expect);
+        }
+
+        if (kind == TEST_PROFILE)
+        {
+            test->profile_path = string_createf(allocator, "%s/%s-%s.profile", runner->output_directory, kind_name, test->name)->str;
+        }
+        char* checks_path = string_createf(allocator, "%s/expect/%s/%s.assembly", directory, kind_name, test->name)->str;
+        FILE* checks = kind != TEST_FAILING ? fopen(checks_path, "r") : NULL;
+        if (checks)
+        {
+            fclose(checks);
+            test->assembly_checks_path = checks_path;
+            test->assembly_path = string_createf(allocator, "%s/%s-%s.s", runner->output_directory, kind_name, test->name)->str;
+        }
+    }
+
+    mem_free(files);
+}
+
+static void Test_finish(Test* test, i32 result)
+{
+    test->result = result;
+    test->process = 0;
+    if (!test->has_expectation) test->state = TEST_SKIPPED;
+    else test->state = result == test->expected ? TEST_PASSED : TEST_FAILED;
+}
+
+static void Test_fail(Test* test, const char* format, ...)
+{
+    va_list arglist;
+    va_start(arglist, format);
+    vsnprintf(test->failure, sizeof(test->failure), format, arglist);
+    va_end(arglist);
+
+    test->process = 0;
+    test->state = TEST_FAILED;
+}
+
+// The flags of the step come after those given with -test
+static void Test_start_compile(Test_Runner* runner, Test* test)
+{
+    char profile_flag[256];
+    if (test->kind == TEST_PROFILE)
+    {
+        const char* flag = test->step == TEST_STEP_COMPILE ? "-fprofile-generate" : "-fprofile-use";
+        snprintf(profile_flag, sizeof(profile_flag), "%s=%s", flag, test->profile_path);
+    }
+
+    char** argv = mem_alloc(sizeof(char*) * (runner->flag_count + 7));
+    i32 argc = 0;
+    argv[argc++] = (char*)os_executable_path();
+    argv[argc++] = test->source_path;
+    for (i32 i = 0; i < runner->flag_count; i++)
+    {
+        argv[argc++] = runner->compiler_flags[i];
+    }
+    if (test->kind == TEST_PROFILE)
+    {
+        argv[argc++] = profile_flag;
+    }
+    if (test->step == TEST_STEP_ASSEMBLY)
+    {
+        argv[argc++] = "-assembly";
+    }
+    argv[argc++] = "-outfile";
+    argv[argc++] = test->step == TEST_STEP_ASSEMBLY ? test->assembly_path : test->output_path;
+    argv[argc] = NULL;
+
+    test->state = TEST_COMPILING;
+    test->start = os_wall_time();
+    test->process = os_spawn(argv, test->log_path);
+    mem_free(argv);
+
+    if (test->process < 0)
+    {
+        Test_finish(test, -1);
+    }
+}
+
+static void Test_start_run(Test* test)
+{
+    char* argv[] = { test->output_path, NULL };
+
+    test->state = TEST_RUNNING;
+    test->start = os_wall_time();
+    test->process = os_spawn(argv, test->log_path);
+
+    if (test->process < 0)
+    {
+        Test_finish(test, -1);
+    }
+}
+
+static bool Test_in_flight(Test* test)
+{
+    return test->state == TEST_COMPILING || test->state == TEST_RUNNING;
+}
+
+// Returns whether the step is in flight
+static bool Test_start_step(Test_Runner* runner, Test* test, Test_Step step)
+{
+    test->step = step;
+    if (step == TEST_STEP_RUN || step == TEST_STEP_RUN_PROFILED) Test_start_run(test);
+    else Test_start_compile(runner, test);
+    return Test_in_flight(test);
+}
+
+static void Test_check_profile(Test* test)
+{
+    size_t size;
+    char* profile = os_map_file(test->profile_path, &size);
+    if (!profile)
+    {
+        Test_fail(test, "The instrumented program wrote no profile");
+        return;
+    }
+
+    const char* magic = IR_PROFILE_MAGIC "\n";
+    if (size < strlen(magic) || strncmp(profile, magic, strlen(magic)) != 0)
+    {
+        Test_fail(test, "The profile does not start with " IR_PROFILE_MAGIC);
+    }
+    os_unmap_file(profile, size);
+}
+
+static void Test_check_assembly(Test* test)
+{
+    size_t size;
+    char* assembly = os_map_file(test->assembly_path, &size);
+    FILE* checks = fopen(test->assembly_checks_path, "r");
+    if (!assembly || !checks)
+    {
+        Test_fail(test, "Unable to read %s", !assembly ? test->assembly_path : test->assembly_checks_path);
+        if (assembly) os_unmap_file(assembly, size);
+        if (checks) fclose(checks);
+        return;
+    }
+
+    char line[256];
+    while (test->state != TEST_FAILED && fgets(line, sizeof(line), checks))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+
+        bool negated = line[0] == '!';
+        char pattern[256];
+        i32 length = 0;
+        for (char* c = line + negated; *c; c++)
+        {
+            if (c[0] == '\\' && c[1] == 'n')
+            {
+                pattern[length++] = '\n';
+                c++;
+            }
+            else pattern[length++] = *c;
+        }
+        pattern[length] = '\0';
+
+        bool matched;
+        if (!os_match_pattern(pattern, assembly, &matched))
+        {
+            Test_fail(test, "Invalid assembly check: %s", line);
+        }
+        else if (matched == negated)
+        {
+            Test_fail(test, "Assembly %s: %s", negated ? "matches" : "does not match", line + negated);
+        }
+    }
+
+    fclose(checks);
+    os_unmap_file(assembly, size);
+    if (test->state != TEST_FAILED)
+    {
+        test->state = TEST_PASSED;
+    }
+}
+
+/*
+Starts the step after the one that just returned `exit_code`, and returns whether it is in flight. Otherwise
+the test is finished.
+ */
+static bool Test_next_step(Test_Runner* runner, Test* test, i32 exit_code)
+{
+    test->process = 0;
+    bool expected = test->has_expectation && exit_code == test->expected;
+    switch(test->step)
+    {
+    case TEST_STEP_COMPILE:
+    {
+        if (test->kind == TEST_FAILING) break;
+        if (exit_code == 0) return Test_start_step(runner, test, TEST_STEP_RUN);
+
+        // The program never ran, what the compiler returned says nothing about the expectation
+        Test_fail(test, "Compiling returned %d", exit_code);
+        test->result = exit_code;
+        if (!test->has_expectation) test->state = TEST_SKIPPED;
+        return false;
+    }
+    case TEST_STEP_RUN:
+    {
+        if (expected && test->kind == TEST_PROFILE)
+        {
+            Test_check_profile(test);
+            return test->state != TEST_FAILED && Test_start_step(runner, test, TEST_STEP_COMPILE_PROFILED);
+        }
+        if (expected && test->assembly_checks_path) return Test_start_step(runner, test, TEST_STEP_ASSEMBLY);
+    }
+    break;
+    case TEST_STEP_COMPILE_PROFILED:
+    {
+        if (exit_code == 0) return Test_start_step(runner, test, TEST_STEP_RUN_PROFILED);
+
+        Test_fail(test, "Compiling with the profile returned %d", exit_code);
+        return false;
+    }
+    case TEST_STEP_RUN_PROFILED:
+    {
+        if (expected && test->assembly_checks_path) return Test_start_step(runner, test, TEST_STEP_ASSEMBLY);
+    }
+    break;
+    case TEST_STEP_ASSEMBLY:
+    {
+        if (exit_code == 0) Test_check_assembly(test);
+        else Test_fail(test, "Compiling with -assembly returned %d", exit_code);
+        return false;
+    }
+    }
+
+    Test_finish(test, exit_code);
+    return false;
+}
+
+// @Note: Succeeding and profile tests that do not compile fail whatever they expect, unless they expect nothing
+static void Test_run_pool(Test_Runner* runner)
+{
+    i32 next = 0;
+    i32 in_flight = 0;
+    while (next < runner->count || in_flight > 0)
+    {
+        while (in_flight < runner->worker_count && next < runner->count)
+        {
+            Test* test = &runner->tests[next++];
+            if (Test_start_step(runner, test, TEST_STEP_COMPILE)) in_flight++;
+        }
+        if (in_flight == 0) continue;
+
+        i32 exit_code;
+        i32 process = os_wait_any(&exit_code);
+        if (process < 0)
+        {
+            COMPILER_BUG("Lost track of %d tests\n", in_flight);
+            return;
+        }
+        f64 now = os_wall_time();
+
+        Test* test = NULL;
+        for (i32 i = 0; i < runner->count; i++)
+        {
+            if (Test_in_flight(&runner->tests[i]) && runner->tests[i].process == process)
+            {
+                test = &runner->tests[i];
+                break;
+            }
+        }
+        if (!test) continue;
+
+        if (test->state == TEST_COMPILING) test->compile_seconds += now - test->start;
+        else test->run_seconds += now - test->start;
+
+        if (Test_next_step(runner, test, exit_code)) continue;
+        in_flight--;
+    }
+}
+
+static void Test_print_report(Test_Runner* runner, f64 wall_seconds)
+{
+    i32 passed = 0;
+    i32 failed = 0;
+    i32 skipped = 0;
+    f64 compile_seconds = 0;
+    f64 run_seconds = 0;
+
+    for (i32 i = 0; i < runner->count; i++)
+    {
+        Test* test = &runner->tests[i];
+        compile_seconds += test->compile_seconds;
+        run_seconds += test->run_seconds;
+
+        char path[64];
+        snprintf(path, sizeof(path), "%s/%s", test_kind_names[test->kind], test->name);
+        printf("%-28s compile %9.3f ms  run %9.3f ms  ", path, test->compile_seconds * 1000.0, test->run_seconds * 1000.0);
+        switch(test->state)
+        {
+        case TEST_PASSED:
+        {
+            printf("\x1b[1;32mSuccess\x1b[0m\n");
+            passed++;
+        }
+        break;
+        case TEST_FAILED:
+        {
+            if (test->failure[0]) printf("\x1b[1;31mFailed\x1b[0m: %s (%s)\n", test->failure, test->log_path);
+            else printf("\x1b[1;31mFailed\x1b[0m: Expected: %d - Got: %d (%s)\n", test->expected, test->result, test->log_path);
+            failed++;
+        }
+        break;
+        default:
+        {
+            if (test->failure[0]) printf("\x1b[1;33mSkipped\x1b[0m: %s, but there is no expectation\n", test->failure);
+            else printf("\x1b[1;33mSkipped\x1b[0m: Returned %d, but there is no expectation\n", test->result);
+            skipped++;
+        }
+        break;
+        }
+    }
+
+    printf("\x1b[1mske:\x1b[0m \x1b[1;32mpassed: %d \x1b[1;31mfailed: %d \x1b[1;33mskipped: %d\x1b[0m\n", passed, failed, skipped);
+    printf("%d tests on %d workers in %.3f ms (%.3f ms compiling, %.3f ms running)\n", runner->count, runner->worker_count,
+           wall_seconds * 1000.0, compile_seconds * 1000.0, run_seconds * 1000.0);
+}
+
+// Outputs are kept when something failed, the log next to them says why
+static void Test_clean_up(Test_Runner* runner)
+{
+    for (i32 i = 0; i < runner->count; i++)
+    {
+        remove(runner->tests[i].output_path);
+        remove(runner->tests[i].log_path);
+        if (runner->tests[i].profile_path) remove(runner->tests[i].profile_path);
+        if (runner->tests[i].assembly_path) remove(runner->tests[i].assembly_path);
+    }
+    remove(runner->output_directory);
+}
+
+bool Test_run_all(Compiler_Arguments arguments, i32 argc, char** argv, Allocator* allocator)
+{
+    Test_Runner runner = {0};
+    const char* directory = arguments.test_directory ? arguments.test_directory->str : TEST_DEFAULT_DIRECTORY;
+
+    if (!os_executable_path())
+    {
+        NOT_IMPLEMENTED("Running tests on this platform\n");
+        return false;
+    }
+
+    strcpy(runner.output_directory, "/tmp/ske-test-XXXXXX");
+    if (!os_make_temp_directory(runner.output_directory))
+    {
+        fprintf(stderr, "Unable to create a directory for the test outputs: %s\n", strerror(errno));
+        return false;
+    }
+
+    // Everything but -test itself, the sources, where the output goes and -j, which is how many tests run at once
+    runner.compiler_flags = mem_alloc(sizeof(char*) * (argc + 1));
+    for (i32 i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-outfile") == 0 || strcmp(argv[i], "-j") == 0)
+        {
+            i++;
+            continue;
+        }
+        if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] >= '0' && argv[i][2] <= '9') continue;
+        if (strcmp(argv[i], "--t") == 0 || strncmp(argv[i], "-test", 5) == 0) continue;
+
+        String flag = string_create(argv[i]);
+        if (is_source_file(&flag)) continue;
+
+        runner.compiler_flags[runner.flag_count++] = argv[i];
+    }
+    runner.worker_count = arguments.job_count > 0 ? arguments.job_count : os_processor_count();
+
+    Test_discover(&runner, directory, TEST_SUCCEEDING, allocator);
+    Test_discover(&runner, directory, TEST_FAILING, allocator);
+    Test_discover(&runner, directory, TEST_PROFILE, allocator);
+    if (runner.count == 0)
+    {
+        fprintf(stderr, "No tests in %s/%s or %s/%s\n", directory, test_kind_names[TEST_SUCCEEDING], directory, test_kind_names[TEST_FAILING]);
+    }
+
+    f64 start = os_wall_time();
+    Test_run_pool(&runner);
+    Test_print_report(&runner, os_wall_time() - start);
+
+    bool passed = true;
+    for (i32 i = 0; i < runner.count; i++)
+    {
+        if (runner.tests[i].state == TEST_FAILED) passed = false;
+    }
+
+    if (passed) Test_clean_up(&runner);
+    else printf("Outputs and logs are in %s\n", runner.output_directory);
+
+    mem_free(runner.tests);
+    mem_free(runner.compiler_flags);
+    return passed;
+}
@@ -0,0 +1,94 @@
+#ifndef SKE_TEST_RUNNER_H
+#define SKE_TEST_RUNNER_H
+
+/* @Note:
+   The regression suite, for -test. Tests are found in <directory>/succeeding and <directory>/failing, and
+   what each has to return in <directory>/expect/succeeding/<name>.expect and <directory>/expect/failing/<name>.expect:
+   the exit code of the compiled program for succeeding tests and that of the compiler for failing ones.
+   The compiler is not reentrant (the arenas, the heap tracker and the trace are global), so every test is
+   compiled by a new compiler process, into an output of its own, and as many tests are in flight at once as
+   -j says, one per processor by default. Flags given with -test are passed on to every compile.
+
+   Tests in <directory>/profile are compiled with -fprofile-generate and run, then compiled again with the
+   profile that run wrote and run again. Both runs have to return what the expectation says, and the profile
+   has to start with IR_PROFILE_MAGIC.
+
+   Succeeding and profile tests can also check the code they compile to, in <directory>/expect/<kind>/<name>.assembly.
+   Once the runs passed, the test is compiled with -assembly (and the profile, for profile tests), and every
+   line of that file is a POSIX extended regular expression the assembly has to match, or must not match when
+   the line starts with !. ^ and $ match at the start and end of every line of the assembly, \n in a pattern is
+   a line break, and empty lines and lines starting with # are skipped. Since the checks see what the
+   optimizations did, flags like -O0 given with -test can make them fail.
+ */
+
+#define TEST_DEFAULT_DIRECTORY "tests"
+
+typedef enum
+{
+    TEST_SUCCEEDING, // Compiled and run
+    TEST_FAILING,    // Only compiled
+    TEST_PROFILE     // Compiled with -fprofile-generate and run, compiled with the profile and run again
+} Test_Kind;
+
+// What the process of a test in flight does, the steps are run in this order and skipped when they do not apply
+typedef enum
+{
+    TEST_STEP_COMPILE,          // With -fprofile-generate for profile tests
+    TEST_STEP_RUN,
+    TEST_STEP_COMPILE_PROFILED, // Profile tests, with -fprofile-use and what the run wrote
+    TEST_STEP_RUN_PROFILED,
+    TEST_STEP_ASSEMBLY          // Tests with assembly checks
+} Test_Step;
+
+typedef enum
+{
+    TEST_PENDING,
+    TEST_COMPILING,
+    TEST_RUNNING,
+    TEST_PASSED,
+    TEST_FAILED,
+    TEST_SKIPPED // Nothing to compare with
+} Test_State;
+
+typedef struct Test Test;
+struct Test
+{
+    Test_Kind kind;
+    Test_State state;
+    char* name;
+    char* source_path;
+    char* output_path;
+    char* log_path;
+    char* profile_path;         // Profile tests
+    char* assembly_path;        // Tests with assembly checks
+    char* assembly_checks_path; // NULL when the test has none
+
+    bool has_expectation;
+    i32 expected;
+    i32 result;
+    char failure[256]; // What failed besides the exit code, empty otherwise
+
+    Test_Step step;
+
+    i32 process;
+    f64 start;
+    f64 compile_seconds;
+    f64 run_seconds;
+};
+
+typedef struct Test_Runner Test_Runner;
+struct Test_Runner
+{
+    Test* tests;
+    i32 count;
+    i32 capacity;
+
+    char** compiler_flags;
+    i32 flag_count;
+    char output_directory[64];
+    i32 worker_count;
+};
+
+bool Test_run_all(Compiler_Arguments arguments, i32 argc, char** argv, Allocator* allocator);
+
+#endif
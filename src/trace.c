@@ -0,0 +1,101 @@
+Trace trace = {0};
+THREAD_LOCAL Trace_Stack trace_stack = {0};
+
+void Trace_init()
+{
+    Trace_free();
+    trace.enabled = true;
+    trace.start = os_wall_time();
+}
+
+void Trace_begin(const char* category, const char* name)
+{
+    if (!trace.enabled) return;
+
+    assert(trace_stack.depth < TRACE_MAX_DEPTH && "Trace events nest too deep");
+
+    char* owned_name = strdup(name);
+    i32 thread = os_thread_id();
+
+    spin_lock(&trace.lock);
+    if (trace.count + 1 > trace.capacity)
+    {
+        trace.capacity = trace.capacity == 0 ? 256 : trace.capacity * 2;
+        trace.events = realloc(trace.events, sizeof(Trace_Event) * trace.capacity);
+    }
+
+    Trace_Event* event = &trace.events[trace.count];
+    event->category = category;
+    event->name = owned_name;
+    event->thread = thread;
+    event->duration = 0;
+
+    trace_stack.open[trace_stack.depth++] = trace.count++;
+
+    // Last, so the bookkeeping above is not part of the event
+    event->start = os_wall_time() - trace.start;
+    spin_unlock(&trace.lock);
+}
+
+void Trace_end()
+{
+    if (!trace.enabled) return;
+
+    f64 now = os_wall_time() - trace.start;
+    assert(trace_stack.depth > 0 && "Trace_end without Trace_begin");
+
+    // The events may have moved since, another thread could have grown them
+    spin_lock(&trace.lock);
+    Trace_Event* event = &trace.events[trace_stack.open[--trace_stack.depth]];
+    event->duration = now - event->start;
+    spin_unlock(&trace.lock);
+}
+
+static void Trace_write_string(FILE* file, const char* string)
+{
+    fputc('"', file);
+    for (const char* c = string; *c; c++)
+    {
+        if (*c == '"' || *c == '\\') fputc('\\', file);
+        if ((unsigned char)*c < 0x20) fprintf(file, "\\u%04x", *c);
+        else fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+// Times are in microseconds
+bool Trace_write(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ske\"}}");
+    for (i32 i = 0; i < trace.count; i++)
+    {
+        Trace_Event* event = &trace.events[i];
+
+        fprintf(file, ",\n{\"name\":");
+        Trace_write_string(file, event->name);
+        fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                event->category, event->start * 1e6, event->duration * 1e6, event->thread);
+    }
+    fprintf(file, "\n]}\n");
+
+    fclose(file);
+    return true;
+}
+
+void Trace_free()
+{
+    for (i32 i = 0; i < trace.count; i++)
+    {
+        free(trace.events[i].name);
+    }
+    free(trace.events);
+    memset(&trace, 0, sizeof(Trace));
+    memset(&trace_stack, 0, sizeof(Trace_Stack));
+}
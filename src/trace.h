@@ -0,0 +1,51 @@
+#ifndef SKE_TRACE_H
+#define SKE_TRACE_H
+
+/* @Note:
+   A timeline of what the compiler did, for -trace. Written as Chrome trace events (chrome://tracing and
+   ui.perfetto.dev read them). Every Trace_begin is closed by a Trace_end, and the pair becomes one complete
+   event, so events nest like the calls that made them: the compile, its stages (see Stats_begin), the
+   optimization passes and the functions translated or generated, and the assembler and the linker.
+   Events carry the id of the thread they ran on, and each thread gets its own track: workers of the job
+   system (see job.h) record into the same trace, and each keeps the events it has open itself.
+   Nothing is recorded unless Trace_init was called, so the calls can stay in the compiler.
+ */
+
+#define TRACE_MAX_DEPTH 32
+
+typedef struct Trace_Event Trace_Event;
+struct Trace_Event
+{
+    const char* category;
+    char* name;    // Owned
+    f64 start;     // Seconds since Trace_init
+    f64 duration;
+    i32 thread;
+};
+
+typedef struct Trace Trace;
+struct Trace
+{
+    bool enabled;
+    f64 start;
+
+    Spin_Lock lock; // Around events, which any thread can grow
+    Trace_Event* events;
+    i32 count;
+    i32 capacity;
+};
+
+typedef struct Trace_Stack Trace_Stack;
+struct Trace_Stack
+{
+    i32 open[TRACE_MAX_DEPTH]; // Indices of the events of this thread that have not ended yet
+    i32 depth;
+};
+
+void Trace_init();
+void Trace_begin(const char* category, const char* name);
+void Trace_end();
+bool Trace_write(const char* path);
+void Trace_free();
+
+#endif
@@ -23,4 +23,196 @@ bool absolute_path(String* str, String* out)
     return false;
 }
 
+f64 os_wall_time()
+{
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (f64)counter.QuadPart / (f64)frequency.QuadPart;
+}
+
+f64 os_cpu_time()
+{
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+
+    // In 100 nanosecond intervals
+    u64 kernel_time = ((u64)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    u64 user_time = ((u64)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (f64)(kernel_time + user_time) * 1e-7;
+}
+
+size_t os_peak_memory()
+{
+    return 0;
+}
+
+i32 os_thread_id()
+{
+    return (i32)GetCurrentThreadId();
+}
+
+i32 os_processor_count()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (i32)info.dwNumberOfProcessors : 1;
+}
+
+const char* os_executable_path()
+{
+    return NULL;
+}
+
+char** os_list_files(const char* directory, const char* extension, i32* count, Allocator* allocator)
+{
+    *count = 0;
+    return NULL;
+}
+
+bool os_make_temp_directory(char* path_template)
+{
+    return false;
+}
+
+// Read instead of mapped, a view of the file does not end in a zero
+char* os_map_file(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return NULL;
+    }
+
+    _fseeki64(file, 0, SEEK_END);
+    *size = (size_t)_ftelli64(file);
+    _fseeki64(file, 0, SEEK_SET);
+
+    char* memory = malloc(*size + 1);
+    if (memory && fread(memory, 1, *size, file) != *size)
+    {
+        free(memory);
+        memory = NULL;
+    }
+    if (memory) memory[*size] = '\0';
+    fclose(file);
+    return memory;
+}
+
+void os_unmap_file(char* memory, size_t size)
+{
+    (void)size;
+    free(memory);
+}
+
+void os_drop_file_pages(char* memory, size_t size)
+{
+    (void)memory;
+    (void)size;
+}
+
+i32 os_spawn(char** argv, const char* log_path)
+{
+    (void)argv;
+    return -1;
+}
+
+i32 os_wait_any(i32* exit_code)
+{
+    return -1;
+}
+
+bool os_match_pattern(const char* pattern, const char* text, bool* matched)
+{
+    (void)pattern;
+    (void)text;
+    *matched = false;
+    return false;
+}
+
+typedef struct Win32_Thread_Start Win32_Thread_Start;
+struct Win32_Thread_Start
+{
+    OS_Thread_Fn function;
+    void* data;
+};
+
+static DWORD WINAPI win32_thread_main(LPVOID data)
+{
+    Win32_Thread_Start start = *(Win32_Thread_Start*)data;
+    mem_free(data);
+    start.function(start.data);
+    return 0;
+}
+
+bool os_thread_start(OS_Thread* thread, OS_Thread_Fn function, void* data)
+{
+    Win32_Thread_Start* start = mem_alloc(sizeof(Win32_Thread_Start));
+    start->function = function;
+    start->data = data;
+    *thread = CreateThread(NULL, 0, win32_thread_main, start, 0, NULL);
+    if (!*thread)
+    {
+        mem_free(start);
+        return false;
+    }
+    return true;
+}
+
+void os_thread_join(OS_Thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void os_thread_yield()
+{
+    SwitchToThread();
+}
+
+void os_mutex_init(OS_Mutex* mutex)
+{
+    InitializeCriticalSection(mutex);
+}
+
+void os_mutex_lock(OS_Mutex* mutex)
+{
+    EnterCriticalSection(mutex);
+}
+
+void os_mutex_unlock(OS_Mutex* mutex)
+{
+    LeaveCriticalSection(mutex);
+}
+
+void os_mutex_destroy(OS_Mutex* mutex)
+{
+    DeleteCriticalSection(mutex);
+}
+
+void os_condition_init(OS_Condition* condition)
+{
+    InitializeConditionVariable(condition);
+}
+
+void os_condition_wait(OS_Condition* condition, OS_Mutex* mutex)
+{
+    SleepConditionVariableCS(condition, mutex, INFINITE);
+}
+
+void os_condition_signal(OS_Condition* condition)
+{
+    WakeConditionVariable(condition);
+}
+
+void os_condition_broadcast(OS_Condition* condition)
+{
+    WakeAllConditionVariable(condition);
+}
+
+void os_condition_destroy(OS_Condition* condition)
+{
+    (void)condition;
+}
+
 #endif